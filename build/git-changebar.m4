@@ -4,7 +4,7 @@ AC_DEFUN([GP_CHECK_GITCHANGEBAR],
 
     GP_CHECK_PLUGIN_DEPS([GitChangeBar], [GITCHANGEBAR],
                          [$GP_GTK_PACKAGE >= 2.18
-                          glib-2.0
+                          glib-2.0 >= 2.32
                           libgit2 >= 0.21])
 
     GP_COMMIT_PLUGIN_STATUS([GitChangeBar])
@@ -0,0 +1,10 @@
+dnl Code shared by several plugins, built when any of them is
+AC_DEFUN([GP_CHECK_UTILSLIB],
+[
+    AM_CONDITIONAL([ENABLE_UTILSLIB],
+                   [test "$enable_debugger" = yes || test "$enable_scope" = yes])
+    AC_CONFIG_FILES([
+        utils/Makefile
+        utils/src/Makefile
+    ])
+])
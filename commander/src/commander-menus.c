@@ -0,0 +1,72 @@
+/*
+ *  
+ *  Copyright (C) 2012  Colomban Wendling <ban@herbesfolles.org>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *  
+ */
+
+#include <gtk/gtk.h>
+
+#include "commander-menus.h"
+
+
+#define N_CHILDREN_KEY "commander-n-children"
+
+
+/* remembers how many children @menu has when its items are read */
+void
+menu_shell_remember_children (GtkMenuShell *menu)
+{
+  GList *children = gtk_container_get_children (GTK_CONTAINER (menu));
+  
+  /* one more so that a menu that was never read can be told apart */
+  g_object_set_data (G_OBJECT (menu), N_CHILDREN_KEY,
+                     GUINT_TO_POINTER (g_list_length (children) + 1));
+  g_list_free (children);
+}
+
+/* gtk_menu_shell_append(), prepend() and insert() don't emit
+ * GtkContainer::add, so items added that way can only be noticed by checking
+ * the number of children of the menus that were read.  Returns whether it
+ * changed in @menu or any of its submenus. */
+gboolean
+menu_shell_children_changed (GtkMenuShell *menu)
+{
+  GList    *children;
+  GList    *node;
+  gboolean  changed;
+  guint     n = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (menu),
+                                                     N_CHILDREN_KEY));
+  
+  if (n == 0) {
+    /* never read, e.g. the submenu of a hidden item */
+    return FALSE;
+  }
+  
+  children = gtk_container_get_children (GTK_CONTAINER (menu));
+  changed = (g_list_length (children) + 1 != n);
+  for (node = children; ! changed && node; node = node->next) {
+    if (GTK_IS_MENU_ITEM (node->data)) {
+      GtkWidget *submenu = gtk_menu_item_get_submenu (node->data);
+      
+      if (submenu) {
+        changed = menu_shell_children_changed (GTK_MENU_SHELL (submenu));
+      }
+    }
+  }
+  g_list_free (children);
+  
+  return changed;
+}
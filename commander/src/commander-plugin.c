@@ -27,6 +27,9 @@
 
 #include <geanyplugin.h>
 
+#include "commander-menus.h"
+#include "commander-score.h"
+
 
 /* uncomment to display each row score (for debugging sort) */
 /*#define DISPLAY_SCORE 1*/
@@ -92,10 +95,23 @@ struct {
   GtkTreeModel *sort;
   
   GtkTreePath  *last_path;
+  
+  gchar        *last_key;
+  gint          last_type;
+  
+  GtkWidget    *menubar;
+  gboolean      menus_dirty;
+  gboolean      documents_dirty;
+  
+  GQueue        mru;
+  gboolean      mru_dirty;
 } plugin_data = {
   NULL, NULL, NULL,
   NULL, NULL,
-  NULL
+  NULL,
+  NULL, 0,
+  NULL, TRUE, TRUE,
+  G_QUEUE_INIT, FALSE
 };
 
 typedef enum {
@@ -110,78 +126,16 @@ enum {
   COL_TYPE,
   COL_WIDGET,
   COL_DOCUMENT,
+  COL_SCORE,
+  COL_RECENT,
   COL_COUNT
 };
 
 
-#define PATH_SEPARATOR " \342\206\222 " /* right arrow */
-
-#define SEPARATORS        " -_./\\\"'"
-#define IS_SEPARATOR(c)   (strchr (SEPARATORS, (c)) != NULL)
-#define next_separator(p) (strpbrk (p, SEPARATORS))
-
-/* TODO: be more tolerant regarding unmatched character in the needle.
- * Right now, we implicitly accept unmatched characters at the end of the
- * needle but absolutely not at the start.  e.g. "xpy" won't match "python" at
- * all, though "pyx" will. */
-static inline gint
-get_score (const gchar *needle,
-           const gchar *haystack)
-{
-  if (! needle || ! haystack) {
-    return needle == NULL;
-  } else if (! *needle || ! *haystack) {
-    return *needle == 0;
-  }
-  
-  if (IS_SEPARATOR (*haystack)) {
-    return get_score (needle + IS_SEPARATOR (*needle), haystack + 1);
-  }
-
-  if (IS_SEPARATOR (*needle)) {
-    return get_score (needle + 1, next_separator (haystack));
-  }
-
-  if (*needle == *haystack) {
-    gint a = get_score (needle + 1, haystack + 1) + 1 + IS_SEPARATOR (haystack[1]);
-    gint b = get_score (needle, next_separator (haystack));
-    
-    return MAX (a, b);
-  } else {
-    return get_score (needle, next_separator (haystack));
-  }
-}
-
-static const gchar *
-path_basename (const gchar *path)
-{
-  const gchar *p1 = strrchr (path, '/');
-  const gchar *p2 = g_strrstr (path, PATH_SEPARATOR);
-
-  if (! p1 && ! p2) {
-    return path;
-  } else if (p1 > p2) {
-    return p1;
-  } else {
-    return p2;
-  }
-}
-
-static gint
-key_score (const gchar *key_,
-           const gchar *text_)
-{
-  gchar  *text  = g_utf8_casefold (text_, -1);
-  gchar  *key   = g_utf8_casefold (key_, -1);
-  gint    score;
-  
-  score = get_score (key, text) + get_score (key, path_basename (text)) / 2;
-  
-  g_free (text);
-  g_free (key);
-  
-  return score;
-}
+/* maximum number of recently used items to remember, and how much having
+ * been used recently weights in a matching row's score */
+#define MRU_MAX             32
+#define BONUS_RECENT        2
 
 static const gchar *
 get_key (gint *type_)
@@ -286,6 +240,84 @@ tree_view_activate_focused_row (GtkTreeView *view)
   }
 }
 
+/* menu structure tracking: the items are only re-read when the menus changed.
+ * all handlers are connected with &plugin_data as data so they can easily be
+ * found back.  items inserted with the GtkMenuShell API don't emit any signal,
+ * they are found by menu_shell_children_changed() when the panel is shown. */
+
+static void menu_unwatch (GtkWidget *widget);
+
+static void
+on_menu_item_notify (GObject    *object,
+                     GParamSpec *pspec,
+                     gpointer    dummy)
+{
+  if (strcmp (pspec->name, "visible") == 0 ||
+      strcmp (pspec->name, "label") == 0 ||
+      strcmp (pspec->name, "submenu") == 0) {
+    plugin_data.menus_dirty = TRUE;
+  }
+}
+
+static void
+on_menu_shell_add (GtkContainer *container,
+                   GtkWidget    *widget,
+                   gpointer      dummy)
+{
+  plugin_data.menus_dirty = TRUE;
+}
+
+static void
+on_menu_shell_remove (GtkContainer *container,
+                      GtkWidget    *widget,
+                      gpointer      dummy)
+{
+  /* the widget may live on elsewhere, don't leave our handlers on it */
+  menu_unwatch (widget);
+  plugin_data.menus_dirty = TRUE;
+}
+
+static void
+watch_object (gpointer      object,
+              const gchar  *signal,
+              GCallback     callback)
+{
+  GSignalMatchType match = G_SIGNAL_MATCH_FUNC | G_SIGNAL_MATCH_DATA;
+  
+  if (! g_signal_handler_find (object, match, 0, 0, NULL,
+                               (gpointer) callback, &plugin_data)) {
+    g_signal_connect (object, signal, callback, &plugin_data);
+  }
+}
+
+static void
+menu_unwatch (GtkWidget *widget)
+{
+  g_signal_handlers_disconnect_matched (widget, G_SIGNAL_MATCH_DATA,
+                                        0, 0, NULL, NULL, &plugin_data);
+  
+  if (GTK_IS_MENU_ITEM (widget)) {
+    GtkWidget *submenu = gtk_menu_item_get_submenu (GTK_MENU_ITEM (widget));
+    GtkWidget *child = gtk_bin_get_child (GTK_BIN (widget));
+    
+    if (child) {
+      g_signal_handlers_disconnect_matched (child, G_SIGNAL_MATCH_DATA,
+                                            0, 0, NULL, NULL, &plugin_data);
+    }
+    if (submenu) {
+      menu_unwatch (submenu);
+    }
+  } else if (GTK_IS_MENU_SHELL (widget)) {
+    GList *children = gtk_container_get_children (GTK_CONTAINER (widget));
+    GList *node;
+    
+    for (node = children; node; node = node->next) {
+      menu_unwatch (node->data);
+    }
+    g_list_free (children);
+  }
+}
+
 static void
 store_populate_menu_items (GtkListStore  *store,
                            GtkMenuShell  *menu,
@@ -294,8 +326,23 @@ store_populate_menu_items (GtkListStore  *store,
   GList  *children;
   GList  *node;
   
+  watch_object (menu, "add", G_CALLBACK (on_menu_shell_add));
+  watch_object (menu, "remove", G_CALLBACK (on_menu_shell_remove));
+  menu_shell_remember_children (menu);
+  
   children = gtk_container_get_children (GTK_CONTAINER (menu));
   for (node = children; node; node = node->next) {
+    if (GTK_IS_MENU_ITEM (node->data)) {
+      GtkWidget *child = gtk_bin_get_child (node->data);
+      
+      /* also watch hidden items, they might get shown later */
+      watch_object (node->data, "notify", G_CALLBACK (on_menu_item_notify));
+      /* the text of the item's label can be changed directly */
+      if (GTK_IS_LABEL (child)) {
+        watch_object (child, "notify", G_CALLBACK (on_menu_item_notify));
+      }
+    }
+    
     if (GTK_IS_SEPARATOR_MENU_ITEM (node->data) ||
         ! gtk_widget_get_visible (node->data)) {
       /* skip that */
@@ -339,7 +386,6 @@ store_populate_menu_items (GtkListStore  *store,
         /* go deeper in the menus... */
         store_populate_menu_items (store, GTK_MENU_SHELL (submenu), path);
       } else {
-        gchar *tmp;
         gchar *tooltip;
         gchar *label = g_markup_printf_escaped ("<big>%s</big>", item_label);
         
@@ -349,10 +395,6 @@ store_populate_menu_items (GtkListStore  *store,
           g_free (tooltip);
         }
         
-        tmp = g_markup_escape_text (path, -1);
-        SETPTR (label, g_strconcat (label, "\n<small><i>", tmp, "</i></small>", NULL));
-        g_free (tmp);
-        
         gtk_list_store_insert_with_values (store, NULL, -1,
                                            COL_LABEL, label,
                                            COL_PATH, path,
@@ -394,22 +436,13 @@ find_menubar (GtkContainer *container)
 }
 
 static void
-fill_store (GtkListStore *store)
+store_populate_documents (GtkListStore *store)
 {
-  GtkWidget  *menubar;
-  guint       i = 0;
-  
-  /* menu items */
-  menubar = find_menubar (GTK_CONTAINER (geany_data->main_widgets->window));
-  store_populate_menu_items (store, GTK_MENU_SHELL (menubar), NULL);
+  guint i = 0;
   
-  /* open files */
   foreach_document (i) {
     gchar *basename = g_path_get_basename (DOC_FILENAME (documents[i]));
-    gchar *label = g_markup_printf_escaped ("<big>%s</big>\n"
-                                            "<small><i>%s</i></small>",
-                                            basename,
-                                            DOC_FILENAME (documents[i]));
+    gchar *label = g_markup_printf_escaped ("<big>%s</big>", basename);
     
     gtk_list_store_insert_with_values (store, NULL, -1,
                                        COL_LABEL, label,
@@ -422,38 +455,245 @@ fill_store (GtkListStore *store)
   }
 }
 
+static void
+store_remove_type (GtkListStore *store,
+                   gint          type)
+{
+  GtkTreeModel *model = GTK_TREE_MODEL (store);
+  GtkTreeIter   iter;
+  gboolean      valid = gtk_tree_model_get_iter_first (model, &iter);
+  
+  while (valid) {
+    gint row_type;
+    
+    gtk_tree_model_get (model, &iter, COL_TYPE, &row_type, -1);
+    if (row_type == type) {
+      valid = gtk_list_store_remove (store, &iter);
+    } else {
+      valid = gtk_tree_model_iter_next (model, &iter);
+    }
+  }
+}
+
+/* MRU history, most recent first */
+
+typedef struct {
+  gint    type;
+  gchar  *path;
+} MruItem;
+
+static void
+mru_item_free (gpointer data)
+{
+  MruItem *item = data;
+  
+  g_free (item->path);
+  g_slice_free (MruItem, item);
+}
+
+static GList *
+mru_find (gint          type,
+          const gchar  *path)
+{
+  GList *node;
+  
+  for (node = plugin_data.mru.head; node; node = node->next) {
+    MruItem *item = node->data;
+    
+    if (item->type == type && strcmp (item->path, path) == 0) {
+      break;
+    }
+  }
+  
+  return node;
+}
+
+static void
+mru_add (gint         type,
+         const gchar *path)
+{
+  GList *node = mru_find (type, path);
+  
+  if (node) {
+    g_queue_unlink (&plugin_data.mru, node);
+    g_queue_push_head_link (&plugin_data.mru, node);
+  } else {
+    MruItem *item = g_slice_new (MruItem);
+    
+    item->type = type;
+    item->path = g_strdup (path);
+    g_queue_push_head (&plugin_data.mru, item);
+    
+    if (g_queue_get_length (&plugin_data.mru) > MRU_MAX) {
+      mru_item_free (g_queue_pop_tail (&plugin_data.mru));
+    }
+  }
+  plugin_data.mru_dirty = TRUE;
+}
+
+/* sets COL_RECENT from the MRU history, from MRU_MAX for the most recently
+ * used item down to 1, or 0 for items not in the history */
+static void
+store_update_recent (GtkListStore *store)
+{
+  GtkTreeModel *model = GTK_TREE_MODEL (store);
+  GtkTreeIter   iter;
+  gboolean      valid;
+  
+  for (valid = gtk_tree_model_get_iter_first (model, &iter);
+       valid;
+       valid = gtk_tree_model_iter_next (model, &iter)) {
+    gchar  *path;
+    gint    type;
+    gint    recent;
+    gint    new_recent = 0;
+    GList  *node;
+    
+    gtk_tree_model_get (model, &iter, COL_PATH, &path, COL_TYPE, &type,
+                        COL_RECENT, &recent, -1);
+    node = mru_find (type, path);
+    if (node) {
+      new_recent = MRU_MAX - g_queue_link_index (&plugin_data.mru, node);
+    }
+    if (new_recent != recent) {
+      gtk_list_store_set (store, &iter, COL_RECENT, new_recent, -1);
+    }
+    g_free (path);
+  }
+  
+  plugin_data.mru_dirty = FALSE;
+}
+
+/* updates the parts of the store that changed since last time */
+static void
+store_refresh (GtkListStore *store)
+{
+  gboolean changed = FALSE;
+  
+  if (! plugin_data.menus_dirty && plugin_data.menubar &&
+      menu_shell_children_changed (GTK_MENU_SHELL (plugin_data.menubar))) {
+    plugin_data.menus_dirty = TRUE;
+  }
+  if (plugin_data.menus_dirty) {
+    if (! plugin_data.menubar) {
+      plugin_data.menubar = find_menubar (GTK_CONTAINER (geany_data->main_widgets->window));
+    }
+    store_remove_type (store, COL_TYPE_MENU_ITEM);
+    store_populate_menu_items (store, GTK_MENU_SHELL (plugin_data.menubar), NULL);
+    plugin_data.menus_dirty = FALSE;
+    changed = TRUE;
+  }
+  
+  if (plugin_data.documents_dirty) {
+    store_remove_type (store, COL_TYPE_FILE);
+    store_populate_documents (store);
+    plugin_data.documents_dirty = FALSE;
+    changed = TRUE;
+  }
+  
+  if (changed || plugin_data.mru_dirty) {
+    store_update_recent (store);
+  }
+  if (changed) {
+    /* new rows don't have a score yet, force a full update */
+    g_free (plugin_data.last_key);
+    plugin_data.last_key = NULL;
+  }
+}
+
+/* gets the sort key of a row, from its cached score */
+static inline gint
+row_get_score (GtkTreeModel  *model,
+               GtkTreeIter   *iter)
+{
+  gint score;
+  gint type;
+  gint recent;
+  
+  gtk_tree_model_get (model, iter, COL_SCORE, &score, COL_TYPE, &type,
+                      COL_RECENT, &recent, -1);
+  if (score > 0) {
+    score += recent * BONUS_RECENT;
+  }
+  if (! (type & plugin_data.last_type)) {
+    score -= 0xf000;
+  }
+  
+  return score;
+}
+
 static gint
 sort_func (GtkTreeModel  *model,
            GtkTreeIter   *a,
            GtkTreeIter   *b,
            gpointer       dummy)
 {
-  gint          scorea;
-  gint          scoreb;
-  gchar        *patha;
-  gchar        *pathb;
-  gint          typea;
-  gint          typeb;
+  return row_get_score (model, b) - row_get_score (model, a);
+}
+
+/* computes the score of each row for the current key once, and caches it in
+ * COL_SCORE so sorting only has to compare integers.  If the key only extends
+ * the previous one, rows that didn't match the previous key usually can't match
+ * the new one either (see key_score_rejects_extensions()), so only the others
+ * are re-scored. */
+static void
+store_update_scores (GtkListStore *store)
+{
+  GtkTreeModel *model = GTK_TREE_MODEL (store);
+  GtkTreeIter   iter;
+  gboolean      valid;
+  gboolean      incremental;
+  gboolean      skip_unmatched;
   gint          type;
-  const gchar  *key = get_key (&type);
+  gchar        *key = g_strdup (get_key (&type));
   
-  gtk_tree_model_get (model, a, COL_PATH, &patha, COL_TYPE, &typea, -1);
-  gtk_tree_model_get (model, b, COL_PATH, &pathb, COL_TYPE, &typeb, -1);
-  
-  scorea = key_score (key, patha);
-  scoreb = key_score (key, pathb);
-  
-  if (! (typea & type)) {
-    scorea -= 0xf000;
+  incremental = (plugin_data.last_key && *plugin_data.last_key &&
+                 type == plugin_data.last_type &&
+                 g_str_has_prefix (key, plugin_data.last_key));
+  skip_unmatched = incremental && key_score_rejects_extensions (plugin_data.last_key);
+  if (incremental && strcmp (key, plugin_data.last_key) == 0) {
+    /* nothing changed */
+    g_free (key);
+    return;
   }
-  if (! (typeb & type)) {
-    scoreb -= 0xf000;
+  
+  for (valid = gtk_tree_model_get_iter_first (model, &iter);
+       valid;
+       valid = gtk_tree_model_iter_next (model, &iter)) {
+    gint score;
+    
+    gtk_tree_model_get (model, &iter, COL_SCORE, &score, -1);
+    if (! skip_unmatched || score > 0) {
+      gchar  *path;
+      gint    new_score;
+      
+      gtk_tree_model_get (model, &iter, COL_PATH, &path, -1);
+      new_score = key_score (key, path, NULL);
+      if (new_score != score) {
+        gtk_list_store_set (store, &iter, COL_SCORE, new_score, -1);
+      }
+      g_free (path);
+    }
   }
   
-  g_free (patha);
-  g_free (pathb);
+  SETPTR (plugin_data.last_key, key);
+  plugin_data.last_type = type;
+}
+
+static void
+update_sort (void)
+{
+  GtkTreeModelSort *sort = GTK_TREE_MODEL_SORT (plugin_data.sort);
   
-  return scoreb - scorea;
+  /* we unset the sort function while updating the scores so the sort model
+   * doesn't try to keep the rows ordered for each change, and then set it
+   * back to force re-sorting the whole model at once.  this is somewhat
+   * hackish but GtkTreeSortable doesn't have a resort() API. */
+  gtk_tree_model_sort_reset_default_sort_func (sort);
+  store_refresh (plugin_data.store);
+  store_update_scores (plugin_data.store);
+  gtk_tree_sortable_set_default_sort_func (GTK_TREE_SORTABLE (sort),
+                                           sort_func, NULL, NULL);
 }
 
 static gboolean
@@ -504,13 +744,7 @@ on_entry_text_notify (GObject    *object,
   GtkTreeView  *view  = GTK_TREE_VIEW (plugin_data.view);
   GtkTreeModel *model = gtk_tree_view_get_model (view);
   
-  /* we force re-sorting the whole model from how it was before, and the
-   * back to the new filter.  this is somewhat hackish but since we don't
-   * know the original sorting order, and GtkTreeSortable don't have a
-   * resort() API anyway. */
-  gtk_tree_model_sort_reset_default_sort_func (GTK_TREE_MODEL_SORT (model));
-  gtk_tree_sortable_set_default_sort_func (GTK_TREE_SORTABLE (model),
-                                           sort_func, NULL, NULL);
+  update_sort ();
   
   if (gtk_tree_model_get_iter_first (model, &iter)) {
     tree_view_set_cursor_from_iter (view, &iter);
@@ -535,8 +769,6 @@ on_panel_hide (GtkWidget *widget,
     plugin_data.last_path = NULL;
   }
   gtk_tree_view_get_cursor (view, &plugin_data.last_path, NULL);
-  
-  gtk_list_store_clear (plugin_data.store);
 }
 
 static void
@@ -545,12 +777,14 @@ on_panel_show (GtkWidget *widget,
 {
   GtkTreePath *path;
   GtkTreeView *view = GTK_TREE_VIEW (plugin_data.view);
+  gboolean     used = plugin_data.mru_dirty;
   
-  fill_store (plugin_data.store);
+  update_sort ();
   
   gtk_widget_grab_focus (plugin_data.entry);
   
-  if (plugin_data.last_path) {
+  /* if something was just used it is now on top, don't move away from it */
+  if (plugin_data.last_path && ! used) {
     gtk_tree_view_set_cursor (view, plugin_data.last_path, NULL, FALSE);
     gtk_tree_view_scroll_to_cell (view, plugin_data.last_path, NULL,
                                   TRUE, 0.5, 0.5);
@@ -578,9 +812,12 @@ on_view_row_activated (GtkTreeView       *view,
   GtkTreeIter   iter;
   
   if (gtk_tree_model_get_iter (model, &iter, path)) {
-    gint type;
+    gint    type;
+    gchar  *row_path;
     
-    gtk_tree_model_get (model, &iter, COL_TYPE, &type, -1);
+    gtk_tree_model_get (model, &iter, COL_TYPE, &type, COL_PATH, &row_path, -1);
+    mru_add (type, row_path);
+    g_free (row_path);
     
     switch (type) {
       case COL_TYPE_FILE: {
@@ -608,6 +845,77 @@ on_view_row_activated (GtkTreeView       *view,
   }
 }
 
+/* appends @text to @markup, escaped and with the characters matching @key
+ * in bold */
+static void
+markup_append_escaped (GString     *markup,
+                       const gchar *text,
+                       gssize       len)
+{
+  gchar *escaped = g_markup_escape_text (text, len);
+  
+  g_string_append (markup, escaped);
+  g_free (escaped);
+}
+
+/* appends @text to @markup, with the characters matching @key in bold */
+static void
+markup_append_matches (GString     *markup,
+                       const gchar *text,
+                       const gchar *key)
+{
+  gint          positions[KEY_MAX];
+  gint          k = 0;
+  gint          i;
+  const gchar  *p;
+  const gchar  *start = text;
+  
+  if (! key || ! *key || key_score (key, text, positions) == 0) {
+    k = KEY_MAX;
+  }
+  
+  for (i = 0, p = text; *p && k < KEY_MAX; p = g_utf8_next_char (p), i++) {
+    /* positions are increasing, and -1 for unmatched key characters */
+    while (k < KEY_MAX && positions[k] < i) {
+      k++;
+    }
+    if (k < KEY_MAX && positions[k] == i) {
+      const gchar *next = g_utf8_next_char (p);
+      
+      markup_append_escaped (markup, start, p - start);
+      g_string_append (markup, "<b>");
+      markup_append_escaped (markup, p, next - p);
+      g_string_append (markup, "</b>");
+      start = next;
+    }
+  }
+  markup_append_escaped (markup, start, -1);
+}
+
+static void
+label_cell_data (GtkTreeViewColumn *column,
+                 GtkCellRenderer   *cell,
+                 GtkTreeModel      *model,
+                 GtkTreeIter       *iter,
+                 gpointer           dummy)
+{
+  gchar    *label;
+  gchar    *path;
+  GString  *markup;
+  
+  gtk_tree_model_get (model, iter, COL_LABEL, &label, COL_PATH, &path, -1);
+  
+  markup = g_string_new (label);
+  g_string_append (markup, "\n<small><i>");
+  markup_append_matches (markup, path, plugin_data.last_key);
+  g_string_append (markup, "</i></small>");
+  g_object_set (cell, "markup", markup->str, NULL);
+  
+  g_string_free (markup, TRUE);
+  g_free (label);
+  g_free (path);
+}
+
 #ifdef DISPLAY_SCORE
 static void
 score_cell_data (GtkTreeViewColumn *column,
@@ -618,18 +926,9 @@ score_cell_data (GtkTreeViewColumn *column,
 {
   gint          score;
   gchar        *text;
-  gchar        *path;
-  gint          pathtype;
-  gint          type;
   gint          width, old_width;
-  const gchar  *key = get_key (&type);
   
-  gtk_tree_model_get (model, iter, COL_PATH, &path, COL_TYPE, &pathtype, -1);
-  
-  score = key_score (key, path);
-  if (! (pathtype & type)) {
-    score -= 0xf000;
-  }
+  score = row_get_score (model, iter);
   
   text = g_strdup_printf ("%d", score);
   g_object_set (cell, "text", text, NULL);
@@ -642,7 +941,6 @@ score_cell_data (GtkTreeViewColumn *column,
   }
   
   g_free (text);
-  g_free (path);
 }
 #endif
 
@@ -689,7 +987,9 @@ create_panel (void)
                                           G_TYPE_STRING,
                                           G_TYPE_INT,
                                           GTK_TYPE_WIDGET,
-                                          G_TYPE_POINTER);
+                                          G_TYPE_POINTER,
+                                          G_TYPE_INT,
+                                          G_TYPE_INT);
   
   plugin_data.sort = gtk_tree_model_sort_new_with_model (GTK_TREE_MODEL (plugin_data.store));
   gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (plugin_data.sort),
@@ -714,9 +1014,9 @@ create_panel (void)
 #endif
   cell = gtk_cell_renderer_text_new ();
   g_object_set (cell, "ellipsize", PANGO_ELLIPSIZE_END, NULL);
-  col = gtk_tree_view_column_new_with_attributes (NULL, cell,
-                                                  "markup", COL_LABEL,
-                                                  NULL);
+  col = gtk_tree_view_column_new_with_attributes (NULL, cell, NULL);
+  gtk_tree_view_column_set_cell_data_func (col, cell, label_cell_data,
+                                           NULL, NULL);
   gtk_tree_view_append_column (GTK_TREE_VIEW (plugin_data.view), col);
   g_signal_connect (plugin_data.view, "row-activated",
                     G_CALLBACK (on_view_row_activated), NULL);
@@ -754,6 +1054,14 @@ on_kb_show_panel (GeanyKeyBinding  *kb,
   return TRUE;
 }
 
+static void
+on_document_list_changed (GObject        *object,
+                          GeanyDocument  *doc,
+                          gpointer        dummy)
+{
+  plugin_data.documents_dirty = TRUE;
+}
+
 static gboolean
 on_plugin_idle_init (gpointer dummy)
 {
@@ -780,6 +1088,17 @@ plugin_init (GeanyData *data)
                              _("Show Command Panel (Files Only)"), NULL,
                              on_kb_show_panel, (gpointer) "f:", NULL);
   
+  /* the file paths of the documents can change on new, open, save (as) and
+   * close */
+  plugin_signal_connect (geany_plugin, NULL, "document-new", TRUE,
+                         G_CALLBACK (on_document_list_changed), NULL);
+  plugin_signal_connect (geany_plugin, NULL, "document-open", TRUE,
+                         G_CALLBACK (on_document_list_changed), NULL);
+  plugin_signal_connect (geany_plugin, NULL, "document-save", TRUE,
+                         G_CALLBACK (on_document_list_changed), NULL);
+  plugin_signal_connect (geany_plugin, NULL, "document-close", TRUE,
+                         G_CALLBACK (on_document_list_changed), NULL);
+  
   /* delay for other plugins to have a chance to load before, so we will
    * include their items */
   plugin_idle_add (geany_plugin, on_plugin_idle_init, NULL);
@@ -794,6 +1113,12 @@ plugin_cleanup (void)
   if (plugin_data.last_path) {
     gtk_tree_path_free (plugin_data.last_path);
   }
+  g_free (plugin_data.last_key);
+  if (plugin_data.menubar) {
+    menu_unwatch (plugin_data.menubar);
+  }
+  g_queue_foreach (&plugin_data.mru, (GFunc) mru_item_free, NULL);
+  g_queue_clear (&plugin_data.mru);
 }
 
 void
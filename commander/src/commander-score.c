@@ -0,0 +1,251 @@
+/*
+ *  
+ *  Copyright (C) 2012  Colomban Wendling <ban@herbesfolles.org>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *  
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include "commander-score.h"
+
+
+#define SEPARATORS        " -_./\\\"'"
+#define IS_SEPARATOR(c)   ((c) == PATH_SEPARATOR_CHAR || \
+                           ((c) > 0 && (c) < 0x80 && strchr (SEPARATORS, (c))))
+
+/* scoring parameters */
+#define SCORE_MATCH         16
+#define BONUS_BOUNDARY      10  /* match at the start of a word */
+#define BONUS_CAMEL         8   /* match at a camelCase or digit transition */
+#define BONUS_BASENAME      4   /* match in the last path component */
+#define BONUS_CONSECUTIVE   6   /* match right after the previous one */
+#define PENALTY_GAP_START   3
+#define PENALTY_GAP_EXTEND  1
+#define PENALTY_SKIP        12  /* needle character not found in the text */
+
+/* maximum number of needle characters that may not be found in a matching
+ * text.  this must not depend on the needle length so that a text not
+ * matching a needle longer than this cannot match any extension of it */
+#define MAX_UNMATCHED       1
+
+/* only the end of longer texts is considered, in characters */
+#define TEXT_MAX            512
+
+#define SCORE_NONE          (G_MININT / 2)
+#define TRACE_START         (-1)  /* no previous match */
+#define TRACE_SKIP          (-2)  /* needle character skipped */
+
+/* scratch space for the scorer so it never has to allocate.  it's only ever
+ * used from the main thread. */
+static struct {
+  gunichar  key[KEY_MAX];
+  gunichar  text[TEXT_MAX];
+  gint      bonus[TEXT_MAX];
+  gint      rows[2][TEXT_MAX + 1];
+  gint16    trace[KEY_MAX][TEXT_MAX];
+} scratch;
+
+/* length of the longest common subsequence of the scratch key and text */
+static gint
+scratch_lcs_length (gint n,
+                    gint m)
+{
+  gint *prev = scratch.rows[0];
+  gint *cur  = scratch.rows[1];
+  gint  i, j;
+  
+  memset (prev, 0, sizeof *prev * (m + 1));
+  for (i = 0; i < n; i++) {
+    gint *tmp;
+    
+    cur[0] = 0;
+    for (j = 0; j < m; j++) {
+      if (scratch.key[i] == scratch.text[j]) {
+        cur[j + 1] = prev[j] + 1;
+      } else {
+        cur[j + 1] = MAX (prev[j + 1], cur[j]);
+      }
+    }
+    tmp = prev; prev = cur; cur = tmp;
+  }
+  
+  return prev[m];
+}
+
+/* Scores how well @key_ matches @text_ with a Smith-Waterman-like alignment
+ * favoring matches at word boundaries and consecutive matches.  Up to
+ * MAX_UNMATCHED characters of the key may be missing from the text, but at
+ * least one has to match.  This runs in O(key × text) time and never
+ * allocates.
+ * If @positions is not %NULL, it is filled with the character offset in
+ * @text_ of each key character, or -1 for the unmatched ones.
+ * Returns 0 if @text_ doesn't match @key_, or a positive score. */
+gint
+key_score (const gchar *key_,
+           const gchar *text_,
+           gint         positions[KEY_MAX])
+{
+  const gchar  *p;
+  gunichar      prev_c  = 0;
+  gint         *prev    = scratch.rows[0];
+  gint         *cur     = scratch.rows[1];
+  gint          n       = 0;
+  gint          m       = 0;
+  gint          offset  = 0;
+  gint          basename_start = 0;
+  gint          best    = SCORE_NONE;
+  gint          best_j  = -1;
+  gint          i, j;
+  
+  if (positions) {
+    for (i = 0; i < KEY_MAX; i++) {
+      positions[i] = -1;
+    }
+  }
+  
+  for (p = key_; *p && n < KEY_MAX; p = g_utf8_next_char (p)) {
+    scratch.key[n++] = g_unichar_tolower (g_utf8_get_char (p));
+  }
+  if (n == 0) {
+    return 1;
+  }
+  
+  /* only keep the end of too long texts, it's the most relevant part */
+  m = (gint) g_utf8_strlen (text_, -1);
+  if (m > TEXT_MAX) {
+    offset = m - TEXT_MAX;
+    text_ = g_utf8_offset_to_pointer (text_, offset);
+  }
+  for (m = 0, p = text_; *p; p = g_utf8_next_char (p), m++) {
+    gunichar c = g_utf8_get_char (p);
+    
+    if (m == 0 || IS_SEPARATOR (prev_c)) {
+      scratch.bonus[m] = BONUS_BOUNDARY;
+    } else if ((g_unichar_islower (prev_c) && g_unichar_isupper (c)) ||
+               (! g_unichar_isdigit (prev_c) && g_unichar_isdigit (c))) {
+      scratch.bonus[m] = BONUS_CAMEL;
+    } else {
+      scratch.bonus[m] = 0;
+    }
+    if (c == '/' || c == PATH_SEPARATOR_CHAR) {
+      basename_start = m + 1;
+    }
+    scratch.text[m] = g_unichar_tolower (c);
+    prev_c = c;
+  }
+  for (j = basename_start; j < m; j++) {
+    scratch.bonus[j] += BONUS_BASENAME;
+  }
+  
+  if (n - scratch_lcs_length (n, m) > MAX_UNMATCHED) {
+    return 0;
+  }
+  
+  /* prev[j] and cur[j] hold the best score of the alignments of the key up to
+   * the previous and the current character whose last match is at text
+   * position j.  the trace allows to find back the matched positions. */
+  for (i = 0; i < n; i++) {
+    gint  gap       = SCORE_NONE; /* best prev[j'] for j' < j - 1 with gap */
+    gint  gap_from  = TRACE_START;
+    gint *tmp;
+    
+    for (j = 0; j < m; j++) {
+      gint score  = SCORE_NONE;
+      gint from   = TRACE_START;
+      
+      if (i > 0 && j > 1) {
+        if (prev[j - 2] > SCORE_NONE &&
+            prev[j - 2] - PENALTY_GAP_START > gap - PENALTY_GAP_EXTEND) {
+          gap = prev[j - 2] - PENALTY_GAP_START;
+          gap_from = j - 2;
+        } else if (gap > SCORE_NONE) {
+          gap -= PENALTY_GAP_EXTEND;
+        }
+      }
+      
+      if (scratch.key[i] == scratch.text[j]) {
+        gint value = SCORE_MATCH + scratch.bonus[j];
+        
+        /* first match, all previous key characters skipped */
+        score = value - i * PENALTY_SKIP;
+        if (i > 0 && j > 0 && prev[j - 1] > SCORE_NONE &&
+            prev[j - 1] + value + BONUS_CONSECUTIVE > score) {
+          score = prev[j - 1] + value + BONUS_CONSECUTIVE;
+          from = j - 1;
+        }
+        if (gap > SCORE_NONE && gap + value > score) {
+          score = gap + value;
+          from = gap_from;
+        }
+      }
+      /* skip this key character, keeping the last match at j */
+      if (i > 0 && prev[j] > SCORE_NONE && prev[j] - PENALTY_SKIP > score) {
+        score = prev[j] - PENALTY_SKIP;
+        from = TRACE_SKIP;
+      }
+      
+      cur[j] = score;
+      scratch.trace[i][j] = (gint16) from;
+    }
+    tmp = prev; prev = cur; cur = tmp;
+  }
+  
+  for (j = 0; j < m; j++) {
+    if (prev[j] > best) {
+      best = prev[j];
+      best_j = j;
+    }
+  }
+  
+  if (best_j < 0) {
+    /* the tolerance for unmatched characters doesn't make a text without any
+     * of the key characters match */
+    return 0;
+  }
+  
+  if (positions) {
+    i = n - 1;
+    j = best_j;
+    while (i >= 0) {
+      gint from = scratch.trace[i][j];
+      
+      if (from == TRACE_SKIP) {
+        i--;
+      } else {
+        positions[i--] = offset + j;
+        if (from == TRACE_START) {
+          break;
+        }
+        j = from;
+      }
+    }
+  }
+  
+  return MAX (1, best);
+}
+
+/* Returns whether texts that don't match @key (their key_score() is 0) can't
+ * match any key starting with @key either, so they don't need to be scored
+ * again when the key is extended.  This holds unless @key is so short that a
+ * text matching none of its characters is only rejected because nothing
+ * matches at all, while an extension could match with the tolerance for
+ * unmatched characters. */
+gboolean
+key_score_rejects_extensions (const gchar *key)
+{
+  return g_utf8_strlen (key, -1) > MAX_UNMATCHED;
+}
@@ -0,0 +1,43 @@
+/*
+ *  
+ *  Copyright (C) 2012  Colomban Wendling <ban@herbesfolles.org>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *  
+ */
+
+#ifndef __COMMANDER_SCORE_H__
+#define __COMMANDER_SCORE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+
+#define PATH_SEPARATOR " \342\206\222 " /* right arrow */
+#define PATH_SEPARATOR_CHAR 0x2192
+
+/* longer keys are truncated to this many characters */
+#define KEY_MAX             32
+
+
+gint      key_score                     (const gchar *key_,
+                                         const gchar *text_,
+                                         gint         positions[KEY_MAX]);
+gboolean  key_score_rejects_extensions  (const gchar *key);
+
+
+G_END_DECLS
+
+#endif /* __COMMANDER_SCORE_H__ */
@@ -0,0 +1,167 @@
+/*
+ *  
+ *  Copyright (C) 2012  Colomban Wendling <ban@herbesfolles.org>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *  
+ */
+
+#include <stdlib.h>
+#include <check.h>
+#include <glib.h>
+#include <gtk/gtk.h>
+
+#include "commander-menus.h"
+#include "commander-score.h"
+
+
+static const gchar *texts[] = {
+  "python",
+  "xylophone",
+  "README",
+  "src/main.c",
+  "commander-plugin.c",
+  "File \342\206\222 Open",
+  "Edit \342\206\222 Preferences",
+  "Build \342\206\222 Make",
+  "x",
+  NULL
+};
+
+/* scores @texts for each prefix of @key in turn, re-scoring the texts that
+ * didn't match the previous prefix only when needed like the panel does, and
+ * checks the scores are the same as when scoring from scratch */
+static void
+check_typing (const gchar *key)
+{
+  gint    scores[G_N_ELEMENTS (texts)];
+  gchar  *prev = g_strdup ("");
+  glong   len;
+  guint   i;
+  
+  for (i = 0; texts[i]; i++) {
+    scores[i] = key_score (prev, texts[i], NULL);
+  }
+  
+  for (len = 1; len <= g_utf8_strlen (key, -1); len++) {
+    gchar    *prefix = g_strndup (key, (gsize) (g_utf8_offset_to_pointer (key, len) - key));
+    gboolean  skip_unmatched = *prev && key_score_rejects_extensions (prev);
+    
+    for (i = 0; texts[i]; i++) {
+      gint full = key_score (prefix, texts[i], NULL);
+      
+      if (! skip_unmatched || scores[i] > 0) {
+        scores[i] = full;
+      }
+      fail_unless (scores[i] == full,
+                   "key \"%s\", text \"%s\": expected %d, got %d",
+                   prefix, texts[i], full, scores[i]);
+    }
+    
+    g_free (prev);
+    prev = prefix;
+  }
+  g_free (prev);
+}
+
+START_TEST (test_typing_matches_full_scoring)
+{
+  check_typing ("xpy");
+  check_typing ("xyz");
+  check_typing ("cm");
+  check_typing ("fop");
+  check_typing ("zmain");
+  check_typing ("pxy");
+  check_typing ("bm");
+}
+END_TEST
+
+START_TEST (test_typing_finds_python)
+{
+  fail_unless (key_score ("x", "python", NULL) == 0);
+  fail_unless (key_score ("xpy", "python", NULL) > 0);
+}
+END_TEST
+
+/* Geany's recent files menu and most plugins add their items this way, which
+ * doesn't emit GtkContainer::add */
+START_TEST (test_menu_shell_append_detected)
+{
+  GtkWidget *menubar;
+  GtkWidget *item;
+  GtkWidget *submenu;
+  
+  if (! gtk_init_check (NULL, NULL)) {
+    /* no display */
+    return;
+  }
+  
+  menubar = gtk_menu_bar_new ();
+  g_object_ref_sink (menubar);
+  item = gtk_menu_item_new_with_label ("File");
+  submenu = gtk_menu_new ();
+  gtk_menu_item_set_submenu (GTK_MENU_ITEM (item), submenu);
+  gtk_menu_shell_append (GTK_MENU_SHELL (menubar), item);
+  gtk_menu_shell_append (GTK_MENU_SHELL (submenu),
+                         gtk_menu_item_new_with_label ("Open"));
+  
+  menu_shell_remember_children (GTK_MENU_SHELL (menubar));
+  menu_shell_remember_children (GTK_MENU_SHELL (submenu));
+  fail_if (menu_shell_children_changed (GTK_MENU_SHELL (menubar)));
+  
+  gtk_menu_shell_append (GTK_MENU_SHELL (submenu),
+                         gtk_menu_item_new_with_label ("Recent"));
+  fail_unless (menu_shell_children_changed (GTK_MENU_SHELL (menubar)));
+  
+  menu_shell_remember_children (GTK_MENU_SHELL (submenu));
+  fail_if (menu_shell_children_changed (GTK_MENU_SHELL (menubar)));
+  
+  gtk_menu_shell_prepend (GTK_MENU_SHELL (menubar),
+                          gtk_menu_item_new_with_label ("Edit"));
+  fail_unless (menu_shell_children_changed (GTK_MENU_SHELL (menubar)));
+  
+  gtk_widget_destroy (menubar);
+  g_object_unref (menubar);
+}
+END_TEST
+
+static Suite *
+commander_suite (void)
+{
+  Suite *s        = suite_create ("Commander");
+  TCase *tc_score = tcase_create ("score");
+  TCase *tc_menus = tcase_create ("menus");
+  
+  suite_add_tcase (s, tc_score);
+  tcase_add_test (tc_score, test_typing_matches_full_scoring);
+  tcase_add_test (tc_score, test_typing_finds_python);
+  
+  suite_add_tcase (s, tc_menus);
+  tcase_add_test (tc_menus, test_menu_shell_append_detected);
+  
+  return s;
+}
+
+int
+main (void)
+{
+  gint      nf;
+  SRunner  *sr = srunner_create (commander_suite ());
+  
+  srunner_run_all (sr, CK_NORMAL);
+  nf = srunner_ntests_failed (sr);
+  srunner_free (sr);
+  
+  return (nf == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
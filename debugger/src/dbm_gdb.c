@@ -65,6 +65,32 @@ typedef struct _queue_item {
 	gboolean format_error_message;
 } queue_item;
 
+/* a set of commands, completed when the last of them is;
+ * the callbacks of commands may add more commands to it */
+typedef struct _command_group {
+	gint pending;
+	/* called when the group completes, the group is freed after that;
+	 * NULL for groups waited for synchronously */
+	void (*done)(gpointer data);
+	gpointer data;
+} command_group;
+
+/* callback for a command result, takes ownership of the record */
+typedef void (*command_callback)(struct gdb_mi_record *record, command_group *group, gpointer data);
+
+/* structure to keep a token-tagged command until its result arrives */
+typedef struct _command_item {
+	guint token;
+	gchar *line;
+	command_callback callback;
+	gpointer data;
+	command_group *group;
+} command_item;
+
+/* maximum size of commands sent but not answered yet, so that GDB
+ * input can't fill up while its output is not read */
+#define MAX_SENT_COMMANDS_SIZE 16384
+
 /* enumeration for stop reason */
 enum sr {
 	SR_BREAKPOINT_HIT,
@@ -121,12 +147,57 @@ static gboolean file_refresh_needed = FALSE;
 /* current frame number */
 static int active_frame = 0;
 
+/* commands waiting to be sent */
+static GQueue commands_queued = G_QUEUE_INIT;
+
+/* commands sent, waiting for a result, by token */
+static GHashTable *commands_sent = NULL;
+static gsize commands_sent_size = 0;
+
+/* last token used */
+static guint last_token = 0;
+
+/* autos being listed while updating */
+static GList *autos_listed = NULL;
+
+/* number of autos GDB variables are being created for */
+static gint autos_creating = 0;
+
+/* GDB variables of watches, autos and listed children, by internal name;
+ * they are kept between stops and updated with -var-update */
+static GHashTable *varobjs = NULL;
+
+/* children listed so far of a GDB variable */
+typedef struct _listed_children {
+	/* listed children, in order */
+	GList *vars;
+	/* number of listed children */
+	gint count;
+	/* whether the variable has more children than listed */
+	gboolean more;
+} listed_children;
+
+/* listed children, by internal name of the parent */
+static GHashTable *children_cache = NULL;
+
+/* listed children whose path expressions haven't been asked for yet,
+ * by internal name */
+static GHashTable *children_undescribed = NULL;
+
+/* number of the first children shown since the last update, by internal name
+ * of the parent, values of the children having children are evaluated then */
+static GHashTable *children_shown = NULL;
+
 /* forward declarations */
 static void stop(void);
 static variable* add_watch(gchar* expression);
-static void update_watches(void);
-static void update_autos(void);
-static void update_files(void);
+static void update_watches(command_group *group);
+static void update_autos(command_group *group);
+static void update_files(command_group *group);
+static void update_varobjs(command_group *group);
+static void varobjs_clear(void);
+static void create_watch(variable *var, command_group *group);
+static void drop_commands(void);
 
 /*
  * print message using color, based on message type
@@ -191,6 +262,24 @@ static void on_gdb_exit(GPid pid, gint status, gpointer data)
 	g_list_free(files);
 	files = NULL;
 
+	/* delete autos being updated */
+	g_list_foreach(autos_listed, (GFunc)variable_free, NULL);
+	g_list_free(autos_listed);
+	autos_listed = NULL;
+	autos_creating = 0;
+
+	/* forget GDB variables */
+	varobjs_clear();
+
+	/* nobody is going to answer */
+	drop_commands();
+
+	if (gdb_id_out)
+	{
+		g_source_remove(gdb_id_out);
+		gdb_id_out = 0;
+	}
+
 	g_source_remove(gdb_src_id);
 	gdb_src_id = 0;
 
@@ -219,18 +308,16 @@ static GList* read_until_prompt(void)
 }
 
 /*
- * write a command to a gdb channel and flush with a newlinw character
+ * write data to a gdb channel and flush
  */
-static void gdb_input_write_line(const gchar *line)
+static void gdb_input_write(const gchar *data)
 {
 	GIOStatus st;
 	GError *err = NULL;
 	gsize count;
 	const char *p;
-	char command[1000];
-	g_snprintf(command, sizeof command, "%s\n", line);
 
-	for (p = command; *p; p += count)
+	for (p = data; *p; p += count)
 	{
 		st = g_io_channel_write_chars(gdb_ch_in, p, strlen(p), &count, &err);
 		if (err || (st == G_IO_STATUS_ERROR) || (st == G_IO_STATUS_EOF))
@@ -259,6 +346,198 @@ static void gdb_input_write_line(const gchar *line)
 	}
 }
 
+/*
+ * write a command to a gdb channel and flush with a newlinw character
+ */
+static void gdb_input_write_line(const gchar *line)
+{
+	gchar *command = g_strconcat(line, "\n", NULL);
+	gdb_input_write(command);
+	g_free(command);
+}
+
+/*
+ * free memory occupied by a command item
+ */
+static void free_command_item(command_item *item)
+{
+	g_free(item->line);
+	g_free(item);
+}
+
+/*
+ * creates a group of commands, "done" is called once all of them are completed
+ */
+static command_group* command_group_new(void (*done)(gpointer data), gpointer data)
+{
+	command_group *group = g_malloc0(sizeof *group);
+
+	group->done = done;
+	group->data = data;
+
+	return group;
+}
+
+/*
+ * calls the group completion callback if no commands are left
+ */
+static void command_group_check(command_group *group)
+{
+	if (group && group->done && !group->pending)
+	{
+		group->done(group->data);
+		g_free(group);
+	}
+}
+
+/*
+ * sends queued commands with a single write, as many as fit
+ * into the limit for unanswered ones
+ */
+static void send_commands(void)
+{
+	GString *batch = g_string_new(NULL);
+	command_item *item;
+
+	if (!commands_sent)
+		commands_sent = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	while ((item = g_queue_peek_head(&commands_queued)) &&
+		(!commands_sent_size || commands_sent_size + strlen(item->line) <= MAX_SENT_COMMANDS_SIZE))
+	{
+		g_queue_pop_head(&commands_queued);
+		g_hash_table_insert(commands_sent, GUINT_TO_POINTER(item->token), item);
+		commands_sent_size += strlen(item->line);
+		g_string_append(batch, item->line);
+
+#ifdef DEBUG_OUTPUT
+		dbg_cbs->send_message(item->line, "red");
+#endif
+	}
+
+	if (batch->len)
+		gdb_input_write(batch->str);
+	g_string_free(batch, TRUE);
+}
+
+/*
+ * queues "command" to be sent tagged with a token by the next send_commands(),
+ * "callback" is called with its result
+ */
+static void queue_command(command_group *group, const gchar *command, command_callback callback, gpointer data)
+{
+	command_item *item = g_malloc0(sizeof *item);
+
+	/* 0 is no valid token */
+	if (!++last_token)
+		last_token++;
+
+	item->token = last_token;
+	item->line = g_strdup_printf("%u%s\n", item->token, command);
+	item->callback = callback;
+	item->data = data;
+	item->group = group;
+
+	if (group)
+		group->pending++;
+
+	g_queue_push_tail(&commands_queued, item);
+}
+
+/*
+ * passes a result record to the command it answers,
+ * returns FALSE if it doesn't answer any
+ */
+static gboolean dispatch_result(struct gdb_mi_record *record)
+{
+	command_item *item;
+	command_group *group;
+
+	if (!record->token || !commands_sent)
+		return FALSE;
+
+	item = g_hash_table_lookup(commands_sent, GUINT_TO_POINTER(strtoul(record->token, NULL, 10)));
+	if (!item)
+		return FALSE;
+
+	g_hash_table_remove(commands_sent, GUINT_TO_POINTER(item->token));
+	commands_sent_size -= strlen(item->line);
+
+	if (gdb_mi_record_matches(record, '^', "error", NULL))
+	{
+		/* save error message */
+		const gchar *msg = gdb_mi_result_var(record->first, "msg", GDB_MI_VAL_STRING);
+		strncpy(err_message, msg ? msg : "", G_N_ELEMENTS(err_message) - 1);
+	}
+
+	group = item->group;
+	if (item->callback)
+		item->callback(record, group, item->data);
+	else
+		gdb_mi_record_free(record);
+	free_command_item(item);
+
+	/* there is room for more commands now, and the callback may have queued some */
+	send_commands();
+
+	if (group)
+	{
+		group->pending--;
+		command_group_check(group);
+	}
+
+	return TRUE;
+}
+
+/*
+ * drops all commands, used when GDB is gone; their callbacks are not called
+ */
+static void drop_commands(void)
+{
+	GHashTable *groups = g_hash_table_new(g_direct_hash, g_direct_equal);
+	GHashTableIter iter;
+	gpointer key, value;
+	GList *items = NULL, *node;
+	command_item *item;
+
+	while ((item = g_queue_pop_head(&commands_queued)))
+		items = g_list_prepend(items, item);
+
+	if (commands_sent)
+	{
+		g_hash_table_iter_init(&iter, commands_sent);
+		while (g_hash_table_iter_next(&iter, NULL, &value))
+			items = g_list_prepend(items, value);
+		g_hash_table_remove_all(commands_sent);
+	}
+	commands_sent_size = 0;
+
+	for (node = items; node; node = node->next)
+	{
+		item = (command_item*)node->data;
+
+		/* groups waited for synchronously are freed by the waiter */
+		if (item->group && item->group->done)
+			g_hash_table_insert(groups, item->group, NULL);
+		free_command_item(item);
+	}
+	g_list_free(items);
+
+	g_hash_table_iter_init(&iter, groups);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		g_free(key);
+	g_hash_table_destroy(groups);
+}
+
+/*
+ * sends queued commands, completing the group right away if it has none
+ */
+static void command_group_start(command_group *group)
+{
+	send_commands();
+	command_group_check(group);
+}
+
 /*
  * free memory occupied by a queue item
  */
@@ -366,7 +645,7 @@ static gboolean on_read_async_output(GIOChannel * src, GIOCondition cond, gpoint
 				}
 
 				/* update source files list */
-				update_files();
+				update_files(NULL);
 
 				/* -exec-run */
 				exec_async_command("-exec-run");
@@ -405,25 +684,35 @@ static gboolean on_read_async_output(GIOChannel * src, GIOCondition cond, gpoint
 }
 
 /*
- * asyncronous gdb output reader
- * looks for a stopped event, then notifies "debug" module and removes async handler
+ * called when the updates on a stop are done
+ */
+static void on_stopped_updated(gpointer data)
+{
+	dbg_cbs->set_stopped(GPOINTER_TO_INT(data));
+}
+
+/*
+ * handles a line of gdb output, read either from the main loop or while
+ * waiting for commands synchronously; passes command results to their
+ * callbacks and notifies "debug" module about stop events
  */
 enum dbs debug_get_state(void);
-static gboolean on_read_from_gdb(GIOChannel * src, GIOCondition cond, gpointer data)
+static void handle_gdb_line(gchar *line)
 {
-	gchar *line;
-	gsize length;
 	const gchar *id;
 	struct gdb_mi_record *record;
 
-	if (G_IO_STATUS_NORMAL != g_io_channel_read_line(src, &line, NULL, &length, NULL))
-		return TRUE;
-
 	record = gdb_mi_record_parse(line);
 
+	/* results of token-tagged commands go to their callbacks */
+	if (record && GDB_MI_TYPE_RESULT == record->type && dispatch_result(record))
+	{
+		g_free(line);
+		return;
+	}
+
 	if (! record || record->type != GDB_MI_TYPE_PROMPT)
 	{
-		line[length] = '\0';
 		if ((record && '~' == record->type) || '~' == line[0])
 		{
 			colorize_message(line);
@@ -439,7 +728,7 @@ static gboolean on_read_from_gdb(GIOChannel * src, GIOCondition cond, gpointer d
 	if (! record)
 	{
 		g_free(line);
-		return TRUE;
+		return;
 	}
 
 	if (!target_pid &&
@@ -468,13 +757,6 @@ static gboolean on_read_from_gdb(GIOChannel * src, GIOCondition cond, gpointer d
 	{
 		const gchar *reason;
 
-		/* removing read callback (will pulling all output left manually) */
-		if (gdb_id_out)
-		{
-			g_source_remove(gdb_id_out);
-			gdb_id_out = 0;
-		}
-
 		/* looking for a reason to stop */
 		if ((reason = gdb_mi_result_var(record->first, "reason", GDB_MI_VAL_STRING)) != NULL)
 		{
@@ -501,23 +783,26 @@ static gboolean on_read_from_gdb(GIOChannel * src, GIOCondition cond, gpointer d
 		if (SR_BREAKPOINT_HIT == stop_reason || SR_END_STEPPING_RANGE == stop_reason || SR_SIGNAL_RECIEVED == stop_reason)
 		{
 			const gchar *thread_id = gdb_mi_result_var(record->first, "thread-id", GDB_MI_VAL_STRING);
+			int thread = thread_id ? atoi(thread_id) : 0;
 
 			active_frame = 0;
 
 			if (SR_BREAKPOINT_HIT == stop_reason || SR_END_STEPPING_RANGE == stop_reason)
 			{
-				/* update autos */
-				update_autos();
-
-				/* update watches */
-				update_watches();
+				/* autos, watches and files are updated with a single batch of
+				 * commands, the stop is reported once all of them are done */
+				command_group *group = command_group_new(on_stopped_updated, GINT_TO_POINTER(thread));
 
-				/* update files */
+				update_varobjs(group);
+				update_autos(group);
+				update_watches(group);
 				if (file_refresh_needed)
 				{
-					update_files();
+					update_files(group);
 					file_refresh_needed = FALSE;
 				}
+
+				command_group_start(group);
 			}
 			else
 			{
@@ -532,9 +817,9 @@ static gboolean on_read_from_gdb(GIOChannel * src, GIOCondition cond, gpointer d
 				}
 				else
 					requested_interrupt = FALSE;
-			}
 
-			dbg_cbs->set_stopped(thread_id ? atoi(thread_id) : 0);
+				dbg_cbs->set_stopped(thread);
+			}
 		}
 		else if (stop_reason == SR_EXITED_NORMALLY || stop_reason == SR_EXITED_SIGNALLED || stop_reason == SR_EXITED_WITH_CODE)
 		{
@@ -555,16 +840,8 @@ static gboolean on_read_from_gdb(GIOChannel * src, GIOCondition cond, gpointer d
 	}
 	else if (gdb_mi_record_matches(record, '^', "error", NULL))
 	{
-		GList *lines, *iter;
 		const gchar *msg = gdb_mi_result_var(record->first, "msg", GDB_MI_VAL_STRING);
 
-		/* removing read callback (will pulling all output left manually) */
-		if (gdb_id_out)
-		{
-			g_source_remove(gdb_id_out);
-			gdb_id_out = 0;
-		}
-
 		/* set debugger stopped if is running */
 		if (DBS_STOPPED != debug_get_state())
 		{
@@ -574,27 +851,51 @@ static gboolean on_read_from_gdb(GIOChannel * src, GIOCondition cond, gpointer d
 			dbg_cbs->set_stopped(thread_id ? atoi(thread_id) : 0);
 		}
 
-		/* reading until prompt */
-		lines = read_until_prompt();
-		for (iter = lines; iter; iter = iter->next)
-		{
-			gchar *l = (gchar*)iter->data;
-			if (strcmp(l, GDB_PROMPT))
-				colorize_message(l);
-			g_free(l);
-		}
-		g_list_free (lines);
-
 		/* send error message */
 		dbg_cbs->report_error(msg);
 	}
 
 	g_free(line);
 	gdb_mi_record_free(record);
+}
+
+/*
+ * asyncronous gdb output reader
+ */
+static gboolean on_read_from_gdb(GIOChannel * src, GIOCondition cond, gpointer data)
+{
+	gchar *line;
+
+	if (G_IO_STATUS_NORMAL != g_io_channel_read_line(src, &line, NULL, NULL, NULL))
+		return TRUE;
+
+	handle_gdb_line(line);
 
 	return TRUE;
 }
 
+/*
+ * reads gdb output until all commands of "group" are done,
+ * or all commands at all if "group" is NULL
+ */
+static void wait_for_group(command_group *group)
+{
+	send_commands();
+
+	while (group ? group->pending : (commands_queued.length || (commands_sent && g_hash_table_size(commands_sent))))
+	{
+		gchar *line;
+
+		if (!gdb_ch_out || G_IO_STATUS_NORMAL != g_io_channel_read_line(gdb_ch_out, &line, NULL, NULL, NULL))
+		{
+			drop_commands();
+			break;
+		}
+
+		handle_gdb_line(line);
+	}
+}
+
 /*
  * execute "command" asyncronously
  * after writing command to an input channel
@@ -607,10 +908,22 @@ static void exec_async_command(const gchar* command)
 	dbg_cbs->send_message(command, "red");
 #endif
 
+	/* keep the order of commands queued before */
+	send_commands();
+
 	gdb_input_write_line(command);
 
 	/* connect read callback to the output chanel */
-	gdb_id_out = g_io_add_watch(gdb_ch_out, G_IO_IN, on_read_from_gdb, NULL);
+	if (!gdb_id_out)
+		gdb_id_out = g_io_add_watch(gdb_ch_out, G_IO_IN, on_read_from_gdb, NULL);
+}
+
+/*
+ * stores the result of a command executed syncronously
+ */
+static void on_sync_command_done(struct gdb_mi_record *record, command_group *group, gpointer data)
+{
+	*(struct gdb_mi_record**)data = record;
 }
 
 /*
@@ -620,68 +933,36 @@ static void exec_async_command(const gchar* command)
  */
 static result_class exec_sync_command(const gchar* command, gboolean wait4prompt, struct gdb_mi_record ** command_record)
 {
-	GList *lines, *iter;
+	struct gdb_mi_record *record = NULL;
+	command_group *group;
 	result_class rc;
 
+	if (!wait4prompt)
+	{
 #ifdef DEBUG_OUTPUT
-	dbg_cbs->send_message(command, "red");
+		dbg_cbs->send_message(command, "red");
 #endif
-
-	/* write command to gdb input channel */
-	gdb_input_write_line(command);
-
-	if (!wait4prompt)
+		send_commands();
+		gdb_input_write_line(command);
 		return RC_DONE;
-
-	if (command_record)
-		*command_record = NULL;
-
-	lines = read_until_prompt();
-
-#ifdef DEBUG_OUTPUT
-	for (iter = lines; iter; iter = iter->next)
-	{
-		dbg_cbs->send_message((gchar*)iter->data, "red");
 	}
-#endif
-
-	rc = RC_ERROR;
 
-	for (iter = lines; iter; iter = iter->next)
-	{
-		gchar *line = (gchar*)iter->data;
-		struct gdb_mi_record *record = gdb_mi_record_parse(line);
-
-		if (record && '^' == record->type)
-		{
-			if (gdb_mi_record_matches(record, '^', "done", NULL))
-				rc = RC_DONE;
-			else if (gdb_mi_record_matches(record, '^', "error", NULL))
-			{
-				/* save error message */
-				const gchar *msg = gdb_mi_result_var(record->first, "msg", GDB_MI_VAL_STRING);
-				strncpy(err_message, msg ? msg : "", G_N_ELEMENTS(err_message) - 1);
+	group = command_group_new(NULL, NULL);
+	queue_command(group, command, on_sync_command_done, &record);
+	wait_for_group(group);
+	g_free(group);
 
-				rc = RC_ERROR;
-			}
-			else if (gdb_mi_record_matches(record, '^', "exit", NULL))
-				rc = RC_EXIT;
+	if (record && gdb_mi_record_matches(record, '^', "done", NULL))
+		rc = RC_DONE;
+	else if (record && gdb_mi_record_matches(record, '^', "exit", NULL))
+		rc = RC_EXIT;
+	else
+		rc = RC_ERROR;
 
-			if (command_record)
-			{
-				*command_record = record;
-				record = NULL;
-			}
-		}
-		else if (! record || '&' != record->type)
-		{
-			colorize_message (line);
-		}
+	if (command_record)
+		*command_record = record;
+	else
 		gdb_mi_record_free(record);
-	}
-
-	g_list_foreach(lines, (GFunc)g_free, NULL);
-	g_list_free(lines);
 
 	return rc;
 }
@@ -1108,9 +1389,14 @@ static void set_active_frame(int frame_number)
 	gchar *command = g_strdup_printf("-stack-select-frame %i", frame_number);
 	if (RC_DONE == exec_sync_command(command, TRUE, NULL))
 	{
+		command_group *group = command_group_new(NULL, NULL);
+
 		active_frame = frame_number;
-		update_autos();
-		update_watches();
+		update_varobjs(group);
+		update_autos(group);
+		update_watches(group);
+		wait_for_group(group);
+		g_free(group);
 	}
 	g_free(command);
 }
@@ -1196,77 +1482,286 @@ static GList* get_stack(void)
 }
 
 /*
- * updates variables from vars list
+ * registers a GDB variable so that updates can be applied to it
  */
-static void get_variables (GList *vars)
+static void varobj_add(variable *var)
 {
-	while (vars)
-	{
-		gchar command[1000];
+	if (!varobjs)
+		varobjs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
-		variable *var = (variable*)vars->data;
+	g_hash_table_insert(varobjs, g_strdup(var->internal->str), var);
+}
 
-		gchar *varname = var->internal->str;
-		struct gdb_mi_record *record = NULL;
-		const gchar *expression = NULL;
-		const gchar *numchild = NULL;
-		const gchar *value = NULL;
-		const gchar *type = NULL;
+/*
+ * forgets listed children of a GDB variable, GDB deletes them
+ * along with the variable or when its type changes
+ */
+static void varobj_forget_children(const gchar *internal)
+{
+	listed_children *listed;
+	GList *iter;
 
-		/* path expression */
-		g_snprintf(command, sizeof command, "-var-info-path-expression \"%s\"", varname);
-		exec_sync_command(command, TRUE, &record);
-		if (record)
-			expression = gdb_mi_result_var(record->first, "path_expr", GDB_MI_VAL_STRING);
-		g_string_assign(var->expression, expression ? expression : "");
-		gdb_mi_record_free(record);
+	if (!children_cache || !(listed = g_hash_table_lookup(children_cache, internal)))
+		return;
 
-		/* children number */
-		g_snprintf(command, sizeof command, "-var-info-num-children \"%s\"", varname);
-		exec_sync_command(command, TRUE, &record);
-		if (record)
-			numchild = gdb_mi_result_var(record->first, "numchild", GDB_MI_VAL_STRING);
-		var->has_children = numchild && atoi(numchild) > 0;
-		gdb_mi_record_free(record);
+	for (iter = listed->vars; iter; iter = iter->next)
+	{
+		variable *var = (variable*)iter->data;
 
-		/* value */
-		g_snprintf(command, sizeof command, "-data-evaluate-expression \"%s\"", var->expression->str);
-		exec_sync_command(command, TRUE, &record);
-		if (record)
-			value = gdb_mi_result_var(record->first, "value", GDB_MI_VAL_STRING);
-		if (!value)
-		{
-			gdb_mi_record_free(record);
-			g_snprintf(command, sizeof command, "-var-evaluate-expression \"%s\"", varname);
-			exec_sync_command(command, TRUE, &record);
-			if (record)
-				value = gdb_mi_result_var(record->first, "value", GDB_MI_VAL_STRING);
-		}
-		g_string_assign(var->value, value ? value : "");
-		gdb_mi_record_free(record);
+		varobj_forget_children(var->internal->str);
+		g_hash_table_remove(varobjs, var->internal->str);
+		if (children_undescribed)
+			g_hash_table_remove(children_undescribed, var->internal->str);
+		variable_free(var);
+	}
+	g_list_free(listed->vars);
 
-		/* type */
-		g_snprintf(command, sizeof command, "-var-info-type \"%s\"", varname);
-		exec_sync_command(command, TRUE, &record);
-		if (record)
-			type = gdb_mi_result_var(record->first, "type", GDB_MI_VAL_STRING);
-		g_string_assign(var->type, type ? type : "");
-		gdb_mi_record_free(record);
+	g_hash_table_remove(children_cache, internal);
+}
 
-		vars = vars->next;
-	}
+/*
+ * forgets a GDB variable and its children
+ */
+static void varobj_forget(variable *var)
+{
+	varobj_forget_children(var->internal->str);
+	if (varobjs)
+		g_hash_table_remove(varobjs, var->internal->str);
 }
 
 /*
- * updates files list
+ * queues deletion of the GDB variable of "var"
  */
-static void update_files(void)
+static void varobj_delete(variable *var, command_group *group)
 {
-	GHashTable *ht;
-	struct gdb_mi_record *record = NULL;
-	const struct gdb_mi_result *files_node;
+	gchar *command = g_strdup_printf("-var-delete %s", var->internal->str);
+	queue_command(group, command, NULL, NULL);
+	g_free(command);
 
-	if (files)
+	varobj_forget(var);
+}
+
+/*
+ * forgets all GDB variables
+ */
+static void varobjs_clear(void)
+{
+	if (children_shown)
+	{
+		g_hash_table_destroy(children_shown);
+		children_shown = NULL;
+	}
+
+	if (children_undescribed)
+	{
+		g_hash_table_destroy(children_undescribed);
+		children_undescribed = NULL;
+	}
+
+	if (children_cache)
+	{
+		GHashTableIter iter;
+		gpointer listed;
+
+		g_hash_table_iter_init(&iter, children_cache);
+		while (g_hash_table_iter_next(&iter, NULL, &listed))
+		{
+			g_list_foreach(((listed_children*)listed)->vars, (GFunc)variable_free, NULL);
+			g_list_free(((listed_children*)listed)->vars);
+		}
+		g_hash_table_destroy(children_cache);
+		children_cache = NULL;
+	}
+
+	if (varobjs)
+	{
+		g_hash_table_destroy(varobjs);
+		varobjs = NULL;
+	}
+}
+
+/*
+ * sets value, type and children flag of a variable from a GDB
+ * variable description (-var-create result or a listed child)
+ */
+static void variable_set_varobj(variable *var, const struct gdb_mi_result *result)
+{
+	const gchar *value = gdb_mi_result_var(result, "value", GDB_MI_VAL_STRING);
+	const gchar *type = gdb_mi_result_var(result, "type", GDB_MI_VAL_STRING);
+	const gchar *numchild = gdb_mi_result_var(result, "numchild", GDB_MI_VAL_STRING);
+	const gchar *has_more = gdb_mi_result_var(result, "has_more", GDB_MI_VAL_STRING);
+
+	g_string_assign(var->value, value ? value : "");
+	g_string_assign(var->type, type ? type : "");
+	/* children number of pretty-printed containers isn't known
+	 * before they are listed, "has_more" tells whether they have any */
+	var->has_children = (numchild && atoi(numchild) > 0) || (has_more && atoi(has_more));
+}
+
+/*
+ * stores the value of a GDB variable
+ */
+static void on_variable_evaluated(struct gdb_mi_record *record, command_group *group, gpointer data)
+{
+	variable *var = (variable*)data;
+	const gchar *value = gdb_mi_result_var(record->first, "value", GDB_MI_VAL_STRING);
+
+	g_string_assign(var->value, value ? value : "");
+	gdb_mi_record_free(record);
+}
+
+/*
+ * stores the value of a variable expression, evaluates the GDB variable
+ * instead if the expression can't be evaluated
+ */
+static void on_expression_evaluated(struct gdb_mi_record *record, command_group *group, gpointer data)
+{
+	variable *var = (variable*)data;
+	const gchar *value = gdb_mi_result_var(record->first, "value", GDB_MI_VAL_STRING);
+
+	if (value)
+		g_string_assign(var->value, value);
+	else
+	{
+		gchar *command = g_strdup_printf("-var-evaluate-expression \"%s\"", var->internal->str);
+		queue_command(group, command, on_variable_evaluated, var);
+		g_free(command);
+	}
+	gdb_mi_record_free(record);
+}
+
+/*
+ * evaluates expression of a variable having children, as GDB variables
+ * only give "{...}" for them, values of others come with GDB variables
+ */
+static void evaluate_variable(variable *var, command_group *group)
+{
+	gchar *escaped;
+	gchar *command;
+
+	if (!var->has_children || !var->expression->len)
+		return;
+
+	escaped = escape_string(var->expression->str);
+	command = g_strdup_printf("-data-evaluate-expression \"%s\"", escaped);
+	queue_command(group, command, on_expression_evaluated, var);
+	g_free(command);
+	g_free(escaped);
+}
+
+/*
+ * stores the path expression of a child variable and evaluates it
+ */
+static void on_path_expression(struct gdb_mi_record *record, command_group *group, gpointer data)
+{
+	variable *var = (variable*)data;
+	const gchar *expression = gdb_mi_result_var(record->first, "path_expr", GDB_MI_VAL_STRING);
+
+	g_string_assign(var->expression, expression ? expression : "");
+	gdb_mi_record_free(record);
+
+	evaluate_variable(var, group);
+}
+
+/*
+ * applies changes of GDB variables since the last update
+ */
+static void on_varobjs_updated(struct gdb_mi_record *record, command_group *group, gpointer data)
+{
+	const struct gdb_mi_result *change = gdb_mi_result_var(record->first, "changelist", GDB_MI_VAL_LIST);
+	GHashTableIter iter;
+	gpointer value;
+
+	gdb_mi_result_foreach_matched (change, change, NULL, GDB_MI_VAL_LIST)
+	{
+		const struct gdb_mi_result *fields = change->val->v.list;
+		const gchar *name = gdb_mi_result_var(fields, "name", GDB_MI_VAL_STRING);
+		const gchar *in_scope = gdb_mi_result_var(fields, "in_scope", GDB_MI_VAL_STRING);
+		const gchar *type_changed = gdb_mi_result_var(fields, "type_changed", GDB_MI_VAL_STRING);
+		const gchar *new_num_children = gdb_mi_result_var(fields, "new_num_children", GDB_MI_VAL_STRING);
+		variable *var;
+
+		if (!name || !varobjs || !(var = g_hash_table_lookup(varobjs, name)))
+			continue;
+
+		if (in_scope && !strcmp(in_scope, "invalid"))
+		{
+			/* GDB can't update the variable anymore, watches are created anew,
+			 * autos are when listed */
+			if (VT_CHILD != var->vt)
+			{
+				varobj_delete(var, group);
+				variable_reset(var);
+				if (VT_WATCH == var->vt)
+					create_watch(var, group);
+			}
+		}
+		else if (in_scope && strcmp(in_scope, "true"))
+		{
+			var->evaluated = FALSE;
+			g_string_assign(var->value, "");
+		}
+		else
+		{
+			const gchar *new_value = gdb_mi_result_var(fields, "value", GDB_MI_VAL_STRING);
+
+			if (type_changed && !strcmp(type_changed, "true"))
+			{
+				const gchar *new_type = gdb_mi_result_var(fields, "new_type", GDB_MI_VAL_STRING);
+				g_string_assign(var->type, new_type ? new_type : "");
+			}
+
+			/* the type or the children of a pretty-printed container
+			 * have changed, its children are listed anew */
+			if (new_num_children)
+			{
+				const gchar *has_more = gdb_mi_result_var(fields, "has_more", GDB_MI_VAL_STRING);
+
+				var->has_children = atoi(new_num_children) > 0 || (has_more && atoi(has_more));
+				varobj_forget_children(var->internal->str);
+			}
+
+			var->evaluated = TRUE;
+			g_string_assign(var->value, new_value ? new_value : "");
+		}
+	}
+	gdb_mi_record_free(record);
+
+	/* changes of children not listed aren't reported, so the values of the
+	 * watches and autos having children are refreshed, those of children
+	 * are when they are shown again, see get_children() */
+	if (varobjs)
+	{
+		g_hash_table_iter_init(&iter, varobjs);
+		while (g_hash_table_iter_next(&iter, NULL, &value))
+		{
+			variable *var = (variable*)value;
+			if (VT_CHILD != var->vt && var->evaluated)
+				evaluate_variable(var, group);
+		}
+	}
+	if (children_shown)
+		g_hash_table_remove_all(children_shown);
+}
+
+/*
+ * updates all GDB variables with a single command
+ */
+static void update_varobjs(command_group *group)
+{
+	if (varobjs && g_hash_table_size(varobjs))
+		queue_command(group, "-var-update --all-values *", on_varobjs_updated, NULL);
+}
+
+/*
+ * rebuilds files list from the source files GDB reports
+ */
+static void on_files_listed(struct gdb_mi_record *record, command_group *group, gpointer data)
+{
+	GHashTable *ht;
+	const struct gdb_mi_result *files_node;
+
+	if (files)
 	{
 		/* free previous list */
 		g_list_foreach(files, (GFunc)g_free, NULL);
@@ -1274,10 +1769,6 @@ static void update_files(void)
 		files = NULL;
 	}
 
-	exec_sync_command("-file-list-exec-source-files", TRUE, &record);
-	if (! record)
-		return;
-
 	ht = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, NULL);
 
 	files_node = gdb_mi_result_var(record->first, "files", GDB_MI_VAL_LIST);
@@ -1297,162 +1788,215 @@ static void update_files(void)
 }
 
 /*
- * updates watches list
+ * updates files list
  */
-static void update_watches(void)
+static void update_files(command_group *group)
 {
-	gchar command[1000];
-	GList *updating = NULL;
-	GList *iter;
+	queue_command(group, "-file-list-exec-source-files", on_files_listed, NULL);
+}
 
-	/* delete all GDB variables */
-	for (iter = watches; iter; iter = iter->next)
-	{
-		variable *var = (variable*)iter->data;
+/*
+ * assigns the GDB variable created for "var"
+ * returns FALSE if it couldn't be created
+ */
+static gboolean variable_created(variable *var, struct gdb_mi_record *record, command_group *group)
+{
+	const gchar *name = NULL;
 
-		if (var->internal->len)
-		{
-			g_snprintf(command, sizeof command, "-var-delete %s", var->internal->str);
-			exec_sync_command(command, TRUE, NULL);
-		}
+	if (gdb_mi_record_matches(record, '^', "done", NULL))
+		name = gdb_mi_result_var(record->first, "name", GDB_MI_VAL_STRING);
 
-		/* reset all variables fields */
-		variable_reset(var);
-	}
+	g_string_assign(var->internal, name ? name : "");
+	var->evaluated = name != NULL;
 
-	/* create GDB variables, adding successfully created
-	variables to the list then passed for updatind */
-	for (iter = watches; iter; iter = iter->next)
+	if (var->evaluated)
 	{
-		variable *var = (variable*)iter->data;
-		struct gdb_mi_record *record = NULL;
-		const gchar *name;
-		gchar *escaped;
+		variable_set_varobj(var, record->first);
+		g_string_assign(var->expression, var->name->str);
+		varobj_add(var);
+		evaluate_variable(var, group);
+	}
+	gdb_mi_record_free(record);
 
-		/* try to create variable */
-		escaped = escape_string(var->name->str);
-		g_snprintf(command, sizeof command, "-var-create - * \"%s\"", escaped);
-		g_free(escaped);
+	return var->evaluated;
+}
 
-		if (RC_DONE != exec_sync_command(command, TRUE, &record) || !record)
-		{
-			/* do not include to updating list, move to next watch */
-			var->evaluated = FALSE;
-			g_string_assign(var->internal, "");
-			gdb_mi_record_free(record);
+/*
+ * assigns the GDB variable created for a watch
+ */
+static void on_watch_created(struct gdb_mi_record *record, command_group *group, gpointer data)
+{
+	variable_created((variable*)data, record, group);
+}
 
-			continue;
-		}
+/*
+ * queues creation of a GDB variable for a watch, it is floating
+ * so that it's evaluated in the current frame on every update
+ */
+static void create_watch(variable *var, command_group *group)
+{
+	gchar *escaped = escape_string(var->name->str);
+	gchar *command = g_strdup_printf("-var-create - @ \"%s\"", escaped);
 
-		/* find and assign internal name */
-		name = gdb_mi_result_var(record->first, "name", GDB_MI_VAL_STRING);
-		g_string_assign(var->internal, name ? name : "");
-		gdb_mi_record_free(record);
+	queue_command(group, command, on_watch_created, var);
 
-		var->evaluated = name != NULL;
+	g_free(command);
+	g_free(escaped);
+}
 
-		/* add to updating list */
-		updating = g_list_prepend(updating, var);
-	}
-	updating = g_list_reverse(updating);
+/*
+ * updates watches list, GDB variables of the watches are kept
+ * between updates, only those failed to create are tried again
+ */
+static void update_watches(command_group *group)
+{
+	GList *iter;
 
-	/* update watches */
-	get_variables(updating);
+	for (iter = watches; iter; iter = iter->next)
+	{
+		variable *var = (variable*)iter->data;
 
-	/* free updating list */
-	g_list_free(updating);
+		if (!var->internal->len)
+			create_watch(var, group);
+	}
 }
 
 /*
- * updates autos list
+ * moves autos GDB variables couldn't be created for to the end of the list
  */
-static void update_autos(void)
+static void move_unevaluated_autos(void)
 {
-	gchar command[1000];
-	GList *unevaluated = NULL, *vars = NULL, *iter;
+	GList *evaluated = NULL, *unevaluated = NULL, *iter;
 
-	/* remove all previous GDB variables for autos */
 	for (iter = autos; iter; iter = iter->next)
 	{
 		variable *var = (variable*)iter->data;
 
-		g_snprintf(command, sizeof command, "-var-delete %s", var->internal->str);
-		exec_sync_command(command, TRUE, NULL);
+		if (var->internal->len)
+			evaluated = g_list_prepend(evaluated, var);
+		else
+			unevaluated = g_list_prepend(unevaluated, var);
 	}
-
-	g_list_foreach(autos, (GFunc)variable_free, NULL);
 	g_list_free(autos);
-	autos = NULL;
 
-	/* add current autos to the list */
+	autos = g_list_concat(g_list_reverse(evaluated), g_list_reverse(unevaluated));
+}
 
-	struct gdb_mi_record *record = NULL;
+/*
+ * assigns the GDB variable created for an auto
+ */
+static void on_auto_created(struct gdb_mi_record *record, command_group *group, gpointer data)
+{
+	variable_created((variable*)data, record, group);
+
+	if (!--autos_creating)
+		move_unevaluated_autos();
+}
 
-	g_snprintf(command, sizeof command, "-stack-list-arguments 0 %i %i", active_frame, active_frame);
-	if (RC_DONE == exec_sync_command(command, TRUE, &record) && record)
+/*
+ * lists the arguments of the active frame
+ */
+static void on_arguments_listed(struct gdb_mi_record *record, command_group *group, gpointer data)
+{
+	const struct gdb_mi_result *stack_args = gdb_mi_result_var(record->first, "stack-args", GDB_MI_VAL_LIST);
+
+	gdb_mi_result_foreach_matched (stack_args, stack_args, "frame", GDB_MI_VAL_LIST)
 	{
-		const struct gdb_mi_result *stack_args = gdb_mi_result_var(record->first, "stack-args", GDB_MI_VAL_LIST);
+		const struct gdb_mi_result *args = gdb_mi_result_var(stack_args->val->v.list, "args", GDB_MI_VAL_LIST);
 
-		gdb_mi_result_foreach_matched (stack_args, stack_args, "frame", GDB_MI_VAL_LIST)
+		gdb_mi_result_foreach_matched (args, args, "name", GDB_MI_VAL_STRING)
 		{
-			const struct gdb_mi_result *args = gdb_mi_result_var(stack_args->val->v.list, "args", GDB_MI_VAL_LIST);
-
-			gdb_mi_result_foreach_matched (args, args, "name", GDB_MI_VAL_STRING)
-			{
-				variable *var = variable_new(args->val->v.string, VT_ARGUMENT);
-				vars = g_list_append(vars, var);
-			}
+			variable *var = variable_new(args->val->v.string, VT_ARGUMENT);
+			autos_listed = g_list_append(autos_listed, var);
 		}
 	}
 	gdb_mi_record_free(record);
+}
 
-	if (RC_DONE == exec_sync_command("-stack-list-locals 0", TRUE, &record) && record)
-	{
-		const struct gdb_mi_result *locals = gdb_mi_result_var(record->first, "locals", GDB_MI_VAL_LIST);
+/*
+ * lists the locals of the active frame and makes the autos list of the listed
+ * variables, reusing GDB variables of the autos having the same names
+ */
+static void on_locals_listed(struct gdb_mi_record *record, command_group *group, gpointer data)
+{
+	const struct gdb_mi_result *locals = gdb_mi_result_var(record->first, "locals", GDB_MI_VAL_LIST);
+	GList *previous = autos, *iter;
 
-		gdb_mi_result_foreach_matched (locals, locals, "name", GDB_MI_VAL_STRING)
-		{
-			variable *var = variable_new(locals->val->v.string, VT_LOCAL);
-			vars = g_list_append(vars, var);
-		}
+	gdb_mi_result_foreach_matched (locals, locals, "name", GDB_MI_VAL_STRING)
+	{
+		variable *var = variable_new(locals->val->v.string, VT_LOCAL);
+		autos_listed = g_list_append(autos_listed, var);
 	}
 	gdb_mi_record_free(record);
 
-	for (iter = vars; iter; iter = iter->next)
+	autos = NULL;
+	for (iter = autos_listed; iter; iter = iter->next)
 	{
-		variable *var = iter->data;
-		struct gdb_mi_record *create_record = NULL;
-		gchar *escaped;
-		const gchar *intname;
+		variable *var = (variable*)iter->data;
+		GList *found;
 
-		/* create new gdb variable */
-		escaped = escape_string(var->name->str);
-		g_snprintf(command, sizeof command, "-var-create - * \"%s\"", escaped);
-		g_free(escaped);
+		for (found = previous; found; found = found->next)
+		{
+			variable *old = (variable*)found->data;
+			if (old->internal->len && !strcmp(old->name->str, var->name->str))
+				break;
+		}
 
-		/* form new variable */
-		if (RC_DONE == exec_sync_command(command, TRUE, &create_record) && create_record &&
-			(intname = gdb_mi_result_var(create_record->first, "name", GDB_MI_VAL_STRING)))
+		if (found)
 		{
-			var->evaluated = TRUE;
-			g_string_assign(var->internal, intname);
-			autos = g_list_append(autos, var);
+			/* floating GDB variables are already updated for the current frame */
+			variable *old = (variable*)found->data;
+
+			previous = g_list_delete_link(previous, found);
+			old->vt = var->vt;
+			variable_free(var);
+			var = old;
 		}
 		else
 		{
-			var->evaluated = FALSE;
-			g_string_assign(var->internal, "");
-			unevaluated = g_list_append(unevaluated, var);
+			gchar *escaped = escape_string(var->name->str);
+			gchar *command = g_strdup_printf("-var-create - @ \"%s\"", escaped);
+
+			queue_command(group, command, on_auto_created, var);
+			autos_creating++;
+
+			g_free(command);
+			g_free(escaped);
 		}
-		gdb_mi_record_free(create_record);
+
+		autos = g_list_prepend(autos, var);
 	}
-	g_list_free(vars);
+	autos = g_list_reverse(autos);
+	g_list_free(autos_listed);
+	autos_listed = NULL;
 
-	/* get values for the autos (without incorrect variables) */
-	get_variables(autos);
+	/* delete GDB variables of the autos that are gone */
+	for (iter = previous; iter; iter = iter->next)
+	{
+		variable *var = (variable*)iter->data;
+
+		if (var->internal->len)
+			varobj_delete(var, group);
+		variable_free(var);
+	}
+	g_list_free(previous);
 
-	/* add incorrect variables */
-	autos = g_list_concat(autos, unevaluated);
+	if (!autos_creating)
+		move_unevaluated_autos();
+}
+
+/*
+ * updates autos list
+ */
+static void update_autos(command_group *group)
+{
+	gchar *command;
+
+	command = g_strdup_printf("-stack-list-arguments 0 %i %i", active_frame, active_frame);
+	queue_command(group, command, on_arguments_listed, NULL);
+	g_free(command);
+
+	queue_command(group, "-stack-list-locals 0", on_locals_listed, NULL);
 }
 
 /*
@@ -1480,96 +2024,183 @@ static GList* get_files (void)
 }
 
 /*
- * get list of children
+ * lists a range of the children of a variable, they are kept with their
+ * GDB variables so that they only need to be listed again if its type changes
  */
-static GList* get_children (gchar* path)
+static void on_children_listed(struct gdb_mi_record *record, command_group *group, gpointer data)
 {
+	const gchar *path = (const gchar*)data;
+	const struct gdb_mi_result *child_node;
+	const gchar *has_more;
+	listed_children *listed;
 	GList *children = NULL;
 
-	gchar command[1000];
-	result_class rc;
-	struct gdb_mi_record *record = NULL;
-	const gchar *numchild;
-	int n;
-
-	/* children number */
-	g_snprintf(command, sizeof command, "-var-info-num-children \"%s\"", path);
-	rc = exec_sync_command(command, TRUE, &record);
-	if (RC_DONE != rc || ! record)
+	if (!gdb_mi_record_matches(record, '^', "done", NULL))
 	{
 		gdb_mi_record_free(record);
-		return NULL;
+		return;
+	}
+
+	if (!children_cache)
+		children_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	if (!(listed = g_hash_table_lookup(children_cache, path)))
+	{
+		listed = g_new0(listed_children, 1);
+		g_hash_table_insert(children_cache, g_strdup(path), listed);
+	}
+
+	child_node = gdb_mi_result_var(record->first, "children", GDB_MI_VAL_LIST);
+	gdb_mi_result_foreach_matched (child_node, child_node, "child", GDB_MI_VAL_LIST)
+	{
+		const gchar *internal = gdb_mi_result_var(child_node->val->v.list, "name", GDB_MI_VAL_STRING);
+		const gchar *name = gdb_mi_result_var(child_node->val->v.list, "exp", GDB_MI_VAL_STRING);
+		variable *var;
+
+		if (! name || ! internal)
+			continue;
+
+		var = variable_new2(name, internal, VT_CHILD);
+		var->evaluated = TRUE;
+		variable_set_varobj(var, child_node->val->v.list);
+		varobj_add(var);
+
+		/* path expression and value are asked for when the child is shown */
+		if (!children_undescribed)
+			children_undescribed = g_hash_table_new(g_str_hash, g_str_equal);
+		g_hash_table_insert(children_undescribed, var->internal->str, var);
+
+		children = g_list_prepend(children, var);
+		listed->count++;
 	}
-	numchild = gdb_mi_result_var(record->first, "numchild", GDB_MI_VAL_STRING);
-	n = numchild ? atoi(numchild) : 0;
+
+	has_more = gdb_mi_result_var(record->first, "has_more", GDB_MI_VAL_STRING);
+	listed->more = has_more && atoi(has_more);
+	listed->vars = g_list_concat(listed->vars, g_list_reverse(children));
+
 	gdb_mi_record_free(record);
-	if (!n)
-		return NULL;
+}
+
+/*
+ * get list of "count" children starting from "from",
+ * "more" is set if there are children after them
+ */
+static GList* get_children (gchar* path, int from, int count, gboolean *more)
+{
+	GList *children = NULL, *iter;
+	listed_children *listed = children_cache ? g_hash_table_lookup(children_cache, path) : NULL;
+	gint shown;
 
-	/* recursive get children and put into list */
-	g_snprintf(command, sizeof command, "-var-list-children \"%s\"", path);
-	rc = exec_sync_command(command, TRUE, &record);
-	if (RC_DONE == rc && record)
+	if (!listed || (listed->more && listed->count < from + count))
 	{
-		const struct gdb_mi_result *child_node = gdb_mi_result_var(record->first, "children", GDB_MI_VAL_LIST);
+		/* only the children that haven't been listed yet are asked for,
+		 * GDB fetches no more children of pretty-printed containers */
+		command_group *group = command_group_new(NULL, NULL);
+		gchar *command = g_strdup_printf("-var-list-children --all-values \"%s\" %d %d",
+			path, listed ? listed->count : 0, from + count);
 
-		gdb_mi_result_foreach_matched (child_node, child_node, "child", GDB_MI_VAL_LIST)
-		{
-			const gchar *internal = gdb_mi_result_var(child_node->val->v.list, "name", GDB_MI_VAL_STRING);
-			const gchar *name = gdb_mi_result_var(child_node->val->v.list, "exp", GDB_MI_VAL_STRING);
-			variable *var;
+		queue_command(group, command, on_children_listed, path);
+		wait_for_group(group);
 
-			if (! name || ! internal)
-				continue;
+		g_free(command);
+		g_free(group);
 
-			var = variable_new2(name, internal, VT_CHILD);
-			var->evaluated = TRUE;
+		if (!children_cache || !(listed = g_hash_table_lookup(children_cache, path)))
+		{
+			*more = FALSE;
+			return NULL;
+		}
+	}
+
+	/* values of the children having children are refreshed when they are
+	 * shown for the first time since the last update */
+	if (!children_shown)
+		children_shown = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	shown = GPOINTER_TO_INT(g_hash_table_lookup(children_shown, path));
+	if (shown < from + count)
+	{
+		command_group *group = command_group_new(NULL, NULL);
+		gint i;
 
-			children = g_list_prepend(children, var);
+		iter = g_list_nth(listed->vars, MAX(from, shown));
+		for (i = MAX(from, shown); iter && i < from + count; iter = iter->next, i++)
+		{
+			variable *var = (variable*)iter->data;
+			if (var->evaluated)
+				evaluate_variable(var, group);
 		}
+		wait_for_group(group);
+		g_free(group);
+
+		if (from <= shown)
+			g_hash_table_insert(children_shown, g_strdup(path), GINT_TO_POINTER(from + count));
 	}
-	gdb_mi_record_free(record);
 
-	children = g_list_reverse(children);
-	get_variables(children);
+	for (iter = g_list_nth(listed->vars, from); iter && count; iter = iter->next, count--)
+		children = g_list_prepend(children, variable_copy((variable*)iter->data));
+	*more = iter || listed->more;
 
-	return children;
+	return g_list_reverse(children);
 }
 
 /*
- * add new watch
+ * get variables by internal names, asking for path expressions
+ * and values of the listed children that are shown for the first time
  */
-static variable* add_watch(gchar* expression)
+static GList* get_variables (GList *internals)
 {
-	gchar command[1000];
-	gchar *escaped;
-	struct gdb_mi_record *record = NULL;
-	const gchar *name;
-	GList *vars = NULL;
-	variable *var = variable_new(expression, VT_WATCH);
+	GList *vars = NULL, *iter;
+	command_group *group = NULL;
 
-	watches = g_list_append(watches, var);
+	for (iter = internals; iter; iter = iter->next)
+	{
+		variable *var;
+		gchar *command;
 
-	/* try to create a variable */
-	escaped = escape_string(var->name->str);
-	g_snprintf(command, sizeof command, "-var-create - * \"%s\"", escaped);
-	g_free(escaped);
+		if (!children_undescribed || !(var = g_hash_table_lookup(children_undescribed, iter->data)))
+			continue;
 
-	if (RC_DONE != exec_sync_command(command, TRUE, &record) || !record)
+		if (!group)
+			group = command_group_new(NULL, NULL);
+
+		/* path expression, the value is evaluated when it's known */
+		command = g_strdup_printf("-var-info-path-expression \"%s\"", var->internal->str);
+		queue_command(group, command, on_path_expression, var);
+		g_free(command);
+
+		g_hash_table_remove(children_undescribed, var->internal->str);
+	}
+
+	if (group)
 	{
-		gdb_mi_record_free(record);
-		return var;
+		wait_for_group(group);
+		g_free(group);
 	}
 
-	name = gdb_mi_result_var(record->first, "name", GDB_MI_VAL_STRING);
-	g_string_assign(var->internal, name ? name : "");
-	var->evaluated = name != NULL;
+	/* variables are looked up after waiting as updates may have forgotten some */
+	for (iter = internals; iter; iter = iter->next)
+	{
+		variable *var;
+		if (varobjs && (var = g_hash_table_lookup(varobjs, iter->data)))
+			vars = g_list_prepend(vars, variable_copy(var));
+	}
 
-	vars = g_list_append(NULL, var);
-	get_variables(vars);
+	return g_list_reverse(vars);
+}
 
-	gdb_mi_record_free(record);
-	g_list_free(vars);
+/*
+ * add new watch
+ */
+static variable* add_watch(gchar* expression)
+{
+	command_group *group = command_group_new(NULL, NULL);
+	variable *var = variable_new(expression, VT_WATCH);
+
+	watches = g_list_append(watches, var);
+
+	/* try to create a variable and update it */
+	create_watch(var, group);
+	wait_for_group(group);
+	g_free(group);
 
 	return var;
 }
@@ -1580,6 +2211,10 @@ static variable* add_watch(gchar* expression)
 static void remove_watch(gchar* internal)
 {
 	GList *iter = watches;
+
+	/* let pending updates finish with the watch before it is freed */
+	wait_for_group(NULL);
+
 	while (iter)
 	{
 		variable *var = (variable*)iter->data;
@@ -1588,6 +2223,7 @@ static void remove_watch(gchar* internal)
 			gchar command[1000];
 			g_snprintf(command, sizeof command, "-var-delete %s", internal);
 			exec_sync_command(command, TRUE, NULL);
+			varobj_forget(var);
 			variable_free(var);
 			watches = g_list_delete_link(watches, iter);
 		}
@@ -523,15 +523,41 @@ static gboolean on_watch_button_pressed_callback(GtkWidget *treeview, GdkEventBu
 		    (int)event->x, (int)event->y, &path, NULL, NULL, NULL))
 		{
 			gchar *expression = NULL;
+			variable_type vt;
 			GtkTreeIter iter;
 			GtkTreeModel *model = gtk_tree_view_get_model(GTK_TREE_VIEW(treeview));
 			gtk_tree_model_get_iter (model, &iter, path);
 
 			gtk_tree_model_get(model, &iter,
 				W_EXPRESSION, &expression,
+				W_VT, &vt,
 			    -1);
 
-			if (strlen(expression))
+			if (VT_MORE == vt)
+			{
+				/* load next children of the parent */
+				if (DBS_STOPPED == debug_state)
+				{
+					GtkTreeIter parent;
+					GList *children;
+					gchar *internal;
+					gboolean more;
+					gint loaded;
+
+					gtk_tree_model_iter_parent(model, &parent, &iter);
+					gtk_tree_model_get (model, &parent,
+						W_INTERNAL, &internal,
+						-1);
+					loaded = gtk_tree_model_iter_n_children(model, &parent) - 1;
+
+					children = active_module->get_children(internal, loaded, WATCH_CHILDREN_PAGE, &more);
+					expand_more(GTK_TREE_VIEW(treeview), &iter, children, more);
+
+					free_variables_list(children);
+					g_free(internal);
+				}
+			}
+			else if (strlen(expression))
 			{
 				GtkTreeIter newvar, empty;
 
@@ -581,6 +607,7 @@ static void on_watch_expanded_callback(GtkTreeView *tree, GtkTreeIter *iter, Gtk
 	{
 		GList *children;
 		gchar *internal;
+		gboolean more;
 
 		/* if item has not been expanded before */
 		gtk_tree_model_get (
@@ -589,11 +616,11 @@ static void on_watch_expanded_callback(GtkTreeView *tree, GtkTreeIter *iter, Gtk
 			W_INTERNAL, &internal,
 			-1);
 		
-		/* get children list */
-		children = active_module->get_children(internal);
+		/* get first page of children list */
+		children = active_module->get_children(internal, 0, WATCH_CHILDREN_PAGE, &more);
 		
 		/* remove stub and add children */
-		expand_stub(tree, iter, children);
+		expand_stub(tree, iter, children, more);
 		
 		/* free children list */
 		free_variables_list(children);
@@ -607,6 +634,40 @@ static void on_watch_expanded_callback(GtkTreeView *tree, GtkTreeIter *iter, Gtk
 	}
 }
 
+/*
+ * gets values of the children shown in a variables tree view
+ */
+static gboolean on_variables_shown(gpointer data)
+{
+	g_object_set_data(G_OBJECT(data), "shown-update", NULL);
+
+	if (DBS_STOPPED == debug_state)
+		update_shown_variables(GTK_TREE_VIEW(data));
+
+	return FALSE;
+}
+
+/*
+ * schedules getting values of the children shown in a variables tree view,
+ * once whatever changes the shown rows is done
+ */
+static void update_shown_later(GtkWidget *tree)
+{
+	if (!g_object_get_data(G_OBJECT(tree), "shown-update"))
+	{
+		g_object_set_data(G_OBJECT(tree), "shown-update", GINT_TO_POINTER(TRUE));
+		g_idle_add(on_variables_shown, tree);
+	}
+}
+
+/*
+ * variables tree view has been scrolled, or its rows have changed
+ */
+static void on_variables_scrolled(GtkAdjustment *adjustment, gpointer user_data)
+{
+	update_shown_later(GTK_WIDGET(user_data));
+}
+
 /* 
  * GUI functions
  */
@@ -759,6 +820,10 @@ static void on_debugger_stopped (int thread_id)
 	watches = active_module->get_watches();
 	update_variables(GTK_TREE_VIEW(wtree), NULL, watches);
 
+	/* children shown anew */
+	update_shown_later(atree);
+	update_shown_later(wtree);
+
 	if (stack)
 	{
 		frame *current = (frame*)stack->data;
@@ -950,6 +1015,10 @@ static void on_select_frame(int frame_number)
 	watches = active_module->get_watches();
 	update_variables(GTK_TREE_VIEW(wtree), NULL, watches);
 
+	/* children shown anew */
+	update_shown_later(atree);
+	update_shown_later(wtree);
+
 	f = (frame*)g_list_nth_data(stack, frame_number);
 	if (f)
 	{
@@ -1017,6 +1086,8 @@ void debug_init(void)
 		GTK_POLICY_AUTOMATIC,
 		GTK_POLICY_AUTOMATIC);
 	gtk_container_add(GTK_CONTAINER(tab_watch), wtree);
+	g_signal_connect(G_OBJECT(gtk_tree_view_get_vadjustment(GTK_TREE_VIEW(wtree))), "value-changed", G_CALLBACK(on_variables_scrolled), wtree);
+	g_signal_connect(G_OBJECT(gtk_tree_view_get_vadjustment(GTK_TREE_VIEW(wtree))), "changed", G_CALLBACK(on_variables_scrolled), wtree);
 
 	/* create autos page */
 	atree = atree_init(on_watch_expanded_callback, on_watch_button_pressed_callback);
@@ -1028,6 +1099,8 @@ void debug_init(void)
 		GTK_POLICY_AUTOMATIC,
 		GTK_POLICY_AUTOMATIC);
 	gtk_container_add(GTK_CONTAINER(tab_autos), atree);
+	g_signal_connect(G_OBJECT(gtk_tree_view_get_vadjustment(GTK_TREE_VIEW(atree))), "value-changed", G_CALLBACK(on_variables_scrolled), atree);
+	g_signal_connect(G_OBJECT(gtk_tree_view_get_vadjustment(GTK_TREE_VIEW(atree))), "changed", G_CALLBACK(on_variables_scrolled), atree);
 	
 	/* create stack trace page */
 	stree = stree_init(editor_open_position, on_select_thread, on_select_frame);
@@ -1376,8 +1449,19 @@ gchar* debug_get_calltip_for_expression(gchar* expression)
 				if (var->has_children)
 				{
 					int lines_left = MAX_CALLTIP_HEIGHT - 1;
-					GList* children = active_module->get_children(var->internal->str);
-					GList* child = children;
+					gboolean more;
+					GList* children = active_module->get_children(var->internal->str, 0, lines_left, &more);
+					GList* internals = NULL;
+					GList* child;
+
+					/* get values of the children having children */
+					for (child = children; child; child = child->next)
+						internals = g_list_append(internals, ((variable*)child->data)->internal->str);
+					child = active_module->get_variables(internals);
+					g_list_free(internals);
+					free_variables_list(children);
+					children = child;
+
 					while(child && lines_left)
 					{
 						variable *varchild = (variable*)child->data;
@@ -1388,7 +1472,7 @@ gchar* debug_get_calltip_for_expression(gchar* expression)
 						child = child->next;
 						lines_left--;
 					}
-					if (!lines_left && child)
+					if (more)
 					{
 						g_string_append(calltip_str, "\n\t\t........");
 					}
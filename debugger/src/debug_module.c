@@ -55,6 +55,19 @@ variable *variable_new2(const gchar *name, const gchar *internal, variable_type
 	return var;
 }
 
+/* creates a copy of a variable */
+variable *variable_copy(variable *var)
+{
+	variable *copy = variable_new2(var->name->str, var->internal->str, var->vt);
+	g_string_assign(copy->expression, var->expression->str);
+	g_string_assign(copy->type, var->type->str);
+	g_string_assign(copy->value, var->value->str);
+	copy->has_children = var->has_children;
+	copy->evaluated = var->evaluated;
+	
+	return copy;
+}
+
 /* frees variable */
 void variable_free(variable *var)
 {
@@ -53,7 +53,8 @@ typedef enum _variable_type {
 	VT_WATCH,
 	VT_GLOBAL,
 	VT_CHILD,
-	VT_NONE
+	VT_NONE,
+	VT_MORE
 } variable_type;
 
 /* type to hold information about a variable */
@@ -130,7 +131,8 @@ typedef struct _dbg_module {
 	
 	GList* (*get_files) (void);
 
-	GList* (*get_children) (gchar* path);
+	GList* (*get_children) (gchar* path, int from, int count, gboolean *more);
+	GList* (*get_variables) (GList* internals);
 	variable* (*add_watch)(gchar* expression);
 	void (*remove_watch)(gchar* path);
 
@@ -164,6 +166,7 @@ typedef struct _dbg_module {
 	get_watches, \
 	get_files, \
 	get_children, \
+	get_variables, \
 	add_watch, \
 	remove_watch, \
 	evaluate_expression, \
@@ -174,6 +177,7 @@ typedef struct _dbg_module {
 void		variable_free(variable *var);
 variable*	variable_new(const gchar *name, variable_type vt);
 variable*	variable_new2(const gchar *name, const gchar *internal, variable_type vt);
+variable*	variable_copy(variable *var);
 void		variable_reset(variable *var);
 
 frame*		frame_new(void);
@@ -89,7 +89,7 @@ static void render_icon(GtkTreeViewColumn *tree_column,
 		W_VT, &vt,
 		-1);
 
-	if (VT_NONE != vt && VT_CHILD != vt)
+	if (VT_NONE != vt && VT_CHILD != vt && VT_MORE != vt)
 	{
 		GdkPixbuf *pixbuf = NULL;
 
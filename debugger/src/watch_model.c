@@ -39,6 +39,9 @@
 /* text for the stub item */
 #define WATCH_CHILDREN_STUB "..."
 
+/* text for the item to load more children */
+#define WATCH_CHILDREN_MORE _("(more...)")
+
 extern dbg_module *active_module;
 
 /*
@@ -81,6 +84,42 @@ inline static void add_stub(GtkTreeStore *store, GtkTreeIter *parent)
 		-1);
 }
 
+/*
+ * adds an item to load more children of "parent" to its end
+ */
+inline static void add_more(GtkTreeStore *store, GtkTreeIter *parent)
+{
+	GtkTreeIter more;
+	gtk_tree_store_append (store, &more, parent);
+	gtk_tree_store_set (store, &more,
+		W_NAME, WATCH_CHILDREN_MORE,
+		W_VALUE, "",
+		W_TYPE, "",
+		W_INTERNAL, "",
+		W_EXPRESSION, "",
+		W_STUB, FALSE,
+		W_CHANGED, FALSE,
+		W_VT, VT_MORE,
+		-1);
+}
+
+/*
+ * sets a new row from "v"
+ */
+inline static void set_new_variable(GtkTreeStore *store, GtkTreeIter *iter, variable *v, gboolean mark_changed)
+{
+	gtk_tree_store_set (store, iter,
+		W_NAME, v->name->str,
+		W_VALUE, v->value->str,
+		W_TYPE, v->type->str,
+		W_INTERNAL, v->internal->str,
+		W_EXPRESSION, v->expression->str,
+		W_STUB, v->has_children,
+		W_CHANGED, mark_changed,
+		W_VT, v->vt,
+		-1);
+}
+
 /*
  * insert all "vars" members to "parent" iterator in the "tree" as new children
  * mark_changed specifies whether to mark new items as beed changed
@@ -106,8 +145,9 @@ inline static void append_variables(GtkTreeView *tree, GtkTreeIter *parent, GLis
 		do
 		{
 			gchar *name = NULL;
-			gtk_tree_model_get(model, &child, W_NAME, &name, -1);
-			if (name && strlen(name))
+			variable_type vt;
+			gtk_tree_model_get(model, &child, W_NAME, &name, W_VT, &vt, -1);
+			if (name && strlen(name) && VT_MORE != vt)
 			{
 				GtkTreePath *path = gtk_tree_model_get_path(model, &child);
 				g_hash_table_insert(ht, name, gtk_tree_row_reference_new(model, path));
@@ -147,16 +187,7 @@ inline static void append_variables(GtkTreeView *tree, GtkTreeIter *parent, GLis
 		else
 		{
 			gtk_tree_store_insert(store, &child, parent, current_position);
-			gtk_tree_store_set (store, &child,
-				W_NAME, v->name->str,
-				W_VALUE, v->value->str,
-				W_TYPE, v->type->str,
-				W_INTERNAL, v->internal->str,
-				W_EXPRESSION, v->expression->str,
-				W_STUB, v->has_children,
-				W_CHANGED, mark_changed,
-				W_VT, v->vt,
-				-1);
+			set_new_variable(store, &child, v, mark_changed);
 			
 			/* expand to row if we were asked to */
 			if (expand)
@@ -228,9 +259,46 @@ static void update_variable(GtkTreeStore *store, GtkTreeIter *iter, variable *va
 } 
 
 /*
- * remove stub item and add vars to parent iterator
+ * counts children of "parent" leaving out the item to load more of them,
+ * "more" is set if "parent" has that item
  */
-void expand_stub(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
+static gint count_children(GtkTreeModel *model, GtkTreeIter *parent, gboolean *more)
+{
+	gint count = gtk_tree_model_iter_n_children(model, parent);
+	GtkTreeIter last;
+	variable_type vt = VT_NONE;
+
+	if (count && gtk_tree_model_iter_nth_child(model, &last, parent, count - 1))
+		gtk_tree_model_get(model, &last, W_VT, &vt, -1);
+
+	*more = VT_MORE == vt;
+	return *more ? count - 1 : count;
+}
+
+/*
+ * adds or removes the item to load more children of "parent"
+ */
+static void set_more(GtkTreeStore *store, GtkTreeIter *parent, gboolean more)
+{
+	GtkTreeModel *model = GTK_TREE_MODEL(store);
+	gboolean has_more;
+	gint count = count_children(model, parent, &has_more);
+
+	if (has_more && !more)
+	{
+		GtkTreeIter last;
+		gtk_tree_model_iter_nth_child(model, &last, parent, count);
+		gtk_tree_store_remove(store, &last);
+	}
+	else if (!has_more && more)
+		add_more(store, parent);
+}
+
+/*
+ * remove stub item and add vars to parent iterator,
+ * "more" tells whether the parent has more children than "vars"
+ */
+void expand_stub(GtkTreeView *tree, GtkTreeIter *parent, GList *vars, gboolean more)
 {
 	GtkTreeModel *model = gtk_tree_view_get_model(tree);
 	GtkTreeStore *store = GTK_TREE_STORE(model);
@@ -250,6 +318,43 @@ void expand_stub(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
 	
 	/* remove stub item */
 	gtk_tree_store_remove(store, &stub);
+
+	/* add an item to load the others */
+	if (more)
+		add_more(store, parent);
+}
+
+/*
+ * add next children "vars" of the parent of the "more" item,
+ * it is removed unless the parent has even more children
+ */
+void expand_more(GtkTreeView *tree, GtkTreeIter *more_item, GList *vars, gboolean more)
+{
+	GtkTreeModel *model = gtk_tree_view_get_model(tree);
+	GtkTreeStore *store = GTK_TREE_STORE(model);
+	GtkTreeIter parent;
+	gboolean changed;
+
+	gtk_tree_model_iter_parent(model, &parent, more_item);
+	gtk_tree_model_get(model, &parent,
+		W_CHANGED, &changed,
+		-1);
+
+	while (vars)
+	{
+		variable *v = (variable*)vars->data;
+		GtkTreeIter child;
+
+		gtk_tree_store_insert_before(store, &child, &parent, more_item);
+		set_new_variable(store, &child, v, changed);
+		if (v->has_children)
+			add_stub(store, &child);
+
+		vars = vars->next;
+	}
+
+	if (!more)
+		gtk_tree_store_remove(store, more_item);
 }
 
 /*
@@ -308,6 +413,10 @@ void update_variables(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
 			gchar *name;
 			gchar *internal;
 			gchar *value;
+			gchar *type;
+			gboolean row_changed;
+			gboolean stub;
+			variable_type vt;
 			GList *var;
 			variable *v;
 			gboolean changed;
@@ -321,14 +430,19 @@ void update_variables(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
 				W_NAME, &name,
 				W_INTERNAL, &internal,
 				W_VALUE, &value,
+				W_TYPE, &type,
+				W_CHANGED, &row_changed,
+				W_STUB, &stub,
+				W_VT, &vt,
 				-1);
 				
 			/* miss empty row in watch tree */
 			if (!strlen(name))
 				break;
 			
-			/* 2. find this path is "vars" list */
-			var = lookup_variable(vars, name);
+			/* 2. find this path is "vars" list,
+			the item to load more children is added anew if needed */
+			var = VT_MORE != vt ? lookup_variable(vars, name) : NULL;
 
 			/* 3. check if we have found currect iterator */
 			if (!var)
@@ -344,10 +458,18 @@ void update_variables(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
 					break;
 			}
 			
-			/* 4. update variable (type, value) */
+			/* 4. update variable (type, value), leaving rows that
+			are already up to date untouched */
 			v = (variable*)var->data;
-			changed = parent_changed || strcmp(value, v->value->str);
-			update_variable(store, &child, v, changed && v->evaluated);
+			changed = (parent_changed || strcmp(value, v->value->str)) && v->evaluated;
+			if (changed != row_changed ||
+				strcmp(value, v->evaluated ? v->value->str : _("Can't evaluate expression")) ||
+				strcmp(type, v->type->str) ||
+				strcmp(internal, v->internal->str))
+			{
+				update_variable(store, &child, v, changed);
+				stub = FALSE;
+			}
 			
 			/* 5. if item have children - process them */ 		
 			if (gtk_tree_model_iter_has_child(model, &child))
@@ -356,6 +478,8 @@ void update_variables(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
 				{
 					/* if children are left from previous variable value - remove all children */
 					remove_children(model, &child);
+					if (stub)
+						gtk_tree_store_set(store, &child, W_STUB, FALSE, -1);
 				}
 				else
 				{
@@ -364,17 +488,22 @@ void update_variables(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
 					GtkTreePath *path = gtk_tree_model_get_path(model, &child);
 					if (!gtk_tree_view_row_expanded(tree, path))
 					{
-						/* remove all children */
-						remove_children(model, &child);
-						/* add stub item */
-						add_stub(store, &child); 
+						/* replace children with a stub item unless it is there already */
+						if (!stub)
+						{
+							remove_children(model, &child);
+							add_stub(store, &child);
+						}
 					}
 					else
 					{
-						/* get children for "parent" item */
-						GList *children = active_module->get_children(v->internal->str);
+						/* get as many children for "parent" item as there are loaded */
+						gboolean more;
+						gint count = MAX(count_children(model, &child, &more), WATCH_CHILDREN_PAGE);
+						GList *children = active_module->get_children(v->internal->str, 0, count, &more);
 						/* update children */
 						update_variables(tree, &child, g_list_copy(children));
+						set_more(store, &child, more);
 						/* frees children list */
 						free_variables_list(children);
 					}
@@ -392,6 +521,7 @@ void update_variables(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
 			g_free(name);
 			g_free(internal);
 			g_free(value);
+			g_free(type);
 
 			if (!gtk_tree_model_iter_next(model, &child))
 				break;
@@ -405,6 +535,110 @@ void update_variables(GtkTreeView *tree, GtkTreeIter *parent, GList *vars)
 	g_list_free(vars);
 }
 
+/*
+ * moves "iter" to the next row shown in "tree"
+ */
+static gboolean next_shown_row(GtkTreeView *tree, GtkTreeModel *model, GtkTreeIter *iter)
+{
+	GtkTreePath *path = gtk_tree_model_get_path(model, iter);
+	gboolean expanded = gtk_tree_view_row_expanded(tree, path);
+	GtkTreeIter next;
+
+	gtk_tree_path_free(path);
+
+	if (expanded && gtk_tree_model_iter_children(model, &next, iter))
+	{
+		*iter = next;
+		return TRUE;
+	}
+
+	while (TRUE)
+	{
+		next = *iter;
+		if (gtk_tree_model_iter_next(model, &next))
+		{
+			*iter = next;
+			return TRUE;
+		}
+		if (!gtk_tree_model_iter_parent(model, &next, iter))
+			return FALSE;
+		*iter = next;
+	}
+}
+
+/*
+ * gets path expressions and values of the children shown in "tree"
+ * that haven't been described yet
+ */
+void update_shown_variables(GtkTreeView *tree)
+{
+	GtkTreeModel *model = gtk_tree_view_get_model(tree);
+	GtkTreeStore *store = GTK_TREE_STORE(model);
+	GtkTreePath *start, *end;
+	GtkTreeIter iter;
+	GHashTable *rows;
+	GList *internals = NULL, *vars, *var;
+
+	if (!gtk_tree_view_get_visible_range(tree, &start, &end))
+		return;
+
+	/* children rows without path expression */
+	rows = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)gtk_tree_iter_free);
+	gtk_tree_model_get_iter(model, &iter, start);
+	do
+	{
+		gchar *internal, *expression;
+		variable_type vt;
+		GtkTreePath *path;
+		gboolean last;
+
+		gtk_tree_model_get (model, &iter,
+			W_INTERNAL, &internal,
+			W_EXPRESSION, &expression,
+			W_VT, &vt,
+			-1);
+
+		if (VT_CHILD == vt && !strlen(expression) && !g_hash_table_lookup(rows, internal))
+		{
+			g_hash_table_insert(rows, internal, gtk_tree_iter_copy(&iter));
+			internals = g_list_prepend(internals, internal);
+		}
+		else
+			g_free(internal);
+		g_free(expression);
+
+		path = gtk_tree_model_get_path(model, &iter);
+		last = gtk_tree_path_compare(path, end) >= 0;
+		gtk_tree_path_free(path);
+		if (last)
+			break;
+	}
+	while (next_shown_row(tree, model, &iter));
+
+	gtk_tree_path_free(start);
+	gtk_tree_path_free(end);
+
+	/* get them all at once */
+	vars = active_module->get_variables(internals);
+	for (var = vars; var; var = var->next)
+	{
+		variable *v = (variable*)var->data;
+		GtkTreeIter *row = g_hash_table_lookup(rows, v->internal->str);
+
+		if (row)
+		{
+			gtk_tree_store_set (store, row,
+				W_VALUE, v->evaluated ? v->value->str : _("Can't evaluate expression"),
+				W_EXPRESSION, v->expression->str,
+				-1);
+		}
+	}
+	free_variables_list(vars);
+
+	g_list_free(internals);
+	g_hash_table_destroy(rows);
+}
+
 /*
  * clear all root variables in "tree" removing their children if available
  */
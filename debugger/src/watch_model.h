@@ -40,6 +40,9 @@ enum
    W_N_COLUMNS
 };
 
+/* number of children loaded at once */
+#define WATCH_CHILDREN_PAGE 100
+
 /* types for the callbacks */
 typedef void (*watch_expanded_callback)(GtkTreeView *tree_view, GtkTreeIter *iter, GtkTreePath *path, gpointer user_data);
 typedef void (*new_watch_dragged)(GtkWidget *wgt, GdkDragContext *context, int x, int y, GtkSelectionData *seldata, guint info, guint time, gpointer userdata);
@@ -54,6 +57,8 @@ GList*	get_root_items(GtkTreeView *tree);
 void	change_watch(GtkTreeView *tree, GtkTreeIter *iter, gpointer var);
 void	free_variables_list(GList *vars);
 void	variable_set_name_only(GtkTreeStore *store, GtkTreeIter *iter, gchar *name);
-void	expand_stub(GtkTreeView *tree, GtkTreeIter *parent, GList *vars);
+void	expand_stub(GtkTreeView *tree, GtkTreeIter *parent, GList *vars, gboolean more);
+void	expand_more(GtkTreeView *tree, GtkTreeIter *more_item, GList *vars, gboolean more);
+void	update_shown_variables(GtkTreeView *tree);
 
 #endif /* guard */
@@ -62,12 +62,20 @@ PLUGIN_SET_TRANSLATABLE_INFO (
 )
 
 
-/* g_async_queue_push() doesn't allow for NULL data, so use a non-NULL fake
- * data that we know cannot ever be a valid job */
-#define QUIT_THREAD_JOB ((AsyncBlobContentsJob *) (&G_queue))
+/* number of unchanged lines around an edit re-diffed with it */
+#define INCREMENTAL_CONTEXT 3
+/* number of threads loading blobs */
+#define WORKER_THREADS 4
+/* number of threads diffing documents */
+#define DIFF_THREADS 2
+/* maximum size of the HEAD blobs kept in the cache when no document uses them */
+#define BLOB_CACHE_MAX_SIZE (32 * 1024 * 1024)
 
 #define RESOURCES_ALLOCATED_QTAG \
   (g_quark_from_string (PLUGIN"/git-resources-allocated"))
+/* incremented on each modification of a document */
+#define DOC_VERSION_QTAG \
+  (g_quark_from_string (PLUGIN"/document-version"))
 
 
 enum {
@@ -88,16 +96,81 @@ typedef void (*BlobContentsReadyFunc) (const gchar *path,
                                        git_buf     *buf,
                                        gpointer     data);
 
+/* an open repository, shared by all documents inside it */
+typedef struct RepoCacheEntry RepoCacheEntry;
+struct RepoCacheEntry {
+  gint            ref_count;
+  GMutex          lock; /* serializes the use of @repo by the workers */
+  gchar          *gitdir;
+  git_repository *repo;
+  GFileMonitor   *monitors[2];
+};
+
+/* the HEAD contents of a file, shared by all documents showing it */
+typedef struct CachedBlob CachedBlob;
+struct CachedBlob {
+  gint    ref_count;
+  gchar  *key;
+  gsize   size;
+  guint   doc_count; /* number of DocBlobs using it, protected by the cache lock */
+  GList  *lru_link;  /* NULL while used by a document or once evicted */
+  git_buf buf;
+};
+
+/* what we know about a document's file */
+typedef struct DocBlob DocBlob;
+struct DocBlob {
+  gchar      *path;
+  gchar      *gitdir;  /* NULL if not in a repository */
+  CachedBlob *blob;    /* NULL if not in a repository or not in HEAD */
+};
+
+/* a hunk, as reported by git_diff_hunk */
+typedef struct DiffHunk DiffHunk;
+struct DiffHunk {
+  gint old_start;
+  gint old_lines;
+  gint new_start;
+  gint new_lines;
+};
+
+/* the last diff of a document and the lines edited since */
+typedef struct DocDiff DocDiff;
+struct DocDiff {
+  CachedBlob *blob;
+  GArray     *old_line_starts;  /* offsets of the lines in @blob, lazily */
+  GArray     *hunks;            /* DiffHunk */
+  gboolean    dirty;
+  gint        dirty_start;      /* first edited line */
+  gint        dirty_end;        /* line after the last edited line */
+  gint        dirty_delta;      /* number of lines added by the edits */
+};
+
 typedef struct AsyncBlobContentsJob AsyncBlobContentsJob;
 struct AsyncBlobContentsJob {
-  gboolean              force;
   guint                 tag;
+  guint                 generation;
   gchar                *path;
-  git_buf               buf;
+  gchar                *gitdir;
+  CachedBlob           *blob;
   BlobContentsReadyFunc callback;
   gpointer              user_data;
 };
 
+/* a full diff of a document against its HEAD blob */
+typedef struct AsyncDiffJob AsyncDiffJob;
+struct AsyncDiffJob {
+  guint       doc_id;
+  guint       version;  /* version of the document @text is a copy of */
+  CachedBlob *blob;
+  gchar      *text;
+  gsize       length;
+  gboolean    has_bom;
+  gchar      *encoding;
+  gboolean    rerun;    /* whether to start again once done */
+  GArray     *hunks;    /* the result */
+};
+
 typedef struct TooltipHunkData TooltipHunkData;
 struct TooltipHunkData {
   gint            line;
@@ -130,11 +203,16 @@ struct UndoHunkData {
   gint     new_lines;
 };
 
-static void         on_git_repo_changed         (GFileMonitor     *monitor,
+static void         on_git_head_changed         (GFileMonitor     *monitor,
+                                                 GFile            *file,
+                                                 GFile            *other_file,
+                                                 GFileMonitorEvent event_type,
+                                                 gpointer          entry);
+static void         on_git_ref_changed          (GFileMonitor     *monitor,
                                                  GFile            *file,
                                                  GFile            *other_file,
                                                  GFileMonitorEvent event_type,
-                                                 gpointer          force);
+                                                 gpointer          entry);
 static gboolean     on_sci_query_tooltip        (GtkWidget   *widget,
                                                  gint         x,
                                                  gint         y,
@@ -159,12 +237,25 @@ static void         write_setting_boolean       (GKeyFile      *kf,
                                                  gconstpointer  value);
 
 
-/* cache */
-static git_buf          G_blob_contents       = { 0 };
-static guint            G_blob_contents_tag   = 0;
+/* caches shared with the workers, protected by the cache lock */
+G_LOCK_DEFINE_STATIC (cache);
+static GHashTable      *G_repos               = NULL; /* gitdir -> RepoCacheEntry */
+static GHashTable      *G_dir_repos           = NULL; /* directory -> RepoCacheEntry */
+static GHashTable      *G_blobs               = NULL; /* key -> CachedBlob */
+static GQueue           G_blob_lru            = G_QUEUE_INIT;
+static gsize            G_blob_lru_size       = 0;
+/* main thread cache: document ID -> DocBlob */
+static GHashTable      *G_doc_blobs           = NULL;
+/* document ID -> DocDiff */
+static GHashTable      *G_doc_diffs           = NULL;
+/* document ID -> AsyncDiffJob in progress */
+static GHashTable      *G_diff_jobs           = NULL;
+/* incremented when cached data gets invalid so late jobs don't store it */
+static guint            G_cache_generation    = 0;
 /* global state */
-static GAsyncQueue     *G_queue               = NULL;
-static GThread         *G_thread              = NULL;
+static GThreadPool     *G_pool                = NULL;
+static GThreadPool     *G_diff_pool           = NULL;
+static GQueue           G_jobs                = G_QUEUE_INIT;
 static gulong           G_source_id           = 0;
 static gboolean         G_monitoring_enabled  = TRUE;
 static struct {
@@ -228,53 +319,122 @@ buf_zero (git_buf *buf)
   }
 }
 
+static CachedBlob *
+cached_blob_ref (CachedBlob *blob)
+{
+  g_atomic_int_inc (&blob->ref_count);
+  
+  return blob;
+}
+
+static void
+cached_blob_unref (CachedBlob *blob)
+{
+  if (blob && g_atomic_int_dec_and_test (&blob->ref_count)) {
+    git_buf_free (&blob->buf);
+    g_free (blob->key);
+    g_slice_free1 (sizeof *blob, blob);
+  }
+}
+
+static void blob_cache_trim (void);
+
+/* takes @blob out of the LRU while a document uses it, so it is neither
+ * evicted nor counted in the cache size */
+static CachedBlob *
+cached_blob_use (CachedBlob *blob)
+{
+  G_LOCK (cache);
+  if (blob->doc_count++ == 0 && blob->lru_link) {
+    g_queue_delete_link (&G_blob_lru, blob->lru_link);
+    blob->lru_link = NULL;
+    G_blob_lru_size -= blob->size;
+  }
+  G_UNLOCK (cache);
+  
+  return cached_blob_ref (blob);
+}
+
+/* puts @blob back in the LRU when no document uses it any more, unless it
+ * was dropped from the cache meanwhile */
 static void
-clear_cached_blob_contents (void)
+cached_blob_unuse (CachedBlob *blob)
 {
-  if (G_blob_contents.ptr) {
-    git_buf_free (&G_blob_contents);
-    buf_zero (&G_blob_contents);
+  if (! blob) {
+    return;
+  }
+  
+  G_LOCK (cache);
+  if (--blob->doc_count == 0 &&
+      g_hash_table_lookup (G_blobs, blob->key) == blob) {
+    g_queue_push_head (&G_blob_lru, blob);
+    blob->lru_link = G_blob_lru.head;
+    G_blob_lru_size += blob->size;
+    blob_cache_trim ();
   }
-  G_blob_contents_tag = 0;
+  G_UNLOCK (cache);
+  
+  cached_blob_unref (blob);
+}
+
+static void
+doc_blob_free (gpointer data)
+{
+  DocBlob *doc_blob = data;
+  
+  cached_blob_unuse (doc_blob->blob);
+  g_free (doc_blob->gitdir);
+  g_free (doc_blob->path);
+  g_slice_free1 (sizeof *doc_blob, doc_blob);
 }
 
-/* get the file blob for @relpath at HEAD */
+static const DocBlob *
+get_doc_blob (GeanyDocument *doc)
+{
+  const DocBlob *doc_blob = g_hash_table_lookup (G_doc_blobs,
+                                                 GUINT_TO_POINTER (doc->id));
+  
+  if (doc_blob && doc->real_path &&
+      strcmp (doc_blob->path, doc->real_path) == 0) {
+    return doc_blob;
+  }
+  
+  return NULL;
+}
+
+/* get the file blob for @relpath in the commit @commit_id */
 static gboolean
 repo_get_file_blob_contents (git_repository  *repo,
+                             const git_oid   *commit_id,
                              const gchar     *relpath,
                              git_buf         *contents,
                              int              check_for_binary_data)
 {
-  git_reference  *head    = NULL;
-  gboolean        success = FALSE;
+  git_commit *commit  = NULL;
+  gboolean    success = FALSE;
   
-  if (git_repository_head (&head, repo) == 0) {
-    git_commit *commit = NULL;
+  if (git_commit_lookup (&commit, repo, commit_id) == 0) {
+    git_tree *tree = NULL;
     
-    if (git_commit_lookup (&commit, repo, git_reference_target (head)) == 0) {
-      git_tree *tree = NULL;
+    if (git_commit_tree (&tree, commit) == 0) {
+      git_tree_entry *entry = NULL;
       
-      if (git_commit_tree (&tree, commit) == 0) {
-        git_tree_entry *entry = NULL;
+      if (git_tree_entry_bypath (&entry, tree, relpath) == 0) {
+        git_blob *blob;
         
-        if (git_tree_entry_bypath (&entry, tree, relpath) == 0) {
-          git_blob *blob;
-          
-          if (git_blob_lookup (&blob, repo, git_tree_entry_id (entry)) == 0) {
-            if (git_blob_filtered_content (contents, blob, relpath,
-                                           check_for_binary_data) == 0 &&
-                git_buf_grow (contents, 0) == 0) {
-              success = TRUE;
-            }
-            git_blob_free (blob);
+        if (git_blob_lookup (&blob, repo, git_tree_entry_id (entry)) == 0) {
+          if (git_blob_filtered_content (contents, blob, relpath,
+                                         check_for_binary_data) == 0 &&
+              git_buf_grow (contents, 0) == 0) {
+            success = TRUE;
           }
-          git_tree_entry_free (entry);
+          git_blob_free (blob);
         }
-        git_tree_free (tree);
+        git_tree_entry_free (entry);
       }
-      git_commit_free (commit);
+      git_tree_free (tree);
     }
-    git_reference_free (head);
+    git_commit_free (commit);
   }
   
   return success;
@@ -285,10 +445,9 @@ free_job (gpointer data)
 {
   AsyncBlobContentsJob *job = data;
   
-  /* unlikely, but if we still have the buffer, free it */
-  if (job->buf.ptr) {
-    git_buf_free (&job->buf);
-  }
+  g_queue_remove (&G_jobs, job);
+  cached_blob_unref (job->blob);
+  g_free (job->gitdir);
   g_free (job->path);
   g_slice_free1 (sizeof *job, job);
 }
@@ -298,14 +457,18 @@ report_work_in_idle (gpointer data)
 {
   AsyncBlobContentsJob *job = data;
   
-  /* update cached blob */
-  clear_cached_blob_contents ();
-  G_blob_contents = job->buf;
-  G_blob_contents_tag = job->buf.ptr ? job->tag : 0;
-  
-  job->callback (job->path, job->buf.ptr ? &job->buf : NULL, job->user_data);
+  /* update the document's cache, unless it was invalidated meanwhile */
+  if (job->generation == G_cache_generation) {
+    DocBlob *doc_blob = g_slice_alloc (sizeof *doc_blob);
+    
+    doc_blob->path = g_strdup (job->path);
+    doc_blob->gitdir = g_strdup (job->gitdir);
+    doc_blob->blob = job->blob ? cached_blob_use (job->blob) : NULL;
+    g_hash_table_replace (G_doc_blobs, GUINT_TO_POINTER (job->tag), doc_blob);
+  }
   
-  buf_zero (&job->buf);
+  job->callback (job->path, job->blob ? &job->blob->buf : NULL,
+                 job->user_data);
   
   return FALSE;
 }
@@ -407,78 +570,269 @@ get_path_in_repository (git_repository *repo,
 #endif
 }
 
-static gpointer
-worker_thread (gpointer data)
+static RepoCacheEntry *
+repo_cache_entry_ref (RepoCacheEntry *entry)
 {
-  GAsyncQueue          *queue       = data;
-  git_repository       *repo        = NULL;
-  GFileMonitor         *monitors[2] = { NULL, NULL };
-  AsyncBlobContentsJob *job;
-  guint                 i;
+  g_atomic_int_inc (&entry->ref_count);
   
-  while ((job = g_async_queue_pop (queue)) != QUIT_THREAD_JOB) {
-    const gchar *path = job->path;
-    
-    if (repo && (job->force ||
-                 ! path_dir_contains (path, git_repository_workdir (repo)))) {
-      /* FIXME: this can fail with nested repositories */
+  return entry;
+}
+
+static void
+repo_cache_entry_unref (gpointer data)
+{
+  RepoCacheEntry *entry = data;
+  
+  if (g_atomic_int_dec_and_test (&entry->ref_count)) {
+    git_repository_free (entry->repo);
+    g_mutex_clear (&entry->lock);
+    g_free (entry->gitdir);
+    g_slice_free1 (sizeof *entry, entry);
+  }
+}
+
+/* called with the cache lock held */
+static RepoCacheEntry *
+repo_cache_entry_new (git_repository *repo)
+{
+  RepoCacheEntry *entry = g_slice_alloc0 (sizeof *entry);
+  
+  entry->ref_count = 1;
+  g_mutex_init (&entry->lock);
+  entry->gitdir = g_strdup (git_repository_path (repo));
+  entry->repo = repo;
+  if (G_monitoring_enabled) {
+    /* we need to monitor HEAD, in case of e.g. branch switch (e.g.
+     * git checkout -b will switch the ref we need to watch) */
+    entry->monitors[0] = monitor_repo_file (repo, "HEAD",
+                                            G_CALLBACK (on_git_head_changed),
+                                            entry);
+    /* and of course the real ref (branch) for when changes get committed */
+    entry->monitors[1] = monitor_head_ref (repo,
+                                           G_CALLBACK (on_git_ref_changed),
+                                           entry);
+  }
+  
+  return entry;
+}
+
+static gboolean
+dir_repo_is (gpointer key,
+             gpointer value,
+             gpointer entry)
+{
+  return value == entry;
+}
+
+/* removes @entry from the cache so the repository gets reopened next time.
+ * must be called from the main thread, as the monitors' signals are emitted
+ * there */
+static void
+repo_cache_remove (RepoCacheEntry *entry)
+{
+  guint i;
+  
+  for (i = 0; i < G_N_ELEMENTS (entry->monitors); i++) {
+    if (entry->monitors[i]) {
+      g_signal_handlers_disconnect_by_data (entry->monitors[i], entry);
+      g_file_monitor_cancel (entry->monitors[i]);
+      g_object_unref (entry->monitors[i]);
+      entry->monitors[i] = NULL;
+    }
+  }
+  
+  G_LOCK (cache);
+  g_hash_table_foreach_remove (G_dir_repos, dir_repo_is, entry);
+  g_hash_table_remove (G_repos, entry->gitdir);
+  G_UNLOCK (cache);
+}
+
+static void
+repo_cache_clear (void)
+{
+  GList *entries;
+  GList *item;
+  
+  G_LOCK (cache);
+  entries = g_hash_table_get_values (G_repos);
+  for (item = entries; item; item = item->next) {
+    repo_cache_entry_ref (item->data);
+  }
+  G_UNLOCK (cache);
+  
+  for (item = entries; item; item = item->next) {
+    repo_cache_remove (item->data);
+    repo_cache_entry_unref (item->data);
+  }
+  g_list_free (entries);
+}
+
+/* gets the (referenced) repository containing @path, opening it if needed */
+static RepoCacheEntry *
+repo_cache_lookup (const gchar *path)
+{
+  gchar          *dirname = g_path_get_dirname (path);
+  RepoCacheEntry *entry;
+  git_repository *repo;
+  
+  G_LOCK (cache);
+  entry = g_hash_table_lookup (G_dir_repos, dirname);
+  if (entry) {
+    repo_cache_entry_ref (entry);
+  }
+  G_UNLOCK (cache);
+  
+  if (! entry && git_repository_open_ext (&repo, dirname, 0, NULL) == 0) {
+    if (git_repository_is_bare (repo)) {
       git_repository_free (repo);
-      repo = NULL;
-      for (i = 0; i < G_N_ELEMENTS (monitors); i++) {
-        if (monitors[i]) {
-          g_object_unref (monitors[i]);
-          monitors[i] = NULL;
-        }
+    } else {
+      G_LOCK (cache);
+      /* the repository might already be known from another directory */
+      entry = g_hash_table_lookup (G_repos, git_repository_path (repo));
+      if (entry) {
+        git_repository_free (repo);
+      } else {
+        entry = repo_cache_entry_new (repo);
+        g_hash_table_insert (G_repos, entry->gitdir, entry);
       }
+      g_hash_table_insert (G_dir_repos, g_strdup (dirname),
+                           repo_cache_entry_ref (entry));
+      repo_cache_entry_ref (entry);
+      G_UNLOCK (cache);
     }
-    if (! repo) {
-      gchar *dirname = g_path_get_dirname (path);
-      if (git_repository_open_ext (&repo, dirname, 0, NULL) == 0) {
-        if (git_repository_is_bare (repo)) {
-          git_repository_free (repo);
-          repo = NULL;
-        } else if (G_monitoring_enabled) {
-          /* we need to monitor HEAD, in case of e.g. branch switch (e.g.
-           * git checkout -b will switch the ref we need to watch) */
-          monitors[0] = monitor_repo_file (repo, "HEAD",
-                                           G_CALLBACK (on_git_repo_changed),
-                                           GINT_TO_POINTER (TRUE));
-          /* and of course the real ref (branch) for when changes get committed */
-          monitors[1] = monitor_head_ref (repo, G_CALLBACK (on_git_repo_changed),
-                                          GINT_TO_POINTER (FALSE));
-        }
-      }
-      g_free(dirname);
+  }
+  g_free (dirname);
+  
+  return entry;
+}
+
+/* evicts the least recently used blobs no document uses.  Called with the
+ * cache lock held */
+static void
+blob_cache_trim (void)
+{
+  while (G_blob_lru_size > BLOB_CACHE_MAX_SIZE && G_blob_lru.tail) {
+    CachedBlob *blob = g_queue_pop_tail (&G_blob_lru);
+    
+    blob->lru_link = NULL;
+    G_blob_lru_size -= blob->size;
+    /* the table holds the cache's reference */
+    g_hash_table_remove (G_blobs, blob->key);
+  }
+}
+
+/* gets the HEAD contents of @path inside @entry's repository from the cache,
+ * or loads it.  @entry has to be locked */
+static CachedBlob *
+repo_get_cached_blob (RepoCacheEntry *entry,
+                      const gchar    *path)
+{
+  CachedBlob *blob = NULL;
+  gchar      *relpath;
+  gchar      *key;
+  git_oid     head_id;
+  gchar       head_str[GIT_OID_HEXSZ + 1];
+  
+  relpath = get_path_in_repository (entry->repo, path);
+  if (! relpath) {
+    return NULL;
+  }
+  if (git_reference_name_to_id (&head_id, entry->repo, "HEAD") != 0) {
+    g_free (relpath);
+    return NULL;
+  }
+  
+  git_oid_tostr (head_str, sizeof head_str, &head_id);
+  key = g_strconcat (entry->gitdir, "\n", head_str, "\n", relpath, NULL);
+  
+  G_LOCK (cache);
+  blob = g_hash_table_lookup (G_blobs, key);
+  if (blob) {
+    cached_blob_ref (blob);
+    if (blob->lru_link) {
+      g_queue_unlink (&G_blob_lru, blob->lru_link);
+      g_queue_push_head_link (&G_blob_lru, blob->lru_link);
     }
+  }
+  G_UNLOCK (cache);
+  
+  if (! blob) {
+    git_buf buf;
     
-    buf_zero (&job->buf);
-    if (repo) {
-      gchar *relpath = get_path_in_repository (repo, path);
-      
-      if (relpath) {
-        if (! repo_get_file_blob_contents (repo, relpath, &job->buf, 0)) {
-          git_buf_free (&job->buf);
-          buf_zero (&job->buf);
-        }
+    buf_zero (&buf);
+    if (repo_get_file_blob_contents (entry->repo, &head_id, relpath,
+                                     &buf, 0)) {
+      G_LOCK (cache);
+      /* a reopened instance of the repository might have been faster */
+      blob = g_hash_table_lookup (G_blobs, key);
+      if (blob) {
+        cached_blob_ref (blob);
+        git_buf_free (&buf);
+      } else {
+        blob = g_slice_alloc (sizeof *blob);
+        blob->ref_count = 2; /* one for the cache and one for the caller */
+        blob->key = key;
+        blob->size = buf.size;
+        blob->doc_count = 0;
+        blob->buf = buf;
+        key = NULL;
         
-        g_free (relpath);
+        g_hash_table_insert (G_blobs, blob->key, blob);
+        g_queue_push_head (&G_blob_lru, blob);
+        blob->lru_link = G_blob_lru.head;
+        G_blob_lru_size += blob->size;
+        blob_cache_trim ();
       }
+      G_UNLOCK (cache);
+    } else {
+      git_buf_free (&buf);
     }
-    
-    g_idle_add_full (G_PRIORITY_LOW, report_work_in_idle, job, free_job);
   }
   
-  for (i = 0; i < G_N_ELEMENTS (monitors); i++) {
-    if (monitors[i]) {
-      g_object_unref (monitors[i]);
-      monitors[i] = NULL;
-    }
+  g_free (key);
+  g_free (relpath);
+  
+  return blob;
+}
+
+static void
+worker_func (gpointer data,
+             gpointer user_data)
+{
+  AsyncBlobContentsJob *job = data;
+  RepoCacheEntry       *entry;
+  
+  entry = repo_cache_lookup (job->path);
+  if (entry) {
+    g_mutex_lock (&entry->lock);
+    job->gitdir = g_strdup (entry->gitdir);
+    job->blob = repo_get_cached_blob (entry, job->path);
+    g_mutex_unlock (&entry->lock);
+    repo_cache_entry_unref (entry);
   }
-  if (repo) {
-    git_repository_free (repo);
+  
+  g_idle_add_full (G_PRIORITY_LOW, report_work_in_idle, job, free_job);
+}
+
+/* forgets what is known about the repository containing @path */
+static void
+forget_repository (const gchar *path)
+{
+  gchar          *dirname = g_path_get_dirname (path);
+  RepoCacheEntry *entry;
+  
+  G_LOCK (cache);
+  entry = g_hash_table_lookup (G_dir_repos, dirname);
+  if (entry) {
+    repo_cache_entry_ref (entry);
   }
+  G_UNLOCK (cache);
   
-  return NULL;
+  if (entry) {
+    repo_cache_remove (entry);
+    repo_cache_entry_unref (entry);
+  }
+  g_free (dirname);
 }
 
 static void
@@ -488,29 +842,37 @@ get_cached_blob_contents_async (const gchar          *path,
                                 BlobContentsReadyFunc callback,
                                 gpointer              user_data)
 {
-  if ((! force && G_blob_contents.ptr && tag == G_blob_contents_tag) ||
-      ! path) {
-    callback (path, &G_blob_contents, user_data);
+  const DocBlob *doc_blob = g_hash_table_lookup (G_doc_blobs,
+                                                 GUINT_TO_POINTER (tag));
+  
+  if (! path) {
+    callback (path, NULL, user_data);
+  } else if (! force && doc_blob && strcmp (doc_blob->path, path) == 0) {
+    callback (path, doc_blob->blob ? &doc_blob->blob->buf : NULL, user_data);
   } else {
     AsyncBlobContentsJob *job = g_slice_alloc (sizeof *job);
     
-    job->force      = force;
+    if (force) {
+      G_cache_generation++;
+      g_hash_table_remove (G_doc_blobs, GUINT_TO_POINTER (tag));
+      forget_repository (path);
+    }
+    
     job->tag        = tag;
+    job->generation = G_cache_generation;
     job->path       = g_strdup (path);
+    job->gitdir     = NULL;
+    job->blob       = NULL;
     job->callback   = callback;
     job->user_data  = user_data;
-    buf_zero (&job->buf);
     
-    if (! G_thread) {
-      G_queue = g_async_queue_new ();
-#if GLIB_CHECK_VERSION (2, 32, 0)
-      G_thread = g_thread_new (PLUGIN"/blob-worker", worker_thread, G_queue);
-#else
-      G_thread = g_thread_create (worker_thread, G_queue, FALSE, NULL);
-#endif
+    if (! G_pool) {
+      G_pool = g_thread_pool_new (worker_func, NULL, WORKER_THREADS, FALSE,
+                                  NULL);
     }
     
-    g_async_queue_push (G_queue, job);
+    g_queue_push_tail (&G_jobs, job);
+    g_thread_pool_push (G_pool, job, NULL);
   }
 }
 
@@ -684,31 +1046,32 @@ add_utf8_bom (gchar   **buffer,
   return TRUE;
 }
 
+/* diffs @old_buf against @text, the UTF-8 contents of a document.  This
+ * can be called from any thread */
 static int
-diff_buf_to_doc (const git_buf   *old_buf,
-                 GeanyDocument   *doc,
-                 git_diff_hunk_cb hunk_cb,
-                 void            *payload)
+diff_buf_to_text (const git_buf   *old_buf,
+                  const gchar     *text,
+                  gsize            length,
+                  gboolean         has_bom,
+                  const gchar     *encoding,
+                  git_diff_hunk_cb hunk_cb,
+                  void            *payload)
 {
-  ScintillaObject  *sci = doc->editor->sci;
   git_diff_options  opts = GIT_DIFF_OPTIONS_INIT;
-  gchar            *buf;
-  size_t            len;
+  gchar            *buf = (gchar *) text;
+  size_t            len = length;
   gboolean          free_buf = FALSE;
   int               ret;
   
-  buf = (gchar *) scintilla_send_message (sci, SCI_GETCHARACTERPOINTER, 0, 0);
-  len = sci_get_length (sci);
-  
   /* add the BOM if needed */
-  if (doc->has_bom) {
+  if (has_bom) {
     /* UTF-8 BOM, converted below */
     free_buf = add_utf8_bom (&buf, &len, free_buf);
   }
   /* convert the buffer back to in-file encoding if necessary */
-  if (encoding_needs_coversion (doc->encoding)) {
+  if (encoding_needs_coversion (encoding)) {
     free_buf = convert_encoding_inplace (&buf, &len, free_buf,
-                                         doc->encoding, "UTF-8", NULL);
+                                         encoding, "UTF-8", NULL);
   }
   
   /* no context lines, and no need to bother about binary checks */
@@ -727,11 +1090,23 @@ diff_buf_to_doc (const git_buf   *old_buf,
 }
 
 static int
-diff_hunk_cb (const git_diff_delta *delta,
-              const git_diff_hunk  *hunk,
-              void                 *data)
+diff_buf_to_doc (const git_buf   *old_buf,
+                 GeanyDocument   *doc,
+                 git_diff_hunk_cb hunk_cb,
+                 void            *payload)
+{
+  ScintillaObject  *sci = doc->editor->sci;
+  
+  return diff_buf_to_text (old_buf,
+                           (const gchar *) scintilla_send_message (sci, SCI_GETCHARACTERPOINTER, 0, 0),
+                           sci_get_length (sci), doc->has_bom, doc->encoding,
+                           hunk_cb, payload);
+}
+
+static void
+add_hunk_markers (ScintillaObject *sci,
+                  const DiffHunk  *hunk)
 {
-  ScintillaObject *sci = data;
   gint line;
   
   if (hunk->new_lines > 0) {
@@ -745,10 +1120,408 @@ diff_hunk_cb (const git_diff_delta *delta,
     scintilla_send_message (sci, SCI_MARKERADD, line,
                             G_markers[MARKER_LINE_REMOVED].num);
   }
+}
+
+static int
+record_hunk_cb (const git_diff_delta *delta,
+                const git_diff_hunk  *hunk,
+                void                 *data)
+{
+  GArray   *hunks = data;
+  DiffHunk  h;
+  
+  h.old_start = hunk->old_start;
+  h.old_lines = hunk->old_lines;
+  h.new_start = hunk->new_start;
+  h.new_lines = hunk->new_lines;
+  g_array_append_val (hunks, h);
   
   return 0;
 }
 
+static void
+doc_diff_free (gpointer data)
+{
+  DocDiff *diff = data;
+  
+  cached_blob_unref (diff->blob);
+  if (diff->old_line_starts) {
+    g_array_free (diff->old_line_starts, TRUE);
+  }
+  g_array_free (diff->hunks, TRUE);
+  g_slice_free1 (sizeof *diff, diff);
+}
+
+/* records that lines starting at @line changed, @lines_added being the
+ * difference in the number of lines */
+static void
+doc_diff_mark_dirty (DocDiff *diff,
+                     gint     line,
+                     gint     lines_added)
+{
+  gint end = line + MAX (lines_added, 0) + 1;
+  
+  if (! diff->dirty) {
+    diff->dirty = TRUE;
+    diff->dirty_start = line;
+    diff->dirty_end = end;
+    diff->dirty_delta = lines_added;
+  } else {
+    /* move the end of the previous edits along with the text */
+    if (diff->dirty_end > line) {
+      diff->dirty_end += lines_added;
+    }
+    diff->dirty_start = MIN (diff->dirty_start, line);
+    diff->dirty_end = MAX (diff->dirty_end, end);
+    diff->dirty_delta += lines_added;
+  }
+}
+
+/* line start offsets of @diff's blob, with an extra one for its end */
+static GArray *
+doc_diff_get_old_line_starts (DocDiff *diff)
+{
+  if (! diff->old_line_starts) {
+    const gchar  *buf   = diff->blob->buf.ptr;
+    gsize         size  = diff->blob->buf.size;
+    gsize         i;
+    
+    diff->old_line_starts = g_array_new (FALSE, FALSE, sizeof (gsize));
+    for (i = 0; i < size; i++) {
+      if (i == 0 || buf[i - 1] == '\n') {
+        g_array_append_val (diff->old_line_starts, i);
+      }
+    }
+    g_array_append_val (diff->old_line_starts, size);
+  }
+  
+  return diff->old_line_starts;
+}
+
+/* the lines of @hunk in the new document, ([*start, *end), empty for
+ * removals) */
+static void
+hunk_get_new_range (const DiffHunk *hunk,
+                    gint           *start,
+                    gint           *end)
+{
+  *start = hunk->new_lines > 0 ? hunk->new_start - 1 : hunk->new_start;
+  *end = *start + hunk->new_lines;
+}
+
+/* re-diffs only the region around the lines edited since the last diff and
+ * updates the markers in that region.  The region is grown so that it never
+ * cuts through a hunk, so its boundaries map exactly to the old lines. */
+static gboolean
+doc_diff_update_incremental (DocDiff       *diff,
+                             GeanyDocument *doc)
+{
+  ScintillaObject  *sci         = doc->editor->sci;
+  gint              line_count  = sci_get_line_count (sci);
+  GArray           *old_starts  = doc_diff_get_old_line_starts (diff);
+  gint              old_count   = (gint) old_starts->len - 1;
+  git_diff_options  opts        = GIT_DIFF_OPTIONS_INIT;
+  GArray           *new_hunks;
+  GArray           *hunks;
+  gboolean          changed;
+  gint              start, end;
+  gint              old_start, old_end;
+  gint              offset = 0, inner_offset = 0;
+  gboolean          to_end;
+  gint              new_pos_start, new_pos_end;
+  gchar            *new_text;
+  guint             first, last, i;
+  gint              line;
+  
+  /* the window, in the lines of the previous version of the document */
+  start = MAX (0, diff->dirty_start - INCREMENTAL_CONTEXT);
+  end = MIN (line_count - diff->dirty_delta,
+             diff->dirty_end - diff->dirty_delta + INCREMENTAL_CONTEXT);
+  do {
+    changed = FALSE;
+    for (i = 0; i < diff->hunks->len; i++) {
+      gint hs, he;
+      
+      hunk_get_new_range (&g_array_index (diff->hunks, DiffHunk, i), &hs, &he);
+      if (he >= start && hs <= end) {
+        if (hs < start) {
+          start = hs;
+          changed = TRUE;
+        }
+        if (he > end) {
+          end = he;
+          changed = TRUE;
+        }
+      }
+    }
+  } while (changed);
+  
+  /* find the hunks inside the window and the matching old lines */
+  first = last = diff->hunks->len;
+  for (i = 0; i < diff->hunks->len; i++) {
+    const DiffHunk *h = &g_array_index (diff->hunks, DiffHunk, i);
+    gint            hs, he;
+    
+    hunk_get_new_range (h, &hs, &he);
+    if (he < start) {
+      offset += h->old_lines - h->new_lines;
+    } else if (hs <= end) {
+      if (first == diff->hunks->len) {
+        first = i;
+      }
+      inner_offset += h->old_lines - h->new_lines;
+    } else {
+      if (last == diff->hunks->len) {
+        last = i;
+      }
+    }
+  }
+  if (first == diff->hunks->len) {
+    first = last;
+  }
+  /* Scintilla has an extra empty line after a trailing newline, so don't
+   * try to map the last line, the window simply extends to the end */
+  to_end = end + diff->dirty_delta >= line_count;
+  old_start = start + offset;
+  old_end = to_end ? old_count : end + offset + inner_offset;
+  if (old_start < 0 || old_end > old_count || old_start > old_end) {
+    return FALSE;
+  }
+  
+  new_pos_start = sci_get_position_from_line (sci, start);
+  if (to_end) {
+    new_pos_end = sci_get_length (sci);
+  } else {
+    new_pos_end = sci_get_position_from_line (sci, end + diff->dirty_delta);
+  }
+  new_text = sci_get_contents_range (sci, new_pos_start, new_pos_end);
+  
+  opts.context_lines = 0;
+  opts.flags = GIT_DIFF_FORCE_TEXT;
+  new_hunks = g_array_new (FALSE, FALSE, sizeof (DiffHunk));
+  if (git_diff_buffers (diff->blob->buf.ptr +
+                          g_array_index (old_starts, gsize, old_start),
+                        g_array_index (old_starts, gsize, old_end) -
+                          g_array_index (old_starts, gsize, old_start),
+                        NULL, new_text, (size_t) (new_pos_end - new_pos_start),
+                        NULL, &opts, NULL, NULL, record_hunk_cb, NULL,
+                        new_hunks) != 0) {
+    g_array_free (new_hunks, TRUE);
+    g_free (new_text);
+    return FALSE;
+  }
+  g_free (new_text);
+  
+  /* rebuild the hunk list: hunks before the window are unchanged, hunks after
+   * it moved by the number of lines added */
+  hunks = g_array_sized_new (FALSE, FALSE, sizeof (DiffHunk),
+                             first + new_hunks->len + diff->hunks->len - last);
+  g_array_append_vals (hunks, diff->hunks->data, first);
+  for (i = 0; i < new_hunks->len; i++) {
+    DiffHunk *h = &g_array_index (new_hunks, DiffHunk, i);
+    
+    h->old_start += old_start;
+    h->new_start += start;
+  }
+  g_array_append_vals (hunks, new_hunks->data, new_hunks->len);
+  for (i = last; i < diff->hunks->len; i++) {
+    DiffHunk h = g_array_index (diff->hunks, DiffHunk, i);
+    
+    h.new_start += diff->dirty_delta;
+    g_array_append_val (hunks, h);
+  }
+  
+  /* only update the markers of the window.  The markers of the hunks around
+   * are at least one line away, see the window computation above */
+  for (line = MAX (start - 1, 0);
+       line < MIN (end + diff->dirty_delta, line_count); line++) {
+    for (i = 0; i < MARKER_COUNT; i++) {
+      scintilla_send_message (sci, SCI_MARKERDELETE, line, G_markers[i].num);
+    }
+  }
+  for (i = 0; i < new_hunks->len; i++) {
+    add_hunk_markers (sci, &g_array_index (new_hunks, DiffHunk, i));
+  }
+  
+  g_array_free (new_hunks, TRUE);
+  g_array_free (diff->hunks, TRUE);
+  diff->hunks = hunks;
+  diff->dirty = FALSE;
+  
+  return TRUE;
+}
+
+static GeanyDocument *
+find_document_by_id (guint id)
+{
+  guint i;
+  
+  foreach_document (i) {
+    if (documents[i]->id == id) {
+      return documents[i];
+    }
+  }
+  
+  return NULL;
+}
+
+static guint
+get_doc_version (GeanyDocument *doc)
+{
+  return GPOINTER_TO_UINT (g_object_get_qdata (G_OBJECT (doc->editor->sci),
+                                               DOC_VERSION_QTAG));
+}
+
+/* replaces all markers of @doc with the ones of @hunks (taking ownership) */
+static void
+doc_diff_apply (GeanyDocument *doc,
+                CachedBlob    *blob,
+                GArray        *hunks)
+{
+  ScintillaObject  *sci   = doc->editor->sci;
+  DocDiff          *diff  = g_slice_alloc0 (sizeof *diff);
+  guint             i;
+  
+  for (i = 0; i < MARKER_COUNT; i++) {
+    scintilla_send_message (sci, SCI_MARKERDELETEALL, G_markers[i].num, 0);
+  }
+  for (i = 0; i < hunks->len; i++) {
+    add_hunk_markers (sci, &g_array_index (hunks, DiffHunk, i));
+  }
+  
+  diff->blob = blob ? cached_blob_ref (blob) : NULL;
+  diff->hunks = hunks;
+  diff->dirty = FALSE;
+  g_hash_table_replace (G_doc_diffs, GUINT_TO_POINTER (doc->id), diff);
+}
+
+static void
+free_diff_job (gpointer data)
+{
+  AsyncDiffJob *job = data;
+  
+  g_queue_remove (&G_jobs, job);
+  if (job->hunks) {
+    g_array_free (job->hunks, TRUE);
+  }
+  cached_blob_unref (job->blob);
+  g_free (job->encoding);
+  g_free (job->text);
+  g_slice_free1 (sizeof *job, job);
+}
+
+static void start_diff_job (GeanyDocument *doc,
+                            CachedBlob    *blob);
+
+static gboolean
+report_diff_in_idle (gpointer data)
+{
+  AsyncDiffJob  *job = data;
+  GeanyDocument *doc = find_document_by_id (job->doc_id);
+  
+  if (g_hash_table_lookup (G_diff_jobs, GUINT_TO_POINTER (job->doc_id)) == job) {
+    g_hash_table_remove (G_diff_jobs, GUINT_TO_POINTER (job->doc_id));
+  }
+  
+  if (doc && g_object_get_qdata (G_OBJECT (doc->editor->sci),
+                                 RESOURCES_ALLOCATED_QTAG)) {
+    const DocBlob *doc_blob = get_doc_blob (doc);
+    
+    if (job->rerun) {
+      /* another update was requested meanwhile */
+      if (doc_blob && doc_blob->blob) {
+        start_diff_job (doc, doc_blob->blob);
+      }
+    } else if (job->hunks && job->version == get_doc_version (doc) &&
+               doc_blob && doc_blob->blob == job->blob) {
+      doc_diff_apply (doc, job->blob, job->hunks);
+      job->hunks = NULL;
+    }
+    /* otherwise the result is stale, and the modification that made it so
+     * already requested a new update */
+  }
+  
+  return FALSE;
+}
+
+static void
+diff_worker_func (gpointer data,
+                  gpointer user_data)
+{
+  AsyncDiffJob *job = data;
+  
+  job->hunks = g_array_new (FALSE, FALSE, sizeof (DiffHunk));
+  if (diff_buf_to_text (&job->blob->buf, job->text, job->length, job->has_bom,
+                        job->encoding, record_hunk_cb, job->hunks) != 0) {
+    g_array_free (job->hunks, TRUE);
+    job->hunks = NULL;
+  }
+  /* the snapshot isn't needed anymore */
+  g_free (job->text);
+  job->text = NULL;
+  
+  g_idle_add_full (G_PRIORITY_LOW, report_diff_in_idle, job, free_diff_job);
+}
+
+/* diffs @doc against @blob in a worker thread, with a copy of the document
+ * so it can be edited meanwhile */
+static void
+start_diff_job (GeanyDocument *doc,
+                CachedBlob    *blob)
+{
+  ScintillaObject  *sci = doc->editor->sci;
+  AsyncDiffJob     *job = g_hash_table_lookup (G_diff_jobs,
+                                               GUINT_TO_POINTER (doc->id));
+  
+  if (job) {
+    /* don't pile up jobs for a document, restart once the current is done */
+    job->rerun = TRUE;
+    return;
+  }
+  
+  job = g_slice_alloc0 (sizeof *job);
+  job->doc_id   = doc->id;
+  job->version  = get_doc_version (doc);
+  job->blob     = cached_blob_ref (blob);
+  job->length   = (gsize) sci_get_length (sci);
+  job->text     = g_malloc (job->length + 1);
+  memcpy (job->text,
+          (const gchar *) scintilla_send_message (sci, SCI_GETCHARACTERPOINTER, 0, 0),
+          job->length);
+  job->text[job->length] = 0;
+  job->has_bom  = doc->has_bom;
+  job->encoding = g_strdup (doc->encoding);
+  job->rerun    = FALSE;
+  job->hunks    = NULL;
+  
+  if (! G_diff_pool) {
+    G_diff_pool = g_thread_pool_new (diff_worker_func, NULL, DIFF_THREADS,
+                                     FALSE, NULL);
+  }
+  
+  g_hash_table_insert (G_diff_jobs, GUINT_TO_POINTER (doc->id), job);
+  g_queue_push_tail (&G_jobs, job);
+  g_thread_pool_push (G_diff_pool, job, NULL);
+}
+
+/* diffs the whole document and recreates all markers */
+static void
+doc_diff_update_full (GeanyDocument *doc,
+                      git_buf       *contents)
+{
+  const DocBlob *doc_blob = get_doc_blob (doc);
+  
+  if (doc_blob && doc_blob->blob && &doc_blob->blob->buf == contents) {
+    start_diff_job (doc, doc_blob->blob);
+  } else {
+    /* we were given contents not cached for the document, diff them now */
+    GArray *hunks = g_array_new (FALSE, FALSE, sizeof (DiffHunk));
+    
+    diff_buf_to_doc (contents, doc, record_hunk_cb, hunks);
+    doc_diff_apply (doc, NULL, hunks);
+  }
+}
+
 static GtkWidget *
 get_widget_for_buf_range (GeanyDocument *doc,
                           const git_buf *contents,
@@ -869,6 +1642,7 @@ on_sci_query_tooltip (GtkWidget  *widget,
   gint              max_x;
   ScintillaObject  *sci         = (ScintillaObject *) widget;
   GeanyDocument    *doc         = document_get_current ();
+  const DocBlob    *doc_blob;
   gboolean          has_tooltip = FALSE;
   
   /* for some reason the widget isn't the current one during tab switch, so
@@ -879,9 +1653,9 @@ on_sci_query_tooltip (GtkWidget  *widget,
   
   min_x = scintilla_send_message (sci, SCI_GETMARGINWIDTHN, 0, 0);
   max_x = min_x + scintilla_send_message (sci, SCI_GETMARGINWIDTHN, 1, 0);
+  doc_blob = get_doc_blob (doc);
   
-  if (x >= min_x && x <= max_x &&
-      G_blob_contents.ptr && G_blob_contents_tag == doc->id) {
+  if (x >= min_x && x <= max_x && doc_blob && doc_blob->blob) {
     gint pos  = scintilla_send_message (sci, SCI_POSITIONFROMPOINT, x, y);
     gint line = sci_get_line_from_position (sci, pos);
     gint mask = scintilla_send_message (sci, SCI_MARKERGET, line, 0);
@@ -889,9 +1663,10 @@ on_sci_query_tooltip (GtkWidget  *widget,
     if (mask & ((1 << G_markers[MARKER_LINE_CHANGED].num) |
                 (1 << G_markers[MARKER_LINE_REMOVED].num))) {
       TooltipHunkData thd = TOOLTIP_HUNK_DATA_INIT (line + 1, doc,
-                                                    &G_blob_contents, tooltip);
+                                                    &doc_blob->blob->buf,
+                                                    tooltip);
       
-      diff_buf_to_doc (&G_blob_contents, doc, tooltip_diff_hunk_cb, &thd);
+      diff_buf_to_doc (&doc_blob->blob->buf, doc, tooltip_diff_hunk_cb, &thd);
       has_tooltip = thd.found;
     }
   }
@@ -899,30 +1674,43 @@ on_sci_query_tooltip (GtkWidget  *widget,
   return has_tooltip;
 }
 
+/* updates the markers of any open document, not only the current one, so
+ * background documents can be prepared in advance */
 static void
 update_diff (const gchar *path,
              git_buf     *contents,
              gpointer     data)
 {
-  GeanyDocument *doc = document_get_current ();
+  GeanyDocument *doc = find_document_by_id (GPOINTER_TO_UINT (data));
   
-  if (doc && doc->id == GPOINTER_TO_UINT (data)) {
+  if (doc && utils_str_equal (doc->real_path, path)) {
     ScintillaObject  *sci = doc->editor->sci;
     gboolean    allocated = !! g_object_get_qdata (G_OBJECT (sci),
                                                    RESOURCES_ALLOCATED_QTAG);
+    DocDiff    *diff      = g_hash_table_lookup (G_doc_diffs,
+                                                 GUINT_TO_POINTER (doc->id));
+    
+    /* if the markers are up to date with the same blob, only update what
+     * was edited since */
+    if (contents && allocated && diff && diff->blob &&
+        &diff->blob->buf == contents &&
+        (! diff->dirty ||
+         (! doc->has_bom && ! encoding_needs_coversion (doc->encoding) &&
+          doc_diff_update_incremental (diff, doc)))) {
+      return;
+    }
     
-    if (allocated) {
+    /* the markers are kept until the new diff replaces them */
+    g_hash_table_remove (G_doc_diffs, GUINT_TO_POINTER (doc->id));
+    if (contents && (allocated || allocate_resources (sci))) {
+      doc_diff_update_full (doc, contents);
+    } else if (! contents && allocated) {
       guint i;
       
-      /* clear previous markers */
       for (i = 0; i < MARKER_COUNT; i++) {
         scintilla_send_message (sci, SCI_MARKERDELETEALL, G_markers[i].num, 0);
       }
-    }
-    
-    if (contents && (allocated || allocate_resources (sci))) {
-      diff_buf_to_doc (contents, doc, diff_hunk_cb, sci);
-    } else if (! contents && allocated) {
+      
       /* if we don't have contents, it probably means the document doesn't
        * match any object known by Git, so next attempts will fail just the
        * same.  So, drop allocated resources if any (if it used to be a valid
@@ -1000,6 +1788,20 @@ on_editor_notify (GObject        *obj,
                   SCNotification *nt,
                   gpointer        user_data)
 {
+  if (nt->nmhdr.code == SCN_MODIFIED &&
+      nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)) {
+    DocDiff *diff = g_hash_table_lookup (G_doc_diffs,
+                                         GUINT_TO_POINTER (editor->document->id));
+    
+    g_object_set_qdata (G_OBJECT (editor->sci), DOC_VERSION_QTAG,
+                        GUINT_TO_POINTER (get_doc_version (editor->document) + 1));
+    if (diff) {
+      doc_diff_mark_dirty (diff,
+                           sci_get_line_from_position (editor->sci,
+                                                       nt->position),
+                           nt->linesAdded);
+    }
+  }
   if (nt->nmhdr.code == SCN_CHARADDED ||
       (nt->nmhdr.code == SCN_MODIFIED &&
        nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT))) {
@@ -1009,39 +1811,116 @@ on_editor_notify (GObject        *obj,
   return FALSE;
 }
 
+/* computes the markers of a document in the background */
+static void
+prepare_diff (GeanyDocument *doc)
+{
+  if (doc->real_path) {
+    get_cached_blob_contents_async (doc->real_path, doc->id, FALSE, update_diff,
+                                    GUINT_TO_POINTER (doc->id));
+  }
+}
+
 static void
 on_document_activate (GObject        *obj,
                       GeanyDocument  *doc,
                       gpointer        user_data)
 {
-  clear_cached_blob_contents ();
   update_diff_push (doc, FALSE);
 }
 
+static void
+on_document_open (GObject        *obj,
+                  GeanyDocument  *doc,
+                  gpointer        user_data)
+{
+  /* documents opened at startup are handled once it is complete */
+  if (main_is_realized () && doc != document_get_current ()) {
+    prepare_diff (doc);
+  }
+}
+
+static void
+on_document_close (GObject        *obj,
+                   GeanyDocument  *doc,
+                   gpointer        user_data)
+{
+  g_hash_table_remove (G_doc_blobs, GUINT_TO_POINTER (doc->id));
+  g_hash_table_remove (G_doc_diffs, GUINT_TO_POINTER (doc->id));
+}
+
 static void
 on_startup_complete (GObject *obj,
                      gpointer user_data)
 {
-  GeanyDocument *doc = document_get_current ();
+  GeanyDocument  *doc = document_get_current ();
+  guint           i;
   
-  if (doc) {
-    update_diff_push (doc, FALSE);
+  foreach_document (i) {
+    if (documents[i] == doc) {
+      update_diff_push (doc, FALSE);
+    } else {
+      prepare_diff (documents[i]);
+    }
+  }
+}
+
+static gboolean
+doc_blob_is_in_repo (gpointer key,
+                     gpointer value,
+                     gpointer gitdir)
+{
+  const DocBlob *doc_blob = value;
+  
+  return utils_str_equal (doc_blob->gitdir, gitdir);
+}
+
+static void
+repo_changed (RepoCacheEntry *entry,
+              gboolean        reopen)
+{
+  GeanyDocument  *doc = document_get_current ();
+  guint           i;
+  
+  /* the HEAD blobs are keyed by commit so they don't need to be dropped, but
+   * documents need to look them up again */
+  G_cache_generation++;
+  g_hash_table_foreach_remove (G_doc_blobs, doc_blob_is_in_repo, entry->gitdir);
+  if (reopen) {
+    repo_cache_entry_ref (entry);
+    repo_cache_remove (entry);
+    repo_cache_entry_unref (entry);
+  }
+  
+  foreach_document (i) {
+    if (documents[i] == doc) {
+      update_diff_push (doc, FALSE);
+    } else {
+      prepare_diff (documents[i]);
+    }
   }
 }
 
 static void
-on_git_repo_changed (GFileMonitor     *monitor,
+on_git_head_changed (GFileMonitor     *monitor,
                      GFile            *file,
                      GFile            *other_file,
                      GFileMonitorEvent event_type,
-                     gpointer          force)
+                     gpointer          entry)
 {
-  GeanyDocument *doc = document_get_current ();
-  
-  if (doc) {
-    clear_cached_blob_contents ();
-    update_diff_push (doc, GPOINTER_TO_INT (force));
-  }
+  /* the branch might have changed, so reopen the repository to monitor the
+   * new reference */
+  repo_changed (entry, TRUE);
+}
+
+static void
+on_git_ref_changed (GFileMonitor     *monitor,
+                    GFile            *file,
+                    GFile            *other_file,
+                    GFileMonitorEvent event_type,
+                    gpointer          entry)
+{
+  repo_changed (entry, FALSE);
 }
 
 static int
@@ -1401,11 +2280,22 @@ plugin_init (GeanyData *data)
 {
   GeanyKeyGroup *kb_group;
   
-  buf_zero (&G_blob_contents);
-  G_blob_contents_tag = 0;
   G_source_id         = 0;
-  G_thread            = NULL;
-  G_queue             = NULL;
+  G_pool              = NULL;
+  G_cache_generation  = 0;
+  G_blob_lru_size     = 0;
+  g_queue_init (&G_blob_lru);
+  g_queue_init (&G_jobs);
+  G_repos     = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                       repo_cache_entry_unref);
+  G_dir_repos = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                       repo_cache_entry_unref);
+  G_blobs     = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                       (GDestroyNotify) cached_blob_unref);
+  G_doc_blobs = g_hash_table_new_full (NULL, NULL, NULL, doc_blob_free);
+  G_doc_diffs = g_hash_table_new_full (NULL, NULL, NULL, doc_diff_free);
+  G_diff_jobs = g_hash_table_new (NULL, NULL);
+  G_diff_pool = NULL;
   
   if (git_libgit2_init () < 0) {
     const git_error *err = giterr_last ();
@@ -1431,6 +2321,10 @@ plugin_init (GeanyData *data)
                          G_CALLBACK (on_document_activate), NULL);
   plugin_signal_connect (geany_plugin, NULL, "document-save", TRUE,
                          G_CALLBACK (on_document_activate), NULL);
+  plugin_signal_connect (geany_plugin, NULL, "document-open", TRUE,
+                         G_CALLBACK (on_document_open), NULL);
+  plugin_signal_connect (geany_plugin, NULL, "document-close", TRUE,
+                         G_CALLBACK (on_document_close), NULL);
   plugin_signal_connect (geany_plugin, NULL, "geany-startup-complete", TRUE,
                          G_CALLBACK (on_startup_complete), NULL);
   
@@ -1450,14 +2344,27 @@ plugin_cleanup (void)
     g_source_remove (G_source_id);
     G_source_id = 0;
   }
-  if (G_thread) {
-    g_async_queue_push (G_queue, QUIT_THREAD_JOB); /* notify the thread */
-    g_thread_join (G_thread);
-    G_thread = NULL;
-    g_async_queue_unref (G_queue);
-    G_queue = NULL;
+  /* wait for the running jobs and drop the results not reported yet */
+  if (G_pool) {
+    g_thread_pool_free (G_pool, FALSE, TRUE);
+    G_pool = NULL;
+  }
+  if (G_diff_pool) {
+    g_thread_pool_free (G_diff_pool, FALSE, TRUE);
+    G_diff_pool = NULL;
+  }
+  while (G_jobs.head && g_idle_remove_by_data (G_jobs.head->data)) {
+    /* nothing, removing the source frees the job */
   }
-  clear_cached_blob_contents ();
+  g_hash_table_destroy (G_diff_jobs);
+  repo_cache_clear ();
+  g_hash_table_destroy (G_doc_diffs);
+  g_hash_table_destroy (G_doc_blobs);
+  g_hash_table_destroy (G_blobs);
+  g_hash_table_destroy (G_dir_repos);
+  g_hash_table_destroy (G_repos);
+  g_queue_clear (&G_blob_lru);
+  G_diff_jobs = G_doc_diffs = G_doc_blobs = G_blobs = G_dir_repos = G_repos = NULL;
   
   foreach_document (i) {
     release_resources (documents[i]->editor->sci);
@@ -1529,6 +2436,8 @@ on_plugin_configure_response (GtkDialog        *dialog,
       foreach_document (i) {
         release_resources (documents[i]->editor->sci);
       }
+      /* reopen the repositories to apply the monitoring setting */
+      repo_cache_clear ();
       if (doc) {
         update_diff_push (doc, TRUE);
       }
@@ -41,7 +41,8 @@
   "font_point_size=12\n" \
   "code_font_point_size=12\n" \
   "bg_color=#fff\n" \
-  "fg_color=#000\n"
+  "fg_color=#000\n" \
+  "update_delay=250\n"
 
 #define MARKDOWN_HTML_TEMPLATE \
   "<html>\n" \
@@ -75,6 +76,7 @@ enum
   PROP_BG_COLOR,
   PROP_FG_COLOR,
   PROP_VIEW_POS,
+  PROP_UPDATE_DELAY,
   PROP_LAST
 };
 
@@ -98,6 +100,7 @@ struct _MarkdownConfigPrivate
     GtkWidget *bg_color_button;
     GtkWidget *fg_color_button;
     GtkWidget *tmpl_file_button;
+    GtkWidget *update_delay_spin;
   } widgets;
 };
 
@@ -177,7 +180,10 @@ markdown_config_set_property(GObject *obj, guint prop_id, const GValue *value, G
     case PROP_TEMPLATE_FILE:
       g_key_file_set_string(conf->priv->kf, "general", "template",
         g_value_get_string(value));
-      /*markdown_config_load_template_text(conf);*/
+      /* Read the new template the next time it's needed */
+      g_free(conf->priv->tmpl_text);
+      conf->priv->tmpl_text = NULL;
+      conf->priv->tmpl_text_len = 0;
       save_later = TRUE;
       break;
     case PROP_FONT_NAME:
@@ -215,6 +221,11 @@ markdown_config_set_property(GObject *obj, guint prop_id, const GValue *value, G
         (gint) g_value_get_uint(value));
       save_later = TRUE;
       break;
+    case PROP_UPDATE_DELAY:
+      g_key_file_set_integer(conf->priv->kf, "view", "update_delay",
+        (gint) g_value_get_uint(value));
+      save_later = TRUE;
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, prop_id, pspec);
       break;
@@ -334,6 +345,13 @@ markdown_config_get_property(GObject *obj, guint prop_id, GValue *value, GParamS
       g_value_set_uint(value, view_pos);
       break;
     }
+    case PROP_UPDATE_DELAY:
+    {
+      guint update_delay;
+      update_delay = markdown_config_get_uint_key(conf, "view", "update_delay", 250);
+      g_value_set_uint(value, update_delay);
+      break;
+    }
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID(obj, prop_id, pspec);
       break;
@@ -383,6 +401,9 @@ markdown_config_class_init(MarkdownConfigClass *klass)
     "Notebook where the view will be positioned", 0,
     MARKDOWN_CONFIG_VIEW_POS_MAX-1, (guint) MARKDOWN_CONFIG_VIEW_POS_SIDEBAR,
     G_PARAM_READWRITE);
+  md_props[PROP_UPDATE_DELAY] = g_param_spec_uint("update-delay", "UpdateDelay",
+    "Milliseconds to wait after the last edit before updating the preview",
+    0, 5000, 250, G_PARAM_READWRITE);
 
   markdown_install_class_properties(g_object_class, PROP_LAST, md_props);
 }
@@ -503,7 +524,7 @@ on_dialog_response(MarkdownConfig *conf, gint response_id, GtkDialog *dialog)
     gboolean pos_sidebar = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(wid));
     gchar *bg_color, *fg_color;
     gchar *tmpl_file = NULL, *fnt = NULL, *code_fnt = NULL;
-    guint fnt_size = 0, code_fnt_size = 0;
+    guint fnt_size = 0, code_fnt_size = 0, update_delay;
     const gchar *font_desc;
     MarkdownConfigViewPos view_pos;
 
@@ -520,6 +541,9 @@ on_dialog_response(MarkdownConfig *conf, gint response_id, GtkDialog *dialog)
 
     tmpl_file = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(conf->priv->widgets.tmpl_file_button));
 
+    update_delay = (guint) gtk_spin_button_get_value_as_int(
+      GTK_SPIN_BUTTON(conf->priv->widgets.update_delay_spin));
+
     g_object_set(conf,
                  "font-name", fnt,
                  "font-point-size", fnt_size,
@@ -529,6 +553,7 @@ on_dialog_response(MarkdownConfig *conf, gint response_id, GtkDialog *dialog)
                  "bg-color", bg_color,
                  "fg-color", fg_color,
                  "template-file", tmpl_file,
+                 "update-delay", update_delay,
                  NULL);
 
     g_free(fnt);
@@ -544,7 +569,7 @@ GtkWidget *markdown_config_gui(MarkdownConfig *conf, GtkDialog *dialog)
   GSList *grp = NULL;
   GtkWidget *table, *label, *hbox, *wid;
   gchar *tmpl_file=NULL, *fnt=NULL, *code_fnt=NULL, *bg=NULL, *fg=NULL;
-  guint view_pos=0, fnt_sz=0, code_fnt_sz=0;
+  guint view_pos=0, fnt_sz=0, code_fnt_sz=0, update_delay=0;
 
   g_object_get(conf,
                "view-pos", &view_pos,
@@ -555,9 +580,10 @@ GtkWidget *markdown_config_gui(MarkdownConfig *conf, GtkDialog *dialog)
                "bg-color", &bg,
                "fg-color", &fg,
                "template-file", &tmpl_file,
+               "update-delay", &update_delay,
                NULL);
 
-  table = markdown_gtk_table_new(6, 2, FALSE);
+  table = markdown_gtk_table_new(7, 2, FALSE);
   markdown_gtk_table_set_col_spacing(MARKDOWN_GTK_TABLE(table), 6);
   markdown_gtk_table_set_row_spacing(MARKDOWN_GTK_TABLE(table), 6);
 
@@ -672,6 +698,17 @@ GtkWidget *markdown_config_gui(MarkdownConfig *conf, GtkDialog *dialog)
     g_free(tmpl_file);
   }
 
+  { /* UPDATE DELAY */
+    label = gtk_label_new(_("Update Delay (ms):"));
+    gtk_misc_set_alignment(GTK_MISC(label), 0.0, 0.5);
+    markdown_gtk_table_attach(MARKDOWN_GTK_TABLE(table), label, 0, 1, 6, 7, GTK_FILL, GTK_FILL);
+
+    wid = gtk_spin_button_new_with_range(0, 5000, 50);
+    conf->priv->widgets.update_delay_spin = wid;
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(wid), update_delay);
+    markdown_gtk_table_attach(MARKDOWN_GTK_TABLE(table), wid, 1, 2, 6, 7, GTK_FILL | GTK_EXPAND, GTK_FILL);
+  }
+
   conf->priv->dlg_handle = g_signal_connect_swapped(dialog, "response",
     G_CALLBACK(on_dialog_response), conf);
 
@@ -710,3 +747,11 @@ void markdown_config_set_view_pos(MarkdownConfig *conf, MarkdownConfigViewPos vi
   g_return_if_fail(MARKDOWN_IS_CONFIG(conf));
   g_object_set(conf, "view-pos", view_pos, NULL);
 }
+
+guint markdown_config_get_update_delay(MarkdownConfig *conf)
+{
+  guint update_delay;
+  g_return_val_if_fail(MARKDOWN_IS_CONFIG(conf), 0);
+  g_object_get(conf, "update-delay", &update_delay, NULL);
+  return update_delay;
+}
@@ -68,6 +68,7 @@ gchar *markdown_config_get_dirname(MarkdownConfig *conf);
 /* Property accessors */
 MarkdownConfigViewPos markdown_config_get_view_pos(MarkdownConfig *conf);
 void markdown_config_set_view_pos(MarkdownConfig *conf, MarkdownConfigViewPos view_pos);
+guint markdown_config_get_update_delay(MarkdownConfig *conf);
 
 G_END_DECLS
 
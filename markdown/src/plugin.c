@@ -49,6 +49,7 @@ PLUGIN_SET_TRANSLATABLE_INFO(LOCALEDIR, GETTEXT_PACKAGE,
 static MarkdownViewer *g_viewer = NULL;
 static GtkWidget *g_scrolled_win = NULL;
 static GtkWidget *g_export_html = NULL;
+static guint g_update_handle = 0;
 
 /* Forward declarations */
 static void update_markdown_viewer(MarkdownViewer *viewer);
@@ -126,6 +127,10 @@ void plugin_init(GeanyData *data)
 /* Cleanup resources on plugin unload. */
 void plugin_cleanup(void)
 {
+  if (g_update_handle != 0) {
+    g_source_remove(g_update_handle);
+    g_update_handle = 0;
+  }
   gtk_widget_destroy(g_export_html);
   gtk_widget_destroy(g_scrolled_win);
 }
@@ -155,11 +160,12 @@ void plugin_help(void)
 }
 
 /* All of the various signal handlers call this function to update the
- * MarkdownViewer on specific events. This causes a bunch of memory
- * allocations, re-compiles the Markdown to HTML, reformats the HTML
- * template, copies the HTML into the webview and causes it to (eventually)
- * be redrawn. Only call it when really needed, like when the scintilla
- * editor's text contents change and not on other editor events.
+ * MarkdownViewer on specific events. This copies the whole document into
+ * the viewer which then has it re-compiled to HTML on a background thread
+ * and (eventually) loaded into the webview. Only call it when really
+ * needed, like when the scintilla editor's text contents change and not on
+ * other editor events, and prefer queue_update_markdown_viewer() for
+ * changes that come in quick succession.
  */
 static void
 update_markdown_viewer(MarkdownViewer *viewer)
@@ -180,6 +186,30 @@ update_markdown_viewer(MarkdownViewer *viewer)
   markdown_viewer_queue_update(viewer);
 }
 
+static gboolean on_update_timeout(MarkdownViewer *viewer)
+{
+  g_update_handle = 0;
+  update_markdown_viewer(viewer);
+  return FALSE;
+}
+
+/* Updates the viewer once no change happened for the configured delay, so
+ * the document isn't copied and re-rendered on each keystroke. */
+static void queue_update_markdown_viewer(MarkdownViewer *viewer)
+{
+  MarkdownConfig *conf = NULL;
+
+  if (g_update_handle != 0) {
+    g_source_remove(g_update_handle);
+  }
+
+  g_object_get(viewer, "config", &conf, NULL);
+  g_update_handle = plugin_timeout_add(geany_plugin,
+    markdown_config_get_update_delay(conf),
+    (GSourceFunc) on_update_timeout, viewer);
+  g_object_unref(conf);
+}
+
 /* Return TRUE if event is a buffer modification that inserts or deletes
  * text and which caused a text changed length greater than 0. */
 #define IS_MOD_NOTIF(nt) (nt->nmhdr.code == SCN_MODIFIED && \
@@ -192,7 +222,7 @@ static gboolean on_editor_notify(GObject *obj, GeanyEditor *editor,
   SCNotification *notif, MarkdownViewer *viewer)
 {
   if (IS_MOD_NOTIF(notif)) {
-    update_markdown_viewer(viewer);
+    queue_update_markdown_viewer(viewer);
   }
   return FALSE; /* Allow others to handle this event too */
 }
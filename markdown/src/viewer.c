@@ -34,6 +34,58 @@
 
 #define MD_ENC_MAX 256
 
+/* The HTML template compiled from the configuration. The HTML for the
+ * Markdown text goes between each of its literal segments. It is never
+ * modified once compiled, so the render thread can share it. */
+typedef struct
+{
+  volatile gint ref_count;
+  gchar *literals;      /* The text of all segments, one after another */
+  gsize literals_len;
+  gsize *segment_lens;  /* The length of each segment */
+  guint n_segments;
+} MarkdownTemplate;
+
+/* A request to render some Markdown text to HTML on the render thread. */
+typedef struct
+{
+  gchar *text;
+  gsize len;
+  MarkdownTemplate *tmpl;
+  gchar *base_uri;
+  gchar *enc;
+  gboolean reload;   /* Whether to also build the whole page */
+  /* The results, filled in by the render thread */
+  GPtrArray *blocks; /* HTML of each top-level block */
+  gchar *html;       /* The whole page, if reload is set */
+} MarkdownRenderJob;
+
+/* A top-level block of the Markdown text */
+typedef struct
+{
+  gsize start;
+  gsize len;
+} MarkdownBlock;
+
+/* Defined in the preview page, used to replace the HTML of the blocks that
+ * changed without reloading the whole page. */
+#define MARKDOWN_PATCH_SCRIPT \
+  "<script type=\"text/javascript\">\n" \
+  "function geanyMarkdownPatch(start, count, blocks) {\n" \
+  "  var root = document.getElementById('geany-markdown');\n" \
+  "  var i, node, next;\n" \
+  "  for (i = 0; i < count; i++)\n" \
+  "    root.removeChild(root.children[start]);\n" \
+  "  next = root.children[start] || null;\n" \
+  "  for (i = 0; i < blocks.length; i++) {\n" \
+  "    node = document.createElement('div');\n" \
+  "    node.className = 'geany-markdown-block';\n" \
+  "    node.innerHTML = blocks[i];\n" \
+  "    root.insertBefore(node, next);\n" \
+  "  }\n" \
+  "}\n" \
+  "</script>\n"
+
 enum
 {
   PROP_0,
@@ -49,13 +101,39 @@ struct _MarkdownViewerPrivate
   gulong load_handle;
   guint update_handle;
   gulong prop_handle;
+  MarkdownTemplate *tmpl;
   GString *text;
   gchar enc[MD_ENC_MAX];
   gdouble vscroll_pos;
   gdouble hscroll_pos;
+  GThreadPool *render_pool;
+  /* The following members are shared with the render thread and must
+   * only be accessed while holding the render_state lock. */
+  MarkdownRenderJob *pending_job;
+  MarkdownRenderJob *done_job;
+  guint done_handle;
+  /* Only used by the render thread */
+  GHashTable *block_cache;
+  gchar *block_links;
+  /* What the page currently loaded in the webview was made with */
+  gboolean page_loading;
+  gboolean page_ready;
+  MarkdownTemplate *page_tmpl;
+  gchar *page_base_uri;
+  gchar *page_enc;
+  GPtrArray *page_blocks;
 };
 
+/* Neither Discount nor peg-markdown are reentrant */
+G_LOCK_DEFINE_STATIC(markdown_lib);
+G_LOCK_DEFINE_STATIC(render_state);
+
 static void markdown_viewer_finalize (GObject *object);
+static void render_worker(gpointer data, gpointer user_data);
+static void render_job_free(MarkdownRenderJob *job);
+static MarkdownTemplate *markdown_template_new(MarkdownConfig *conf);
+static gboolean markdown_template_equal(const MarkdownTemplate *a, const MarkdownTemplate *b);
+static void markdown_template_unref(MarkdownTemplate *tmpl);
 
 static GParamSpec *viewer_props[N_PROPERTIES] = { NULL };
 
@@ -151,6 +229,25 @@ markdown_viewer_finalize(GObject *object)
   MarkdownViewer *self;
   g_return_if_fail(MARKDOWN_IS_VIEWER(object));
   self = MARKDOWN_VIEWER(object);
+  if (self->priv->update_handle != 0) {
+    g_source_remove(self->priv->update_handle);
+  }
+  /* Drop the queued requests and wait for the one in progress, if any */
+  g_thread_pool_free(self->priv->render_pool, TRUE, TRUE);
+  if (self->priv->done_handle != 0) {
+    g_source_remove(self->priv->done_handle);
+  }
+  render_job_free(self->priv->pending_job);
+  render_job_free(self->priv->done_job);
+  g_hash_table_destroy(self->priv->block_cache);
+  g_free(self->priv->block_links);
+  markdown_template_unref(self->priv->tmpl);
+  markdown_template_unref(self->priv->page_tmpl);
+  g_free(self->priv->page_base_uri);
+  g_free(self->priv->page_enc);
+  if (self->priv->page_blocks) {
+    g_ptr_array_free(self->priv->page_blocks, TRUE);
+  }
   if (self->priv->conf) {
     g_signal_handler_disconnect(self->priv->conf, self->priv->prop_handle);
     g_object_unref(self->priv->conf);
@@ -165,9 +262,38 @@ static void
 markdown_viewer_init(MarkdownViewer *self)
 {
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE(self, MARKDOWN_TYPE_VIEWER, MarkdownViewerPrivate);
+  /* A single thread, so requests are rendered in the order they were made */
+  self->priv->render_pool = g_thread_pool_new(render_worker, NULL, 1, FALSE, NULL);
+  self->priv->block_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 }
 
 
+static void
+on_config_notify(MarkdownConfig *conf, GParamSpec *pspec, MarkdownViewer *self)
+{
+  MarkdownTemplate *tmpl = markdown_template_new(conf);
+
+  /* Keep the current template if the change didn't affect it, so that
+   * the page doesn't need to be reloaded. */
+  if (self->priv->tmpl && markdown_template_equal(tmpl, self->priv->tmpl)) {
+    markdown_template_unref(tmpl);
+  } else {
+    markdown_template_unref(self->priv->tmpl);
+    self->priv->tmpl = tmpl;
+  }
+
+  markdown_viewer_queue_update(self);
+}
+
+static MarkdownTemplate *
+markdown_viewer_get_template(MarkdownViewer *self)
+{
+  if (!self->priv->tmpl) {
+    self->priv->tmpl = markdown_template_new(self->priv->conf);
+  }
+  return self->priv->tmpl;
+}
+
 GtkWidget *
 markdown_viewer_new(MarkdownConfig *conf)
 {
@@ -176,43 +302,64 @@ markdown_viewer_new(MarkdownConfig *conf)
   self = g_object_new(MARKDOWN_TYPE_VIEWER, "config", conf, NULL);
 
   /* Cause the view to be updated whenever the config changes. */
-  self->priv->prop_handle = g_signal_connect_swapped(self->priv->conf, "notify",
-      G_CALLBACK(markdown_viewer_queue_update), self);
+  self->priv->prop_handle = g_signal_connect(self->priv->conf, "notify",
+      G_CALLBACK(on_config_notify), self);
 
   return GTK_WIDGET(self);
 }
 
-static void
-replace_all(MarkdownViewer *self,
-            GString *haystack,
-            const gchar *needle,
-            const gchar *replacement)
+static MarkdownTemplate *
+markdown_template_ref(MarkdownTemplate *tmpl)
 {
-  gchar *ptr;
-  gsize needle_len = strlen(needle);
+  g_atomic_int_inc(&tmpl->ref_count);
+  return tmpl;
+}
 
-  /* For each occurrence of needle in haystack */
-  while ((ptr = strstr(haystack->str, needle)) != NULL) {
-    goffset offset = ptr - haystack->str;
-    g_string_erase(haystack, offset, needle_len);
-    g_string_insert(haystack, offset, replacement);
+static void
+markdown_template_unref(MarkdownTemplate *tmpl)
+{
+  if (tmpl && g_atomic_int_dec_and_test(&tmpl->ref_count)) {
+    g_free(tmpl->literals);
+    g_free(tmpl->segment_lens);
+    g_slice_free(MarkdownTemplate, tmpl);
   }
 }
 
-static gchar *
-template_replace(MarkdownViewer *self, const gchar *html_text)
+static void
+template_add_segment(GArray *segment_lens, GString *literals, gsize *segment_start)
 {
-  MarkdownConfigViewPos view_pos;
+  gsize len = literals->len - *segment_start;
+
+  g_array_append_val(segment_lens, len);
+  *segment_start = literals->len;
+}
+
+/* Compiles the configured template: all substitution strings but
+ * @@markdown@@ are replaced with their values right away, and the result is
+ * split around the @@markdown@@ ones. Must be called from the main thread. */
+static MarkdownTemplate *
+markdown_template_new(MarkdownConfig *conf)
+{
+  enum { VAR_MARKDOWN, VAR_FONT_NAME, VAR_CODE_FONT_NAME, VAR_FONT_POINT_SIZE,
+    VAR_CODE_FONT_POINT_SIZE, VAR_BG_COLOR, VAR_FG_COLOR, N_VARS };
+  static const gchar *var_names[N_VARS] = {
+    "markdown", "font_name", "code_font_name", "font_point_size",
+    "code_font_point_size", "bg_color", "fg_color"
+  };
+  const gchar *var_values[N_VARS] = { NULL };
   guint font_point_size = 0, code_font_point_size = 0;
   gchar *font_name = NULL, *code_font_name = NULL;
   gchar *bg_color = NULL, *fg_color = NULL;
   gchar font_pt_size[10] = { 0 };
   gchar code_font_pt_size[10] = { 0 };
-  GString *tmpl;
+  MarkdownTemplate *tmpl;
+  GString *literals;
+  GArray *segment_lens;
+  gsize segment_start = 0;
+  const gchar *p, *start;
 
   { /* Read all the configuration settings into strings */
-    g_object_get(self->priv->conf,
-                 "view-pos", &view_pos,
+    g_object_get(conf,
                  "font-name", &font_name,
                  "code-font-name", &code_font_name,
                  "font-point-size", &font_point_size,
@@ -222,25 +369,484 @@ template_replace(MarkdownViewer *self, const gchar *html_text)
                  NULL);
     g_snprintf(font_pt_size, 10, "%d", font_point_size);
     g_snprintf(code_font_pt_size, 10, "%d", code_font_point_size);
+    var_values[VAR_FONT_NAME] = font_name;
+    var_values[VAR_CODE_FONT_NAME] = code_font_name;
+    var_values[VAR_FONT_POINT_SIZE] = font_pt_size;
+    var_values[VAR_CODE_FONT_POINT_SIZE] = code_font_pt_size;
+    var_values[VAR_BG_COLOR] = bg_color;
+    var_values[VAR_FG_COLOR] = fg_color;
+  }
+
+  literals = g_string_new(NULL);
+  segment_lens = g_array_new(FALSE, FALSE, sizeof(gsize));
+
+  p = markdown_config_get_template_text(conf);
+  if (!p) {
+    p = "";
   }
 
-  /* Load the template into a GString to be modified in place */
-  tmpl = g_string_new(markdown_config_get_template_text(self->priv->conf));
+  while ((start = strstr(p, "@@")) != NULL) {
+    const gchar *name = start + 2;
+    const gchar *name_end = strstr(name, "@@");
+    guint i = N_VARS;
 
-  replace_all(self, tmpl, "@@font_name@@", font_name);
-  replace_all(self, tmpl, "@@code_font_name@@", code_font_name);
-  replace_all(self, tmpl, "@@font_point_size@@", font_pt_size);
-  replace_all(self, tmpl, "@@code_font_point_size@@", code_font_pt_size);
-  replace_all(self, tmpl, "@@bg_color@@", bg_color);
-  replace_all(self, tmpl, "@@fg_color@@", fg_color);
-  replace_all(self, tmpl, "@@markdown@@", html_text);
+    if (name_end) {
+      for (i = 0; i < N_VARS; i++) {
+        if (strlen(var_names[i]) == (gsize) (name_end - name) &&
+            strncmp(var_names[i], name, name_end - name) == 0) {
+          break;
+        }
+      }
+    }
+
+    g_string_append_len(literals, p, start - p);
+    if (i == N_VARS) {
+      /* Not a substitution string, keep the "@@" and look further */
+      g_string_append_len(literals, start, 2);
+      p = start + 2;
+      continue;
+    }
+
+    if (i == VAR_MARKDOWN) {
+      template_add_segment(segment_lens, literals, &segment_start);
+    } else if (var_values[i]) {
+      g_string_append(literals, var_values[i]);
+    }
+    p = name_end + 2;
+  }
+  g_string_append(literals, p);
+  template_add_segment(segment_lens, literals, &segment_start);
 
   g_free(font_name);
   g_free(code_font_name);
   g_free(bg_color);
   g_free(fg_color);
 
-  return g_string_free(tmpl, FALSE);
+  tmpl = g_slice_new(MarkdownTemplate);
+  tmpl->ref_count = 1;
+  tmpl->literals_len = literals->len;
+  tmpl->literals = g_string_free(literals, FALSE);
+  tmpl->n_segments = segment_lens->len;
+  tmpl->segment_lens = (gsize *) g_array_free(segment_lens, FALSE);
+
+  return tmpl;
+}
+
+static gboolean
+markdown_template_equal(const MarkdownTemplate *a, const MarkdownTemplate *b)
+{
+  return a->literals_len == b->literals_len &&
+         a->n_segments == b->n_segments &&
+         memcmp(a->segment_lens, b->segment_lens, a->n_segments * sizeof(gsize)) == 0 &&
+         memcmp(a->literals, b->literals, a->literals_len) == 0;
+}
+
+/* Fills in the template with the given HTML. Safe to call from any thread. */
+static gchar *
+markdown_template_render(const MarkdownTemplate *tmpl, const gchar *html_text, gsize len)
+{
+  const gchar *literal = tmpl->literals;
+  gchar *html, *out;
+  guint i;
+
+  out = html = g_malloc(tmpl->literals_len + (tmpl->n_segments - 1) * len + 1);
+  for (i = 0; i < tmpl->n_segments; i++) {
+    if (i > 0) {
+      memcpy(out, html_text, len);
+      out += len;
+    }
+    memcpy(out, literal, tmpl->segment_lens[i]);
+    out += tmpl->segment_lens[i];
+    literal += tmpl->segment_lens[i];
+  }
+  *out = '\0';
+
+  return html;
+}
+
+/* Compiles the Markdown text to HTML. Safe to call from any thread. */
+static gchar *
+markdown_to_html(gchar *text, gsize len)
+{
+  gchar *html = NULL;
+
+  G_LOCK(markdown_lib);
+  {
+#ifndef FULL_PRICE  /* this version using Discount markdown library
+                     * is faster but may invoke endless discussions
+                     * about the GPL and licenses similar to (but the
+                     * same as) the old BSD 4-clause license being
+                     * incompatible */
+    MMIOT *doc;
+    gchar *md_as_html;
+    doc = mkd_string(text, len, 0);
+    mkd_compile(doc, 0);
+    if (mkd_document(doc, &md_as_html) != EOF) {
+      html = g_strdup(md_as_html);
+    }
+    mkd_cleanup(doc);
+#else /* this version is slower but is unquestionably GPL-friendly
+       * and the lib also has much more readable/maintainable code */
+
+    /* TODO: become 100% convinced this wasn't malloc()'d outside of GLIB
+     * functions with libc allocator (probably same anyway). */
+    html = markdown_to_string(text, 0, HTML_FORMAT);
+#endif
+  }
+  G_UNLOCK(markdown_lib);
+
+  return html;
+}
+
+static gchar *
+render_html(gchar *text, gsize len, const MarkdownTemplate *tmpl)
+{
+  gchar *md_as_html, *html = NULL;
+
+  md_as_html = markdown_to_html(text, len);
+  if (md_as_html) {
+    html = markdown_template_render(tmpl, md_as_html, strlen(md_as_html));
+    g_free(md_as_html);
+  }
+
+  return html;
+}
+
+/* The Markdown text is split into top-level blocks at blank lines so that
+ * only the blocks that changed need to be compiled again and patched into
+ * the page. The splitting errs on the side of keeping lines together, since
+ * compiling a block in pieces could change its output: fenced code,
+ * indented lines and list items following a list always stay in the block
+ * they follow, and block-level HTML stays in one block from its opening tag
+ * to the matching closing tag (or to the end of the text if it isn't closed). */
+
+static const gchar *
+line_next(const gchar *p, const gchar *end)
+{
+  const gchar *nl = memchr(p, '\n', end - p);
+  return nl ? nl + 1 : end;
+}
+
+static const gchar *
+line_skip_indent(const gchar *p, const gchar *end)
+{
+  gint i;
+  for (i = 0; i < 3 && p < end && *p == ' '; i++, p++);
+  return p;
+}
+
+static gboolean
+line_is_blank(const gchar *p, const gchar *end)
+{
+  for (; p < end && *p != '\n'; p++) {
+    if (*p != ' ' && *p != '\t' && *p != '\r') {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static gboolean
+line_is_fence(const gchar *p, const gchar *end)
+{
+  p = line_skip_indent(p, end);
+  return end - p >= 3 && (strncmp(p, "```", 3) == 0 || strncmp(p, "~~~", 3) == 0);
+}
+
+static gboolean
+line_is_list_item(const gchar *p, const gchar *end)
+{
+  p = line_skip_indent(p, end);
+  if (p < end && (*p == '-' || *p == '*' || *p == '+')) {
+    p++;
+  } else {
+    const gchar *digits = p;
+    while (p < end && g_ascii_isdigit(*p)) {
+      p++;
+    }
+    if (p == digits || p >= end || *p != '.') {
+      return FALSE;
+    }
+    p++;
+  }
+  return p < end && (*p == ' ' || *p == '\t');
+}
+
+/* A "[id]: url" link definition, which can be referenced from any block */
+static gboolean
+line_is_link_definition(const gchar *p, const gchar *end)
+{
+  p = line_skip_indent(p, end);
+  if (p >= end || *p != '[') {
+    return FALSE;
+  }
+  for (p++; p < end && *p != '\n' && *p != ']'; p++);
+  return end - p >= 2 && p[0] == ']' && p[1] == ':';
+}
+
+static const gchar *const html_block_tags[] = {
+  "address", "article", "aside", "blockquote", "center", "del", "details",
+  "div", "dl", "fieldset", "figure", "footer", "form", "h1", "h2", "h3", "h4",
+  "h5", "h6", "header", "iframe", "ins", "map", "math", "nav", "noscript",
+  "ol", "p", "pre", "script", "section", "style", "table", "ul", "video"
+};
+
+/* Returns whether the text at p is the tag name followed by the end of the
+ * name */
+static gboolean
+html_tag_name_is(const gchar *p, const gchar *end, const gchar *tag)
+{
+  gsize tag_len = strlen(tag);
+
+  if ((gsize) (end - p) < tag_len || g_ascii_strncasecmp(p, tag, tag_len) != 0) {
+    return FALSE;
+  }
+  p += tag_len;
+  return p == end || *p == '>' || *p == '/' || g_ascii_isspace(*p);
+}
+
+/* The block-level HTML element opened at the start of the line, or NULL */
+static const gchar *
+line_html_block_tag(const gchar *p, const gchar *end)
+{
+  guint i;
+
+  if (p >= end || *p != '<') {
+    return NULL;
+  }
+  for (i = 0; i < G_N_ELEMENTS(html_block_tags); i++) {
+    if (html_tag_name_is(p + 1, end, html_block_tags[i])) {
+      return html_block_tags[i];
+    }
+  }
+  return NULL;
+}
+
+/* The number of elements of the tag opened minus the number closed in the
+ * line */
+static gint
+line_html_tag_depth(const gchar *p, const gchar *end, const gchar *tag)
+{
+  gint depth = 0;
+
+  for (; p < end && *p != '\n'; p++) {
+    if (*p != '<') {
+      continue;
+    }
+    if (p + 1 < end && p[1] == '/') {
+      if (html_tag_name_is(p + 2, end, tag)) {
+        depth--;
+      }
+    } else if (html_tag_name_is(p + 1, end, tag)) {
+      depth++;
+    }
+  }
+  return depth;
+}
+
+/* Returns whether the line contains str */
+static gboolean
+line_contains(const gchar *p, const gchar *end, const gchar *str)
+{
+  gsize str_len = strlen(str);
+
+  for (; p + str_len <= end && *p != '\n'; p++) {
+    if (strncmp(p, str, str_len) == 0) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+static void
+add_block(GArray *blocks, gsize start, gsize len)
+{
+  MarkdownBlock block;
+
+  block.start = start;
+  block.len = len;
+  g_array_append_val(blocks, block);
+}
+
+/* Fills blocks with the ranges of the top-level blocks of the text and
+ * appends all its link definitions to links. */
+static void
+split_blocks(const gchar *text, gsize len, GArray *blocks, GString *links)
+{
+  const gchar *end = text + len;
+  const gchar *p, *next, *block_start = text;
+  const gchar *html_tag = NULL; /* the HTML element the lines are in */
+  gint html_depth = 0;
+  gboolean block_empty = TRUE, block_is_list = FALSE;
+  gboolean in_fence = FALSE, in_html_comment = FALSE, after_blank = FALSE;
+
+  for (p = text; p < end; p = next) {
+    gboolean is_list;
+    const gchar *tag;
+
+    next = line_next(p, end);
+    if (in_fence) {
+      in_fence = !line_is_fence(p, end);
+      continue;
+    }
+    if (html_tag) {
+      html_depth += line_html_tag_depth(p, end, html_tag);
+      if (html_depth <= 0) {
+        html_tag = NULL;
+      }
+      continue;
+    }
+    if (in_html_comment) {
+      in_html_comment = !line_contains(p, end, "-->");
+      continue;
+    }
+    if (line_is_blank(p, end)) {
+      after_blank = TRUE;
+      continue;
+    }
+
+    is_list = line_is_list_item(p, end);
+    if (block_empty) {
+      block_empty = FALSE;
+      block_is_list = is_list;
+    } else if (after_blank && *p != ' ' && *p != '\t' &&
+               !(is_list && block_is_list)) {
+      add_block(blocks, block_start - text, p - block_start);
+      block_start = p;
+      block_is_list = is_list;
+    }
+    after_blank = FALSE;
+
+    if (line_is_fence(p, end)) {
+      in_fence = TRUE;
+    } else if ((tag = line_html_block_tag(p, end)) != NULL) {
+      html_depth = line_html_tag_depth(p, end, tag);
+      if (html_depth > 0) {
+        html_tag = tag;
+      }
+    } else if (end - p >= 4 && strncmp(p, "<!--", 4) == 0) {
+      in_html_comment = !line_contains(p + 4, end, "-->");
+    } else if (line_is_link_definition(p, end)) {
+      g_string_append_len(links, p, next - p);
+      if (next == end) {
+        g_string_append_c(links, '\n');
+      }
+    }
+  }
+
+  if (block_start < end) {
+    add_block(blocks, block_start - text, end - block_start);
+  }
+}
+
+/* Compiles each top-level block of the text to HTML, re-using the HTML of
+ * the blocks that were already compiled for the previous text. Must only
+ * be called from the render thread. */
+static GPtrArray *
+render_blocks(MarkdownViewer *self, const gchar *text, gsize len)
+{
+  GArray *blocks = g_array_new(FALSE, FALSE, sizeof(MarkdownBlock));
+  GString *links = g_string_new(NULL);
+  GHashTable *cache;
+  GPtrArray *fragments;
+  guint i;
+
+  split_blocks(text, len, blocks, links);
+
+  /* The link definitions are appended to every block so that references
+   * work across blocks, so when they change nothing can be re-used. */
+  if (g_strcmp0(links->str, self->priv->block_links) != 0) {
+    g_hash_table_remove_all(self->priv->block_cache);
+    g_free(self->priv->block_links);
+    self->priv->block_links = g_string_free(links, FALSE);
+  } else {
+    g_string_free(links, TRUE);
+  }
+
+  /* Only the blocks of this text are kept for next time */
+  cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  fragments = g_ptr_array_new_with_free_func(g_free);
+
+  for (i = 0; i < blocks->len; i++) {
+    MarkdownBlock *block = &g_array_index(blocks, MarkdownBlock, i);
+    gchar *source = g_strndup(text + block->start, block->len);
+    gpointer key, html;
+
+    if ((html = g_hash_table_lookup(cache, source)) != NULL) {
+      g_free(source);
+    } else {
+      if (g_hash_table_lookup_extended(self->priv->block_cache, source, &key, &html)) {
+        g_hash_table_steal(self->priv->block_cache, source);
+        g_free(key);
+      } else {
+        gchar *block_text = g_strconcat(source, "\n\n", self->priv->block_links, NULL);
+        html = markdown_to_html(block_text, strlen(block_text));
+        g_free(block_text);
+        if (!html) {
+          html = g_strdup("");
+        }
+      }
+      g_hash_table_insert(cache, source, html);
+    }
+    g_ptr_array_add(fragments, g_strdup(html));
+  }
+
+  g_hash_table_destroy(self->priv->block_cache);
+  self->priv->block_cache = cache;
+  g_array_free(blocks, TRUE);
+
+  return fragments;
+}
+
+/* Builds the whole preview page from the HTML of the blocks, each wrapped
+ * so that it can later be replaced by geanyMarkdownPatch(). */
+static gchar *
+render_page(const MarkdownTemplate *tmpl, GPtrArray *fragments)
+{
+  static const gchar root_start[] = "<div id=\"geany-markdown\">\n";
+  static const gchar root_end[] = "</div>\n" MARKDOWN_PATCH_SCRIPT;
+  static const gchar block_start[] = "<div class=\"geany-markdown-block\">";
+  static const gchar block_end[] = "</div>\n";
+  GString *body;
+  gchar *html;
+  gsize size;
+  guint i;
+
+  size = sizeof root_start - 1 + sizeof root_end - 1 +
+    fragments->len * (sizeof block_start - 1 + sizeof block_end - 1);
+  for (i = 0; i < fragments->len; i++) {
+    size += strlen(g_ptr_array_index(fragments, i));
+  }
+
+  body = g_string_sized_new(size);
+  g_string_append_len(body, root_start, sizeof root_start - 1);
+  for (i = 0; i < fragments->len; i++) {
+    g_string_append_len(body, block_start, sizeof block_start - 1);
+    g_string_append(body, g_ptr_array_index(fragments, i));
+    g_string_append_len(body, block_end, sizeof block_end - 1);
+  }
+  g_string_append_len(body, root_end, sizeof root_end - 1);
+
+  html = markdown_template_render(tmpl, body->str, body->len);
+  g_string_free(body, TRUE);
+
+  return html;
+}
+
+static void
+render_job_free(MarkdownRenderJob *job)
+{
+  if (job) {
+    g_free(job->text);
+    markdown_template_unref(job->tmpl);
+    g_free(job->base_uri);
+    g_free(job->enc);
+    if (job->blocks) {
+      g_ptr_array_free(job->blocks, TRUE);
+    }
+    g_free(job->html);
+    g_slice_free(MarkdownRenderJob, job);
+  }
 }
 
 static gboolean
@@ -253,47 +859,26 @@ push_scroll_pos(MarkdownViewer *self)
   if (GTK_IS_SCROLLED_WINDOW(parent)) {
     GtkAdjustment *adj;
     adj = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(parent));
-    /* Another hack to try and keep scroll position from
-     * resetting to top while typing, just don't store the new
-     * scroll positions if they're 0. */
-    if (gtk_adjustment_get_value(adj) != 0)
-        self->priv->vscroll_pos = gtk_adjustment_get_value(adj);
+    self->priv->vscroll_pos = gtk_adjustment_get_value(adj);
     adj = gtk_scrolled_window_get_hadjustment(GTK_SCROLLED_WINDOW(parent));
-    if (gtk_adjustment_get_value(adj) != 0)
-        self->priv->hscroll_pos = gtk_adjustment_get_value(adj);
+    self->priv->hscroll_pos = gtk_adjustment_get_value(adj);
     pushed = TRUE;
   }
 
   return pushed;
 }
 
-static gboolean
+static void
 pop_scroll_pos(MarkdownViewer *self)
 {
-  GtkWidget *parent;
-  gboolean popped = FALSE;
+  gchar *script;
 
-  /* first process any pending events, like drawing of the webview */
-  while (gtk_events_pending()) {
-    gtk_main_iteration();
-  }
-
-  parent = gtk_widget_get_parent(GTK_WIDGET(self));
-  if (GTK_IS_SCROLLED_WINDOW(parent)) {
-    GtkAdjustment *adj;
-    adj = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(parent));
-    gtk_adjustment_set_value(adj, self->priv->vscroll_pos);
-    adj = gtk_scrolled_window_get_hadjustment(GTK_SCROLLED_WINDOW(parent));
-    gtk_adjustment_set_value(adj, self->priv->hscroll_pos);
-    /* process any new events, like making sure the new scroll position
-     * takes effect. */
-    while (gtk_events_pending()) {
-      gtk_main_iteration();
-    }
-    popped = TRUE;
-  }
-
-  return popped;
+  /* Let the page scroll itself, unlike the adjustments it is guaranteed
+   * to be laid out for the new content by then. */
+  script = g_strdup_printf("window.scrollTo(%d, %d);",
+    (gint) self->priv->hscroll_pos, (gint) self->priv->vscroll_pos);
+  webkit_web_view_execute_script(WEBKIT_WEB_VIEW(self), script);
+  g_free(script);
 }
 
 static void
@@ -304,105 +889,270 @@ on_webview_load_status_notify(WebKitWebView *view, GParamSpec *pspec,
 
   g_object_get(view, "load-status", &load_status, NULL);
 
-  /* When the webkit is done loading, reset the scroll position. */
+  /* When the webkit is done loading, reset the scroll position. Pages
+   * that were navigated to from the preview are never patched. */
   if (load_status == WEBKIT_LOAD_FINISHED) {
-    pop_scroll_pos(self);
+    self->priv->page_ready = self->priv->page_loading;
+    self->priv->page_loading = FALSE;
+    if (self->priv->page_ready) {
+      pop_scroll_pos(self);
+    }
   }
 }
 
 gchar *
 markdown_viewer_get_html(MarkdownViewer *self)
 {
-  gchar *md_as_html, *html = NULL;
-
   /* Ensure the internal buffer is created */
   if (!self->priv->text) {
     update_internal_text(self, "");
   }
 
-  {
-#ifndef FULL_PRICE  /* this version using Discount markdown library
-                     * is faster but may invoke endless discussions
-                     * about the GPL and licenses similar to (but the
-                     * same as) the old BSD 4-clause license being
-                     * incompatible */
-    MMIOT *doc;
-    doc = mkd_string(self->priv->text->str, self->priv->text->len, 0);
-    mkd_compile(doc, 0);
-    if (mkd_document(doc, &md_as_html) != EOF) {
-      html = template_replace(self, md_as_html);
-    }
-    mkd_cleanup(doc);
-#else /* this version is slower but is unquestionably GPL-friendly
-       * and the lib also has much more readable/maintainable code */
+  return render_html(self->priv->text->str, self->priv->text->len,
+    markdown_viewer_get_template(self));
+}
 
-    md_as_html = markdown_to_string(self->priv->text->str, 0, HTML_FORMAT);
-    if (md_as_html) {
-      html = template_replace(self, md_as_html);
-      g_free(md_as_html); /* TODO: become 100% convinced this wasn't
-                           * malloc()'d outside of GLIB functions with
-                           * libc allocator (probably same anyway). */
-    }
-#endif
+static gchar *
+get_base_uri(void)
+{
+  gchar *base_path;
+  gchar *base_uri; /* A file URI not a path URI; last component is stripped */
+  GError *error = NULL;
+  GeanyDocument *doc = document_get_current();
+
+  /* If the current document has a known path (ie. is saved), use that,
+   * substituting the file's basename for `index.html`. */
+  if (DOC_VALID(doc) && doc->real_path != NULL) {
+    gchar *base_dir = g_path_get_dirname(doc->real_path);
+    base_path = g_build_filename(base_dir, "index.html", NULL);
+    g_free(base_dir);
+  }
+  /* Otherwise assume use a file `index.html` in the current working directory. */
+  else {
+    gchar *cwd = g_get_current_dir();
+    base_path = g_build_filename(cwd, "index.html", NULL);
+    g_free(cwd);
   }
 
-  return html;
+  base_uri = g_filename_to_uri(base_path, NULL, &error);
+  if (base_uri == NULL) {
+    g_warning("failed to encode path '%s' as URI: %s", base_path, error->message);
+    g_error_free(error);
+    base_uri = g_strdup("file://./index.html");
+    g_debug("using phony base URI '%s', broken relative paths are likely", base_uri);
+  }
+  g_free(base_path);
+
+  return base_uri;
 }
 
+/* Whether the page has to be loaded from scratch to show the result of
+ * job, rather than just having the changed blocks patched in. */
 static gboolean
-markdown_viewer_update_view(MarkdownViewer *self)
+needs_reload(MarkdownViewer *self, MarkdownRenderJob *job)
 {
-  gchar *html = markdown_viewer_get_html(self);
+  return !self->priv->page_ready ||
+         g_strcmp0(job->base_uri, self->priv->page_base_uri) != 0 ||
+         g_strcmp0(job->enc, self->priv->page_enc) != 0 ||
+         job->tmpl != self->priv->page_tmpl;
+}
+
+static void
+markdown_viewer_load_page(MarkdownViewer *self, MarkdownRenderJob *job)
+{
+  if (!job->html) {
+    job->html = render_page(job->tmpl, job->blocks);
+  }
 
-  push_scroll_pos(self);
+  if (self->priv->page_ready) {
+    push_scroll_pos(self);
+  }
+
+  /* Connect a signal handler (only needed once) to restore the scroll
+   * position once the webview is reloaded. */
+  if (self->priv->load_handle == 0) {
+    self->priv->load_handle =
+      g_signal_connect_swapped(WEBKIT_WEB_VIEW(self), "notify::load-status",
+        G_CALLBACK(on_webview_load_status_notify), self);
+  }
 
-  if (html) {
-    gchar *base_path;
-    gchar *base_uri; /* A file URI not a path URI; last component is stripped */
-    GError *error = NULL;
-    GeanyDocument *doc = document_get_current();
+  self->priv->page_ready = FALSE;
+  self->priv->page_loading = TRUE;
+  webkit_web_view_load_string(WEBKIT_WEB_VIEW(self), job->html, "text/html",
+    job->enc, job->base_uri);
+
+  /* Remember what the page was made with */
+  markdown_template_unref(self->priv->page_tmpl);
+  self->priv->page_tmpl = markdown_template_ref(job->tmpl);
+  SETPTR(self->priv->page_base_uri, job->base_uri);
+  job->base_uri = NULL;
+  SETPTR(self->priv->page_enc, job->enc);
+  job->enc = NULL;
+}
 
-    /* If the current document has a known path (ie. is saved), use that,
-     * substituting the file's basename for `index.html`. */
-    if (DOC_VALID(doc) && doc->real_path != NULL) {
-      gchar *base_dir = g_path_get_dirname(doc->real_path);
-      base_path = g_build_filename(base_dir, "index.html", NULL);
-      g_free(base_dir);
+static void
+append_js_string(GString *str, const gchar *text)
+{
+  const gchar *p;
+
+  g_string_append_c(str, '"');
+  for (p = text; *p; p++) {
+    switch (*p) {
+      case '"':  g_string_append(str, "\\\""); break;
+      case '\\': g_string_append(str, "\\\\"); break;
+      case '\n': g_string_append(str, "\\n"); break;
+      case '\r': g_string_append(str, "\\r"); break;
+      default:
+        /* U+2028 and U+2029 can't appear literally in JavaScript strings */
+        if ((guchar) p[0] == 0xe2 && (guchar) p[1] == 0x80 &&
+            ((guchar) p[2] == 0xa8 || (guchar) p[2] == 0xa9)) {
+          g_string_append(str, (guchar) p[2] == 0xa8 ? "\\u2028" : "\\u2029");
+          p += 2;
+        } else {
+          g_string_append_c(str, *p);
+        }
+        break;
     }
-    /* Otherwise assume use a file `index.html` in the current working directory. */
-    else {
-      gchar *cwd = g_get_current_dir();
-      base_path = g_build_filename(cwd, "index.html", NULL);
-      g_free(cwd);
+  }
+  g_string_append_c(str, '"');
+}
+
+/* Replaces the blocks that differ between what's shown and fragments in the
+ * loaded page, leaving the common leading and trailing blocks alone. */
+static void
+markdown_viewer_patch_page(MarkdownViewer *self, GPtrArray *fragments)
+{
+  GPtrArray *shown = self->priv->page_blocks;
+  guint n_shown = shown ? shown->len : 0;
+  guint prefix = 0, suffix = 0, i;
+  GString *script;
+
+  while (prefix < n_shown && prefix < fragments->len &&
+         strcmp(shown->pdata[prefix], fragments->pdata[prefix]) == 0) {
+    prefix++;
+  }
+  while (suffix < n_shown - prefix && suffix < fragments->len - prefix &&
+         strcmp(shown->pdata[n_shown - suffix - 1],
+                fragments->pdata[fragments->len - suffix - 1]) == 0) {
+    suffix++;
+  }
+
+  if (prefix + suffix == n_shown && n_shown == fragments->len) {
+    return; /* Nothing changed */
+  }
+
+  script = g_string_new(NULL);
+  g_string_append_printf(script, "geanyMarkdownPatch(%u, %u, [",
+    prefix, n_shown - prefix - suffix);
+  for (i = prefix; i < fragments->len - suffix; i++) {
+    if (i > prefix) {
+      g_string_append_c(script, ',');
     }
+    append_js_string(script, fragments->pdata[i]);
+  }
+  g_string_append(script, "]);");
+
+  webkit_web_view_execute_script(WEBKIT_WEB_VIEW(self), script->str);
+  g_string_free(script, TRUE);
+}
 
-    base_uri = g_filename_to_uri(base_path, NULL, &error);
-    if (base_uri == NULL) {
-      g_warning("failed to encode path '%s' as URI: %s", base_path, error->message);
-      g_error_free(error);
-      base_uri = g_strdup("file://./index.html");
-      g_debug("using phony base URI '%s', broken relative paths are likely", base_uri);
+/* Called on the main thread with the most recently rendered HTML. */
+static gboolean
+on_render_done(MarkdownViewer *self)
+{
+  MarkdownRenderJob *job;
+
+  G_LOCK(render_state);
+  job = self->priv->done_job;
+  self->priv->done_job = NULL;
+  self->priv->done_handle = 0;
+  G_UNLOCK(render_state);
+
+  if (job && job->blocks) {
+    if (needs_reload(self, job)) {
+      markdown_viewer_load_page(self, job);
+    } else {
+      markdown_viewer_patch_page(self, job->blocks);
     }
-    g_free(base_path);
-
-    /* Connect a signal handler (only needed once) to restore the scroll
-     * position once the webview is reloaded. */
-    if (self->priv->load_handle == 0) {
-      self->priv->load_handle =
-        g_signal_connect_swapped(WEBKIT_WEB_VIEW(self), "notify::load-status",
-          G_CALLBACK(on_webview_load_status_notify), self);
+    if (self->priv->page_blocks) {
+      g_ptr_array_free(self->priv->page_blocks, TRUE);
     }
+    self->priv->page_blocks = job->blocks;
+    job->blocks = NULL;
+  }
+  render_job_free(job);
 
-    webkit_web_view_load_string(WEBKIT_WEB_VIEW(self), html, "text/html",
-      self->priv->enc, base_uri);
+  return FALSE;
+}
 
-    g_free(base_uri);
-    g_free(html);
+/* Runs on the render thread. Each push only signals that a request is
+ * pending, the request itself is taken from the viewer so that one that
+ * got superseded before the thread got to it is never rendered. */
+static void
+render_worker(gpointer data, gpointer user_data)
+{
+  MarkdownViewer *self = data;
+  MarkdownRenderJob *job;
+
+  G_LOCK(render_state);
+  job = self->priv->pending_job;
+  self->priv->pending_job = NULL;
+  G_UNLOCK(render_state);
+
+  if (!job) {
+    return;
   }
 
-  if (self->priv->update_handle != 0) {
-    g_source_remove(self->priv->update_handle);
+  job->blocks = render_blocks(self, job->text, job->len);
+  if (job->reload) {
+    job->html = render_page(job->tmpl, job->blocks);
+  }
+  g_free(job->text);
+  job->text = NULL;
+
+  G_LOCK(render_state);
+  /* The GUI didn't get to show the previous result yet, replace it */
+  render_job_free(self->priv->done_job);
+  self->priv->done_job = job;
+  if (self->priv->done_handle == 0) {
+    self->priv->done_handle = g_idle_add((GSourceFunc) on_render_done, self);
   }
+  G_UNLOCK(render_state);
+}
+
+static gboolean
+markdown_viewer_update_view(MarkdownViewer *self)
+{
+  MarkdownRenderJob *job, *old_job;
+
+  /* Ensure the internal buffer is created */
+  if (!self->priv->text) {
+    update_internal_text(self, "");
+  }
+
+  job = g_slice_new0(MarkdownRenderJob);
+  job->text = g_strndup(self->priv->text->str, self->priv->text->len);
+  job->len = self->priv->text->len;
+  job->tmpl = markdown_template_ref(markdown_viewer_get_template(self));
+  job->base_uri = get_base_uri();
+  job->enc = g_strdup(self->priv->enc);
+  /* Only a hint to build the whole page on the render thread already,
+   * whether it is needed is decided again once the job is done. */
+  job->reload = needs_reload(self, job);
+
+  G_LOCK(render_state);
+  old_job = self->priv->pending_job;
+  self->priv->pending_job = job;
+  G_UNLOCK(render_state);
+
+  /* If a request was still pending, the render thread has yet to be woken
+   * up for it and will pick up this one instead. */
+  if (old_job) {
+    render_job_free(old_job);
+  } else {
+    g_thread_pool_push(self->priv->render_pool, self, NULL);
+  }
+
   self->priv->update_handle = 0;
 
   return FALSE; /* When used as an idle handler, says to remove the source */
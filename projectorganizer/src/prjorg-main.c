@@ -28,6 +28,8 @@
 #include "prjorg-project.h"
 #include "prjorg-sidebar.h"
 #include "prjorg-menu.h"
+#include "prjorg-quickopen.h"
+#include "prjorg-tagindex.h"
 
 
 GeanyPlugin *geany_plugin;
@@ -53,6 +55,8 @@ static void on_doc_open(G_GNUC_UNUSED GObject * obj, G_GNUC_UNUSED GeanyDocument
 	if (prjorg_project_is_in_project(doc->file_name))
 		prjorg_project_remove_single_tm_file(doc->file_name);
 
+	/* the tags of open documents aren't indexed */
+	prjorg_tag_index_invalidate();
 	prjorg_sidebar_update(FALSE);
 }
 
@@ -77,6 +81,7 @@ static void on_doc_close(G_GNUC_UNUSED GObject * obj, GeanyDocument * doc,
 	if (prjorg_project_is_in_project(doc->file_name))
 		prjorg_project_add_single_tm_file(doc->file_name);
 
+	prjorg_tag_index_invalidate();
 	prjorg_sidebar_update(FALSE);
 }
 
@@ -139,6 +144,7 @@ static void on_project_open(G_GNUC_UNUSED GObject * obj, GKeyFile * config,
 
 static void on_project_close(G_GNUC_UNUSED GObject * obj, G_GNUC_UNUSED gpointer user_data)
 {
+	prjorg_quick_open_hide();
 	prjorg_project_close();
 	prjorg_sidebar_update(TRUE);
 	prjorg_sidebar_activate(FALSE);
@@ -214,6 +220,7 @@ void plugin_cleanup(void)
 
 	prjorg_menu_cleanup();
 	prjorg_sidebar_cleanup();
+	prjorg_quick_open_cleanup();
 }
 
 
@@ -29,6 +29,7 @@
 #include "prjorg-project.h"
 #include "prjorg-utils.h"
 #include "prjorg-sidebar.h"
+#include "prjorg-quickopen.h"
 
 #include <string.h>
 
@@ -42,11 +43,12 @@ enum
 	KB_FIND_IN_PROJECT,
 	KB_FIND_FILE,
 	KB_FIND_TAG,
+	KB_QUICK_OPEN,
 	KB_COUNT
 };
 
 
-static GtkWidget *s_fif_item, *s_ff_item, *s_ft_item, *s_shs_item, *s_sep_item, *s_context_osf_item, *s_context_sep_item;
+static GtkWidget *s_fif_item, *s_ff_item, *s_ft_item, *s_qo_item, *s_shs_item, *s_sep_item, *s_context_osf_item, *s_context_sep_item;
 
 
 static gboolean try_swap_header_source(gchar *utf8_file_name, gboolean is_header, GSList *file_list, GSList *header_patterns, GSList *source_patterns)
@@ -209,6 +211,13 @@ static void on_find_tag(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpoi
 }
 
 
+static void on_quick_open(G_GNUC_UNUSED GtkMenuItem * menuitem, G_GNUC_UNUSED gpointer user_data)
+{
+	if (geany_data->app->project)
+		prjorg_quick_open_show();
+}
+
+
 static gboolean kb_callback(guint key_id)
 {
 	switch (key_id)
@@ -225,6 +234,9 @@ static gboolean kb_callback(guint key_id)
 		case KB_FIND_TAG:
 			on_find_tag(NULL, NULL);
 			return TRUE;
+		case KB_QUICK_OPEN:
+			on_quick_open(NULL, NULL);
+			return TRUE;
 	}
 	return FALSE;
 }
@@ -410,6 +422,16 @@ void prjorg_menu_init(void)
 	keybindings_set_item(key_group, KB_FIND_TAG, NULL,
 		0, 0, "find_tag", _("Find project symbol"), s_ft_item);
 
+	image = gtk_image_new_from_stock(GTK_STOCK_OPEN, GTK_ICON_SIZE_MENU);
+	gtk_widget_show(image);
+	s_qo_item = gtk_image_menu_item_new_with_mnemonic(_("_Quick Open Project File..."));
+	gtk_image_menu_item_set_image(GTK_IMAGE_MENU_ITEM(s_qo_item), image);
+	gtk_widget_show(s_qo_item);
+	gtk_container_add(GTK_CONTAINER(geany->main_widgets->project_menu), s_qo_item);
+	g_signal_connect((gpointer) s_qo_item, "activate", G_CALLBACK(on_quick_open), NULL);
+	keybindings_set_item(key_group, KB_QUICK_OPEN, NULL,
+		0, 0, "quick_open", _("Quick open project file"), s_qo_item);
+
 	s_shs_item = gtk_menu_item_new_with_mnemonic(_("Swap Header/Source"));
 	gtk_widget_show(s_shs_item);
 	gtk_container_add(GTK_CONTAINER(geany->main_widgets->project_menu), s_shs_item);
@@ -436,6 +458,7 @@ void prjorg_menu_activate_menu_items(gboolean activate)
 	gtk_widget_set_sensitive(s_shs_item, activate);
 	gtk_widget_set_sensitive(s_ff_item, activate);
 	gtk_widget_set_sensitive(s_ft_item, activate);
+	gtk_widget_set_sensitive(s_qo_item, activate);
 	gtk_widget_set_sensitive(s_fif_item, activate);
 }
 
@@ -445,6 +468,7 @@ void prjorg_menu_cleanup(void)
 	gtk_widget_destroy(s_fif_item);
 	gtk_widget_destroy(s_ff_item);
 	gtk_widget_destroy(s_ft_item);
+	gtk_widget_destroy(s_qo_item);
 	gtk_widget_destroy(s_shs_item);
 	gtk_widget_destroy(s_sep_item);
 
@@ -16,6 +16,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <gdk/gdkkeysyms.h>
 #include <glib/gstdio.h>
@@ -27,6 +29,24 @@
 
 #include "prjorg-utils.h"
 #include "prjorg-project.h"
+#include "prjorg-scanner.h"
+#include "prjorg-sidebar.h"
+#include "prjorg-tagindex.h"
+
+#define TAG_THREADS 2
+#define TAG_BATCH_MIN_SIZE (256 * 1024)	/* bytes of files parsed per workspace update */
+#define TAG_BATCH_MAX_SIZE (8 * 1024 * 1024)
+#define TAG_WAIT_INTERVAL 20	/* ms to wait when no detected file is ready */
+
+#define CACHE_MAGIC "prjorg-cache"
+#define CACHE_VERSION 1
+
+/* Directory monitors use inotify watches which are a per-user resource shared
+ * with other applications and GIO doesn't report when they run out. Only this
+ * many directories get a monitor, the rest is polled. */
+#define MAX_MONITORS 4096
+#define POLL_INTERVAL 1000	/* ms */
+#define POLL_TIME_BUDGET 5000	/* us spent polling every POLL_INTERVAL */
 
 extern GeanyPlugin *geany_plugin;
 extern GeanyData *geany_data;
@@ -47,6 +67,21 @@ static PropertyDialogElements *e;
 static GSList *s_idle_add_funcs;
 static GSList *s_idle_remove_funcs;
 
+static PrjOrgScanner *s_scanner = NULL;
+static GPtrArray *s_scan_tables = NULL;  /* file tables being filled by s_scanner, one per root */
+static gboolean s_tags_generated = FALSE;
+
+static gchar *s_cache_file = NULL;  /* locale */
+
+static GHashTable *s_pending_changes = NULL;  /* maps locale path->PrjOrgRoot of changed files */
+static guint s_flush_changes_id = 0;
+
+static PrjOrgScanner *s_dir_scanner = NULL;  /* scans directories created since the last scan */
+static GPtrArray *s_dir_scan_roots = NULL;  /* PrjOrgRoot of every directory scanned by s_dir_scanner */
+
+static guint s_poll_id = 0;
+static gboolean s_polling_reported = FALSE;
+
 
 static void clear_idle_queue(GSList **queue)
 {
@@ -68,249 +103,947 @@ static void collect_source_files(gchar *filename, TMSourceFile *sf, gpointer use
 }
 
 
-/* path - absolute path in locale, returned list in locale */
-static GSList *get_file_list(const gchar *utf8_path, GSList *patterns,
-		GSList *ignored_dirs_patterns, GSList *ignored_file_patterns, GHashTable *visited_paths)
+static GSList *get_precompiled_file_patterns(void)
 {
-	GSList *list = NULL;
-	GDir *dir;
-	gchar *locale_path = utils_get_locale_from_utf8(utf8_path);
-	gchar *real_path = tm_get_real_path(locale_path);
+	GSList *pattern_list;
 
-	dir = g_dir_open(locale_path, 0, NULL);
-	if (!dir || !real_path || g_hash_table_lookup(visited_paths, real_path))
+	if (!geany_data->app->project->file_patterns || !geany_data->app->project->file_patterns[0])
 	{
-		g_free(locale_path);
-		g_free(real_path);
-		return NULL;
+		gchar **all_pattern = g_strsplit ("*", " ", -1);
+		pattern_list = get_precompiled_patterns(all_pattern);
+		g_strfreev(all_pattern);
+	}
+	else
+		pattern_list = get_precompiled_patterns(geany_data->app->project->file_patterns);
+
+	return pattern_list;
+}
+
+
+static void free_patterns(GSList *pattern_list)
+{
+	g_slist_foreach(pattern_list, (GFunc) g_pattern_spec_free, NULL);
+	g_slist_free(pattern_list);
+}
+
+
+/* The files not known yet are added to the sidebar as they are found, the
+ * files which disappeared are removed when the scan finishes */
+static void on_scan_batch(guint root_index, GPtrArray *utf8_files, gpointer user_data)
+{
+	GHashTable *file_table = s_scan_tables->pdata[root_index];
+	PrjOrgRoot *root = g_slist_nth_data(prj_org->roots, root_index);
+	GPtrArray *utf8_added = g_ptr_array_new();
+	GPtrArray *utf8_removed = g_ptr_array_new();
+	guint i;
+
+	for (i = 0; i < utf8_files->len; i++)
+	{
+		gchar *utf8_path = utf8_files->pdata[i];
+
+		g_hash_table_insert(file_table, g_strdup(utf8_path), NULL);
+		if (!g_hash_table_lookup_extended(root->file_table, utf8_path, NULL, NULL))
+		{
+			g_hash_table_insert(root->file_table, g_strdup(utf8_path), NULL);
+			g_ptr_array_add(utf8_added, utf8_path);
+		}
+	}
+
+	if (utf8_added->len > 0)
+		prjorg_sidebar_update_files(utf8_added, utf8_removed);
+
+	g_ptr_array_free(utf8_added, TRUE);
+	g_ptr_array_free(utf8_removed, TRUE);
+}
+
+
+typedef struct
+{
+	GPatternSpec *pattern;
+	GeanyFiletype *ft;
+} FiletypePattern;
+
+typedef struct
+{
+	PrjOrgRoot *root;
+	gchar *utf8_path;
+	GeanyFiletype *ft;	/* NULL when it has to be detected from the file contents */
+	gint64 size;
+} TagJob;
+
+/* Filetypes of the project files are detected and the files read in worker
+ * threads, the files are then parsed in batches on the main thread because the
+ * tag manager isn't thread-safe */
+typedef struct
+{
+	GThreadPool *pool;
+	GAsyncQueue *detected;	/* TagJobs processed by the pool */
+	GPtrArray *ft_patterns;	/* FiletypePatterns, read-only in workers */
+	gint cancelled;	/* atomic */
+	GPtrArray *batch;	/* detected TagJobs waiting for the next workspace update */
+	gint64 batch_size;
+	gint64 indexed_size;
+	guint total;
+	guint done;
+	gint64 last_progress_time;
+	gboolean progress_shown;
+	guint idle_id;
+} TagGenerator;
+
+static TagGenerator *s_tag_generator = NULL;
+
+
+static void tag_job_free(TagJob *job)
+{
+	g_free(job->utf8_path);
+	g_free(job);
+}
+
+
+static void filetype_pattern_free(FiletypePattern *ftp)
+{
+	g_pattern_spec_free(ftp->pattern);
+	g_free(ftp);
+}
+
+
+static GPtrArray *get_precompiled_filetype_patterns(void)
+{
+	GPtrArray *ft_patterns = g_ptr_array_new_with_free_func((GDestroyNotify)filetype_pattern_free);
+	guint i;
+
+	for (i = 0; i < geany_data->filetypes_array->len; i++)
+	{
+		GeanyFiletype *ft = filetypes[i];
+		gint j;
+
+		if (ft->id == GEANY_FILETYPES_NONE)
+			continue;
+
+		for (j = 0; ft->pattern[j] != NULL; j++)
+		{
+			FiletypePattern *ftp = g_new0(FiletypePattern, 1);
+
+			ftp->pattern = g_pattern_spec_new(ft->pattern[j]);
+			ftp->ft = ft;
+			g_ptr_array_add(ft_patterns, ftp);
+		}
 	}
 
-	g_hash_table_insert(visited_paths, real_path, GINT_TO_POINTER(1));
+	return ft_patterns;
+}
+
+
+/* Runs in a worker thread. Only the file extension is checked here using
+ * precompiled patterns; the files it fails for are detected from their
+ * contents on the main thread. The file is read so the parser running on the
+ * main thread finds it in the page cache instead of waiting for the disk. */
+static void detect_filetype_func(gpointer data, gpointer user_data)
+{
+	TagGenerator *generator = user_data;
+	TagJob *job = data;
+	gchar *locale_filename;
+	GStatBuf s;
 
-	while (TRUE)
+	if (g_atomic_int_get(&generator->cancelled))
 	{
-		const gchar *locale_name;
-		gchar *locale_filename, *utf8_filename, *utf8_name;
+		tag_job_free(job);
+		return;
+	}
 
-		locale_name = g_dir_read_name(dir);
-		if (!locale_name)
-			break;
+	locale_filename = utils_get_locale_from_utf8(job->utf8_path);
+	if (g_stat(locale_filename, &s) != 0 || s.st_size > 10*1024*1024)
+		job->ft = filetypes[GEANY_FILETYPES_NONE];
+	else
+	{
+		gchar *utf8_base_filename = g_path_get_basename(job->utf8_path);
+		gchar *contents;
+		guint i;
 
-		utf8_name = utils_get_utf8_from_locale(locale_name);
-		locale_filename = g_build_filename(locale_path, locale_name, NULL);
-		utf8_filename = utils_get_utf8_from_locale(locale_filename);
+		job->size = s.st_size;
+		if (g_file_get_contents(locale_filename, &contents, NULL, NULL))
+			g_free(contents);
 
-		if (g_file_test(locale_filename, G_FILE_TEST_IS_DIR))
+#ifdef G_OS_WIN32
+		SETPTR(utf8_base_filename, g_utf8_strdown(utf8_base_filename, -1));
+#endif
+		for (i = 0; i < generator->ft_patterns->len; i++)
 		{
-			GSList *lst;
+			FiletypePattern *ftp = generator->ft_patterns->pdata[i];
 
-			if (!patterns_match(ignored_dirs_patterns, utf8_name))
+			if (g_pattern_match_string(ftp->pattern, utf8_base_filename))
 			{
-				lst = get_file_list(utf8_filename, patterns, ignored_dirs_patterns,
-						ignored_file_patterns, visited_paths);
-				if (lst)
-					list = g_slist_concat(list, lst);
+				job->ft = ftp->ft;
+				break;
 			}
 		}
-		else if (g_file_test(locale_filename, G_FILE_TEST_IS_REGULAR))
+		g_free(utf8_base_filename);
+	}
+
+	g_free(locale_filename);
+	g_async_queue_push(generator->detected, job);
+}
+
+
+static void tag_generator_free(TagGenerator *generator)
+{
+	TagJob *job;
+
+	if (generator->idle_id)
+		g_source_remove(generator->idle_id);
+
+	g_atomic_int_set(&generator->cancelled, TRUE);
+	/* queued jobs notice the cancelled flag and return immediately */
+	g_thread_pool_free(generator->pool, FALSE, TRUE);
+
+	while ((job = g_async_queue_try_pop(generator->detected)) != NULL)
+		tag_job_free(job);
+	g_async_queue_unref(generator->detected);
+	g_ptr_array_free(generator->batch, TRUE);
+	g_ptr_array_free(generator->ft_patterns, TRUE);
+	g_free(generator);
+}
+
+
+static void cancel_tag_generation(void)
+{
+	if (!s_tag_generator)
+		return;
+
+	tag_generator_free(s_tag_generator);
+	s_tag_generator = NULL;
+}
+
+
+/* All files of the batch are added to the workspace by a single
+ * tm_workspace_add_source_files() call, which parses them and sorts the
+ * workspace tags once */
+static void add_batch(TagGenerator *generator)
+{
+	GPtrArray *source_files = g_ptr_array_new();
+	guint i;
+
+	for (i = 0; i < generator->batch->len; i++)
+	{
+		TagJob *job = generator->batch->pdata[i];
+		gpointer value;
+
+		/* the file might have been removed or re-added in the meantime */
+		if (g_hash_table_lookup_extended(job->root->file_table, job->utf8_path, NULL, &value) && !value)
 		{
-			if (patterns_match(patterns, utf8_name) && !patterns_match(ignored_file_patterns, utf8_name))
-				list = g_slist_prepend(list, g_strdup(utf8_filename));
-		}
+			gchar *locale_path = utils_get_locale_from_utf8(job->utf8_path);
+			GeanyFiletype *ft = job->ft ? job->ft : filetypes_detect_from_file(job->utf8_path);
+			TMSourceFile *sf;
 
-		g_free(utf8_filename);
-		g_free(locale_filename);
-		g_free(utf8_name);
+			sf = tm_source_file_new(locale_path, ft->name);
+			if (sf && !document_find_by_filename(job->utf8_path))
+				g_ptr_array_add(source_files, sf);
+
+			g_hash_table_insert(job->root->file_table, g_strdup(job->utf8_path), sf);
+			g_free(locale_path);
+		}
 	}
 
-	g_dir_close(dir);
-	g_free(locale_path);
+	if (source_files->len > 0)
+	{
+		tm_workspace_add_source_files(source_files);
+		prjorg_tag_index_invalidate();
+	}
+	g_ptr_array_free(source_files, TRUE);
 
-	return list;
+	generator->done += generator->batch->len;
+	generator->indexed_size += generator->batch_size;
+	g_ptr_array_set_size(generator->batch, 0);
+	generator->batch_size = 0;
 }
 
 
-static gint prjorg_project_rescan_root(PrjOrgRoot *root)
+/* Every workspace update re-sorts all the workspace tags so the batches grow
+ * with the workspace, which keeps the total sorting work proportional to the
+ * number of tags. The batch size is capped so that a single dispatch doesn't
+ * block the UI for too long. */
+static gboolean generate_tags_idle(gpointer user_data)
 {
-	GPtrArray *source_files;
-	GSList *pattern_list = NULL;
-	GSList *ignored_dirs_list = NULL;
-	GSList *ignored_file_list = NULL;
-	GHashTable *visited_paths;
-	GSList *lst;
-	GSList *elem = NULL;
-	gint filenum = 0;
+	TagGenerator *generator = s_tag_generator;
+	gint64 batch_limit, now;
+	TagJob *job = NULL;
 
-	source_files = g_ptr_array_new();
-	g_hash_table_foreach(root->file_table, (GHFunc)collect_source_files, source_files);
-	tm_workspace_remove_source_files(source_files);
-	g_ptr_array_free(source_files, TRUE);
-	g_hash_table_remove_all(root->file_table);
+	generator->idle_id = 0;
+	batch_limit = CLAMP(generator->indexed_size / 4, TAG_BATCH_MIN_SIZE, TAG_BATCH_MAX_SIZE);
 
-	if (!geany_data->app->project->file_patterns || !geany_data->app->project->file_patterns[0])
+	while (generator->batch_size < batch_limit &&
+		(job = g_async_queue_try_pop(generator->detected)) != NULL)
 	{
-		gchar **all_pattern = g_strsplit ("*", " ", -1);
-		pattern_list = get_precompiled_patterns(all_pattern);
-		g_strfreev(all_pattern);
+		g_ptr_array_add(generator->batch, job);
+		generator->batch_size += job->size;
 	}
+
+	/* a partial batch waits for more files unless all of them are detected */
+	if (generator->batch_size >= batch_limit ||
+		generator->done + generator->batch->len == generator->total)
+		add_batch(generator);
+
+	if (generator->done == generator->total)
+	{
+		if (generator->progress_shown)
+			ui_set_statusbar(FALSE, _("Project Organizer: indexed %u files"), generator->total);
+		cancel_tag_generation();
+		return FALSE;
+	}
+
+	/* don't report progress of quick runs */
+	now = g_get_monotonic_time();
+	if (now - generator->last_progress_time > G_USEC_PER_SEC)
+	{
+		ui_set_statusbar(FALSE, _("Project Organizer: indexing files (%u/%u)"),
+			generator->done, generator->total);
+		generator->last_progress_time = now;
+		generator->progress_shown = TRUE;
+	}
+
+	/* don't spin while the workers have nothing ready */
+	if (!job)
+		generator->idle_id = plugin_timeout_add(geany_plugin, TAG_WAIT_INTERVAL, generate_tags_idle, NULL);
 	else
-		pattern_list = get_precompiled_patterns(geany_data->app->project->file_patterns);
+		generator->idle_id = plugin_idle_add(geany_plugin, generate_tags_idle, NULL);
 
-	ignored_dirs_list = get_precompiled_patterns(prj_org->ignored_dirs_patterns);
-	ignored_file_list = get_precompiled_patterns(prj_org->ignored_file_patterns);
+	return FALSE;
+}
 
-	visited_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-	lst = get_file_list(root->base_dir, pattern_list, ignored_dirs_list, ignored_file_list, visited_paths);
-	g_hash_table_destroy(visited_paths);
 
-	foreach_slist(elem, lst)
+/* The file gets its TMSourceFile once its filetype is detected, the generator
+ * is created on demand and frees itself when all queued files are done */
+static void queue_tag_job(PrjOrgRoot *root, const gchar *utf8_path)
+{
+	TagGenerator *generator = s_tag_generator;
+	TagJob *job;
+
+	if (!generator)
 	{
-		char *path = elem->data;
+		generator = g_new0(TagGenerator, 1);
+		generator->detected = g_async_queue_new();
+		generator->batch = g_ptr_array_new_with_free_func((GDestroyNotify)tag_job_free);
+		generator->ft_patterns = get_precompiled_filetype_patterns();
+		generator->pool = g_thread_pool_new(detect_filetype_func, generator, TAG_THREADS, FALSE, NULL);
+		generator->last_progress_time = g_get_monotonic_time();
+		s_tag_generator = generator;
+	}
+
+	job = g_new0(TagJob, 1);
+	job->root = root;
+	job->utf8_path = g_strdup(utf8_path);
+	g_thread_pool_push(generator->pool, job, NULL);
+	generator->total++;
+
+	if (!generator->idle_id)
+		generator->idle_id = plugin_idle_add(geany_plugin, generate_tags_idle, NULL);
+}
+
+
+/* only files without a TMSourceFile are parsed, the rest is kept from the
+ * previous scan */
+static void regenerate_tags(void)
+{
+	GSList *elem = NULL;
 
-		if (path)
+	cancel_tag_generation();
+
+	foreach_slist (elem, prj_org->roots)
+	{
+		PrjOrgRoot *root = elem->data;
+		GHashTableIter iter;
+		gpointer key, value;
+
+		g_hash_table_iter_init(&iter, root->file_table);
+		while (g_hash_table_iter_next(&iter, &key, &value))
 		{
-			g_hash_table_insert(root->file_table, g_strdup(path), NULL);
-			filenum++;
+			if (!value)
+				queue_tag_job(root, key);
 		}
 	}
+}
 
-	g_slist_foreach(lst, (GFunc) g_free, NULL);
-	g_slist_free(lst);
 
-	g_slist_foreach(pattern_list, (GFunc) g_pattern_spec_free, NULL);
-	g_slist_free(pattern_list);
+static void cancel_dir_scan(void)
+{
+	if (!s_dir_scanner)
+		return;
+
+	prjorg_scanner_free(s_dir_scanner);
+	s_dir_scanner = NULL;
+	g_ptr_array_free(s_dir_scan_roots, TRUE);
+	s_dir_scan_roots = NULL;
+}
+
+
+static void cancel_scan(void)
+{
+	cancel_tag_generation();
+	cancel_dir_scan();
+
+	if (!s_scanner)
+		return;
 
-	g_slist_foreach(ignored_dirs_list, (GFunc) g_pattern_spec_free, NULL);
-	g_slist_free(ignored_dirs_list);
+	prjorg_scanner_free(s_scanner);
+	s_scanner = NULL;
+	g_ptr_array_free(s_scan_tables, TRUE);
+	s_scan_tables = NULL;
+}
 
-	g_slist_foreach(ignored_file_list, (GFunc) g_pattern_spec_free, NULL);
-	g_slist_free(ignored_file_list);
 
-	return filenum;
+/* the files are parsed by the tag generator so many files created at once
+ * don't block the UI */
+static void add_file(PrjOrgRoot *root, const gchar *utf8_path)
+{
+	g_hash_table_insert(root->file_table, g_strdup(utf8_path), NULL);
+	if (s_tags_generated)
+		queue_tag_job(root, utf8_path);
 }
 
 
-static gboolean match_basename(gconstpointer pft, gconstpointer user_data)
+/* The TMSourceFile of the removed file is added to source_files, it has to be
+ * removed from the workspace before it can be freed by
+ * remove_source_files() */
+static void remove_file(PrjOrgRoot *root, const gchar *utf8_path, GPtrArray *source_files)
 {
-	const GeanyFiletype *ft = pft;
-	const gchar *utf8_base_filename = user_data;
-	gint j;
-	gboolean ret = FALSE;
+	gpointer key, value;
 
-	if (G_UNLIKELY(ft->id == GEANY_FILETYPES_NONE))
-		return FALSE;
+	if (!g_hash_table_lookup_extended(root->file_table, utf8_path, &key, &value))
+		return;
 
-	for (j = 0; ft->pattern[j] != NULL; j++)
-	{
-		GPatternSpec *pattern = g_pattern_spec_new(ft->pattern[j]);
+	g_hash_table_steal(root->file_table, key);
+	if (value)
+		g_ptr_array_add(source_files, value);
+	g_free(key);
+}
+
+
+/* Removes the files and directory listings under the deleted directory, the
+ * removed files are added to utf8_removed */
+static void remove_dir(PrjOrgRoot *root, const gchar *locale_path, const gchar *utf8_path,
+	GPtrArray *utf8_removed, GPtrArray *source_files)
+{
+	gchar *locale_prefix = g_strconcat(locale_path, G_DIR_SEPARATOR_S, NULL);
+	gchar *utf8_prefix = g_strconcat(utf8_path, G_DIR_SEPARATOR_S, NULL);
+	GHashTableIter iter;
+	gpointer key, value;
 
-		if (g_pattern_match_string(pattern, utf8_base_filename))
+	g_hash_table_iter_init(&iter, root->file_table);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+	{
+		if (g_str_has_prefix(key, utf8_prefix))
 		{
-			ret = TRUE;
-			g_pattern_spec_free(pattern);
-			break;
+			g_hash_table_iter_steal(&iter);
+			if (value)
+				g_ptr_array_add(source_files, value);
+			g_ptr_array_add(utf8_removed, key);
 		}
-		g_pattern_spec_free(pattern);
 	}
-	return ret;
+
+	g_hash_table_iter_init(&iter, root->dir_cache);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+	{
+		if (strcmp(key, locale_path) == 0 || g_str_has_prefix(key, locale_prefix))
+			g_hash_table_iter_remove(&iter);
+	}
+
+	g_free(locale_prefix);
+	g_free(utf8_prefix);
 }
 
 
-/* Stolen and modified version from Geany. The only difference is that Geany
- * first looks at shebang inside the file and then, if it fails, checks the
- * file extension. Opening every file is too expensive so instead check just
- * extension and only if this fails, look at the shebang */
-static GeanyFiletype *filetypes_detect(const gchar *utf8_filename)
+static void remove_source_files(GPtrArray *source_files)
 {
-	struct stat s;
-	GeanyFiletype *ft = NULL;
-	gchar *locale_filename;
+	if (source_files->len > 0)
+	{
+		tm_workspace_remove_source_files(source_files);
+		prjorg_tag_index_invalidate();
+	}
+	g_ptr_array_foreach(source_files, (GFunc)tm_source_file_free, NULL);
+	g_ptr_array_free(source_files, TRUE);
+}
 
-	locale_filename = utils_get_locale_from_utf8(utf8_filename);
-	if (g_stat(locale_filename, &s) != 0 || s.st_size > 10*1024*1024)
-		ft = filetypes[GEANY_FILETYPES_NONE];
-	else
+
+static void update_monitors(PrjOrgRoot *root, gpointer user_data);
+
+
+static void on_dir_scan_batch(guint root_index, GPtrArray *utf8_files, gpointer user_data)
+{
+	PrjOrgRoot *root = s_dir_scan_roots->pdata[root_index];
+	GPtrArray *utf8_added, *utf8_removed;
+	guint i;
+
+	utf8_added = g_ptr_array_new();
+	utf8_removed = g_ptr_array_new();
+
+	for (i = 0; i < utf8_files->len; i++)
 	{
-		guint i;
-		gchar *utf8_base_filename;
+		gchar *utf8_path = utf8_files->pdata[i];
 
-		/* to match against the basename of the file (because of Makefile*) */
-		utf8_base_filename = g_path_get_basename(utf8_filename);
-#ifdef G_OS_WIN32
-		/* use lower case basename */
-		SETPTR(utf8_base_filename, g_utf8_strdown(utf8_base_filename, -1));
-#endif
+		if (g_hash_table_lookup_extended(root->file_table, utf8_path, NULL, NULL))
+			continue;
+
+		g_hash_table_insert(root->file_table, g_strdup(utf8_path), NULL);
+		if (s_tags_generated)
+			queue_tag_job(root, utf8_path);
+		g_ptr_array_add(utf8_added, utf8_path);
+	}
 
-		for (i = 0; i < geany_data->filetypes_array->len; i++)
+	if (utf8_added->len > 0)
+		prjorg_sidebar_update_files(utf8_added, utf8_removed);
+
+	g_ptr_array_free(utf8_added, TRUE);
+	g_ptr_array_free(utf8_removed, TRUE);
+}
+
+
+static void on_dir_scan_finished(gpointer user_data)
+{
+	guint i;
+
+	for (i = 0; i < s_dir_scan_roots->len; i++)
+	{
+		PrjOrgRoot *root = s_dir_scan_roots->pdata[i];
+		GHashTable *dir_cache = prjorg_scanner_steal_dir_cache(s_dir_scanner, i);
+		GHashTableIter iter;
+		gpointer key, value;
+
+		g_hash_table_iter_init(&iter, dir_cache);
+		while (g_hash_table_iter_next(&iter, &key, &value))
 		{
-			GeanyFiletype *ftype = filetypes[i];
+			g_hash_table_iter_steal(&iter);
+			g_hash_table_insert(root->dir_cache, key, value);
+		}
+		g_hash_table_destroy(dir_cache);
+	}
+
+	cancel_dir_scan();
+
+	g_slist_foreach(prj_org->roots, (GFunc)update_monitors, NULL);
+}
+
+
+/* New directories are scanned on their own and their files are added to the
+ * file tables as they are found, the rest of the project isn't touched */
+static void scan_new_dirs(GPtrArray *roots, GPtrArray *utf8_dirs)
+{
+	guint i;
+
+	s_dir_scanner = prjorg_scanner_new(get_precompiled_file_patterns(),
+		get_precompiled_patterns(prj_org->ignored_dirs_patterns),
+		get_precompiled_patterns(prj_org->ignored_file_patterns),
+		on_dir_scan_batch, on_dir_scan_finished, NULL);
+	s_dir_scan_roots = g_ptr_array_new();
+
+	for (i = 0; i < utf8_dirs->len; i++)
+	{
+		prjorg_scanner_add_root(s_dir_scanner, utf8_dirs->pdata[i], NULL);
+		g_ptr_array_add(s_dir_scan_roots, roots->pdata[i]);
+	}
+
+	prjorg_scanner_start(s_dir_scanner);
+}
+
+
+/* Applies all changes collected since the last flush at once so e.g. a branch
+ * switch touching thousands of files results in a single sidebar update. Only
+ * the final state of each path matters - it is checked on the disk here. */
+static gboolean flush_changes(gpointer user_data)
+{
+	GSList *pattern_list, *ignored_dirs_list, *ignored_file_list;
+	GPtrArray *utf8_added, *utf8_removed, *source_files, *new_dir_roots, *utf8_new_dirs;
+	GHashTableIter iter;
+	gpointer key, value;
+	gboolean dirs_removed = FALSE;
+
+	/* the running scans may or may not have seen the changes - wait for them */
+	if (prjorg_project_is_scanning() || s_dir_scanner)
+		return TRUE;
 
-			if (match_basename(ftype, utf8_base_filename))
+	s_flush_changes_id = 0;
+
+	pattern_list = get_precompiled_file_patterns();
+	ignored_dirs_list = get_precompiled_patterns(prj_org->ignored_dirs_patterns);
+	ignored_file_list = get_precompiled_patterns(prj_org->ignored_file_patterns);
+	utf8_added = g_ptr_array_new_with_free_func(g_free);
+	utf8_removed = g_ptr_array_new_with_free_func(g_free);
+	source_files = g_ptr_array_new();
+	new_dir_roots = g_ptr_array_new();
+	utf8_new_dirs = g_ptr_array_new_with_free_func(g_free);
+
+	g_hash_table_iter_init(&iter, s_pending_changes);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+	{
+		gchar *locale_path = key;
+		PrjOrgRoot *root = value;
+		gchar *utf8_path = utils_get_utf8_from_locale(locale_path);
+		gchar *utf8_name = g_path_get_basename(utf8_path);
+		gboolean in_table = g_hash_table_lookup_extended(root->file_table, utf8_path, NULL, NULL);
+
+		if (g_file_test(locale_path, G_FILE_TEST_IS_DIR))
+		{
+			/* new directories have to be scanned and monitored */
+			if (!patterns_match(ignored_dirs_list, utf8_name))
 			{
-				ft = ftype;
-				break;
+				/* a known directory reported as created has been replaced */
+				if (g_hash_table_lookup(root->dir_cache, locale_path))
+				{
+					remove_dir(root, locale_path, utf8_path, utf8_removed, source_files);
+					dirs_removed = TRUE;
+				}
+				g_ptr_array_add(new_dir_roots, root);
+				g_ptr_array_add(utf8_new_dirs, g_strdup(utf8_path));
 			}
 		}
+		else if (g_file_test(locale_path, G_FILE_TEST_IS_REGULAR))
+		{
+			if (!in_table && patterns_match(pattern_list, utf8_name) &&
+				!patterns_match(ignored_file_list, utf8_name))
+			{
+				add_file(root, utf8_path);
+				g_ptr_array_add(utf8_added, g_strdup(utf8_path));
+			}
+		}
+		else if (g_hash_table_lookup(root->dir_cache, locale_path))
+		{
+			remove_dir(root, locale_path, utf8_path, utf8_removed, source_files);
+			dirs_removed = TRUE;
+		}
+		else if (in_table)
+		{
+			remove_file(root, utf8_path, source_files);
+			g_ptr_array_add(utf8_removed, g_strdup(utf8_path));
+		}
 
-		if (ft == NULL)
-			ft = filetypes_detect_from_file(utf8_filename);
+		g_free(utf8_name);
+		g_free(utf8_path);
+	}
+	g_hash_table_remove_all(s_pending_changes);
+
+	remove_source_files(source_files);
+	if (utf8_added->len > 0 || utf8_removed->len > 0)
+		prjorg_sidebar_update_files(utf8_added, utf8_removed);
+	if (dirs_removed)
+		g_slist_foreach(prj_org->roots, (GFunc)update_monitors, NULL);
+	if (utf8_new_dirs->len > 0)
+		scan_new_dirs(new_dir_roots, utf8_new_dirs);
+
+	g_ptr_array_free(utf8_added, TRUE);
+	g_ptr_array_free(utf8_removed, TRUE);
+	g_ptr_array_free(new_dir_roots, TRUE);
+	g_ptr_array_free(utf8_new_dirs, TRUE);
+	free_patterns(pattern_list);
+	free_patterns(ignored_dirs_list);
+	free_patterns(ignored_file_list);
 
-		g_free(utf8_base_filename);
+	return FALSE;
+}
+
+
+/* takes ownership of locale_path */
+static void queue_change(gchar *locale_path, PrjOrgRoot *root)
+{
+	if (!s_pending_changes)
+		s_pending_changes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	g_hash_table_insert(s_pending_changes, locale_path, root);
+
+	if (!s_flush_changes_id)
+		s_flush_changes_id = plugin_timeout_add(geany_plugin, 300, flush_changes, NULL);
+}
+
+
+static void on_dir_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+	GFileMonitorEvent event, PrjOrgRoot *root)
+{
+	gchar *locale_path;
+
+	/* without G_FILE_MONITOR_SEND_MOVED renames are reported as a deletion
+	 * and a creation; content changes don't affect the file list */
+	if (event != G_FILE_MONITOR_EVENT_CREATED && event != G_FILE_MONITOR_EVENT_DELETED)
+		return;
+
+	locale_path = g_file_get_path(file);
+	if (locale_path)
+		queue_change(locale_path, root);
+}
+
+
+/* Checks the mtimes of the directories without a monitor, a slice of them at a
+ * time. The changes are reported the same way as the monitor events. */
+static gboolean poll_dirs(gpointer user_data)
+{
+	gint64 start = g_get_monotonic_time();
+	GSList *elem;
+
+	/* the directory caches are in use by the scanners */
+	if (prjorg_project_is_scanning() || s_dir_scanner)
+		return TRUE;
+
+	foreach_slist(elem, prj_org->roots)
+	{
+		PrjOrgRoot *root = elem->data;
+		GPtrArray *changed_paths = g_ptr_array_new();
+		guint i;
+
+		for (i = 0; i < root->polled_dirs->len && g_get_monotonic_time() - start < POLL_TIME_BUDGET; i++)
+		{
+			prjorg_scanner_dir_cache_refresh(root->dir_cache,
+				root->polled_dirs->pdata[root->poll_pos], changed_paths);
+			root->poll_pos = (root->poll_pos + 1) % root->polled_dirs->len;
+		}
+
+		/* the pending changes take ownership of the paths */
+		for (i = 0; i < changed_paths->len; i++)
+			queue_change(changed_paths->pdata[i], root);
+		g_ptr_array_free(changed_paths, TRUE);
 	}
 
-	g_free(locale_filename);
+	return TRUE;
+}
+
+
+static void free_monitor(GFileMonitor *monitor)
+{
+	g_file_monitor_cancel(monitor);
+	g_object_unref(monitor);
+}
+
+
+typedef struct
+{
+	const gchar *locale_path;
+	guint depth;
+} DirDepth;
+
+
+static gint dir_depth_cmp(gconstpointer a, gconstpointer b)
+{
+	const DirDepth *d1 = a;
+	const DirDepth *d2 = b;
 
-	return ft;
+	return (gint)d1->depth - (gint)d2->depth;
 }
 
 
-static void regenerate_tags(PrjOrgRoot *root, gpointer user_data)
+static guint count_monitors(void)
+{
+	GSList *elem;
+	guint num = 0;
+
+	foreach_slist(elem, prj_org->roots)
+	{
+		PrjOrgRoot *root = elem->data;
+
+		num += g_hash_table_size(root->monitors);
+	}
+	return num;
+}
+
+
+/* Every scanned directory gets its own monitor because directory monitors
+ * aren't recursive. Directories over the MAX_MONITORS budget and those whose
+ * monitor can't be created are polled by poll_dirs() instead; the shallow ones
+ * are the most likely to be edited by hand so they get the monitors first. */
+static void update_monitors(PrjOrgRoot *root, gpointer user_data)
 {
 	GHashTableIter iter;
 	gpointer key, value;
-	GPtrArray *source_files;
-	GHashTable *file_table;
+	DirDepth *dirs;
+	guint num = 0, used, budget, i;
 
-	source_files = g_ptr_array_new();
-	file_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GFreeFunc)tm_source_file_free);
-	g_hash_table_iter_init(&iter, root->file_table);
+	g_hash_table_iter_init(&iter, root->monitors);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+	{
+		if (!g_hash_table_lookup(root->dir_cache, key))
+			g_hash_table_iter_remove(&iter);
+	}
+
+	dirs = g_new(DirDepth, g_hash_table_size(root->dir_cache) + 1);
+	g_hash_table_iter_init(&iter, root->dir_cache);
 	while (g_hash_table_iter_next(&iter, &key, &value))
 	{
-		TMSourceFile *sf;
-		gchar *utf8_path = key;
-		gchar *locale_path = utils_get_locale_from_utf8(utf8_path);
+		const gchar *locale_path = key;
+		const gchar *c;
 
-		sf = tm_source_file_new(locale_path, filetypes_detect(utf8_path)->name);
-		if (sf && !document_find_by_filename(utf8_path))
-			g_ptr_array_add(source_files, sf);
+		if (g_hash_table_lookup(root->monitors, locale_path))
+			continue;
 
-		g_hash_table_insert(file_table, g_strdup(utf8_path), sf);
-		g_free(locale_path);
+		dirs[num].locale_path = locale_path;
+		dirs[num].depth = 0;
+		for (c = locale_path; *c; c++)
+		{
+			if (G_IS_DIR_SEPARATOR(*c))
+				dirs[num].depth++;
+		}
+		num++;
 	}
-	g_hash_table_destroy(root->file_table);
-	root->file_table = file_table;
+	qsort(dirs, num, sizeof(DirDepth), dir_depth_cmp);
 
-	tm_workspace_add_source_files(source_files);
-	g_ptr_array_free(source_files, TRUE);
+	used = count_monitors();
+	budget = used < MAX_MONITORS ? MAX_MONITORS - used : 0;
+	g_ptr_array_set_size(root->polled_dirs, 0);
+	root->poll_pos = 0;
+
+	for (i = 0; i < num; i++)
+	{
+		GFileMonitor *monitor = NULL;
+
+		if (budget > 0)
+		{
+			GFile *file = g_file_new_for_path(dirs[i].locale_path);
+
+			monitor = g_file_monitor_directory(file, G_FILE_MONITOR_NONE, NULL, NULL);
+			g_object_unref(file);
+		}
+
+		if (monitor)
+		{
+			g_signal_connect(monitor, "changed", G_CALLBACK(on_dir_changed), root);
+			g_hash_table_insert(root->monitors, g_strdup(dirs[i].locale_path), monitor);
+			budget--;
+		}
+		else
+			g_ptr_array_add(root->polled_dirs, g_strdup(dirs[i].locale_path));
+	}
+	g_free(dirs);
+
+	if (root->polled_dirs->len > 0)
+	{
+		if (!s_polling_reported)
+		{
+			msgwin_status_add(_("Project Organizer: %u directories of %s can't be watched for changes, "
+				"they are checked periodically instead"), root->polled_dirs->len, root->base_dir);
+			s_polling_reported = TRUE;
+		}
+		if (!s_poll_id)
+			s_poll_id = plugin_timeout_add(geany_plugin, POLL_INTERVAL, poll_dirs, NULL);
+	}
 }
 
 
-void prjorg_project_rescan(void)
+/* The TMSourceFiles of the files still present in the project are moved to
+ * the new file tables so only the new files have to be parsed; the removed
+ * files are dropped from the workspace */
+static void on_scan_finished(gpointer user_data)
 {
+	GPtrArray *utf8_added, *utf8_removed;
 	GSList *elem;
-	gint filenum = 0;
+	guint i;
+
+	cancel_tag_generation();
+	clear_idle_queue(&s_idle_add_funcs);
+	clear_idle_queue(&s_idle_remove_funcs);
+
+	s_tags_generated = prj_org->generate_tag_prefs != PrjOrgTagNo;
+	utf8_added = g_ptr_array_new();
+	utf8_removed = g_ptr_array_new_with_free_func(g_free);
+
+	i = 0;
+	foreach_slist(elem, prj_org->roots)
+	{
+		PrjOrgRoot *root = elem->data;
+		GHashTable *file_table = s_scan_tables->pdata[i];
+		GPtrArray *source_files;
+		GHashTableIter iter;
+		gpointer key, value;
+
+		source_files = g_ptr_array_new();
+		g_hash_table_iter_init(&iter, root->file_table);
+		while (g_hash_table_iter_next(&iter, &key, &value))
+		{
+			gboolean found = g_hash_table_lookup_extended(file_table, key, NULL, NULL);
+
+			if (!found)
+				g_ptr_array_add(utf8_removed, g_strdup(key));
+
+			if (!value)
+				continue;
+
+			if (s_tags_generated && found)
+			{
+				g_hash_table_iter_steal(&iter);
+				/* keeps the key already in the table and frees the stolen one */
+				g_hash_table_insert(file_table, key, value);
+			}
+			else
+				g_ptr_array_add(source_files, value);
+		}
+		if (source_files->len > 0)
+		{
+			tm_workspace_remove_source_files(source_files);
+			prjorg_tag_index_invalidate();
+		}
+		g_ptr_array_free(source_files, TRUE);
+		g_hash_table_destroy(root->file_table);
+
+		root->file_table = file_table;
+		g_hash_table_destroy(root->dir_cache);
+		root->dir_cache = prjorg_scanner_steal_dir_cache(s_scanner, i);
+
+		i++;
+	}
+
+	prjorg_scanner_free(s_scanner);
+	s_scanner = NULL;
+	/* the tables are owned by the roots now */
+	g_ptr_array_set_free_func(s_scan_tables, NULL);
+	g_ptr_array_free(s_scan_tables, TRUE);
+	s_scan_tables = NULL;
+
+	if (s_tags_generated)
+		regenerate_tags();
+
+	g_slist_foreach(prj_org->roots, (GFunc)update_monitors, NULL);
+
+	/* the found files are in the sidebar already */
+	if (utf8_removed->len > 0)
+		prjorg_sidebar_update_files(utf8_added, utf8_removed);
+
+	g_ptr_array_free(utf8_added, TRUE);
+	g_ptr_array_free(utf8_removed, TRUE);
+}
+
+
+/* The directories are scanned by worker threads and the found files are merged
+ * into new file tables on the main thread. New files are added to the current
+ * file tables and the sidebar as they are found; when the scan finishes, the
+ * tables are swapped, which drops the files not found anymore. */
+void prjorg_project_rescan(void)
+{
+	GSList *pattern_list = NULL;
+	GSList *ignored_dirs_list = NULL;
+	GSList *ignored_file_list = NULL;
+	GSList *elem = NULL;
 
 	if (!prj_org)
 		return;
 
-	clear_idle_queue(&s_idle_add_funcs);
-	clear_idle_queue(&s_idle_remove_funcs);
+	cancel_scan();
+
+	pattern_list = get_precompiled_file_patterns();
+	ignored_dirs_list = get_precompiled_patterns(prj_org->ignored_dirs_patterns);
+	ignored_file_list = get_precompiled_patterns(prj_org->ignored_file_patterns);
+
+	s_scanner = prjorg_scanner_new(pattern_list, ignored_dirs_list, ignored_file_list,
+		on_scan_batch, on_scan_finished, NULL);
+	s_scan_tables = g_ptr_array_new_with_free_func((GDestroyNotify)g_hash_table_destroy);
 
 	foreach_slist(elem, prj_org->roots)
-		filenum += prjorg_project_rescan_root(elem->data);
+	{
+		PrjOrgRoot *root = elem->data;
 
-	if (prj_org->generate_tag_prefs == PrjOrgTagYes || (prj_org->generate_tag_prefs == PrjOrgTagAuto && filenum < 300))
-		g_slist_foreach(prj_org->roots, (GFunc)regenerate_tags, NULL);
+		prjorg_scanner_add_root(s_scanner, root->base_dir, root->dir_cache);
+		g_ptr_array_add(s_scan_tables,
+			g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GFreeFunc)tm_source_file_free));
+	}
+
+	prjorg_scanner_start(s_scanner);
+}
+
+
+gboolean prjorg_project_is_scanning(void)
+{
+	return s_scanner != NULL;
 }
 
 
@@ -378,10 +1111,19 @@ static PrjOrgRoot *create_root(const gchar *utf8_base_dir)
 	PrjOrgRoot *root = (PrjOrgRoot *) g_new0(PrjOrgRoot, 1);
 	root->base_dir = g_strdup(utf8_base_dir);
 	root->file_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GFreeFunc)tm_source_file_free);
+	root->dir_cache = prjorg_scanner_dir_cache_new();
+	root->monitors = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)free_monitor);
+	root->polled_dirs = g_ptr_array_new_with_free_func(g_free);
 	return root;
 }
 
 
+static gboolean is_pending_in_root(gchar *locale_path, PrjOrgRoot *pending_root, PrjOrgRoot *root)
+{
+	return pending_root == root;
+}
+
+
 static void close_root(PrjOrgRoot *root, gpointer user_data)
 {
 	GPtrArray *source_files;
@@ -390,8 +1132,15 @@ static void close_root(PrjOrgRoot *root, gpointer user_data)
 	g_hash_table_foreach(root->file_table, (GHFunc)collect_source_files, source_files);
 	tm_workspace_remove_source_files(source_files);
 	g_ptr_array_free(source_files, TRUE);
+	prjorg_tag_index_invalidate();
+
+	if (s_pending_changes)
+		g_hash_table_foreach_remove(s_pending_changes, (GHRFunc)is_pending_in_root, root);
 
+	g_hash_table_destroy(root->monitors);
+	g_ptr_array_free(root->polled_dirs, TRUE);
 	g_hash_table_destroy(root->file_table);
+	g_hash_table_destroy(root->dir_cache);
 	g_free(root->base_dir);
 	g_free(root);
 }
@@ -444,6 +1193,7 @@ void prjorg_project_remove_external_dir(const gchar *utf8_dirname)
 	{
 		PrjOrgRoot *found_root = found->data;
 
+		cancel_scan();
 		prj_org->roots = g_slist_remove(prj_org->roots, found_root);
 		close_root(found_root, NULL);
 		prjorg_project_rescan();
@@ -452,12 +1202,173 @@ void prjorg_project_remove_external_dir(const gchar *utf8_dirname)
 }
 
 
+static gchar *get_patterns_key(gchar **ignored_dirs_patterns, gchar **ignored_file_patterns)
+{
+	gchar **file_patterns = geany_data->app->project->file_patterns;
+	gchar *file_str, *dirs_str, *ignored_file_str, *key;
+
+	file_str = file_patterns ? g_strjoinv(" ", file_patterns) : g_strdup("");
+	dirs_str = g_strjoinv(" ", ignored_dirs_patterns);
+	ignored_file_str = g_strjoinv(" ", ignored_file_patterns);
+	key = g_strjoin("\n", file_str, dirs_str, ignored_file_str, NULL);
+
+	g_free(file_str);
+	g_free(dirs_str);
+	g_free(ignored_file_str);
+	return key;
+}
+
+
+/* The cache contains the file list and the directory listings of every root so
+ * the project tree can be displayed right after opening the project and the
+ * first scan only has to re-read directories modified since the last session */
+static void save_cache(void)
+{
+	GSList *elem = NULL;
+	GString *buf;
+	gchar *key;
+
+	if (!s_cache_file)
+		return;
+
+	buf = g_string_new(NULL);
+	key = get_patterns_key(prj_org->ignored_dirs_patterns, prj_org->ignored_file_patterns);
+	cache_write_string(buf, CACHE_MAGIC);
+	cache_write_int(buf, CACHE_VERSION);
+	cache_write_string(buf, key);
+	cache_write_int(buf, g_slist_length(prj_org->roots));
+
+	foreach_slist (elem, prj_org->roots)
+	{
+		PrjOrgRoot *root = elem->data;
+		GHashTableIter iter;
+		gpointer k, v;
+
+		cache_write_string(buf, root->base_dir);
+		cache_write_int(buf, g_hash_table_size(root->file_table));
+		g_hash_table_iter_init(&iter, root->file_table);
+		while (g_hash_table_iter_next(&iter, &k, &v))
+			cache_write_string(buf, k);
+		prjorg_scanner_dir_cache_save(root->dir_cache, buf);
+	}
+
+	g_file_set_contents(s_cache_file, buf->str, buf->len, NULL);
+
+	g_string_free(buf, TRUE);
+	g_free(key);
+}
+
+
+static PrjOrgRoot *find_root(const gchar *utf8_base_dir)
+{
+	GSList *elem = NULL;
+
+	foreach_slist (elem, prj_org->roots)
+	{
+		PrjOrgRoot *root = elem->data;
+
+		if (g_strcmp0(root->base_dir, utf8_base_dir) == 0)
+			return root;
+	}
+	return NULL;
+}
+
+
+static gboolean load_cache_root(const gchar **pos, const gchar *end, gboolean files_valid)
+{
+	const gchar *utf8_base_dir = cache_read_string(pos, end);
+	GHashTable *file_table, *dir_cache;
+	PrjOrgRoot *root;
+	gint64 num, i;
+
+	if (!utf8_base_dir || !cache_read_int(pos, end, &num))
+		return FALSE;
+
+	file_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GFreeFunc)tm_source_file_free);
+	for (i = 0; i < num; i++)
+	{
+		const gchar *utf8_path = cache_read_string(pos, end);
+
+		if (!utf8_path)
+		{
+			g_hash_table_destroy(file_table);
+			return FALSE;
+		}
+		g_hash_table_insert(file_table, g_strdup(utf8_path), NULL);
+	}
+
+	dir_cache = prjorg_scanner_dir_cache_new();
+	if (!prjorg_scanner_dir_cache_load(dir_cache, pos, end))
+	{
+		g_hash_table_destroy(file_table);
+		g_hash_table_destroy(dir_cache);
+		return FALSE;
+	}
+
+	/* the root might have been removed from the project since */
+	root = find_root(utf8_base_dir);
+	if (root)
+	{
+		g_hash_table_destroy(root->dir_cache);
+		root->dir_cache = dir_cache;
+		dir_cache = NULL;
+
+		/* the directory listings don't depend on the patterns, the file list does */
+		if (files_valid)
+		{
+			g_hash_table_destroy(root->file_table);
+			root->file_table = file_table;
+			file_table = NULL;
+		}
+	}
+
+	if (file_table)
+		g_hash_table_destroy(file_table);
+	if (dir_cache)
+		g_hash_table_destroy(dir_cache);
+	return TRUE;
+}
+
+
+static void load_cache(gchar **ignored_dirs_patterns, gchar **ignored_file_patterns)
+{
+	const gchar *pos, *end, *magic, *cached_key;
+	gint64 version, num, i;
+	GMappedFile *map;
+	gchar *key;
+
+	map = g_mapped_file_new(s_cache_file, FALSE, NULL);
+	if (!map)
+		return;
+
+	pos = g_mapped_file_get_contents(map);
+	end = pos + g_mapped_file_get_length(map);
+
+	magic = cache_read_string(&pos, end);
+	if (g_strcmp0(magic, CACHE_MAGIC) == 0 &&
+		cache_read_int(&pos, end, &version) && version == CACHE_VERSION &&
+		(cached_key = cache_read_string(&pos, end)) != NULL &&
+		cache_read_int(&pos, end, &num))
+	{
+		key = get_patterns_key(ignored_dirs_patterns, ignored_file_patterns);
+		for (i = 0; i < num; i++)
+		{
+			if (!load_cache_root(&pos, end, g_strcmp0(key, cached_key) == 0))
+				break;
+		}
+		g_free(key);
+	}
+
+	g_mapped_file_unref(map);
+}
+
+
 void prjorg_project_open(GKeyFile * key_file)
 {
 	gchar **source_patterns, **header_patterns, **ignored_dirs_patterns, **ignored_file_patterns, **external_dirs, **dir_ptr, *last_name;
 	gint generate_tag_prefs;
 	GSList *elem = NULL, *ext_list = NULL;
-	gchar *utf8_base_path;
+	gchar *utf8_base_path, *utf8_cache_file;
 
 	if (prj_org != NULL)
 		prjorg_project_close();
@@ -502,6 +1413,11 @@ void prjorg_project_open(GKeyFile * key_file)
 	prj_org->roots = g_slist_prepend(prj_org->roots, create_root(utf8_base_path));
 	g_free(utf8_base_path);
 
+	utf8_cache_file = g_strconcat(geany_data->app->project->file_name, ".prjorg-cache", NULL);
+	s_cache_file = utils_get_locale_from_utf8(utf8_cache_file);
+	g_free(utf8_cache_file);
+	load_cache(ignored_dirs_patterns, ignored_file_patterns);
+
 	update_project(
 		source_patterns,
 		header_patterns,
@@ -621,7 +1537,7 @@ GtkWidget *prjorg_project_add_properties_tab(GtkWidget *notebook)
 	label = gtk_label_new(_("Index all project files:"));
 	gtk_misc_set_alignment(GTK_MISC(label), 0, 0);
 	e->generate_tag_prefs = gtk_combo_box_text_new();
-	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(e->generate_tag_prefs), _("Auto (index if less than 300 files)"));
+	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(e->generate_tag_prefs), _("Auto"));
 	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(e->generate_tag_prefs), _("Yes"));
 	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(e->generate_tag_prefs), _("No"));
 	gtk_combo_box_set_active(GTK_COMBO_BOX(e->generate_tag_prefs), prj_org->generate_tag_prefs);
@@ -656,11 +1572,29 @@ void prjorg_project_close(void)
 	if (!prj_org)
 		return;  /* can happen on plugin reload */
 
+	cancel_scan();
 	clear_idle_queue(&s_idle_add_funcs);
 	clear_idle_queue(&s_idle_remove_funcs);
 
+	save_cache();
+	g_free(s_cache_file);
+	s_cache_file = NULL;
+
 	g_slist_foreach(prj_org->roots, (GFunc)close_root, NULL);
 	g_slist_free(prj_org->roots);
+	prjorg_tag_index_clear();
+
+	if (s_flush_changes_id)
+		g_source_remove(s_flush_changes_id);
+	s_flush_changes_id = 0;
+	if (s_pending_changes)
+		g_hash_table_destroy(s_pending_changes);
+	s_pending_changes = NULL;
+
+	if (s_poll_id)
+		g_source_remove(s_poll_id);
+	s_poll_id = 0;
+	s_polling_reported = FALSE;
 
 	g_strfreev(prj_org->source_patterns);
 	g_strfreev(prj_org->header_patterns);
@@ -710,6 +1644,7 @@ static gboolean add_tm_idle(gpointer foo)
 			if (sf != NULL && !document_find_by_filename(utf8_fname))
 			{
 				tm_workspace_add_source_file(sf);
+				prjorg_tag_index_invalidate();
 				break;  /* single file representation in TM is enough */
 			}
 		}
@@ -755,7 +1690,10 @@ static gboolean remove_tm_idle(gpointer foo)
 			TMSourceFile *sf = g_hash_table_lookup(root->file_table, utf8_fname);
 
 			if (sf != NULL)
+			{
 				tm_workspace_remove_source_file(sf);
+				prjorg_tag_index_invalidate();
+			}
 		}
 	}
 
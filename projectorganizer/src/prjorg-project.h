@@ -23,6 +23,10 @@ typedef struct
 {
 	gchar *base_dir;
 	GHashTable *file_table; /* contains all file names within base_dir, maps file_name->TMSourceFile */
+	GHashTable *dir_cache; /* directory listings from the last scan, see prjorg-scanner.c */
+	GHashTable *monitors; /* maps locale directory path->GFileMonitor for the directories in dir_cache */
+	GPtrArray *polled_dirs; /* locale paths of the directories in dir_cache without a monitor */
+	guint poll_pos; /* index of the next directory in polled_dirs to check */
 } PrjOrgRoot;
 
 typedef enum
@@ -54,6 +58,7 @@ void prjorg_project_close(void);
 void prjorg_project_save(GKeyFile * key_file);
 void prjorg_project_read_properties_tab(void);
 void prjorg_project_rescan(void);
+gboolean prjorg_project_is_scanning(void);
 
 void prjorg_project_add_external_dir(const gchar *utf8_dirname);
 void prjorg_project_remove_external_dir(const gchar *utf8_dirname);
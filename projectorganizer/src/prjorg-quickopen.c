@@ -0,0 +1,469 @@
+/*
+ * Copyright 2010 Jiri Techet <techet@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <gdk/gdkkeysyms.h>
+
+#ifdef HAVE_CONFIG_H
+	#include "config.h"
+#endif
+#include <geanyplugin.h>
+#include <gtkcompat.h>
+
+#include "prjorg-utils.h"
+#include "prjorg-project.h"
+#include "prjorg-quickopen.h"
+
+/* number of best matches displayed in the list */
+#define QUICK_OPEN_MAX_RESULTS 200
+
+extern GeanyPlugin *geany_plugin;
+extern GeanyData *geany_data;
+
+enum
+{
+	QO_COLUMN_NAME,
+	QO_COLUMN_DIR,
+	QO_COLUMN_PATH,
+	QO_N_COLUMNS
+};
+
+typedef struct
+{
+	const gchar *path;  /* utf8 full path */
+	const gchar *lower;  /* lower-cased displayed (relative) path */
+	guint name_offset;  /* offset of the file name within lower */
+} QuickOpenFile;
+
+typedef struct
+{
+	guint file;
+	gint score;
+} QuickOpenMatch;
+
+
+static struct
+{
+	GtkWidget *widget;
+	GtkWidget *entry;
+	GtkWidget *view;
+	GtkListStore *store;
+} s_qo_dialog = {NULL, NULL, NULL, NULL};
+
+/* all project files, rebuilt every time the dialog is shown */
+static GStringChunk *s_chunk = NULL;
+static GArray *s_files = NULL;
+
+/* files matching s_query; when the query is extended, only these have to be checked */
+static gchar *s_query = NULL;
+static GArray *s_matches = NULL;
+
+
+static void index_clear(void)
+{
+	if (s_chunk)
+		g_string_chunk_free(s_chunk);
+	s_chunk = NULL;
+	if (s_files)
+		g_array_free(s_files, TRUE);
+	s_files = NULL;
+	if (s_matches)
+		g_array_free(s_matches, TRUE);
+	s_matches = NULL;
+	g_free(s_query);
+	s_query = NULL;
+}
+
+
+static void index_build(void)
+{
+	GSList *elem = NULL;
+	gboolean is_project_root = TRUE;
+
+	index_clear();
+	s_chunk = g_string_chunk_new(64 * 1024);
+	s_files = g_array_new(FALSE, FALSE, sizeof(QuickOpenFile));
+
+	foreach_slist (elem, prj_org->roots)
+	{
+		PrjOrgRoot *root = elem->data;
+		GHashTableIter iter;
+		gpointer key, value;
+		gsize offset;
+
+		/* files of external directories are displayed with the directory name */
+		if (is_project_root)
+			offset = strlen(root->base_dir) + 1;
+		else
+		{
+			gchar *parent = g_path_get_dirname(root->base_dir);
+			offset = strlen(parent) + 1;
+			g_free(parent);
+		}
+		is_project_root = FALSE;
+
+		g_hash_table_iter_init(&iter, root->file_table);
+		while (g_hash_table_iter_next(&iter, &key, &value))
+		{
+			const gchar *path = key;
+			QuickOpenFile file;
+			gchar *lower, *sep;
+
+			if (strlen(path) < offset)
+				continue;
+
+			lower = g_utf8_strdown(path + offset, -1);
+			sep = strrchr(lower, G_DIR_SEPARATOR);
+			file.path = g_string_chunk_insert(s_chunk, path);
+			file.lower = g_string_chunk_insert(s_chunk, lower);
+			file.name_offset = sep ? sep - lower + 1 : 0;
+			g_array_append_val(s_files, file);
+			g_free(lower);
+		}
+	}
+}
+
+
+/* Scores the positions where the characters of query appear in str (in order);
+ * returns -1 if they don't appear. */
+static gint match_score(const gchar *query, const gchar *str)
+{
+	const gchar *s = str;
+	const gchar *prev = NULL;
+	gint score = 0;
+
+	for (; *query; query++)
+	{
+		const gchar *found = strchr(s, *query);
+
+		if (!found)
+			return -1;
+
+		if (found == str || strchr("/\\_-. ", found[-1]))
+			score += 8;  /* start of a word */
+		if (prev && found == prev + 1)
+			score += 5;  /* consecutive characters */
+		else if (prev)
+			score -= MIN(found - prev - 1, 5);  /* gap */
+		score += 1;
+
+		prev = found;
+		s = found + 1;
+	}
+	return score;
+}
+
+
+static gint file_score(const QuickOpenFile *file, const gchar *query)
+{
+	gint score;
+
+	/* prefer matches in the file name over matches in the directories */
+	score = match_score(query, file->lower + file->name_offset);
+	if (score >= 0)
+		score += 100;
+	else
+	{
+		score = match_score(query, file->lower);
+		if (score < 0)
+			return -1;
+	}
+
+	return score - (gint)strlen(file->lower) / 16;
+}
+
+
+static gint match_cmp(gconstpointer a, gconstpointer b)
+{
+	const QuickOpenMatch *m1 = a;
+	const QuickOpenMatch *m2 = b;
+
+	if (m1->score != m2->score)
+		return m2->score - m1->score;
+	return strcmp(g_array_index(s_files, QuickOpenFile, m1->file).lower,
+		g_array_index(s_files, QuickOpenFile, m2->file).lower);
+}
+
+
+static void filter(const gchar *utf8_text)
+{
+	GArray *matches;
+	gchar *query, *lower, *c;
+	guint i, num;
+
+	/* spaces are ignored so "prj side" finds prjorg-sidebar.c */
+	lower = g_utf8_strdown(utf8_text, -1);
+	query = g_strdup(lower);
+	for (c = lower, num = 0; *c; c++)
+	{
+		if (*c != ' ')
+			query[num++] = *c;
+	}
+	query[num] = '\0';
+	g_free(lower);
+
+	matches = g_array_new(FALSE, FALSE, sizeof(QuickOpenMatch));
+	if (s_matches && s_query && g_str_has_prefix(query, s_query))
+	{
+		/* files not matching the shorter query cannot match the longer one */
+		for (i = 0; i < s_matches->len; i++)
+		{
+			QuickOpenMatch m = {g_array_index(s_matches, QuickOpenMatch, i).file, 0};
+
+			m.score = file_score(&g_array_index(s_files, QuickOpenFile, m.file), query);
+			if (m.score >= 0)
+				g_array_append_val(matches, m);
+		}
+	}
+	else
+	{
+		for (i = 0; i < s_files->len; i++)
+		{
+			QuickOpenMatch m = {i, 0};
+
+			m.score = file_score(&g_array_index(s_files, QuickOpenFile, i), query);
+			if (m.score >= 0)
+				g_array_append_val(matches, m);
+		}
+	}
+	g_array_sort(matches, match_cmp);
+
+	if (s_matches)
+		g_array_free(s_matches, TRUE);
+	s_matches = matches;
+	SETPTR(s_query, query);
+}
+
+
+static void update_list(void)
+{
+	GtkTreeIter iter;
+	guint i;
+
+	filter(gtk_entry_get_text(GTK_ENTRY(s_qo_dialog.entry)));
+
+	gtk_list_store_clear(s_qo_dialog.store);
+	for (i = 0; i < s_matches->len && i < QUICK_OPEN_MAX_RESULTS; i++)
+	{
+		QuickOpenFile *file = &g_array_index(s_files, QuickOpenFile, g_array_index(s_matches, QuickOpenMatch, i).file);
+		gchar *name = g_path_get_basename(file->path);
+		gchar *dir = g_path_get_dirname(file->path);
+
+		gtk_list_store_insert_with_values(s_qo_dialog.store, &iter, -1,
+			QO_COLUMN_NAME, name, QO_COLUMN_DIR, dir, QO_COLUMN_PATH, file->path, -1);
+		g_free(name);
+		g_free(dir);
+	}
+
+	if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(s_qo_dialog.store), &iter))
+	{
+		GtkTreePath *path = gtk_tree_model_get_path(GTK_TREE_MODEL(s_qo_dialog.store), &iter);
+
+		gtk_tree_view_set_cursor(GTK_TREE_VIEW(s_qo_dialog.view), path, NULL, FALSE);
+		gtk_tree_path_free(path);
+	}
+}
+
+
+static void open_selected(void)
+{
+	GtkTreeSelection *selection;
+	GtkTreeModel *model;
+	GtkTreeIter iter;
+	gchar *utf8_path;
+
+	selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(s_qo_dialog.view));
+	if (!gtk_tree_selection_get_selected(selection, &model, &iter))
+		return;
+
+	gtk_tree_model_get(model, &iter, QO_COLUMN_PATH, &utf8_path, -1);
+	prjorg_quick_open_hide();
+	open_file(utf8_path);
+	g_free(utf8_path);
+}
+
+
+static void move_cursor(gint step)
+{
+	GtkTreeModel *model = GTK_TREE_MODEL(s_qo_dialog.store);
+	GtkTreePath *path;
+	gint num, row = 0;
+
+	num = gtk_tree_model_iter_n_children(model, NULL);
+	if (num == 0)
+		return;
+
+	gtk_tree_view_get_cursor(GTK_TREE_VIEW(s_qo_dialog.view), &path, NULL);
+	if (path)
+	{
+		row = gtk_tree_path_get_indices(path)[0];
+		gtk_tree_path_free(path);
+	}
+	row = CLAMP(row + step, 0, num - 1);
+
+	path = gtk_tree_path_new_from_indices(row, -1);
+	gtk_tree_view_set_cursor(GTK_TREE_VIEW(s_qo_dialog.view), path, NULL, FALSE);
+	gtk_tree_path_free(path);
+}
+
+
+static gboolean on_entry_key_press(G_GNUC_UNUSED GtkWidget *widget, GdkEventKey *event,
+	G_GNUC_UNUSED gpointer user_data)
+{
+	switch (event->keyval)
+	{
+		case GDK_Escape:
+			prjorg_quick_open_hide();
+			return TRUE;
+		case GDK_Return:
+		case GDK_ISO_Enter:
+		case GDK_KP_Enter:
+			open_selected();
+			return TRUE;
+		case GDK_Up:
+		case GDK_KP_Up:
+			move_cursor(-1);
+			return TRUE;
+		case GDK_Down:
+		case GDK_KP_Down:
+			move_cursor(1);
+			return TRUE;
+		case GDK_Page_Up:
+		case GDK_KP_Page_Up:
+			move_cursor(-10);
+			return TRUE;
+		case GDK_Page_Down:
+		case GDK_KP_Page_Down:
+			move_cursor(10);
+			return TRUE;
+	}
+	return FALSE;
+}
+
+
+static void on_entry_changed(G_GNUC_UNUSED GtkEditable *editable, G_GNUC_UNUSED gpointer user_data)
+{
+	update_list();
+}
+
+
+static void on_row_activated(G_GNUC_UNUSED GtkTreeView *view, G_GNUC_UNUSED GtkTreePath *path,
+	G_GNUC_UNUSED GtkTreeViewColumn *column, G_GNUC_UNUSED gpointer user_data)
+{
+	open_selected();
+}
+
+
+static gboolean on_delete_event(G_GNUC_UNUSED GtkWidget *widget, G_GNUC_UNUSED GdkEvent *event,
+	G_GNUC_UNUSED gpointer user_data)
+{
+	prjorg_quick_open_hide();
+	return TRUE;
+}
+
+
+static void create_dialog(void)
+{
+	GtkWidget *vbox, *swin;
+	GtkCellRenderer *renderer;
+	GtkTreeViewColumn *column;
+
+	s_qo_dialog.widget = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+	gtk_window_set_title(GTK_WINDOW(s_qo_dialog.widget), _("Quick Open"));
+	gtk_window_set_transient_for(GTK_WINDOW(s_qo_dialog.widget), GTK_WINDOW(geany->main_widgets->window));
+	gtk_window_set_destroy_with_parent(GTK_WINDOW(s_qo_dialog.widget), TRUE);
+	gtk_window_set_position(GTK_WINDOW(s_qo_dialog.widget), GTK_WIN_POS_CENTER_ON_PARENT);
+	gtk_window_set_type_hint(GTK_WINDOW(s_qo_dialog.widget), GDK_WINDOW_TYPE_HINT_DIALOG);
+	gtk_window_set_default_size(GTK_WINDOW(s_qo_dialog.widget), 500, 400);
+	g_signal_connect(s_qo_dialog.widget, "delete-event", G_CALLBACK(on_delete_event), NULL);
+
+	vbox = gtk_vbox_new(FALSE, 6);
+	gtk_container_set_border_width(GTK_CONTAINER(vbox), 6);
+	gtk_container_add(GTK_CONTAINER(s_qo_dialog.widget), vbox);
+
+	s_qo_dialog.entry = gtk_entry_new();
+	ui_entry_add_clear_icon(GTK_ENTRY(s_qo_dialog.entry));
+	g_signal_connect(s_qo_dialog.entry, "changed", G_CALLBACK(on_entry_changed), NULL);
+	g_signal_connect(s_qo_dialog.entry, "key-press-event", G_CALLBACK(on_entry_key_press), NULL);
+	gtk_box_pack_start(GTK_BOX(vbox), s_qo_dialog.entry, FALSE, FALSE, 0);
+
+	s_qo_dialog.store = gtk_list_store_new(QO_N_COLUMNS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+	s_qo_dialog.view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(s_qo_dialog.store));
+	g_object_unref(s_qo_dialog.store);
+	gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(s_qo_dialog.view), FALSE);
+	gtk_widget_set_can_focus(s_qo_dialog.view, FALSE);
+	g_signal_connect(s_qo_dialog.view, "row-activated", G_CALLBACK(on_row_activated), NULL);
+
+	renderer = gtk_cell_renderer_text_new();
+	column = gtk_tree_view_column_new_with_attributes(NULL, renderer, "text", QO_COLUMN_NAME, NULL);
+	gtk_tree_view_append_column(GTK_TREE_VIEW(s_qo_dialog.view), column);
+
+	renderer = gtk_cell_renderer_text_new();
+	g_object_set(renderer, "ellipsize", PANGO_ELLIPSIZE_START, "foreground", "gray", NULL);
+	column = gtk_tree_view_column_new_with_attributes(NULL, renderer, "text", QO_COLUMN_DIR, NULL);
+	gtk_tree_view_column_set_expand(column, TRUE);
+	gtk_tree_view_append_column(GTK_TREE_VIEW(s_qo_dialog.view), column);
+
+	swin = gtk_scrolled_window_new(NULL, NULL);
+	gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(swin), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+	gtk_scrolled_window_set_shadow_type(GTK_SCROLLED_WINDOW(swin), GTK_SHADOW_IN);
+	gtk_container_add(GTK_CONTAINER(swin), s_qo_dialog.view);
+	gtk_box_pack_start(GTK_BOX(vbox), swin, TRUE, TRUE, 0);
+
+	gtk_widget_show_all(vbox);
+}
+
+
+void prjorg_quick_open_show(void)
+{
+	if (!prj_org)
+		return;
+
+	if (!s_qo_dialog.widget)
+		create_dialog();
+
+	index_build();
+
+	g_signal_handlers_block_by_func(s_qo_dialog.entry, on_entry_changed, NULL);
+	gtk_entry_set_text(GTK_ENTRY(s_qo_dialog.entry), "");
+	g_signal_handlers_unblock_by_func(s_qo_dialog.entry, on_entry_changed, NULL);
+	update_list();
+
+	gtk_window_present(GTK_WINDOW(s_qo_dialog.widget));
+	gtk_widget_grab_focus(s_qo_dialog.entry);
+}
+
+
+void prjorg_quick_open_hide(void)
+{
+	if (s_qo_dialog.widget)
+	{
+		gtk_widget_hide(s_qo_dialog.widget);
+		gtk_list_store_clear(s_qo_dialog.store);
+	}
+	index_clear();
+}
+
+
+void prjorg_quick_open_cleanup(void)
+{
+	index_clear();
+	if (s_qo_dialog.widget)
+		gtk_widget_destroy(s_qo_dialog.widget);
+	memset(&s_qo_dialog, 0, sizeof(s_qo_dialog));
+}
@@ -0,0 +1,613 @@
+/*
+ * Copyright 2010 Jiri Techet <techet@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <glib/gstdio.h>
+
+#ifdef HAVE_CONFIG_H
+	#include "config.h"
+#endif
+#include <geanyplugin.h>
+
+#ifndef G_OS_WIN32
+	#include <dirent.h>
+#endif
+
+#include "prjorg-utils.h"
+#include "prjorg-scanner.h"
+
+#define SCANNER_THREADS 4
+/* how often (in ms) found files are handed over to the main thread */
+#define SCANNER_BATCH_INTERVAL 100
+
+extern GeanyPlugin *geany_plugin;
+
+typedef struct
+{
+	gint refcount;
+	time_t mtime;
+	time_t read_time;
+	GPtrArray *file_names;	/* utf8 names of regular files */
+	GPtrArray *dir_names;	/* locale names of subdirectories */
+} DirEntry;
+
+typedef struct
+{
+	gchar *utf8_base_dir;
+	GHashTable *old_cache;	/* read-only while the scan runs */
+	GHashTable *new_cache;	/* the rest is protected by PrjOrgScanner->lock */
+	GHashTable *visited_paths;
+	GPtrArray *pending;
+} ScanRoot;
+
+typedef struct
+{
+	ScanRoot *root;
+	gchar *locale_path;
+	gchar *utf8_path;
+} ScanJob;
+
+/* The scanner is freed by whoever drops the last reference - the owner or the
+ * last job still running after the scan was cancelled */
+struct PrjOrgScanner
+{
+	gint refcount;	/* atomic, one for the owner and one per queued or running job */
+
+	GSList *patterns;
+	GSList *ignored_dirs_patterns;
+	GSList *ignored_file_patterns;
+
+	PrjOrgScanBatchFunc batch_func;
+	PrjOrgScanFinishedFunc finished_func;
+	gpointer user_data;
+
+	GPtrArray *roots;
+	GThreadPool *pool;
+	GMutex lock;
+	gboolean cancelled;
+	gint outstanding;	/* number of queued or running jobs, atomic */
+	guint timeout_id;
+};
+
+
+static DirEntry *dir_entry_new(void)
+{
+	DirEntry *entry = g_new0(DirEntry, 1);
+
+	entry->refcount = 1;
+	entry->file_names = g_ptr_array_new_with_free_func(g_free);
+	entry->dir_names = g_ptr_array_new_with_free_func(g_free);
+	return entry;
+}
+
+
+static void dir_entry_unref(DirEntry *entry)
+{
+	if (g_atomic_int_dec_and_test(&entry->refcount))
+	{
+		g_ptr_array_free(entry->file_names, TRUE);
+		g_ptr_array_free(entry->dir_names, TRUE);
+		g_free(entry);
+	}
+}
+
+
+/* maps locale directory path -> DirEntry */
+GHashTable *prjorg_scanner_dir_cache_new(void)
+{
+	return g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)dir_entry_unref);
+}
+
+
+void prjorg_scanner_dir_cache_save(GHashTable *dir_cache, GString *buf)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	cache_write_int(buf, g_hash_table_size(dir_cache));
+
+	g_hash_table_iter_init(&iter, dir_cache);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+	{
+		DirEntry *entry = value;
+		guint i;
+
+		cache_write_string(buf, key);
+		cache_write_int(buf, entry->mtime);
+		cache_write_int(buf, entry->read_time);
+		cache_write_int(buf, entry->file_names->len);
+		for (i = 0; i < entry->file_names->len; i++)
+			cache_write_string(buf, entry->file_names->pdata[i]);
+		cache_write_int(buf, entry->dir_names->len);
+		for (i = 0; i < entry->dir_names->len; i++)
+			cache_write_string(buf, entry->dir_names->pdata[i]);
+	}
+}
+
+
+static gboolean read_names(GPtrArray *names, const gchar **pos, const gchar *end)
+{
+	gint64 num, i;
+
+	if (!cache_read_int(pos, end, &num))
+		return FALSE;
+
+	for (i = 0; i < num; i++)
+	{
+		const gchar *name = cache_read_string(pos, end);
+
+		if (!name)
+			return FALSE;
+		g_ptr_array_add(names, g_strdup(name));
+	}
+
+	return TRUE;
+}
+
+
+/* Reads the listings written by prjorg_scanner_dir_cache_save() into dir_cache
+ * and advances pos behind them */
+gboolean prjorg_scanner_dir_cache_load(GHashTable *dir_cache, const gchar **pos, const gchar *end)
+{
+	gint64 num, i;
+
+	if (!cache_read_int(pos, end, &num))
+		return FALSE;
+
+	for (i = 0; i < num; i++)
+	{
+		const gchar *locale_path = cache_read_string(pos, end);
+		DirEntry *entry = dir_entry_new();
+		gint64 mtime, read_time;
+
+		if (!locale_path || !cache_read_int(pos, end, &mtime) || !cache_read_int(pos, end, &read_time) ||
+			!read_names(entry->file_names, pos, end) || !read_names(entry->dir_names, pos, end))
+		{
+			dir_entry_unref(entry);
+			return FALSE;
+		}
+
+		entry->mtime = mtime;
+		entry->read_time = read_time;
+		g_hash_table_insert(dir_cache, g_strdup(locale_path), entry);
+	}
+
+	return TRUE;
+}
+
+
+#ifdef G_OS_WIN32
+static void read_directory(const gchar *locale_path, DirEntry *entry)
+{
+	GDir *dir = g_dir_open(locale_path, 0, NULL);
+	const gchar *locale_name;
+
+	if (!dir)
+		return;
+
+	while ((locale_name = g_dir_read_name(dir)) != NULL)
+	{
+		gchar *locale_filename = g_build_filename(locale_path, locale_name, NULL);
+
+		if (g_file_test(locale_filename, G_FILE_TEST_IS_DIR))
+			g_ptr_array_add(entry->dir_names, g_strdup(locale_name));
+		else if (g_file_test(locale_filename, G_FILE_TEST_IS_REGULAR))
+			g_ptr_array_add(entry->file_names, utils_get_utf8_from_locale(locale_name));
+		g_free(locale_filename);
+	}
+
+	g_dir_close(dir);
+}
+#else
+/* Single readdir() pass; the entry type is taken from d_type and stat() is
+ * only needed for symlinks and file systems which don't fill d_type in. */
+static void read_directory(const gchar *locale_path, DirEntry *entry)
+{
+	DIR *dir = opendir(locale_path);
+	struct dirent *dirent;
+
+	if (!dir)
+		return;
+
+	while ((dirent = readdir(dir)) != NULL)
+	{
+		const gchar *locale_name = dirent->d_name;
+		gboolean is_dir = FALSE, is_regular = FALSE;
+		gboolean need_stat = TRUE;
+
+		if (locale_name[0] == '.' &&
+			(locale_name[1] == '\0' || (locale_name[1] == '.' && locale_name[2] == '\0')))
+			continue;
+
+#ifdef DT_UNKNOWN
+		is_dir = dirent->d_type == DT_DIR;
+		is_regular = dirent->d_type == DT_REG;
+		need_stat = dirent->d_type == DT_LNK || dirent->d_type == DT_UNKNOWN;
+#endif
+		if (need_stat)
+		{
+			gchar *locale_filename = g_build_filename(locale_path, locale_name, NULL);
+			GStatBuf s;
+
+			if (g_stat(locale_filename, &s) == 0)
+			{
+				is_dir = S_ISDIR(s.st_mode);
+				is_regular = S_ISREG(s.st_mode);
+			}
+			g_free(locale_filename);
+		}
+
+		if (is_dir)
+			g_ptr_array_add(entry->dir_names, g_strdup(locale_name));
+		else if (is_regular)
+			g_ptr_array_add(entry->file_names, utils_get_utf8_from_locale(locale_name));
+	}
+
+	closedir(dir);
+}
+#endif
+
+
+static void append_missing(GPtrArray *names, GPtrArray *other_names, const gchar *locale_path,
+	gboolean utf8, GPtrArray *changed_paths)
+{
+	GHashTable *other = g_hash_table_new(g_str_hash, g_str_equal);
+	guint i;
+
+	for (i = 0; i < other_names->len; i++)
+		g_hash_table_insert(other, other_names->pdata[i], GINT_TO_POINTER(1));
+
+	for (i = 0; i < names->len; i++)
+	{
+		const gchar *name = names->pdata[i];
+
+		if (g_hash_table_lookup(other, name))
+			continue;
+
+		if (utf8)
+		{
+			gchar *locale_name = utils_get_locale_from_utf8(name);
+
+			g_ptr_array_add(changed_paths, g_build_filename(locale_path, locale_name, NULL));
+			g_free(locale_name);
+		}
+		else
+			g_ptr_array_add(changed_paths, g_build_filename(locale_path, name, NULL));
+	}
+
+	g_hash_table_destroy(other);
+}
+
+
+/* Re-reads the listing of locale_path if the directory has been modified since
+ * it was read and appends the locale paths of the added and removed entries to
+ * changed_paths. Used for directories which can't be monitored. */
+void prjorg_scanner_dir_cache_refresh(GHashTable *dir_cache, const gchar *locale_path,
+	GPtrArray *changed_paths)
+{
+	DirEntry *entry = g_hash_table_lookup(dir_cache, locale_path);
+	DirEntry *new_entry;
+	GStatBuf s;
+	time_t now;
+
+	now = time(NULL);
+	if (!entry || g_stat(locale_path, &s) != 0 || !S_ISDIR(s.st_mode))
+		return;
+
+	if (entry->mtime == s.st_mtime && entry->mtime < entry->read_time)
+		return;
+
+	new_entry = dir_entry_new();
+	new_entry->mtime = s.st_mtime;
+	new_entry->read_time = now;
+	read_directory(locale_path, new_entry);
+
+	append_missing(entry->file_names, new_entry->file_names, locale_path, TRUE, changed_paths);
+	append_missing(new_entry->file_names, entry->file_names, locale_path, TRUE, changed_paths);
+	append_missing(entry->dir_names, new_entry->dir_names, locale_path, FALSE, changed_paths);
+	append_missing(new_entry->dir_names, entry->dir_names, locale_path, FALSE, changed_paths);
+
+	g_hash_table_insert(dir_cache, g_strdup(locale_path), new_entry);
+}
+
+
+/* must be called with scanner->lock held */
+static void push_job(PrjOrgScanner *scanner, ScanRoot *root, gchar *locale_path, gchar *utf8_path)
+{
+	ScanJob *job = g_new0(ScanJob, 1);
+
+	job->root = root;
+	job->locale_path = locale_path;
+	job->utf8_path = utf8_path;
+
+	g_atomic_int_inc(&scanner->outstanding);
+	g_atomic_int_inc(&scanner->refcount);
+	g_thread_pool_push(scanner->pool, job, NULL);
+}
+
+
+static void scan_dir(PrjOrgScanner *scanner, ScanJob *job)
+{
+	ScanRoot *root = job->root;
+	GPtrArray *files, *subdirs;
+	DirEntry *entry;
+	GStatBuf s;
+	gchar *real_path;
+	gboolean skip;
+	time_t now;
+	guint i;
+
+	now = time(NULL);
+	if (g_stat(job->locale_path, &s) != 0 || !S_ISDIR(s.st_mode))
+		return;
+
+	real_path = tm_get_real_path(job->locale_path);
+	if (!real_path)
+		return;
+
+	g_mutex_lock(&scanner->lock);
+	skip = scanner->cancelled || g_hash_table_lookup(root->visited_paths, real_path);
+	if (skip)
+		g_free(real_path);
+	else
+		g_hash_table_insert(root->visited_paths, real_path, GINT_TO_POINTER(1));
+
+	/* Directory mtime changes only when its entries are added, removed or
+	 * renamed so an unchanged directory can use the listing from the previous
+	 * scan. Listings read in the same second as the last modification are not
+	 * trusted because of the timestamp granularity. The owner may modify
+	 * old_cache once the scan is cancelled, which is checked under the lock. */
+	entry = !skip && root->old_cache ? g_hash_table_lookup(root->old_cache, job->locale_path) : NULL;
+	if (entry && entry->mtime == s.st_mtime && entry->mtime < entry->read_time)
+		g_atomic_int_inc(&entry->refcount);
+	else
+		entry = NULL;
+	g_mutex_unlock(&scanner->lock);
+
+	if (skip)
+		return;
+
+	if (!entry)
+	{
+		entry = dir_entry_new();
+		entry->mtime = s.st_mtime;
+		entry->read_time = now;
+		read_directory(job->locale_path, entry);
+	}
+
+	files = g_ptr_array_new();
+	for (i = 0; i < entry->file_names->len; i++)
+	{
+		const gchar *utf8_name = entry->file_names->pdata[i];
+
+		if (patterns_match(scanner->patterns, utf8_name) &&
+			!patterns_match(scanner->ignored_file_patterns, utf8_name))
+			g_ptr_array_add(files, g_build_filename(job->utf8_path, utf8_name, NULL));
+	}
+
+	subdirs = g_ptr_array_new();
+	for (i = 0; i < entry->dir_names->len; i++)
+	{
+		const gchar *locale_name = entry->dir_names->pdata[i];
+		gchar *utf8_name = utils_get_utf8_from_locale(locale_name);
+
+		if (!patterns_match(scanner->ignored_dirs_patterns, utf8_name))
+		{
+			g_ptr_array_add(subdirs, g_build_filename(job->locale_path, locale_name, NULL));
+			g_ptr_array_add(subdirs, g_build_filename(job->utf8_path, utf8_name, NULL));
+		}
+		g_free(utf8_name);
+	}
+
+	g_mutex_lock(&scanner->lock);
+	g_hash_table_insert(root->new_cache, g_strdup(job->locale_path), entry);
+	for (i = 0; i < files->len; i++)
+		g_ptr_array_add(root->pending, files->pdata[i]);
+	for (i = 0; i + 1 < subdirs->len; i += 2)
+	{
+		if (scanner->cancelled)
+		{
+			g_free(subdirs->pdata[i]);
+			g_free(subdirs->pdata[i+1]);
+		}
+		else
+			push_job(scanner, root, subdirs->pdata[i], subdirs->pdata[i+1]);
+	}
+	g_mutex_unlock(&scanner->lock);
+
+	g_ptr_array_free(files, TRUE);
+	g_ptr_array_free(subdirs, TRUE);
+}
+
+
+static void scanner_unref(PrjOrgScanner *scanner)
+{
+	if (!g_atomic_int_dec_and_test(&scanner->refcount))
+		return;
+
+	g_ptr_array_free(scanner->roots, TRUE);
+	g_mutex_clear(&scanner->lock);
+
+	g_slist_foreach(scanner->patterns, (GFunc) g_pattern_spec_free, NULL);
+	g_slist_free(scanner->patterns);
+	g_slist_foreach(scanner->ignored_dirs_patterns, (GFunc) g_pattern_spec_free, NULL);
+	g_slist_free(scanner->ignored_dirs_patterns);
+	g_slist_foreach(scanner->ignored_file_patterns, (GFunc) g_pattern_spec_free, NULL);
+	g_slist_free(scanner->ignored_file_patterns);
+
+	g_free(scanner);
+}
+
+
+static void scan_dir_func(gpointer data, gpointer user_data)
+{
+	PrjOrgScanner *scanner = user_data;
+	ScanJob *job = data;
+
+	scan_dir(scanner, job);
+
+	g_free(job->locale_path);
+	g_free(job->utf8_path);
+	g_free(job);
+
+	/* decrement only after the results were added to the pending array */
+	g_atomic_int_add(&scanner->outstanding, -1);
+	scanner_unref(scanner);
+}
+
+
+static gboolean flush_batches(gpointer data)
+{
+	PrjOrgScanner *scanner = data;
+	gboolean finished;
+	guint i;
+
+	/* read before flushing so no results can arrive after the last flush */
+	finished = g_atomic_int_get(&scanner->outstanding) == 0;
+
+	for (i = 0; i < scanner->roots->len; i++)
+	{
+		ScanRoot *root = scanner->roots->pdata[i];
+		GPtrArray *batch;
+
+		g_mutex_lock(&scanner->lock);
+		batch = root->pending;
+		root->pending = g_ptr_array_new_with_free_func(g_free);
+		g_mutex_unlock(&scanner->lock);
+
+		if (batch->len > 0)
+			scanner->batch_func(i, batch, scanner->user_data);
+		g_ptr_array_free(batch, TRUE);
+	}
+
+	if (!finished)
+		return TRUE;
+
+	scanner->timeout_id = 0;
+	/* may free the scanner */
+	scanner->finished_func(scanner->user_data);
+	return FALSE;
+}
+
+
+static void scan_root_free(ScanRoot *root)
+{
+	if (root->old_cache)
+		g_hash_table_unref(root->old_cache);
+	if (root->new_cache)
+		g_hash_table_destroy(root->new_cache);
+	g_hash_table_destroy(root->visited_paths);
+	g_ptr_array_free(root->pending, TRUE);
+	g_free(root->utf8_base_dir);
+	g_free(root);
+}
+
+
+/* Takes ownership of the pattern lists */
+PrjOrgScanner *prjorg_scanner_new(GSList *patterns, GSList *ignored_dirs_patterns,
+	GSList *ignored_file_patterns, PrjOrgScanBatchFunc batch_func,
+	PrjOrgScanFinishedFunc finished_func, gpointer user_data)
+{
+	PrjOrgScanner *scanner = g_new0(PrjOrgScanner, 1);
+
+	scanner->refcount = 1;
+	scanner->patterns = patterns;
+	scanner->ignored_dirs_patterns = ignored_dirs_patterns;
+	scanner->ignored_file_patterns = ignored_file_patterns;
+	scanner->batch_func = batch_func;
+	scanner->finished_func = finished_func;
+	scanner->user_data = user_data;
+	scanner->roots = g_ptr_array_new_with_free_func((GDestroyNotify)scan_root_free);
+	g_mutex_init(&scanner->lock);
+
+	return scanner;
+}
+
+
+/* dir_cache holds the directory listings of the previous scan of this root
+ * (may be NULL) and must not be modified until the scan finishes */
+guint prjorg_scanner_add_root(PrjOrgScanner *scanner, const gchar *utf8_base_dir, GHashTable *dir_cache)
+{
+	ScanRoot *root = g_new0(ScanRoot, 1);
+
+	root->utf8_base_dir = g_strdup(utf8_base_dir);
+	root->old_cache = dir_cache ? g_hash_table_ref(dir_cache) : NULL;
+	root->new_cache = prjorg_scanner_dir_cache_new();
+	root->visited_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	root->pending = g_ptr_array_new_with_free_func(g_free);
+	g_ptr_array_add(scanner->roots, root);
+
+	return scanner->roots->len - 1;
+}
+
+
+void prjorg_scanner_start(PrjOrgScanner *scanner)
+{
+	guint i;
+
+	g_return_if_fail(scanner->pool == NULL);
+
+	scanner->pool = g_thread_pool_new(scan_dir_func, scanner, SCANNER_THREADS, FALSE, NULL);
+
+	g_mutex_lock(&scanner->lock);
+	for (i = 0; i < scanner->roots->len; i++)
+	{
+		ScanRoot *root = scanner->roots->pdata[i];
+
+		push_job(scanner, root, utils_get_locale_from_utf8(root->utf8_base_dir),
+			g_strdup(root->utf8_base_dir));
+	}
+	g_mutex_unlock(&scanner->lock);
+
+	scanner->timeout_id = plugin_timeout_add(geany_plugin, SCANNER_BATCH_INTERVAL, flush_batches, scanner);
+}
+
+
+/* Returns the directory listings collected by the finished scan; they should
+ * be passed to the next scan of the same root */
+GHashTable *prjorg_scanner_steal_dir_cache(PrjOrgScanner *scanner, guint root_index)
+{
+	ScanRoot *root = scanner->roots->pdata[root_index];
+	GHashTable *cache = root->new_cache;
+
+	root->new_cache = NULL;
+	return cache;
+}
+
+
+/* Cancels the scan if it is still running. Doesn't wait for the running jobs,
+ * they finish in the background without touching the directory cache passed
+ * to prjorg_scanner_add_root() and without reporting any results. */
+void prjorg_scanner_free(PrjOrgScanner *scanner)
+{
+	if (scanner->timeout_id)
+		g_source_remove(scanner->timeout_id);
+
+	g_mutex_lock(&scanner->lock);
+	scanner->cancelled = TRUE;
+	g_mutex_unlock(&scanner->lock);
+
+	/* queued jobs notice the cancelled flag and return immediately; the pool
+	 * frees itself once they are done */
+	if (scanner->pool)
+		g_thread_pool_free(scanner->pool, FALSE, FALSE);
+
+	scanner_unref(scanner);
+}
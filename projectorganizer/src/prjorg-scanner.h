@@ -0,0 +1,44 @@
+/*
+ * Copyright 2010 Jiri Techet <techet@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PRJORG_SCANNER_H__
+#define __PRJORG_SCANNER_H__
+
+typedef struct PrjOrgScanner PrjOrgScanner;
+
+/* Called on the main thread with a batch of newly found files (utf8 full paths)
+ * belonging to the root with the given index. The array is owned by the scanner. */
+typedef void (*PrjOrgScanBatchFunc)(guint root_index, GPtrArray *utf8_files, gpointer user_data);
+/* Called on the main thread once all roots have been scanned */
+typedef void (*PrjOrgScanFinishedFunc)(gpointer user_data);
+
+GHashTable *prjorg_scanner_dir_cache_new(void);
+void prjorg_scanner_dir_cache_save(GHashTable *dir_cache, GString *buf);
+gboolean prjorg_scanner_dir_cache_load(GHashTable *dir_cache, const gchar **pos, const gchar *end);
+void prjorg_scanner_dir_cache_refresh(GHashTable *dir_cache, const gchar *locale_path,
+	GPtrArray *changed_paths);
+
+PrjOrgScanner *prjorg_scanner_new(GSList *patterns, GSList *ignored_dirs_patterns,
+	GSList *ignored_file_patterns, PrjOrgScanBatchFunc batch_func,
+	PrjOrgScanFinishedFunc finished_func, gpointer user_data);
+guint prjorg_scanner_add_root(PrjOrgScanner *scanner, const gchar *utf8_base_dir, GHashTable *dir_cache);
+void prjorg_scanner_start(PrjOrgScanner *scanner);
+GHashTable *prjorg_scanner_steal_dir_cache(PrjOrgScanner *scanner, guint root_index);
+void prjorg_scanner_free(PrjOrgScanner *scanner);
+
+#endif
@@ -29,6 +29,7 @@
 #include "prjorg-utils.h"
 #include "prjorg-project.h"
 #include "prjorg-sidebar.h"
+#include "prjorg-tagindex.h"
 
 extern GeanyPlugin *geany_plugin;
 extern GeanyData *geany_data;
@@ -41,13 +42,6 @@ enum
 	FILEVIEW_N_COLUMNS,
 };
 
-typedef enum
-{
-	MATCH_FULL,
-	MATCH_PREFIX,
-	MATCH_PATTERN
-} MatchType;
-
 typedef struct
 {
 	GeanyProject *project;
@@ -483,6 +477,7 @@ static void create_dialog_find_tag(void)
 	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(s_ft_dialog.combo_match), _("exact"));
 	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(s_ft_dialog.combo_match), _("prefix"));
 	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(s_ft_dialog.combo_match), _("pattern"));
+	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(s_ft_dialog.combo_match), _("substring"));
 	gtk_combo_box_set_active(GTK_COMBO_BOX(s_ft_dialog.combo_match), 1);
 	gtk_label_set_mnemonic_widget(GTK_LABEL(label), s_ft_dialog.combo_match);
 
@@ -546,78 +541,54 @@ static const char *tm_tag_type_name(const TMTag *tag)
 }
 
 
-static gboolean match(TMTag *tag, const gchar *name, gboolean declaration, gboolean case_sensitive,
-	MatchType match_type, GPatternSpec *pspec, gchar *utf8_path)
+static gboolean match(TMTag *tag, gboolean declaration, gchar *utf8_path, GHashTable *file_matches)
 {
 	const gint forward_types = tm_tag_prototype_t | tm_tag_externvar_t;
-	gboolean matches = FALSE;
 	gint type;
 
 	type = declaration ? forward_types : tm_tag_max_t - forward_types;
-	matches = tag->type & type;
+	if (!(tag->type & type))
+		return FALSE;
 
-	if (matches)
+	if (utf8_path)
 	{
-		gchar *name_case;
-
-		if (case_sensitive)
-			name_case = g_strdup(tag->name);
-		else
-			name_case = g_utf8_strdown(tag->name, -1);
+		gpointer matches;
 
-		switch (match_type)
+		/* many tags share a file so remember the result per file */
+		if (!g_hash_table_lookup_extended(file_matches, tag->file, NULL, &matches))
 		{
-			case MATCH_FULL:
-				matches = g_strcmp0(name_case, name) == 0;
-				break;
-			case MATCH_PATTERN:
-				matches = g_pattern_match_string(pspec, name_case);
-				break;
-			case MATCH_PREFIX:
-				matches = g_str_has_prefix(name_case, name);
-				break;
-		}
-		g_free(name_case);
-	}
-
-	if (matches && utf8_path)
-	{
-		gchar *utf8_file_name = utils_get_utf8_from_locale(tag->file->file_name);
-		gchar *relpath;
+			gchar *utf8_file_name = utils_get_utf8_from_locale(tag->file->file_name);
+			gchar *relpath;
 
-		relpath = get_relative_path(utf8_path, utf8_file_name);
-		matches = relpath != NULL;
-		g_free(relpath);
-		g_free(utf8_file_name);
+			relpath = get_relative_path(utf8_path, utf8_file_name);
+			matches = GINT_TO_POINTER(relpath != NULL);
+			g_hash_table_insert(file_matches, tag->file, matches);
+			g_free(relpath);
+			g_free(utf8_file_name);
+		}
+		return GPOINTER_TO_INT(matches);
 	}
 
-	return matches;
+	return TRUE;
 }
 
 
-static void find_tags(const gchar *name, gboolean declaration, gboolean case_sensitive, MatchType match_type, gchar *utf8_path)
+static void find_tags(const gchar *name, gboolean declaration, gboolean case_sensitive, PrjOrgMatchType match_type, gchar *utf8_path)
 {
 	gchar *utf8_base_path = get_project_base_path();
 	gchar *locale_base_path = utils_get_locale_from_utf8(utf8_base_path);
-	GPtrArray *tags_array = geany_data->app->tm_workspace->tags_array;
+	GHashTable *file_matches = g_hash_table_new(g_direct_hash, g_direct_equal);
+	GPtrArray *tags;
 	guint i;
-	gchar *name_case;
-	GPatternSpec *pspec;
-
-	if (case_sensitive)
-		name_case = g_strdup(name);
-	else
-		name_case = g_utf8_strdown(name, -1);
-
-	pspec = g_pattern_spec_new(name_case);
 
 	msgwin_set_messages_dir(locale_base_path);
 	msgwin_clear_tab(MSG_MESSAGE);
-	for (i = 0; i < tags_array->len; i++) /* TODO: binary search */
+	tags = prjorg_tag_index_find(name, case_sensitive, match_type);
+	for (i = 0; i < tags->len; i++)
 	{
-		TMTag *tag = tags_array->pdata[i];
+		TMTag *tag = tags->pdata[i];
 
-		if (match(tag, name_case, declaration, case_sensitive, match_type, pspec, utf8_path))
+		if (match(tag, declaration, utf8_path, file_matches))
 		{
 			gchar *scopestr = tag->scope ? g_strconcat(tag->scope, "::", NULL) : g_strdup("");
 			gchar *utf8_fname = utils_get_utf8_from_locale(tag->file->file_name);
@@ -633,8 +604,8 @@ static void find_tags(const gchar *name, gboolean declaration, gboolean case_sen
 	}
 	msgwin_switch_tab(MSG_MESSAGE, TRUE);
 
-	g_free(name_case);
-	g_pattern_spec_free(pspec);
+	g_ptr_array_free(tags, TRUE);
+	g_hash_table_destroy(file_matches);
 	g_free(utf8_base_path);
 	g_free(locale_base_path);
 }
@@ -667,7 +638,7 @@ static void find_tag(GtkTreeIter *iter)
 	{
 		const gchar *name;
 		gboolean case_sensitive, declaration;
-		MatchType match_type;
+		PrjOrgMatchType match_type;
 
 		name = gtk_entry_get_text(GTK_ENTRY(entry));
 		case_sensitive = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(s_ft_dialog.case_sensitive));
@@ -730,8 +701,8 @@ static void on_find_tag(G_GNUC_UNUSED GtkMenuItem *menuitem, G_GNUC_UNUSED gpoin
 
 static void on_reload_project(G_GNUC_UNUSED GtkMenuItem *menuitem, G_GNUC_UNUSED gpointer user_data)
 {
+	/* the sidebar gets updated once the scan finishes */
 	prjorg_project_rescan();
-	prjorg_sidebar_update(TRUE);
 }
 
 
@@ -878,6 +849,44 @@ static void on_find_in_files(G_GNUC_UNUSED GtkMenuItem *menuitem, G_GNUC_UNUSED
 }
 
 
+static GIcon *create_file_icon(const gchar *utf8_name, GSList *header_patterns, GSList *source_patterns)
+{
+	GIcon *icon = NULL;
+	gchar *content_type = g_content_type_guess(utf8_name, NULL, 0, NULL);
+
+	if (content_type)
+	{
+		icon = g_content_type_get_icon(content_type);
+		if (icon)
+		{
+			GtkIconInfo *icon_info;
+
+			icon_info = gtk_icon_theme_lookup_by_gicon(gtk_icon_theme_get_default(), icon, 16, 0);
+			if (!icon_info)
+			{
+				g_object_unref(icon);
+				icon = NULL;
+			}
+			else
+				gtk_icon_info_free(icon_info);
+		}
+		g_free(content_type);
+	}
+
+	if (!icon)
+	{
+		if (patterns_match(header_patterns, utf8_name))
+			icon = g_icon_new_for_string("prjorg-header", NULL);
+		else if (patterns_match(source_patterns, utf8_name))
+			icon = g_icon_new_for_string("prjorg-source", NULL);
+		else
+			icon = g_icon_new_for_string("prjorg-file", NULL);
+	}
+
+	return icon;
+}
+
+
 static void create_branch(gint level, GSList *leaf_list, GtkTreeIter *parent,
 	GSList *header_patterns, GSList *source_patterns, gboolean project)
 {
@@ -899,61 +908,14 @@ static void create_branch(gint level, GSList *leaf_list, GtkTreeIter *parent,
 	{
 		GtkTreeIter iter;
 		gchar **path_arr = elem->data;
-		GIcon *icon = NULL;
-		gchar *content_type = g_content_type_guess(path_arr[level], NULL, 0, NULL);
-
-		if (content_type)
-		{
-			icon = g_content_type_get_icon(content_type);
-			if (icon)
-			{
-				GtkIconInfo *icon_info;
-
-				icon_info = gtk_icon_theme_lookup_by_gicon(gtk_icon_theme_get_default(), icon, 16, 0);
-				if (!icon_info)
-				{
-					g_object_unref(icon);
-					icon = NULL;
-				}
-				else
-					gtk_icon_info_free(icon_info);
-			}
-			g_free(content_type);
-		}
+		GIcon *icon = create_file_icon(path_arr[level], header_patterns, source_patterns);
 
-		if (patterns_match(header_patterns, path_arr[level]))
-		{
-			if (! icon)
-				icon = g_icon_new_for_string("prjorg-header", NULL);
-
-			gtk_tree_store_insert_with_values(s_file_store, &iter, parent, 0,
-				FILEVIEW_COLUMN_ICON, icon,
-				FILEVIEW_COLUMN_NAME, path_arr[level],
-				FILEVIEW_COLUMN_COLOR, project ? NULL : &s_external_color, -1);
-		}
-		else if (patterns_match(source_patterns, path_arr[level]))
-		{
-			if (! icon)
-				icon = g_icon_new_for_string("prjorg-source", NULL);
-
-			gtk_tree_store_insert_with_values(s_file_store, &iter, parent, 0,
-				FILEVIEW_COLUMN_ICON, icon,
-				FILEVIEW_COLUMN_NAME, path_arr[level],
-				FILEVIEW_COLUMN_COLOR, project ? NULL : &s_external_color, -1);
-		}
-		else
-		{
-			if (! icon)
-				icon = g_icon_new_for_string("prjorg-file", NULL);
-
-			gtk_tree_store_insert_with_values(s_file_store, &iter, parent, 0,
-				FILEVIEW_COLUMN_ICON, icon,
-				FILEVIEW_COLUMN_NAME, path_arr[level],
-				FILEVIEW_COLUMN_COLOR, project ? NULL : &s_external_color, -1);
-		}
+		gtk_tree_store_insert_with_values(s_file_store, &iter, parent, 0,
+			FILEVIEW_COLUMN_ICON, icon,
+			FILEVIEW_COLUMN_NAME, path_arr[level],
+			FILEVIEW_COLUMN_COLOR, project ? NULL : &s_external_color, -1);
 
-		if (icon)
-			g_object_unref(icon);
+		g_object_unref(icon);
 	}
 
 	if (dir_list)
@@ -1064,6 +1026,8 @@ static void load_project_root(PrjOrgRoot *root, GtkTreeIter *parent, GSList *hea
 			gtk_widget_set_sensitive(s_project_toolbar.follow, TRUE);
 			gtk_widget_set_sensitive(s_project_toolbar.add, TRUE);
 		}
+		else if (prjorg_project_is_scanning())
+			set_intro_message(_("Scanning project directory..."));
 		else
 			set_intro_message(_("Set file patterns under Project->Properties"));
 	}
@@ -1162,30 +1126,47 @@ static gboolean find_in_tree(GtkTreeIter *parent, gchar **path_split, gint level
 }
 
 
-static gboolean expand_path(gchar *utf8_expanded_path, gboolean select)
+/* Finds the top-level row of the root containing utf8_file_path and returns
+ * the path relative to this root or NULL if the path is outside all roots */
+static gchar *get_root_iter(const gchar *utf8_file_path, GtkTreeIter *root_iter, gboolean *project)
 {
-	GtkTreeIter root_iter, found_iter;
-	gchar *utf8_path = NULL;
-	gchar **path_split;
+	GtkTreeModel *model = GTK_TREE_MODEL(s_file_store);
 	GSList *elem = NULL;
-	GtkTreeModel *model;
+	gboolean first = TRUE;
+
+	if (!gtk_tree_model_iter_children(model, root_iter, NULL))
+		return NULL;
 
-	model = GTK_TREE_MODEL(s_file_store);
-	gtk_tree_model_iter_children(model, &root_iter, NULL);
 	foreach_slist (elem, prj_org->roots)
 	{
 		PrjOrgRoot *root = elem->data;
+		gchar *utf8_path = get_relative_path(root->base_dir, utf8_file_path);
 
-		utf8_path = get_relative_path(root->base_dir, utf8_expanded_path);
 		if (utf8_path)
-			break;
+		{
+			if (project)
+				*project = first;
+			return utf8_path;
+		}
 
-		g_free(utf8_path);
-		utf8_path = NULL;
-		if (!gtk_tree_model_iter_next(model, &root_iter))
+		first = FALSE;
+		if (!gtk_tree_model_iter_next(model, root_iter))
 			break;
 	}
 
+	return NULL;
+}
+
+
+static gboolean expand_path(gchar *utf8_expanded_path, gboolean select)
+{
+	GtkTreeIter root_iter, found_iter;
+	gchar *utf8_path;
+	gchar **path_split;
+	GtkTreeModel *model;
+
+	model = GTK_TREE_MODEL(s_file_store);
+	utf8_path = get_root_iter(utf8_expanded_path, &root_iter, NULL);
 	if (!utf8_path)
 		return FALSE;
 
@@ -1313,6 +1294,159 @@ void prjorg_sidebar_update(gboolean reload)
 }
 
 
+/* Inserts the file into the tree keeping the order created by load_project() -
+ * directories first, then files, both sorted by name */
+static void add_file_to_tree(GtkTreeIter *root_iter, gchar **path_split,
+	GSList *header_patterns, GSList *source_patterns, gboolean project)
+{
+	GtkTreeModel *model = GTK_TREE_MODEL(s_file_store);
+	GtkTreeIter parent = *root_iter;
+	gint level;
+
+	for (level = 0; path_split[level] != NULL; level++)
+	{
+		gboolean is_dir = path_split[level+1] != NULL;
+		gboolean found = FALSE;
+		GtkTreeIter iter, new_iter;
+		GtkTreeIter *sibling = NULL;
+		gboolean iterate;
+
+		iterate = gtk_tree_model_iter_children(model, &iter, &parent);
+		while (iterate)
+		{
+			gboolean iter_is_dir = gtk_tree_model_iter_has_child(model, &iter);
+			gint cmpres;
+
+			if (is_dir == iter_is_dir)
+			{
+				gchar *name;
+
+				gtk_tree_model_get(model, &iter, FILEVIEW_COLUMN_NAME, &name, -1);
+				cmpres = g_strcmp0(name, path_split[level]);
+				g_free(name);
+			}
+			else
+				cmpres = iter_is_dir ? -1 : 1;
+
+			if (cmpres == 0)
+			{
+				if (!is_dir)
+					return;  /* already there */
+				found = TRUE;
+				break;
+			}
+			else if (cmpres > 0)
+			{
+				sibling = &iter;
+				break;
+			}
+
+			iterate = gtk_tree_model_iter_next(model, &iter);
+		}
+
+		if (!found)
+		{
+			GIcon *icon;
+
+			if (is_dir)
+				icon = g_icon_new_for_string("folder", NULL);
+			else
+				icon = create_file_icon(path_split[level], header_patterns, source_patterns);
+
+			gtk_tree_store_insert_before(s_file_store, &new_iter, &parent, sibling);
+			gtk_tree_store_set(s_file_store, &new_iter,
+				FILEVIEW_COLUMN_ICON, icon,
+				FILEVIEW_COLUMN_NAME, path_split[level],
+				FILEVIEW_COLUMN_COLOR, project ? NULL : &s_external_color, -1);
+			g_object_unref(icon);
+			iter = new_iter;
+		}
+
+		parent = iter;
+	}
+}
+
+
+/* removes the file and all directories which become empty */
+static void remove_file_from_tree(GtkTreeIter *root_iter, gchar **path_split)
+{
+	GtkTreeModel *model = GTK_TREE_MODEL(s_file_store);
+	GtkTreeIter iter, parent, grandparent;
+
+	if (!find_in_tree(root_iter, path_split, 0, &iter))
+		return;
+
+	while (gtk_tree_model_iter_parent(model, &parent, &iter))
+	{
+		gtk_tree_store_remove(s_file_store, &iter);
+
+		/* never remove the root rows */
+		if (gtk_tree_model_iter_has_child(model, &parent) ||
+			!gtk_tree_model_iter_parent(model, &grandparent, &parent))
+			break;
+		iter = parent;
+	}
+}
+
+
+/* Applies the changes of the file list without rebuilding the whole tree */
+void prjorg_sidebar_update_files(GPtrArray *utf8_added, GPtrArray *utf8_removed)
+{
+	GSList *header_patterns, *source_patterns;
+	gchar *utf8_path;
+	guint i;
+
+	if (!prj_org || !geany_data->app->project)
+		return;
+
+	/* the intro message is displayed instead of empty project root */
+	if (gtk_tree_model_iter_n_children(GTK_TREE_MODEL(s_file_store), NULL) != (gint)g_slist_length(prj_org->roots))
+	{
+		prjorg_sidebar_update(TRUE);
+		return;
+	}
+
+	header_patterns = get_precompiled_patterns(prj_org->header_patterns);
+	source_patterns = get_precompiled_patterns(prj_org->source_patterns);
+
+	foreach_ptr_array(utf8_path, i, utf8_removed)
+	{
+		GtkTreeIter root_iter;
+		gchar *utf8_rel_path = get_root_iter(utf8_path, &root_iter, NULL);
+
+		if (utf8_rel_path)
+		{
+			gchar **path_split = g_strsplit_set(utf8_rel_path, "/\\", 0);
+
+			remove_file_from_tree(&root_iter, path_split);
+			g_strfreev(path_split);
+		}
+		g_free(utf8_rel_path);
+	}
+
+	foreach_ptr_array(utf8_path, i, utf8_added)
+	{
+		GtkTreeIter root_iter;
+		gboolean project;
+		gchar *utf8_rel_path = get_root_iter(utf8_path, &root_iter, &project);
+
+		if (utf8_rel_path)
+		{
+			gchar **path_split = g_strsplit_set(utf8_rel_path, "/\\", 0);
+
+			add_file_to_tree(&root_iter, path_split, header_patterns, source_patterns, project);
+			g_strfreev(path_split);
+		}
+		g_free(utf8_rel_path);
+	}
+
+	g_slist_foreach(header_patterns, (GFunc) g_pattern_spec_free, NULL);
+	g_slist_free(header_patterns);
+	g_slist_foreach(source_patterns, (GFunc) g_pattern_spec_free, NULL);
+	g_slist_free(source_patterns);
+}
+
+
 void prjorg_sidebar_find_file_in_active(void)
 {
 	find_file(NULL);
@@ -28,6 +28,7 @@ void prjorg_sidebar_find_file_in_active(void);
 void prjorg_sidebar_find_tag_in_active(void);
 
 void prjorg_sidebar_update(gboolean reload);
+void prjorg_sidebar_update_files(GPtrArray *utf8_added, GPtrArray *utf8_removed);
 
 
 
@@ -0,0 +1,455 @@
+/*
+ * Copyright 2010 Jiri Techet <techet@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+	#include "config.h"
+#endif
+#include <geanyplugin.h>
+
+#include "prjorg-tagindex.h"
+
+extern GeanyData *geany_data;
+
+typedef struct
+{
+	const gchar *name;  /* case-folded, owned by TagIndex::names_chunk */
+	guint first;  /* first position in TagIndex::tags */
+	guint num;
+} IndexName;
+
+/* The index holds the workspace tags of the files not open in Geany. These
+ * change only when the workspace is updated by this plugin or when a document
+ * is opened or closed, which bumps s_generation. The tags of open documents
+ * are re-parsed by Geany while typing so they are searched directly instead. */
+typedef struct
+{
+	guint generation;  /* value of s_generation the index was built for */
+
+	GStringChunk *names_chunk;
+	GArray *names;  /* IndexName sorted by name */
+	TMTag **tags;  /* workspace tags grouped by name */
+	GHashTable *trigrams;  /* trigram -> GArray of indices to names */
+} TagIndex;
+
+typedef struct
+{
+	const gchar *name;
+	guint tag;
+} BuildEntry;
+
+
+static TagIndex *s_index = NULL;
+static guint s_generation = 0;
+
+
+static gchar *fold_name(const gchar *name)
+{
+	const gchar *c;
+
+	for (c = name; *c; c++)
+	{
+		if ((guchar)*c >= 0x80)
+			return g_utf8_strdown(name, -1);
+	}
+	return g_ascii_strdown(name, -1);
+}
+
+
+static gint build_entry_cmp(gconstpointer a, gconstpointer b)
+{
+	const BuildEntry *e1 = a;
+	const BuildEntry *e2 = b;
+	gint cmp;
+
+	/* names are interned in the string chunk so equal names are equal pointers */
+	if (e1->name != e2->name)
+	{
+		cmp = strcmp(e1->name, e2->name);
+		if (cmp != 0)
+			return cmp;
+	}
+	return e1->tag < e2->tag ? -1 : e1->tag > e2->tag;
+}
+
+
+static void index_trigrams(TagIndex *index, const gchar *name, guint name_idx)
+{
+	const guchar *c;
+
+	for (c = (const guchar *)name; c[0] && c[1] && c[2]; c++)
+	{
+		gpointer key = GUINT_TO_POINTER(((guint)c[0] << 16) | ((guint)c[1] << 8) | c[2]);
+		GArray *postings = g_hash_table_lookup(index->trigrams, key);
+
+		if (!postings)
+		{
+			postings = g_array_new(FALSE, FALSE, sizeof(guint));
+			g_hash_table_insert(index->trigrams, key, postings);
+		}
+		/* names are indexed in increasing order so duplicates are always last */
+		if (postings->len == 0 || g_array_index(postings, guint, postings->len - 1) != name_idx)
+			g_array_append_val(postings, name_idx);
+	}
+}
+
+
+static void free_postings(GArray *postings)
+{
+	g_array_free(postings, TRUE);
+}
+
+
+static TagIndex *index_new(void)
+{
+	GPtrArray *tags_array = geany_data->app->tm_workspace->tags_array;
+	GHashTable *open_files = g_hash_table_new(g_direct_hash, g_direct_equal);
+	TagIndex *index = g_new0(TagIndex, 1);
+	BuildEntry *entries;
+	guint i, len = 0;
+
+	foreach_document(i)
+	{
+		if (documents[i]->tm_file)
+			g_hash_table_insert(open_files, documents[i]->tm_file, documents[i]->tm_file);
+	}
+
+	index->generation = s_generation;
+	index->names_chunk = g_string_chunk_new(64 * 1024);
+	index->names = g_array_new(FALSE, FALSE, sizeof(IndexName));
+	index->trigrams = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+		(GDestroyNotify)free_postings);
+
+	entries = g_new(BuildEntry, MAX(tags_array->len, 1));
+	for (i = 0; i < tags_array->len; i++)
+	{
+		TMTag *tag = tags_array->pdata[i];
+		gchar *folded;
+
+		if (g_hash_table_lookup(open_files, tag->file))
+			continue;
+
+		folded = fold_name(tag->name);
+		entries[len].name = g_string_chunk_insert_const(index->names_chunk, folded);
+		entries[len].tag = i;
+		len++;
+		g_free(folded);
+	}
+	qsort(entries, len, sizeof(BuildEntry), build_entry_cmp);
+
+	index->tags = g_new(TMTag *, MAX(len, 1));
+	for (i = 0; i < len; i++)
+	{
+		if (i == 0 || entries[i].name != entries[i - 1].name)
+		{
+			IndexName n = {entries[i].name, i, 0};
+
+			g_array_append_val(index->names, n);
+			index_trigrams(index, n.name, index->names->len - 1);
+		}
+		g_array_index(index->names, IndexName, index->names->len - 1).num++;
+		index->tags[i] = tags_array->pdata[entries[i].tag];
+	}
+
+	g_free(entries);
+	g_hash_table_destroy(open_files);
+	return index;
+}
+
+
+static void index_free(TagIndex *index)
+{
+	g_string_chunk_free(index->names_chunk);
+	g_array_free(index->names, TRUE);
+	g_free(index->tags);
+	g_hash_table_destroy(index->trigrams);
+	g_free(index);
+}
+
+
+void prjorg_tag_index_invalidate(void)
+{
+	s_generation++;
+}
+
+
+void prjorg_tag_index_clear(void)
+{
+	if (s_index)
+		index_free(s_index);
+	s_index = NULL;
+}
+
+
+/* index of the first name not smaller than folded */
+static guint lower_bound(TagIndex *index, const gchar *folded)
+{
+	guint lo = 0, hi = index->names->len;
+
+	while (lo < hi)
+	{
+		guint mid = lo + (hi - lo) / 2;
+
+		if (strcmp(g_array_index(index->names, IndexName, mid).name, folded) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+static gboolean postings_contain(GArray *postings, guint name_idx)
+{
+	guint lo = 0, hi = postings->len;
+
+	while (lo < hi)
+	{
+		guint mid = lo + (hi - lo) / 2;
+		guint val = g_array_index(postings, guint, mid);
+
+		if (val == name_idx)
+			return TRUE;
+		if (val < name_idx)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return FALSE;
+}
+
+
+static gint postings_len_cmp(gconstpointer a, gconstpointer b)
+{
+	const GArray *p1 = *(GArray **)a;
+	const GArray *p2 = *(GArray **)b;
+
+	return p1->len < p2->len ? -1 : p1->len > p2->len;
+}
+
+
+/* Returns indices of names containing all trigrams of the literal parts of
+ * folded (parts are separated by any character from separators) or NULL when
+ * there's no trigram to look up. */
+static GArray *get_trigram_candidates(TagIndex *index, const gchar *folded, const gchar *separators)
+{
+	GPtrArray *lists = g_ptr_array_new();
+	gchar **parts = g_strsplit_set(folded, separators, -1);
+	GArray *candidates = NULL;
+	gboolean missing = FALSE;
+	gchar **part;
+	guint i, j;
+
+	foreach_strv (part, parts)
+	{
+		const guchar *c;
+
+		for (c = (const guchar *)*part; !missing && c[0] && c[1] && c[2]; c++)
+		{
+			gpointer key = GUINT_TO_POINTER(((guint)c[0] << 16) | ((guint)c[1] << 8) | c[2]);
+			GArray *postings = g_hash_table_lookup(index->trigrams, key);
+
+			if (postings)
+				g_ptr_array_add(lists, postings);
+			else
+				missing = TRUE;
+		}
+	}
+	g_strfreev(parts);
+
+	if (missing)
+		candidates = g_array_new(FALSE, FALSE, sizeof(guint));
+	else if (lists->len > 0)
+	{
+		GArray *shortest;
+
+		/* start with the shortest list and check the rest for every candidate */
+		g_ptr_array_sort(lists, postings_len_cmp);
+		shortest = lists->pdata[0];
+		candidates = g_array_sized_new(FALSE, FALSE, sizeof(guint), shortest->len);
+		for (i = 0; i < shortest->len; i++)
+		{
+			guint name_idx = g_array_index(shortest, guint, i);
+			gboolean found = TRUE;
+
+			for (j = 1; found && j < lists->len; j++)
+				found = postings_contain(lists->pdata[j], name_idx);
+			if (found)
+				g_array_append_val(candidates, name_idx);
+		}
+	}
+
+	g_ptr_array_free(lists, TRUE);
+	return candidates;
+}
+
+
+static gboolean name_matches(const gchar *name, const gchar *query, PrjOrgMatchType match_type,
+	GPatternSpec *pspec)
+{
+	switch (match_type)
+	{
+		case PRJORG_MATCH_FULL:
+			return strcmp(name, query) == 0;
+		case PRJORG_MATCH_PREFIX:
+			return g_str_has_prefix(name, query);
+		case PRJORG_MATCH_PATTERN:
+			return g_pattern_match_string(pspec, name);
+		case PRJORG_MATCH_SUBSTRING:
+			return strstr(name, query) != NULL;
+	}
+	return FALSE;
+}
+
+
+static void add_name_tags(TagIndex *index, guint name_idx, const gchar *name, gboolean case_sensitive,
+	PrjOrgMatchType match_type, GPatternSpec *pspec, GPtrArray *result)
+{
+	IndexName *n = &g_array_index(index->names, IndexName, name_idx);
+	guint i;
+
+	for (i = n->first; i < n->first + n->num; i++)
+	{
+		TMTag *tag = index->tags[i];
+
+		if (!case_sensitive || name_matches(tag->name, name, match_type, pspec))
+			g_ptr_array_add(result, tag);
+	}
+}
+
+
+/* the tags of open documents aren't in the index */
+static void add_document_tags(const gchar *name, const gchar *folded, gboolean case_sensitive,
+	PrjOrgMatchType match_type, GPatternSpec *pspec, GPatternSpec *folded_pspec, GPtrArray *result)
+{
+	guint i, j;
+
+	foreach_document(i)
+	{
+		TMSourceFile *sf = documents[i]->tm_file;
+
+		if (!sf)
+			continue;
+
+		for (j = 0; j < sf->tags_array->len; j++)
+		{
+			TMTag *tag = sf->tags_array->pdata[j];
+			gchar *folded_name = fold_name(tag->name);
+
+			if (name_matches(folded_name, folded, match_type, folded_pspec) &&
+				(!case_sensitive || name_matches(tag->name, name, match_type, pspec)))
+				g_ptr_array_add(result, tag);
+			g_free(folded_name);
+		}
+	}
+}
+
+
+static GPtrArray *index_find(TagIndex *index, const gchar *name, gboolean case_sensitive,
+	PrjOrgMatchType match_type)
+{
+	GPtrArray *result = g_ptr_array_new();
+	gchar *folded = fold_name(name);
+	GPatternSpec *folded_pspec = NULL;
+	GPatternSpec *pspec = NULL;
+	GArray *candidates = NULL;
+	guint first = 0, last = index->names->len;
+	guint i;
+
+	if (match_type == PRJORG_MATCH_PATTERN)
+	{
+		folded_pspec = g_pattern_spec_new(folded);
+		pspec = g_pattern_spec_new(name);
+	}
+
+	if (match_type == PRJORG_MATCH_FULL || match_type == PRJORG_MATCH_PREFIX)
+	{
+		first = lower_bound(index, folded);
+		for (last = first; last < index->names->len; last++)
+		{
+			const gchar *n = g_array_index(index->names, IndexName, last).name;
+
+			if (match_type == PRJORG_MATCH_FULL ? strcmp(n, folded) != 0 : !g_str_has_prefix(n, folded))
+				break;
+		}
+	}
+	else if (match_type == PRJORG_MATCH_PATTERN)
+	{
+		candidates = get_trigram_candidates(index, folded, "*?");
+		/* without trigrams at least restrict the range by the literal prefix */
+		if (!candidates && folded[0] != '*' && folded[0] != '?')
+		{
+			gchar *prefix = g_strndup(folded, strcspn(folded, "*?"));
+
+			first = lower_bound(index, prefix);
+			for (last = first; last < index->names->len; last++)
+			{
+				if (!g_str_has_prefix(g_array_index(index->names, IndexName, last).name, prefix))
+					break;
+			}
+			g_free(prefix);
+		}
+	}
+	else
+		candidates = get_trigram_candidates(index, folded, "");
+
+	if (candidates)
+	{
+		for (i = 0; i < candidates->len; i++)
+		{
+			guint name_idx = g_array_index(candidates, guint, i);
+			const gchar *n = g_array_index(index->names, IndexName, name_idx).name;
+
+			if (name_matches(n, folded, match_type, folded_pspec))
+				add_name_tags(index, name_idx, name, case_sensitive, match_type, pspec, result);
+		}
+		g_array_free(candidates, TRUE);
+	}
+	else
+	{
+		for (i = first; i < last; i++)
+		{
+			const gchar *n = g_array_index(index->names, IndexName, i).name;
+
+			if (name_matches(n, folded, match_type, folded_pspec))
+				add_name_tags(index, i, name, case_sensitive, match_type, pspec, result);
+		}
+	}
+
+	add_document_tags(name, folded, case_sensitive, match_type, pspec, folded_pspec, result);
+
+	if (folded_pspec)
+		g_pattern_spec_free(folded_pspec);
+	if (pspec)
+		g_pattern_spec_free(pspec);
+	g_free(folded);
+	return result;
+}
+
+
+GPtrArray *prjorg_tag_index_find(const gchar *name, gboolean case_sensitive, PrjOrgMatchType match_type)
+{
+	/* the tags of a stale index may be freed already, they must not be touched */
+	if (s_index && s_index->generation != s_generation)
+		prjorg_tag_index_clear();
+	if (!s_index)
+		s_index = index_new();
+
+	return index_find(s_index, name, case_sensitive, match_type);
+}
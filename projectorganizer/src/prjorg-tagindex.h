@@ -0,0 +1,41 @@
+/*
+ * Copyright 2010 Jiri Techet <techet@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PRJORG_TAGINDEX_H__
+#define __PRJORG_TAGINDEX_H__
+
+typedef enum
+{
+	PRJORG_MATCH_FULL,
+	PRJORG_MATCH_PREFIX,
+	PRJORG_MATCH_PATTERN,
+	PRJORG_MATCH_SUBSTRING
+} PrjOrgMatchType;
+
+/* Returns the TMTags of the workspace whose name matches, the tags of files
+ * not open in Geany first. The array has to be freed by the caller, the tags
+ * stay valid only until the next workspace update. */
+GPtrArray *prjorg_tag_index_find(const gchar *name, gboolean case_sensitive, PrjOrgMatchType match_type);
+/* Has to be called after every change of the workspace tags of files not open
+ * in Geany and when a document is opened or closed; the index is rebuilt on
+ * the next search */
+void prjorg_tag_index_invalidate(void);
+/* Frees the index */
+void prjorg_tag_index_clear(void);
+
+#endif
@@ -149,3 +149,49 @@ gchar *get_project_base_path(void)
 	}
 	return NULL;
 }
+
+
+/* The cache files consist of NUL-terminated tokens so they can be parsed
+ * directly from the mapped file */
+void cache_write_string(GString *buf, const gchar *str)
+{
+	g_string_append_len(buf, str, strlen(str) + 1);
+}
+
+
+void cache_write_int(GString *buf, gint64 val)
+{
+	g_string_append_printf(buf, "%" G_GINT64_FORMAT, val);
+	g_string_append_c(buf, '\0');
+}
+
+
+/* returns NULL when there are no more complete tokens */
+const gchar *cache_read_string(const gchar **pos, const gchar *end)
+{
+	const gchar *str = *pos;
+	const gchar *nul;
+
+	if (str >= end)
+		return NULL;
+
+	nul = memchr(str, '\0', end - str);
+	if (!nul)
+		return NULL;
+
+	*pos = nul + 1;
+	return str;
+}
+
+
+gboolean cache_read_int(const gchar **pos, const gchar *end, gint64 *val)
+{
+	const gchar *str = cache_read_string(pos, end);
+	gchar *str_end;
+
+	if (!str)
+		return FALSE;
+
+	*val = g_ascii_strtoll(str, &str_end, 10);
+	return str_end != str && *str_end == '\0';
+}
@@ -28,4 +28,9 @@ void open_file(gchar *utf8_name);
 gchar *get_selection(void);
 gchar *get_project_base_path(void);
 
+void cache_write_string(GString *buf, const gchar *str);
+void cache_write_int(GString *buf, gint64 val);
+const gchar *cache_read_string(const gchar **pos, const gchar *end);
+gboolean cache_read_int(const gchar **pos, const gchar *end, gint64 *val);
+
 #endif
@@ -22,14 +22,33 @@
 #include <string.h>
 
 #include "common.h"
+#include "gdb_mi.h"
+
+/* node arrays of parsed messages are reused, so parsing usually allocates nothing */
+static GPtrArray *parse_arrays;
+/* one record arena per parse_message() nesting level, as callbacks may parse */
+static GPtrArray *parse_arenas;
+static guint parse_depth;
+
+static GArray *parse_array_new(void)
+{
+	return parse_arrays->len ? (GArray *) g_ptr_array_remove_index_fast(parse_arrays,
+		parse_arrays->len - 1) : g_array_new(FALSE, FALSE, sizeof(ParseNode));
+}
+
+static void parse_array_free(GArray *nodes);
 
 static void parse_node_free(ParseNode *node, G_GNUC_UNUSED gpointer gdata)
 {
 	if (node->type == PT_ARRAY)
-	{
-		parse_foreach((GArray *) node->value, (GFunc) parse_node_free, NULL);
-		g_array_free((GArray *) node->value, TRUE);
-	}
+		parse_array_free((GArray *) node->value);
+}
+
+static void parse_array_free(GArray *nodes)
+{
+	parse_foreach(nodes, (GFunc) parse_node_free, NULL);
+	g_array_set_size(nodes, 0);
+	g_ptr_array_add(parse_arrays, nodes);
 }
 
 void parse_foreach(GArray *nodes, GFunc func, gpointer gdata)
@@ -134,6 +153,84 @@ static const ParseRoute parse_routes[] =
 	{ NULL, NULL, '\0', '\0', 0 }
 };
 
+#define PARSE_ROUTES_COUNT (G_N_ELEMENTS(parse_routes) - 1)
+
+/* prefix trie of the routes, node 0 is the root */
+typedef struct _ParseTrieNode
+{
+	char c;
+	guint child;  /* first child, 0 if none */
+	guint next;   /* next sibling, 0 if none */
+	guint route;  /* first route ending here, PARSE_ROUTES_COUNT if none */
+} ParseTrieNode;
+
+static GArray *parse_trie;
+/* next route with the same prefix, PARSE_ROUTES_COUNT if none */
+static guint parse_route_next[PARSE_ROUTES_COUNT];
+
+#define parse_trie_node(i) (&g_array_index(parse_trie, ParseTrieNode, (i)))
+
+static guint parse_trie_child(guint i, char c)
+{
+	for (i = parse_trie_node(i)->child; i && parse_trie_node(i)->c != c;
+		i = parse_trie_node(i)->next);
+	return i;
+}
+
+static void parse_trie_add(guint route)
+{
+	const char *s;
+	guint i = 0;
+	guint *last;
+
+	for (s = parse_routes[route].prefix; *s; s++)
+	{
+		guint child = parse_trie_child(i, *s);
+
+		if (!child)
+		{
+			ParseTrieNode node = { *s, 0, parse_trie_node(i)->child, PARSE_ROUTES_COUNT };
+
+			child = parse_trie->len;
+			g_array_append_val(parse_trie, node);
+			parse_trie_node(i)->child = child;
+		}
+
+		i = child;
+	}
+
+	/* same prefix routes are tried in table order */
+	for (last = &parse_trie_node(i)->route; *last < PARSE_ROUTES_COUNT;
+		last = &parse_route_next[*last]);
+	*last = route;
+	parse_route_next[route] = PARSE_ROUTES_COUNT;
+}
+
+/* the first route in table order whose prefix and mark match */
+static const ParseRoute *parse_route_find(const char *message, const char *token)
+{
+	guint found = PARSE_ROUTES_COUNT;
+	guint i = 0;
+
+	do
+	{
+		guint route;
+
+		for (route = parse_trie_node(i)->route; route < found; route = parse_route_next[route])
+		{
+			char mark = parse_routes[route].mark;
+
+			if (!mark || (token && (mark == '*' || mark == *token)))
+			{
+				found = route;
+				break;
+			}
+		}
+	} while (*message && (i = parse_trie_child(i, *message++)) != 0);
+
+	return parse_routes + found;
+}
+
 static char *parse_error(const char *text)
 {
 	dc_error("%s", text);
@@ -170,88 +267,57 @@ char *parse_string(char *text, char newline)
 	return text + 1;
 }
 
-/* no name checks: break script and break list w/ multi-location violate tuple/list syntax */
-static char *parse_text(GArray *nodes, char *text, char end, char newline)
+/* the nodes point into the record and the message, which have to outlive them */
+static void parse_results(GArray *nodes, const struct gdb_mi_result *result, gboolean top)
 {
-	do
+	for (; result; result = result->next)
 	{
 		ParseNode node;
 
-		/* gdb.info says "string", but... */
-		if (isalpha(*++text) || *text == '_')
-		{
-			node.name = text;
-
-			while (isalnum(*++text) || (strchr("_.-", *text) && *text));
-			if (*text != '=')
-				return parse_error("= expected");
+		/* break script and break list w/ multi-location have values without names */
+		node.name = result->var ? result->var : "";
 
-			*text++ = '\0';
-		}
-		else
-			node.name = "";
-
-		if (*text == '"')
+		if (result->val->type == GDB_MI_VAL_STRING)
 		{
 			node.type = PT_VALUE;
-			node.value = text;
-			text = parse_string(text, newline);
-
-			if (!text && !newline)
-			{
-				parse_foreach(nodes, (GFunc) parse_node_free, NULL);
-				g_array_set_size(nodes, 0);
-				return NULL;
-			}
+			node.value = result->val->v.string;
 		}
+		else if (top && !strcmp(node.name, "time"))
+			continue;
 		else
 		{
-			static const char ends[2] = { ']', '}' };
-
-			gboolean brace = *text == '{';
-			GArray *array;
-
-			if (!brace && *text != '[')
-				return parse_error("\" { or [ expected");
+			GArray *array = parse_array_new();
 
-			array = g_array_new(FALSE, FALSE, sizeof(ParseNode));
+			parse_results(array, result->val->v.list, FALSE);
 			node.type = PT_ARRAY;
 			node.value = array;
-
-			if (text[1] == ends[brace])
-				text += 2;
-			else
-				text = parse_text(array, text, ends[brace], newline);
 		}
 
-		if (end != '\0' || node.type == PT_VALUE || strcmp(node.name, "time"))
-			g_array_append_val(nodes, node);
-
-		if (!text)
-			return NULL;
-
-	} while (*text == ',');
-
-	return *text == end ? text + (end != '\0') : parse_error(", or end expected");
+		g_array_append_val(nodes, node);
+	}
 }
 
 void parse_message(char *message, const char *token)
 {
-	const ParseRoute *route;
-
-	for (route = parse_routes; route->prefix; route++)
-		if (g_str_has_prefix(message, route->prefix))
-			if (!route->mark || (token && (route->mark == '*' || route->mark == *token)))
-				break;
+	const ParseRoute *route = parse_route_find(message, token);
 
 	if (route->callback)
 	{
-		GArray *nodes = g_array_new(FALSE, FALSE, sizeof(ParseNode));
-		const char *comma = strchr(route->prefix, ',');
+		GArray *nodes = parse_array_new();
+		struct gdb_mi_record *record = NULL;
+
+		/* values stay 7-bit escaped, they are decoded per variable mode */
+		if (strchr(route->prefix, ','))
+		{
+			if (parse_depth == parse_arenas->len)
+				g_ptr_array_add(parse_arenas, gdb_mi_arena_new());
 
-		if (comma)
-			parse_text(nodes, message + (comma - route->prefix), '\0', route->newline);
+			record = gdb_mi_record_parse_raw(message, route->newline,
+				(struct gdb_mi_arena *) g_ptr_array_index(parse_arenas, parse_depth));
+			parse_results(nodes, record->first, TRUE);
+		}
 
+		iff (!record || !record->error, "%s", record->error)
 		iff (nodes->len >= route->args, "missing argument(s)")
 		{
 			if (token)
@@ -260,11 +326,12 @@ void parse_message(char *message, const char *token)
 				g_array_append_val(nodes, node);
 			}
 
+			parse_depth++;
 			route->callback(nodes);
+			parse_depth--;
 		}
 
-		parse_foreach(nodes, (GFunc) parse_node_free, NULL);
-		g_array_free(nodes, TRUE);
+		parse_array_free(nodes);
 	}
 }
 
@@ -621,6 +688,16 @@ void parse_save(GKeyFile *config)
 
 void parse_init(void)
 {
+	static const ParseTrieNode root = { '\0', 0, 0, PARSE_ROUTES_COUNT };
+	guint route;
+
+	parse_trie = g_array_new(FALSE, FALSE, sizeof(ParseTrieNode));
+	g_array_append_val(parse_trie, root);
+	for (route = 0; route < PARSE_ROUTES_COUNT; route++)
+		parse_trie_add(route);
+
+	parse_arrays = g_ptr_array_new();
+	parse_arenas = g_ptr_array_new_with_free_func((GDestroyNotify) gdb_mi_arena_free);
 	errors = g_string_sized_new(MAXLEN);
 	parse_modes = SCP_TREE_STORE(get_object("parse_mode_store"));
 	scp_tree_store_set_sort_column_id(parse_modes, MODE_NAME, GTK_SORT_ASCENDING);
@@ -628,5 +705,9 @@ void parse_init(void)
 
 void parse_finalize(void)
 {
+	g_array_free(parse_trie, TRUE);
+	g_ptr_array_foreach(parse_arrays, (GFunc) g_array_free, GINT_TO_POINTER(TRUE));
+	g_ptr_array_free(parse_arrays, TRUE);
+	g_ptr_array_free(parse_arenas, TRUE);
 	g_string_free(errors, TRUE);
 }
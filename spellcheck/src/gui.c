@@ -47,14 +47,23 @@ typedef struct
 } SpellClickInfo;
 static SpellClickInfo clickinfo;
 
+/* a range of lines [start, end[ */
 typedef struct
 {
-	GeanyDocument *doc;
-	gint line_number;
-	gint line_count;
-	guint check_while_typing_idle_source_id;
-} CheckLineData;
-static CheckLineData check_line_data;
+	gint start;
+	gint end;
+} LineRange;
+
+/* lines still to be checked, as sorted and disjoint LineRanges, per document ID */
+static GHashTable *dirty_lines = NULL;
+static guint check_source_id = 0;
+
+/* how long to wait after a modification before checking, not to report words being typed */
+#define CHECK_DELAY 300
+/* how long to check lines for in an idle callback, in microseconds */
+#define CHECK_SLICE_DURATION 8000
+/* how many lines to take at once from the lines to check */
+#define CHECK_SLICE_LINES 8
 
 /* Flag to indicate that a callback function will be triggered by generating the appropriate event
  * but the callback should be ignored. */
@@ -261,6 +270,9 @@ static GtkWidget *init_editor_submenu(void)
 
 static void perform_check(GeanyDocument *doc)
 {
+	/* the whole document is checked, forget about the lines waiting for it */
+	if (dirty_lines != NULL)
+		g_hash_table_remove(dirty_lines, GUINT_TO_POINTER(doc->id));
 	clear_spellcheck_error_markers(doc);
 
 	if (sc_info->use_msgwin)
@@ -279,17 +291,19 @@ static void perform_spell_check_cb(GtkWidget *menu_item, GeanyDocument *doc)
 }
 
 
-static gboolean perform_check_delayed_cb(gpointer doc)
-{
-	perform_check((GeanyDocument*)doc);
-	return FALSE;
-}
+static void mark_lines_dirty(GeanyDocument *doc, gint line_number, gint line_count);
+static void schedule_check(guint delay);
 
 
 void sc_gui_document_open_cb(GObject *obj, GeanyDocument *doc, gpointer user_data)
 {
 	if (sc_info->check_on_document_open && main_is_realized())
-		g_idle_add(perform_check_delayed_cb, doc);
+	{
+		/* check in the background, starting with the visible part */
+		clear_spellcheck_error_markers(doc);
+		mark_lines_dirty(doc, 0, sci_get_line_count(doc->editor->sci));
+		schedule_check(0);
+	}
 }
 
 
@@ -491,97 +505,260 @@ static void indicator_clear_on_line(GeanyDocument *doc, gint line_number)
 }
 
 
-static gboolean check_lines(gpointer data)
+static GArray *get_dirty_lines(GeanyDocument *doc, gboolean create)
+{
+	GArray *ranges;
+
+	if (dirty_lines == NULL)
+	{
+		if (! create)
+			return NULL;
+		dirty_lines = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+			(GDestroyNotify) g_array_unref);
+	}
+	ranges = g_hash_table_lookup(dirty_lines, GUINT_TO_POINTER(doc->id));
+	if (ranges == NULL && create)
+	{
+		ranges = g_array_new(FALSE, FALSE, sizeof(LineRange));
+		g_hash_table_insert(dirty_lines, GUINT_TO_POINTER(doc->id), ranges);
+	}
+	return ranges;
+}
+
+
+static void mark_lines_dirty(GeanyDocument *doc, gint line_number, gint line_count)
+{
+	GArray *ranges = get_dirty_lines(doc, TRUE);
+	LineRange new_range;
+	guint i;
+
+	new_range.start = line_number;
+	new_range.end = line_number + line_count;
+
+	/* merge with all the ranges it touches, and insert it in place */
+	i = 0;
+	while (i < ranges->len)
+	{
+		LineRange *range = &g_array_index(ranges, LineRange, i);
+
+		if (range->end < new_range.start)
+			i++;
+		else if (range->start > new_range.end)
+			break;
+		else
+		{
+			new_range.start = MIN(new_range.start, range->start);
+			new_range.end = MAX(new_range.end, range->end);
+			g_array_remove_index(ranges, i);
+		}
+	}
+	g_array_insert_val(ranges, i, new_range);
+}
+
+
+/* maps a line number after lines_added lines have been added (or removed if negative)
+ * after line_number */
+static gint shift_line(gint line, gint line_number, gint lines_added)
+{
+	if (line <= line_number)
+		return line;
+	else if (lines_added < 0 && line <= line_number - lines_added)
+		return line_number + 1; /* the line was removed */
+	else
+		return line + lines_added;
+}
+
+
+static void shift_dirty_lines(GeanyDocument *doc, gint line_number, gint lines_added)
+{
+	GArray *ranges = get_dirty_lines(doc, FALSE);
+	guint i = 0;
+
+	if (ranges == NULL)
+		return;
+
+	while (i < ranges->len)
+	{
+		LineRange *range = &g_array_index(ranges, LineRange, i);
+
+		range->start = shift_line(range->start, line_number, lines_added);
+		range->end = shift_line(range->end, line_number, lines_added);
+		if (range->start >= range->end)
+			g_array_remove_index(ranges, i);
+		else
+			i++;
+	}
+}
+
+
+/* Removes up to CHECK_SLICE_LINES lines in [from, to[ from the dirty ranges, and stores
+ * them in taken. Returns FALSE if there are no dirty lines in [from, to[. */
+static gboolean take_dirty_lines(GArray *ranges, gint from, gint to, LineRange *taken)
 {
-	GeanyDocument *doc = check_line_data.doc;
+	guint i;
 
-	/* since we're in an timeout callback, the document may have been closed */
-	if (DOC_VALID (doc))
+	for (i = 0; i < ranges->len; i++)
 	{
-		gint line_number = check_line_data.line_number;
-		gint line_count = check_line_data.line_count;
-		gint i;
+		LineRange *range = &g_array_index(ranges, LineRange, i);
 
-		for (i = 0; i < line_count; i++)
+		if (range->end > from && range->start < to)
 		{
-			indicator_clear_on_line(doc, line_number);
-			if (sc_speller_process_line(doc, line_number) != 0)
+			taken->start = MAX(range->start, from);
+			taken->end = MIN(MIN(range->end, to), taken->start + CHECK_SLICE_LINES);
+
+			/* remove the taken lines, splitting the range if needed */
+			if (taken->end < range->end && taken->start > range->start)
 			{
-				if (sc_info->use_msgwin)
-					msgwin_switch_tab(MSG_MESSAGE, FALSE);
+				LineRange tail;
+
+				tail.start = taken->end;
+				tail.end = range->end;
+				range->end = taken->start;
+				g_array_insert_val(ranges, i + 1, tail);
 			}
-			line_number++;
+			else if (taken->start > range->start)
+				range->end = taken->start;
+			else if (taken->end < range->end)
+				range->start = taken->end;
+			else
+				g_array_remove_index(ranges, i);
+			return TRUE;
 		}
 	}
-	check_line_data.check_while_typing_idle_source_id = 0;
 	return FALSE;
 }
 
 
-static gboolean need_delay(void)
+static void check_lines(GeanyDocument *doc, const LineRange *lines)
 {
-	static gint64 time_prev = 0; /* time in microseconds */
-	gint64 time_now;
-	GTimeVal t;
-	const gint timeout = 500; /* delay in milliseconds */
-	gboolean ret = FALSE;
+	gint line_count = sci_get_line_count(doc->editor->sci);
+	gint line_number;
+
+	for (line_number = lines->start; line_number < MIN(lines->end, line_count); line_number++)
+	{
+		indicator_clear_on_line(doc, line_number);
+		if (sc_speller_process_line(doc, line_number) != 0)
+		{
+			if (sc_info->use_msgwin)
+				msgwin_switch_tab(MSG_MESSAGE, FALSE);
+		}
+	}
+}
 
-	g_get_current_time(&t);
 
-	time_now = ((gint64) t.tv_sec * G_USEC_PER_SEC) + t.tv_usec;
+/* Checks the next dirty lines of a document, those visible in the current document first.
+ * Returns FALSE if there was nothing left to check. */
+static gboolean check_next_dirty_lines(void)
+{
+	GeanyDocument *doc = document_get_current();
+	GArray *ranges = NULL;
+	LineRange lines;
 
-	/* delay keypresses for 0.5 seconds */
-	if (time_now < (time_prev + (timeout * 1000)))
-		return TRUE;
+	if (dirty_lines == NULL)
+		return FALSE;
 
-	if (check_line_data.check_while_typing_idle_source_id == 0)
+	if (doc != NULL)
+		ranges = get_dirty_lines(doc, FALSE);
+	if (ranges != NULL && ranges->len > 0)
 	{
-		check_line_data.check_while_typing_idle_source_id =
-			plugin_timeout_add(geany_plugin, timeout, check_lines, NULL);
-		ret = TRUE;
+		ScintillaObject *sci = doc->editor->sci;
+		gint first_visible = scintilla_send_message(sci, SCI_DOCLINEFROMVISIBLE,
+			scintilla_send_message(sci, SCI_GETFIRSTVISIBLELINE, 0, 0), 0);
+		gint n_visible = scintilla_send_message(sci, SCI_LINESONSCREEN, 0, 0);
+
+		if (! take_dirty_lines(ranges, first_visible, first_visible + n_visible + 1, &lines))
+			take_dirty_lines(ranges, 0, G_MAXINT, &lines);
 	}
+	else
+	{
+		GHashTableIter iter;
+		gpointer key;
 
-	/* set current time for the next key press */
-	time_prev = time_now;
+		/* then the other documents */
+		ranges = NULL;
+		g_hash_table_iter_init(&iter, dirty_lines);
+		while (g_hash_table_iter_next(&iter, &key, (gpointer *) &ranges))
+		{
+			doc = document_find_by_id(GPOINTER_TO_UINT(key));
+			if (doc != NULL && ranges->len > 0)
+				break;
+			/* nothing left or the document has been closed */
+			g_hash_table_iter_remove(&iter);
+			ranges = NULL;
+		}
+		if (ranges == NULL)
+			return FALSE;
+
+		take_dirty_lines(ranges, 0, G_MAXINT, &lines);
+	}
 
-	return ret;
+	check_lines(doc, &lines);
+	return TRUE;
 }
 
 
-static void check_on_text_changed(GeanyDocument *doc, gint position, gint lines_added)
+static gboolean check_dirty_lines_cb(gpointer data)
 {
-	gint line_number;
-	gint line_count;
+	gint64 deadline = g_get_monotonic_time() + CHECK_SLICE_DURATION;
+
+	/* check in small slices, not to block the UI */
+	do
+	{
+		if (! check_next_dirty_lines())
+		{
+			check_source_id = 0;
+			return FALSE;
+		}
+	}
+	while (g_get_monotonic_time() < deadline);
+
+	return TRUE;
+}
+
+
+static gboolean check_dirty_lines_delayed_cb(gpointer data)
+{
+	check_source_id = plugin_idle_add(geany_plugin, check_dirty_lines_cb, NULL);
+	return FALSE;
+}
 
-	/* Iterating over all lines which changed as indicated by lines_added. lines_added is 0
-	 * if only one line has changed, in this case set line_count to 1. Otherwise, iterating over all
-	 * new lines makes spell checking work for pasted text. */
-	line_count = MAX(1, lines_added);
 
-	line_number = sci_get_line_from_position(doc->editor->sci, position);
-	/* TODO: storing these information in the global check_line_data struct isn't that good.
-	 * The data gets overwritten when a new line is inserted and so there is a chance that the
-	 * previous line is not checked to the end. One solution could be to simple maintain a list
-	 * of line numbers which needs to be checked and do this in the timeout handler. */
-	check_line_data.doc = doc;
-	check_line_data.line_number = line_number;
-	check_line_data.line_count = line_count;
+/* (Re)starts checking the dirty lines after delay milliseconds */
+static void schedule_check(guint delay)
+{
+	if (check_source_id != 0)
+		g_source_remove(check_source_id);
 
-	/* check only once in a while */
-	if (! need_delay())
-		check_lines(NULL);
+	if (delay > 0)
+		check_source_id = plugin_timeout_add(geany_plugin, delay, check_dirty_lines_delayed_cb, NULL);
+	else
+		check_source_id = plugin_idle_add(geany_plugin, check_dirty_lines_cb, NULL);
 }
 
 
 gboolean sc_gui_editor_notify(GObject *object, GeanyEditor *editor,
 							  SCNotification *nt, gpointer data)
 {
-	if (! sc_info->check_while_typing)
-		return FALSE;
-
 	if (nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT))
 	{
-		check_on_text_changed(editor->document, nt->position, nt->linesAdded);
+		GeanyDocument *doc = editor->document;
+		gint line_number = sci_get_line_from_position(editor->sci, nt->position);
+
+		/* outdate the checks in progress */
+		sc_speller_document_modified(doc);
+
+		/* keep the lines waiting to be checked in sync with the text */
+		if (nt->linesAdded != 0)
+			shift_dirty_lines(doc, line_number, nt->linesAdded);
+
+		if (! sc_info->check_while_typing)
+			return FALSE;
+
+		/* check the changed lines, all the new ones for pasted text */
+		mark_lines_dirty(doc, line_number, MAX(1, nt->linesAdded + 1));
+
+		/* pause checking while typing */
+		schedule_check(CHECK_DELAY);
 	}
 
 	return FALSE;
@@ -769,8 +946,10 @@ void sc_gui_init(void)
 void sc_gui_free(void)
 {
 	g_free(clickinfo.word);
-	if (check_line_data.check_while_typing_idle_source_id != 0)
-		g_source_remove(check_line_data.check_while_typing_idle_source_id);
+	if (check_source_id != 0)
+		g_source_remove(check_source_id);
+	if (dirty_lines != NULL)
+		g_hash_table_destroy(dirty_lines);
 	if (sc_info->toolbar_button != NULL)
 		gtk_widget_destroy(GTK_WIDGET(sc_info->toolbar_button));
 	free_editor_menu_items();
@@ -38,8 +38,69 @@
 
 
 
+/* size of the pieces a document is split into for checking it on several threads */
+#define CHUNK_SIZE (64 * 1024)
+
+/* how often the main thread looks for finished jobs, in milliseconds */
+#define JOBS_POLL_INTERVAL 20
+
+/* number of verdicts after which they are forgotten, to bound the memory used */
+#define VERDICTS_MAX 100000
+
+/* incremented on each modification of a document, see sc_speller_document_modified() */
+#define DOC_VERSION_QUARK (g_quark_from_static_string("spellcheck-document-version"))
+
+/* text and style bytes of a job, see SCI_GETSTYLEDTEXT */
+#define JOB_CHAR(job, i) ((job)->styled_text[(i) * 2])
+#define JOB_STYLE(job, i) ((guchar) (job)->styled_text[(i) * 2 + 1])
+
+typedef struct
+{
+	gint start;
+	gint end;
+	/* start and end offsets of the misspelled words, written only by the checking thread */
+	GArray *misspelled;
+} CheckChunk;
+
+typedef struct
+{
+	guint doc_id;
+	guint doc_version;
+	gint start_pos;
+	gint length;
+	gint lexer;
+	gboolean word_chars[256];
+	gchar *styled_text;
+	GArray *chunks;
+	gint pending; /* number of chunks left to check, atomic */
+	gint cancelled; /* atomic */
+} CheckJob;
+
+typedef struct
+{
+	CheckJob *job;
+	guint index;
+} CheckChunkTask;
+
+
 static EnchantBroker *sc_speller_broker = NULL;
 static EnchantDict *sc_speller_dict = NULL;
+/* the dictionary is shared with the checking threads */
+G_LOCK_DEFINE_STATIC(sc_speller_dict);
+
+/* whether the words already checked are correct, with the dictionary's generation */
+static GHashTable *sc_speller_verdicts = NULL;
+static guint sc_speller_verdicts_generation = 0;
+G_LOCK_DEFINE_STATIC(sc_speller_verdicts);
+
+static GThreadPool *sc_speller_pool = NULL;
+static GSList *sc_speller_jobs = NULL;
+static guint sc_speller_jobs_poll_id = 0;
+
+
+static gboolean is_text_style(gint lexer, gint style);
+static gboolean check_jobs_poll_cb(gpointer data);
+static void start_check(GeanyDocument *doc, gint start_pos, gint end_pos);
 
 
 
@@ -58,155 +119,305 @@ static gboolean is_word_sep(gunichar c)
 
 
 /* Strip punctuation and white space, more or less Unicode-safe.
- * The offset of the start of the word is stored in offset if non-NULL. */
-static gchar *strip_word(const gchar *word_to_check, gint *result_offset)
+ * This works in place: the string is truncated and the start of the stripped word
+ * inside it is returned. */
+static gchar *strip_word(gchar *word)
 {
-	gunichar c;
-	gchar *word = g_strdup(word_to_check);
-	gchar *word_start = word;
 	gchar *word_end;
-	gint offset = 0;
-	gint word_len;
-	gint new_word_len;
+	gunichar c;
 
 	/* strip from the left */
-	do
+	while (*word != '\0')
 	{
 		c = g_utf8_get_char_validated(word, -1);
-		if (is_word_sep(c))
-		{	/* skip this character */
-			word = g_utf8_next_char(word);
-		}
-		else
+		if (c == (gunichar) -1 || c == (gunichar) -2 || ! is_word_sep(c))
 			break;
-	} while (c != (gunichar) -1 && c != 0 && *word != '\0');
-	word_len = strlen(word_to_check);
-	offset = word - word_start;
-	new_word_len = word_len - offset;
-
-	if (new_word_len <= 0)
-	{	/* empty or only punctuation in input string */
-		*result_offset = 0;
-		g_free(word_start);
-		return NULL;
-	}
-	/* move the string in-place and truncate it */
-	g_memmove(word_start, word, new_word_len);
-	word = word_start;
-	word[new_word_len] = '\0';
-	if (EMPTY(word))
-	{
-		g_free(word);
-		return NULL;
+		word = g_utf8_next_char(word);
 	}
 	/* strip from the right */
 	word_end = word + strlen(word);
-	do
+	while (word_end > word)
 	{
-		word_end = g_utf8_prev_char(word_end);
-		c = g_utf8_get_char_validated(word_end, -1);
-		if (is_word_sep(c))
-		{	/* skip this character */
-			*word_end = '\0';
-		}
-		else
-			break;
-	} while (c != (gunichar) -1 && word_end >= word);
+		gchar *prev = g_utf8_find_prev_char(word, word_end);
 
-	if (result_offset != NULL)
-		*result_offset = offset;
+		if (prev == NULL)
+			break;
+		c = g_utf8_get_char_validated(prev, word_end - prev);
+		if (c == (gunichar) -1 || c == (gunichar) -2 || ! is_word_sep(c))
+			break;
+		word_end = prev;
+	}
+	*word_end = '\0';
 
 	return word;
 }
 
 
-static gint sc_speller_check_word(GeanyDocument *doc, gint line_number, const gchar *word,
-						   gint start_pos, gint end_pos)
+static void sc_speller_verdicts_clear(void)
 {
-	gsize n_suggs = 0;
-	gchar *word_to_check;
-	gint offset;
+	G_LOCK(sc_speller_verdicts);
+	if (sc_speller_verdicts != NULL)
+		g_hash_table_remove_all(sc_speller_verdicts);
+	sc_speller_verdicts_generation++;
+	G_UNLOCK(sc_speller_verdicts);
+}
 
-	g_return_val_if_fail(sc_speller_dict != NULL, 0);
-	g_return_val_if_fail(doc != NULL, 0);
-	g_return_val_if_fail(word != NULL, 0);
-	g_return_val_if_fail(start_pos >= 0 && end_pos >= 0, 0);
 
-	if (EMPTY(word))
-		return 0;
+/* Checks a word against the dictionary, first looking it up in the verdicts of the words
+ * already checked. local_verdicts is an optional cache only used by the calling thread,
+ * to avoid locking for each occurrence of the common words. This is thread-safe. */
+static gboolean check_word_cached(const gchar *word, GHashTable *local_verdicts)
+{
+	gpointer verdict;
+	gboolean found;
+	gboolean correct;
+	guint generation;
+
+	if (local_verdicts != NULL &&
+		g_hash_table_lookup_extended(local_verdicts, word, NULL, &verdict))
+		return GPOINTER_TO_INT(verdict);
+
+	G_LOCK(sc_speller_verdicts);
+	found = g_hash_table_lookup_extended(sc_speller_verdicts, word, NULL, &verdict);
+	generation = sc_speller_verdicts_generation;
+	G_UNLOCK(sc_speller_verdicts);
+
+	if (found)
+		correct = GPOINTER_TO_INT(verdict);
+	else
+	{
+		G_LOCK(sc_speller_dict);
+		correct = (sc_speller_dict == NULL || enchant_dict_check(sc_speller_dict, word, -1) == 0);
+		G_UNLOCK(sc_speller_dict);
+
+		G_LOCK(sc_speller_verdicts);
+		/* don't store verdicts from a dictionary that has been changed meanwhile */
+		if (generation == sc_speller_verdicts_generation)
+		{
+			if (g_hash_table_size(sc_speller_verdicts) >= VERDICTS_MAX)
+				g_hash_table_remove_all(sc_speller_verdicts);
+			g_hash_table_insert(sc_speller_verdicts, g_strdup(word), GINT_TO_POINTER(correct));
+		}
+		G_UNLOCK(sc_speller_verdicts);
+	}
+
+	if (local_verdicts != NULL)
+		g_hash_table_insert(local_verdicts, g_strdup(word), GINT_TO_POINTER(correct));
+
+	return correct;
+}
+
+
+static guint get_doc_version(GeanyDocument *doc)
+{
+	return GPOINTER_TO_UINT(g_object_get_qdata(G_OBJECT(doc->editor->sci), DOC_VERSION_QUARK));
+}
+
+
+/* Has to be called on every text insertion and deletion, so running checks of the
+ * document know their results are outdated */
+void sc_speller_document_modified(GeanyDocument *doc)
+{
+	g_object_set_qdata(G_OBJECT(doc->editor->sci), DOC_VERSION_QUARK,
+		GUINT_TO_POINTER(get_doc_version(doc) + 1));
+}
+
+
+/* Creates a check job for the range [start_pos, end_pos[ of the document.
+ * The text and style bytes are read from Scintilla all at once here, so the job itself
+ * doesn't need to access it anymore. */
+static CheckJob *check_job_new(GeanyDocument *doc, gint start_pos, gint end_pos)
+{
+	ScintillaObject *sci = doc->editor->sci;
+	CheckJob *job = g_slice_new0(CheckJob);
+	struct Sci_TextRange tr;
+	gint wordchars_len;
+	gchar *wordchars;
+	gint i;
+
+	job->doc_id = doc->id;
+	job->doc_version = get_doc_version(doc);
+	job->start_pos = start_pos;
+	job->length = end_pos - start_pos;
+	job->lexer = scintilla_send_message(sci, SCI_GETLEXER, 0, 0);
+
+	/* make sure the range is styled, the styles tell what's text */
+	scintilla_send_message(sci, SCI_COLOURISE, start_pos, end_pos);
+	job->styled_text = g_malloc(job->length * 2 + 2);
+	tr.chrg.cpMin = start_pos;
+	tr.chrg.cpMax = end_pos;
+	tr.lpstrText = job->styled_text;
+	scintilla_send_message(sci, SCI_GETSTYLEDTEXT, 0, (sptr_t) &tr);
+
+	/* use the document's word characters, plus ' (single quote) to be able to check
+	 * for "doesn't", "isn't" and similar, but treat underscores as separators */
+	wordchars_len = scintilla_send_message(sci, SCI_GETWORDCHARS, 0, 0);
+	wordchars = g_malloc0(wordchars_len + 1);
+	scintilla_send_message(sci, SCI_GETWORDCHARS, 0, (sptr_t) wordchars);
+	for (i = 0; i < wordchars_len; i++)
+		job->word_chars[(guchar) wordchars[i]] = TRUE;
+	g_free(wordchars);
+	job->word_chars['\''] = TRUE;
+	job->word_chars['_'] = FALSE;
+	/* non-ASCII characters are handled by strip_word() */
+	for (i = 0x80; i < 0x100; i++)
+		job->word_chars[i] = TRUE;
+
+	job->chunks = g_array_new(FALSE, TRUE, sizeof(CheckChunk));
+
+	return job;
+}
+
+
+static void check_job_add_chunk(CheckJob *job, gint start, gint end)
+{
+	CheckChunk chunk;
+
+	chunk.start = start;
+	chunk.end = end;
+	chunk.misspelled = g_array_new(FALSE, FALSE, sizeof(gint));
+	g_array_append_val(job->chunks, chunk);
+}
+
+
+static void check_job_free(CheckJob *job)
+{
+	guint i;
+
+	for (i = 0; i < job->chunks->len; i++)
+		g_array_free(g_array_index(job->chunks, CheckChunk, i).misspelled, TRUE);
+	g_array_free(job->chunks, TRUE);
+	g_free(job->styled_text);
+	g_slice_free(CheckJob, job);
+}
 
-	/* ignore numbers or words starting with digits */
-	if (isdigit(*word))
-		return 0;
 
-	/* ignore non-text */
-	if (! sc_speller_is_text(doc, start_pos))
-		return 0;
+/* Finds the misspelled words in [chunk->start, chunk->end[ of the job's text, and stores
+ * their ranges in chunk->misspelled. This doesn't access Scintilla so it can be run
+ * from any thread. */
+static void check_chunk(CheckJob *job, CheckChunk *chunk, GHashTable *local_verdicts)
+{
+	GString *word = g_string_sized_new(64);
+	gint i = chunk->start;
 
-	/* strip punctuation and white space */
-	word_to_check = strip_word(word, &offset);
-	if (EMPTY(word_to_check))
+	while (i < chunk->end)
 	{
-		g_free(word_to_check);
-		return 0;
+		gint word_start;
+		gchar *stripped;
+
+		if (! job->word_chars[(guchar) JOB_CHAR(job, i)])
+		{
+			i++;
+			continue;
+		}
+
+		word_start = i;
+		g_string_truncate(word, 0);
+		while (i < chunk->end && job->word_chars[(guchar) JOB_CHAR(job, i)])
+			g_string_append_c(word, JOB_CHAR(job, i++));
+
+		/* ignore numbers or words starting with digits, and non-text */
+		if (isdigit((guchar) word->str[0]) ||
+			! is_text_style(job->lexer, JOB_STYLE(job, word_start)))
+			continue;
+
+		stripped = strip_word(word->str);
+		if (EMPTY(stripped))
+			continue;
+
+		if (! check_word_cached(stripped, local_verdicts))
+		{
+			gint range[2];
+
+			range[0] = word_start + (stripped - word->str);
+			range[1] = range[0] + strlen(stripped);
+			g_array_append_vals(chunk->misspelled, range, 2);
+		}
+
+		if (g_atomic_int_get(&job->cancelled))
+			break;
 	}
+	g_string_free(word, TRUE);
+}
+
 
-	/* recalculate start_pos and end_pos */
-	start_pos += offset;
-	end_pos = start_pos + strlen(word_to_check);
+/* Adds the suggestions for a misspelled word to the messages window */
+static void report_misspelled_word(GeanyDocument *doc, gint line_number, const gchar *word)
+{
+	gsize n_suggs = 0;
+	gsize j;
+	gchar **suggs;
+	GString *str;
 
-	/* early out if the word is spelled correctly */
-	if (enchant_dict_check(sc_speller_dict, word_to_check, -1) == 0)
+	str = g_string_sized_new(256);
+	suggs = sc_speller_dict_suggest(word, &n_suggs);
+	if (suggs != NULL)
 	{
-		g_free(word_to_check);
-		return 0;
+		g_string_append_printf(str, "line %d: %s | ",  line_number + 1, word);
+
+		g_string_append(str, _("Try: "));
+
+		/* Now find the misspellings in the line, limit suggestions to a maximum of 15 (for now) */
+		for (j = 0; j < MIN(n_suggs, 15); j++)
+		{
+			g_string_append(str, suggs[j]);
+			g_string_append_c(str, ' ');
+		}
+
+		msgwin_msg_add(COLOR_RED, line_number + 1, doc, "%s", str->str);
+
+		if (n_suggs > 0)
+			sc_speller_dict_free_string_list(suggs);
 	}
+	g_string_free(str, TRUE);
+}
 
-	editor_indicator_set_on_range(doc->editor, GEANY_INDICATOR_ERROR, start_pos, end_pos);
 
-	if (sc_info->use_msgwin && line_number != -1)
+/* Applies the results of a finished job to its document, and returns the number of
+ * misspelled words */
+static gint check_job_apply(CheckJob *job, GeanyDocument *doc)
+{
+	gint n_misspelled = 0;
+	guint i, j;
+
+	for (i = 0; i < job->chunks->len; i++)
 	{
-		gsize j;
-		gchar **suggs;
-		GString *str;
+		GArray *misspelled = g_array_index(job->chunks, CheckChunk, i).misspelled;
 
-		str = g_string_sized_new(256);
-		suggs = enchant_dict_suggest(sc_speller_dict, word_to_check, -1, &n_suggs);
-		if (suggs != NULL)
+		for (j = 0; j + 1 < misspelled->len; j += 2)
 		{
-			g_string_append_printf(str, "line %d: %s | ",  line_number + 1, word_to_check);
+			gint start = g_array_index(misspelled, gint, j);
+			gint end = g_array_index(misspelled, gint, j + 1);
 
-			g_string_append(str, _("Try: "));
+			editor_indicator_set_on_range(doc->editor, GEANY_INDICATOR_ERROR,
+				job->start_pos + start, job->start_pos + end);
 
-			/* Now find the misspellings in the line, limit suggestions to a maximum of 15 (for now) */
-			for (j = 0; j < MIN(n_suggs, 15); j++)
+			if (sc_info->use_msgwin)
 			{
-				g_string_append(str, suggs[j]);
-				g_string_append_c(str, ' ');
-			}
+				gchar *word = g_malloc(end - start + 1);
+				gint k;
 
-			msgwin_msg_add(COLOR_RED, line_number + 1, doc, "%s", str->str);
+				for (k = start; k < end; k++)
+					word[k - start] = JOB_CHAR(job, k);
+				word[end - start] = '\0';
 
-			if (suggs != NULL && n_suggs > 0)
-				enchant_dict_free_string_list(sc_speller_dict, suggs);
+				report_misspelled_word(doc,
+					sci_get_line_from_position(doc->editor->sci, job->start_pos + start), word);
+				g_free(word);
+			}
+			n_misspelled++;
 		}
-		g_string_free(str, TRUE);
 	}
 
-	g_free(word_to_check);
-	return n_suggs;
+	return n_misspelled;
 }
 
 
 gint sc_speller_process_line(GeanyDocument *doc, gint line_number)
 {
+	CheckJob *job;
 	gint pos_start, pos_end;
-	gint wstart, wend;
-	gint suggestions_found = 0;
-	gint wordchars_len;
-	gchar *wordchars;
-	gchar *underscore_in_wordchars = NULL;
-	gboolean wordchars_modified = FALSE;
+	gint n_misspelled;
 
 	g_return_val_if_fail(sc_speller_dict != NULL, 0);
 	g_return_val_if_fail(doc != NULL, 0);
@@ -214,78 +425,162 @@ gint sc_speller_process_line(GeanyDocument *doc, gint line_number)
 	if (! DOC_VALID(doc))
 		return 0; /* current document has been closed */
 
-	/* add ' (single quote) temporarily to wordchars
-	 * to be able to check for "doesn't", "isn't" and similar */
-	wordchars_len = scintilla_send_message(doc->editor->sci, SCI_GETWORDCHARS, 0, 0);
-	wordchars = g_malloc0(wordchars_len + 2); /* 2 = temporarily added "'" and "\0" */
-	scintilla_send_message(doc->editor->sci, SCI_GETWORDCHARS, 0, (sptr_t)wordchars);
-	if (! strchr(wordchars, '\''))
+	pos_start = sci_get_position_from_line(doc->editor->sci, line_number);
+	pos_end = sci_get_position_from_line(doc->editor->sci, line_number + 1);
+
+	job = check_job_new(doc, pos_start, pos_end);
+	check_job_add_chunk(job, 0, job->length);
+
+	check_chunk(job, &g_array_index(job->chunks, CheckChunk, 0), NULL);
+	n_misspelled = check_job_apply(job, doc);
+
+	check_job_free(job);
+	return n_misspelled;
+}
+
+
+static void check_chunk_worker(gpointer data, gpointer user_data)
+{
+	CheckChunkTask *task = data;
+	CheckJob *job = task->job;
+
+	if (! g_atomic_int_get(&job->cancelled))
 	{
-		/* temporarily add "'" to the wordchars */
-		wordchars[wordchars_len] = '\'';
-		wordchars_modified = TRUE;
+		GHashTable *local_verdicts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+		check_chunk(job, &g_array_index(job->chunks, CheckChunk, task->index), local_verdicts);
+		g_hash_table_destroy(local_verdicts);
 	}
-	underscore_in_wordchars = strchr(wordchars, '_');
-	if (underscore_in_wordchars != NULL)
+
+	/* the main thread notices it in check_jobs_poll_cb() */
+	g_atomic_int_add(&job->pending, -1);
+
+	g_slice_free(CheckChunkTask, task);
+}
+
+
+static void check_job_finish(CheckJob *job)
+{
+	GeanyDocument *doc = document_find_by_id(job->doc_id);
+
+	sc_speller_jobs = g_slist_remove(sc_speller_jobs, job);
+
+	if (! g_atomic_int_get(&job->cancelled) && doc != NULL)
 	{
-		/* Temporarily remove underscore from the wordchars to treat
-		 * it as a word seperator. Replace it by a "'" which we added already above. */
-		*underscore_in_wordchars = '\'';
-		wordchars_modified = TRUE;
+		if (get_doc_version(doc) != job->doc_version)
+		{	/* the document changed while checking it, the results are outdated */
+			gint length = sci_get_length(doc->editor->sci);
+
+			start_check(doc, MIN(job->start_pos, length),
+				MIN(job->start_pos + job->length, length));
+		}
+		else if (check_job_apply(job, doc) == 0 && sc_info->use_msgwin)
+			msgwin_msg_add(COLOR_BLUE, -1, NULL, _("The checked text is spelled correctly."));
 	}
-	if (wordchars_modified)
+
+	if (sc_speller_jobs == NULL)
+		ui_progress_bar_stop();
+
+	check_job_free(job);
+}
+
+
+/* Finishes the jobs whose chunks have all been checked. The workers don't schedule this
+ * themselves because plugin_idle_add() may only be called from the main thread. */
+static gboolean check_jobs_poll_cb(gpointer data)
+{
+	GSList *node, *next;
+
+	/* finishing a job may start a new one, but only ever prepends it */
+	for (node = sc_speller_jobs; node != NULL; node = next)
 	{
-		/* apply previously changed WORDCHARS setting */
-		scintilla_send_message(doc->editor->sci, SCI_SETWORDCHARS, 0, (sptr_t)wordchars);
+		next = node->next;
+		if (g_atomic_int_get(&((CheckJob *) node->data)->pending) == 0)
+			check_job_finish(node->data);
 	}
-	pos_start = sci_get_position_from_line(doc->editor->sci, line_number);
-	pos_end = sci_get_position_from_line(doc->editor->sci, line_number + 1);
 
-	while (pos_start < pos_end)
+	if (sc_speller_jobs != NULL)
+		return TRUE;
+
+	sc_speller_jobs_poll_id = 0;
+	return FALSE;
+}
+
+
+/* Snapshots the range [start_pos, end_pos[ of the document, and checks it in chunks of
+ * whole lines on the worker threads */
+static void start_check(GeanyDocument *doc, gint start_pos, gint end_pos)
+{
+	CheckJob *job;
+	GSList *node;
+	gint chunk_start;
+	guint i;
+
+	/* cancel any previous check of the document, it is superseded by this one */
+	foreach_slist(node, sc_speller_jobs)
 	{
-		gchar *word;
+		CheckJob *other = node->data;
 
-		wstart = scintilla_send_message(doc->editor->sci, SCI_WORDSTARTPOSITION, pos_start, TRUE);
-		wend = scintilla_send_message(doc->editor->sci, SCI_WORDENDPOSITION, wstart, FALSE);
-		if (wstart == wend)
-			break;
+		if (other->doc_id == doc->id)
+			g_atomic_int_set(&other->cancelled, TRUE);
+	}
 
-		word = sci_get_contents_range(doc->editor->sci, wstart, wend);
+	if (sc_speller_pool == NULL)
+	{
+		gint n_threads = 4;
 
-		suggestions_found += sc_speller_check_word(doc, line_number, word, wstart, wend);
+#if GLIB_CHECK_VERSION(2, 36, 0)
+		n_threads = g_get_num_processors();
+#endif
+		sc_speller_pool = g_thread_pool_new(check_chunk_worker, NULL, n_threads, FALSE, NULL);
+	}
 
-		pos_start = wend + 1;
+	job = check_job_new(doc, start_pos, end_pos);
 
-		g_free(word);
+	/* split at line ends so words are never cut */
+	for (chunk_start = 0; chunk_start < job->length || job->chunks->len == 0; )
+	{
+		gint chunk_end = MIN(chunk_start + CHUNK_SIZE, job->length);
+
+		while (chunk_end < job->length && JOB_CHAR(job, chunk_end - 1) != '\n')
+			chunk_end++;
+
+		check_job_add_chunk(job, chunk_start, chunk_end);
+		chunk_start = chunk_end;
 	}
 
-	if (wordchars_modified)
+	if (sc_speller_jobs == NULL)
+		ui_progress_bar_start(_("Checking"));
+	sc_speller_jobs = g_slist_prepend(sc_speller_jobs, job);
+
+	/* the chunks array must not change anymore once the first task is pushed */
+	job->pending = job->chunks->len;
+	for (i = 0; i < job->chunks->len; i++)
 	{
-		if (underscore_in_wordchars != NULL)
-			/* re-add underscore if we removed it above */
-			*underscore_in_wordchars = '_';
-		/* reset wordchars for the current document */
-		wordchars[wordchars_len] = '\0';
-		scintilla_send_message(doc->editor->sci, SCI_SETWORDCHARS, 0, (sptr_t)wordchars);
+		CheckChunkTask *task = g_slice_new(CheckChunkTask);
+
+		task->job = job;
+		task->index = i;
+		g_thread_pool_push(sc_speller_pool, task, NULL);
 	}
-	g_free(wordchars);
-	return suggestions_found;
+
+	if (sc_speller_jobs_poll_id == 0)
+		sc_speller_jobs_poll_id = plugin_timeout_add(geany_plugin, JOBS_POLL_INTERVAL,
+			check_jobs_poll_cb, NULL);
 }
 
 
 void sc_speller_check_document(GeanyDocument *doc)
 {
-	gint i;
 	gint first_line, last_line;
 	gchar *dict_string = NULL;
-	gint suggestions_found = 0;
 
 	g_return_if_fail(sc_speller_dict != NULL);
 	g_return_if_fail(doc != NULL);
 
-	ui_progress_bar_start(_("Checking"));
-
+	G_LOCK(sc_speller_dict);
 	enchant_dict_describe(sc_speller_dict, dict_describe, &dict_string);
+	G_UNLOCK(sc_speller_dict);
 
 	if (sci_has_selection(doc->editor->sci))
 	{
@@ -304,7 +599,7 @@ void sc_speller_check_document(GeanyDocument *doc)
 	else
 	{
 		first_line = 0;
-		last_line = sci_get_line_count(doc->editor->sci);
+		last_line = sci_get_line_count(doc->editor->sci) - 1;
 		if (sc_info->use_msgwin)
 			msgwin_msg_add(COLOR_BLUE, -1, NULL, _("Checking file \"%s\" (using %s):"),
 				DOC_FILENAME(doc), dict_string);
@@ -312,29 +607,8 @@ void sc_speller_check_document(GeanyDocument *doc)
 	}
 	g_free(dict_string);
 
-	if (first_line == last_line)
-	{
-		suggestions_found += sc_speller_process_line(doc, first_line);
-	}
-	else
-	{
-		for (i = first_line; i < last_line; i++)
-		{
-			if (! DOC_VALID(doc))
-			{	/* current document has been closed (might happen while checking large files) */
-				ui_progress_bar_stop();
-				return;
-			}
-			suggestions_found += sc_speller_process_line(doc, i);
-
-			/* process other GTK events to keep the GUI being responsive */
-			while (g_main_context_iteration(NULL, FALSE));
-		}
-	}
-	if (suggestions_found == 0 && sc_info->use_msgwin)
-		msgwin_msg_add(COLOR_BLUE, -1, NULL, _("The checked text is spelled correctly."));
-
-	ui_progress_bar_stop();
+	start_check(doc, sci_get_position_from_line(doc->editor->sci, first_line),
+		sci_get_position_from_line(doc->editor->sci, last_line + 1));
 }
 
 
@@ -461,7 +735,9 @@ void sc_speller_dict_free_string_list(gchar **tmp_suggs)
 {
 	g_return_if_fail(sc_speller_dict != NULL);
 
+	G_LOCK(sc_speller_dict);
 	enchant_dict_free_string_list(sc_speller_dict, tmp_suggs);
+	G_UNLOCK(sc_speller_dict);
 }
 
 
@@ -470,24 +746,39 @@ void sc_speller_add_word(const gchar *word)
 	g_return_if_fail(sc_speller_dict != NULL);
 	g_return_if_fail(word != NULL);
 
+	G_LOCK(sc_speller_dict);
 	enchant_dict_add_to_pwl(sc_speller_dict, word, -1);
+	G_UNLOCK(sc_speller_dict);
+	sc_speller_verdicts_clear();
 }
 
 gboolean sc_speller_dict_check(const gchar *word)
 {
+	gboolean result;
+
 	g_return_val_if_fail(sc_speller_dict != NULL, FALSE);
 	g_return_val_if_fail(word != NULL, FALSE);
 
-	return enchant_dict_check(sc_speller_dict, word, -1);
+	G_LOCK(sc_speller_dict);
+	result = enchant_dict_check(sc_speller_dict, word, -1);
+	G_UNLOCK(sc_speller_dict);
+
+	return result;
 }
 
 
 gchar **sc_speller_dict_suggest(const gchar *word, gsize *n_suggs)
 {
+	gchar **suggs;
+
 	g_return_val_if_fail(sc_speller_dict != NULL, NULL);
 	g_return_val_if_fail(word != NULL, NULL);
 
-	return enchant_dict_suggest(sc_speller_dict, word, -1, n_suggs);
+	G_LOCK(sc_speller_dict);
+	suggs = enchant_dict_suggest(sc_speller_dict, word, -1, n_suggs);
+	G_UNLOCK(sc_speller_dict);
+
+	return suggs;
 }
 
 
@@ -496,7 +787,10 @@ void sc_speller_add_word_to_session(const gchar *word)
 	g_return_if_fail(sc_speller_dict != NULL);
 	g_return_if_fail(word != NULL);
 
+	G_LOCK(sc_speller_dict);
 	enchant_dict_add_to_session(sc_speller_dict, word, -1);
+	G_UNLOCK(sc_speller_dict);
+	sc_speller_verdicts_clear();
 }
 
 
@@ -506,17 +800,24 @@ void sc_speller_store_replacement(const gchar *old_word, const gchar *new_word)
 	g_return_if_fail(old_word != NULL);
 	g_return_if_fail(new_word != NULL);
 
+	G_LOCK(sc_speller_dict);
 	enchant_dict_store_replacement(sc_speller_dict, old_word, -1, new_word, -1);
+	G_UNLOCK(sc_speller_dict);
 }
 
 
 void sc_speller_reinit_enchant_dict(void)
 {
 	const gchar *lang = sc_info->default_language;
+	EnchantDict *dict;
 
 	/* Release a previous dict object */
+	G_LOCK(sc_speller_dict);
 	if (sc_speller_dict != NULL)
 		enchant_broker_free_dict(sc_speller_broker, sc_speller_dict);
+	sc_speller_dict = NULL;
+	G_UNLOCK(sc_speller_dict);
+	sc_speller_verdicts_clear();
 
 #if HAVE_ENCHANT_1_5
 	{
@@ -554,10 +855,13 @@ void sc_speller_reinit_enchant_dict(void)
 
 	/* Request new dict object */
 	if (! EMPTY(lang))
-		sc_speller_dict = enchant_broker_request_dict(sc_speller_broker, lang);
+		dict = enchant_broker_request_dict(sc_speller_broker, lang);
 	else
-		sc_speller_dict = NULL;
-	if (sc_speller_dict == NULL)
+		dict = NULL;
+	G_LOCK(sc_speller_dict);
+	sc_speller_dict = dict;
+	G_UNLOCK(sc_speller_dict);
+	if (dict == NULL)
 	{
 		broker_init_failed();
 		gtk_widget_set_sensitive(sc_info->menu_item, FALSE);
@@ -572,6 +876,7 @@ void sc_speller_reinit_enchant_dict(void)
 void sc_speller_init(void)
 {
 	sc_speller_broker = enchant_broker_init();
+	sc_speller_verdicts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
 	sc_speller_reinit_enchant_dict();
 }
@@ -579,6 +884,28 @@ void sc_speller_init(void)
 
 void sc_speller_free(void)
 {
+	GSList *node;
+
+	/* let the running checks finish, they stop early once cancelled */
+	foreach_slist(node, sc_speller_jobs)
+		g_atomic_int_set(&((CheckJob *) node->data)->cancelled, TRUE);
+	if (sc_speller_pool != NULL)
+		g_thread_pool_free(sc_speller_pool, FALSE, TRUE);
+	sc_speller_pool = NULL;
+	if (sc_speller_jobs_poll_id != 0)
+		g_source_remove(sc_speller_jobs_poll_id);
+	sc_speller_jobs_poll_id = 0;
+	if (sc_speller_jobs != NULL)
+	{
+		foreach_slist(node, sc_speller_jobs)
+			check_job_free(node->data);
+		g_slist_free(sc_speller_jobs);
+		sc_speller_jobs = NULL;
+		ui_progress_bar_stop();
+	}
+	g_hash_table_destroy(sc_speller_verdicts);
+	sc_speller_verdicts = NULL;
+
 	sc_speller_dicts_free();
 	if (sc_speller_dict != NULL)
 		enchant_broker_free_dict(sc_speller_broker, sc_speller_dict);
@@ -586,19 +913,14 @@ void sc_speller_free(void)
 }
 
 
-gboolean sc_speller_is_text(GeanyDocument *doc, gint pos)
+/* Whether the given style of the given lexer is text to check. This doesn't need to access
+ * Scintilla so it can be used from the checking threads. */
+static gboolean is_text_style(gint lexer, gint style)
 {
-	gint lexer, style;
-
-	g_return_val_if_fail(doc != NULL, FALSE);
-	g_return_val_if_fail(pos >= 0, FALSE);
-
-	style = sci_get_style_at(doc->editor->sci, pos);
 	/* early out for the default style */
 	if (style == STYLE_DEFAULT)
 		return TRUE;
 
-	lexer = scintilla_send_message(doc->editor->sci, SCI_GETLEXER, 0, 0);
 	switch (lexer)
 	{
 		case SCLEX_ABAQUS:
@@ -1251,3 +1573,17 @@ gboolean sc_speller_is_text(GeanyDocument *doc, gint pos)
 	 * valid text to not ignore more than we want */
 	return TRUE;
 }
+
+
+gboolean sc_speller_is_text(GeanyDocument *doc, gint pos)
+{
+	gint lexer, style;
+
+	g_return_val_if_fail(doc != NULL, FALSE);
+	g_return_val_if_fail(pos >= 0, FALSE);
+
+	style = sci_get_style_at(doc->editor->sci, pos);
+	lexer = scintilla_send_message(doc->editor->sci, SCI_GETLEXER, 0, 0);
+
+	return is_text_style(lexer, style);
+}
@@ -52,6 +52,21 @@ static GtkCellRenderer 		*render_icon, *render_text;
 
 static gboolean 			flag_on_expand_refresh 		= FALSE;
 
+/* ------------------
+ * LOADING STATE
+ * ------------------ */
+
+static guint 				icons_update_id 			= 0;
+static gchar 				*reveal_uri 				= NULL;
+static gboolean 			reveal_rename 				= FALSE;
+
+/* ------------------
+ * ICON CACHE
+ * ------------------ */
+
+static GHashTable 			*icon_cache 				= NULL; 	/* stock id or content type -> GdkPixbuf */
+static GHashTable 			*content_type_cache 		= NULL; 	/* extension -> content type */
+
 /* ------------------
  *  CONFIG VARS
  * ------------------ */
@@ -97,7 +112,8 @@ enum
 	TREEBROWSER_RENDER_ICON 							= 0,
 	TREEBROWSER_RENDER_TEXT 							= 1,
 
-	TREEBROWSER_FLAGS_SEPARATOR 						= -1
+	TREEBROWSER_FLAGS_SEPARATOR 						= -1,
+	TREEBROWSER_FLAGS_ICON_PENDING 						= 1
 };
 
 
@@ -160,6 +176,9 @@ static void 	treebrowser_bookmarks_set_state(void);
 static void 	treebrowser_load_bookmarks(void);
 static void 	gtk_tree_store_iter_clear_nodes(gpointer iter, gboolean delete_root);
 static void 	treebrowser_rename_current(void);
+static gboolean treebrowser_search(gchar *uri, gpointer parent);
+static gboolean treebrowser_expand_to_path(gchar* root, gchar* find);
+static void 	treebrowser_reveal_pending(void);
 static void 	on_menu_create_new_object(GtkMenuItem *menuitem, const gchar *type);
 static void 	load_settings(void);
 static gboolean save_settings(void);
@@ -193,19 +212,100 @@ tree_view_row_expanded_iter(GtkTreeView *tree_view, GtkTreeIter *iter)
 	return expanded;
 }
 
+static void
+icon_cache_value_free(gpointer icon)
+{
+	if (icon)
+		g_object_unref(icon);
+}
+
+/* Returns: a new reference to the icon cached for key, which may be NULL
+ * if there is none. found tells whether key was cached at all. */
+static GdkPixbuf *
+icon_cache_lookup(const gchar *key, gboolean *found)
+{
+	gpointer icon = NULL;
+
+	if (icon_cache == NULL)
+		icon_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, icon_cache_value_free);
+
+	*found = g_hash_table_lookup_extended(icon_cache, key, NULL, &icon);
+
+	return icon ? g_object_ref(icon) : NULL;
+}
+
+static GdkPixbuf *
+icon_cache_insert(const gchar *key, GdkPixbuf *icon)
+{
+	g_hash_table_insert(icon_cache, g_strdup(key), icon ? g_object_ref(icon) : NULL);
+
+	return icon;
+}
+
+static void
+on_icon_theme_changed(GtkIconTheme *icon_theme, gpointer user_data)
+{
+	if (icon_cache)
+		g_hash_table_remove_all(icon_cache);
+}
+
+/* Rows share the pixbufs, every call returns a new reference */
 static GdkPixbuf *
 utils_pixbuf_from_stock(const gchar *stock_id)
 {
-	GtkIconSet *icon_set;
+	GtkIconSet 	*icon_set;
+	GdkPixbuf 	*icon;
+	gboolean 	found;
+
+	icon = icon_cache_lookup(stock_id, &found);
+	if (found)
+		return icon;
 
 	icon_set = gtk_icon_factory_lookup_default(stock_id);
 
 	if (icon_set)
-		return gtk_icon_set_render_icon(icon_set, gtk_widget_get_default_style(),
+		icon = gtk_icon_set_render_icon(icon_set, gtk_widget_get_default_style(),
 										gtk_widget_get_default_direction(),
 										GTK_STATE_NORMAL, GTK_ICON_SIZE_MENU, NULL, NULL);
-	return NULL;
+
+	return icon_cache_insert(stock_id, icon);
+}
+
+#if defined(HAVE_GIO) && GTK_CHECK_VERSION(2, 14, 0)
+/* Same as g_content_type_guess() by name, remembered per extension. Names
+ * with an extension are guessed through a neutral one, so that patterns
+ * for whole names (e.g. CMakeLists.txt) don't carry over to other files. */
+static const gchar *
+utils_content_type_from_path(const gchar *path)
+{
+	const gchar *base_name, *ext;
+	gchar 		*key, *ctype;
+
+	if (content_type_cache == NULL)
+		content_type_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+	base_name = strrchr(path, G_DIR_SEPARATOR);
+	base_name = base_name ? base_name + 1 : path;
+	for (ext = base_name; *ext == '.'; ext++);
+	ext = strchr(ext, '.');
+
+	/* extensions start with a dot, whole names with a separator */
+	key = ext ? g_strdup(ext) : g_strconcat(G_DIR_SEPARATOR_S, base_name, NULL);
+	ctype = g_hash_table_lookup(content_type_cache, key);
+	if (ctype == NULL)
+	{
+		gchar *name = ext ? g_strconcat("_", ext, NULL) : g_strdup(base_name);
+
+		ctype = g_content_type_guess(name, NULL, 0, NULL);
+		g_hash_table_insert(content_type_cache, key, ctype);
+		g_free(name);
+	}
+	else
+		g_free(key);
+
+	return ctype;
 }
+#endif
 
 static GdkPixbuf *
 utils_pixbuf_from_path(gchar *path)
@@ -214,24 +314,29 @@ utils_pixbuf_from_path(gchar *path)
 	GIcon 		*icon;
 	GdkPixbuf 	*ret = NULL;
 	GtkIconInfo *info;
-	gchar 		*ctype;
+	const gchar *ctype;
 	gint 		width;
+	gboolean 	found;
+
+	ctype = utils_content_type_from_path(path);
+	ret = icon_cache_lookup(ctype, &found);
+	if (found)
+		return ret;
 
-	ctype = g_content_type_guess(path, NULL, 0, NULL);
 	icon = g_content_type_get_icon(ctype);
-	g_free(ctype);
 
 	if (icon != NULL)
 	{
 		gtk_icon_size_lookup(GTK_ICON_SIZE_MENU, &width, NULL);
 		info = gtk_icon_theme_lookup_by_gicon(gtk_icon_theme_get_default(), icon, width, GTK_ICON_LOOKUP_USE_BUILTIN);
 		g_object_unref(icon);
-		if (!info)
-			return NULL;
-		ret = gtk_icon_info_load_icon (info, NULL);
-		gtk_icon_info_free(info);
+		if (info)
+		{
+			ret = gtk_icon_info_load_icon (info, NULL);
+			gtk_icon_info_free(info);
+		}
 	}
-	return ret;
+	return icon_cache_insert(ctype, ret);
 #else
 	return utils_pixbuf_from_stock(g_file_test(path, G_FILE_TEST_IS_DIR)
 									? GTK_STOCK_DIRECTORY
@@ -469,17 +574,816 @@ treebrowser_chroot(const gchar *dir)
 	treebrowser_load_bookmarks();
 }
 
+/* Fills in the row at iter for the file fname at uri. With content type
+ * icons, files get a stock icon until the row gets visible, the real one
+ * is looked up by treebrowser_update_icons(). */
+static void
+treebrowser_set_entry(GtkTreeIter *iter, const gchar *fname, const gchar *uri, gboolean is_dir)
+{
+	GtkTreeIter 	iter_empty;
+	GdkPixbuf 		*icon = NULL;
+
+	if (is_dir)
+	{
+		icon = CONFIG_SHOW_ICONS ? utils_pixbuf_from_stock(GTK_STOCK_DIRECTORY) : NULL;
+		gtk_tree_store_set(treestore, iter,
+						TREEBROWSER_COLUMN_ICON, 	icon,
+						TREEBROWSER_COLUMN_NAME, 	fname,
+						TREEBROWSER_COLUMN_URI, 	uri,
+						-1);
+		gtk_tree_store_prepend(treestore, &iter_empty, iter);
+		gtk_tree_store_set(treestore, &iter_empty,
+						TREEBROWSER_COLUMN_ICON, 	NULL,
+						TREEBROWSER_COLUMN_NAME, 	_("(Empty)"),
+						TREEBROWSER_COLUMN_URI, 	NULL,
+						-1);
+	}
+	else
+	{
+		icon = CONFIG_SHOW_ICONS ? utils_pixbuf_from_stock(GTK_STOCK_FILE) : NULL;
+		gtk_tree_store_set(treestore, iter,
+						TREEBROWSER_COLUMN_ICON, 	icon,
+						TREEBROWSER_COLUMN_NAME, 	fname,
+						TREEBROWSER_COLUMN_URI, 	uri,
+						TREEBROWSER_COLUMN_FLAG, 	CONFIG_SHOW_ICONS == 2 ? TREEBROWSER_FLAGS_ICON_PENDING : 0,
+						-1);
+	}
+
+	if (icon)
+		g_object_unref(icon);
+}
+
+/* Moves iter to the next row shown in the tree view, in display order */
+static gboolean
+tree_view_iter_next_visible(GtkTreeView *tree_view, GtkTreeIter *iter)
+{
+	GtkTreeModel 	*model = gtk_tree_view_get_model(tree_view);
+	GtkTreeIter 	next;
+
+	if (tree_view_row_expanded_iter(tree_view, iter) && gtk_tree_model_iter_children(model, &next, iter))
+	{
+		*iter = next;
+		return TRUE;
+	}
+
+	while (TRUE)
+	{
+		next = *iter;
+		if (gtk_tree_model_iter_next(model, &next))
+		{
+			*iter = next;
+			return TRUE;
+		}
+		if (! gtk_tree_model_iter_parent(model, &next, iter))
+			return FALSE;
+		*iter = next;
+	}
+}
+
+/* Looks up the content type icons of the rows currently on screen */
+static gboolean
+treebrowser_update_icons(gpointer data)
+{
+	GtkTreeModel 	*model = GTK_TREE_MODEL(treestore);
+	GtkTreePath 	*start, *end, *path;
+	GtkTreeIter 	iter;
+	gboolean 		valid;
+
+	icons_update_id = 0;
+
+	if (! gtk_tree_view_get_visible_range(GTK_TREE_VIEW(treeview), &start, &end))
+		return FALSE;
+
+	valid = gtk_tree_model_get_iter(model, &iter, start);
+	while (valid)
+	{
+		gint flag;
+
+		gtk_tree_model_get(model, &iter, TREEBROWSER_COLUMN_FLAG, &flag, -1);
+		if (flag == TREEBROWSER_FLAGS_ICON_PENDING)
+		{
+			GdkPixbuf 	*icon;
+			gchar 		*uri;
+
+			gtk_tree_model_get(model, &iter, TREEBROWSER_COLUMN_URI, &uri, -1);
+			icon = utils_pixbuf_from_path(uri);
+			if (icon)
+			{
+				gtk_tree_store_set(treestore, &iter, TREEBROWSER_COLUMN_ICON, icon, -1);
+				g_object_unref(icon);
+			}
+			gtk_tree_store_set(treestore, &iter, TREEBROWSER_COLUMN_FLAG, 0, -1);
+			g_free(uri);
+		}
+
+		path = gtk_tree_model_get_path(model, &iter);
+		valid = gtk_tree_path_compare(path, end) < 0 &&
+				tree_view_iter_next_visible(GTK_TREE_VIEW(treeview), &iter);
+		gtk_tree_path_free(path);
+	}
+
+	gtk_tree_path_free(start);
+	gtk_tree_path_free(end);
+
+	return FALSE;
+}
+
+static void
+treebrowser_queue_update_icons(void)
+{
+	if (CONFIG_SHOW_ICONS == 2 && icons_update_id == 0)
+		icons_update_id = g_idle_add(treebrowser_update_icons, NULL);
+}
+
+#ifdef HAVE_GIO
+
+/* ------------------
+ * ASYNC DIRECTORY LOADING
+ * ------------------ */
+
+#define BROWSE_BATCH_SIZE 	200
+#define BROWSE_ATTRIBUTES 	G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+							G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+							G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," \
+							G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP
+
+typedef struct
+{
+	GtkTreeRowReference 	*parent; 		/* NULL when loading the root */
+	GtkTreeRowReference 	*placeholder; 	/* the "(Loading...)" row */
+	gchar 					*directory; 	/* with a trailing separator */
+	GCancellable 			*cancellable;
+	GFileEnumerator 		*enumerator;
+	gboolean 				empty;
+	GSequence 				*rows; 			/* BrowseRow of the rows with a file, sorted */
+	guint 					rows_stamp; 	/* browse_rows_stamp when rows was up to date */
+} BrowseJob;
+
+/* A row of the directory being loaded. The tree store's iters stay valid
+ * as long as their row exists. */
+typedef struct
+{
+	gboolean 				is_dir;
+	gchar 					*name;
+	GtkTreeIter 			iter;
+} BrowseRow;
+
+static GSList 				*browse_jobs 				= NULL;
+/* changed whenever rows are inserted or removed other than by
+ * browse_job_add_files(), e.g. by a directory monitor */
+static guint 				browse_rows_stamp 			= 0;
+static gboolean 			browse_adding_rows 			= FALSE;
+
+static void
+browse_row_free(BrowseRow *row)
+{
+	g_free(row->name);
+	g_slice_free(BrowseRow, row);
+}
+
+static void
+on_treestore_rows_changed(void)
+{
+	if (! browse_adding_rows)
+		browse_rows_stamp++;
+}
+
+static void
+browse_job_free(BrowseJob *job)
+{
+	browse_jobs = g_slist_remove(browse_jobs, job);
+
+	if (job->parent)
+		gtk_tree_row_reference_free(job->parent);
+	gtk_tree_row_reference_free(job->placeholder);
+	if (job->enumerator)
+		g_object_unref(job->enumerator);
+	g_object_unref(job->cancellable);
+	g_free(job->directory);
+	g_sequence_free(job->rows);
+	g_slice_free(BrowseJob, job);
+}
+
+/* Returns: FALSE if the job was cancelled or the rows it fills are gone */
+static gboolean
+browse_job_get_parent(BrowseJob *job, GtkTreeIter **parent, GtkTreeIter *iter)
+{
+	GtkTreePath *path;
+
+	*parent = NULL;
+
+	if (g_cancellable_is_cancelled(job->cancellable) || ! gtk_tree_row_reference_valid(job->placeholder))
+		return FALSE;
+
+	if (job->parent == NULL)
+		return TRUE;
+
+	path = gtk_tree_row_reference_get_path(job->parent);
+	if (path == NULL)
+		return FALSE;
+	gtk_tree_model_get_iter(GTK_TREE_MODEL(treestore), iter, path);
+	gtk_tree_path_free(path);
+	*parent = iter;
+
+	return TRUE;
+}
+
+/* Cancels loading of parent and of the directories below it, or all
+ * loading if parent is NULL */
+static void
+browse_jobs_cancel(GtkTreeIter *parent)
+{
+	GtkTreePath 	*path = NULL;
+	GSList 			*node;
+
+	if (parent)
+		path = gtk_tree_model_get_path(GTK_TREE_MODEL(treestore), parent);
+
+	for (node = browse_jobs; node != NULL; node = node->next)
+	{
+		BrowseJob 		*job = node->data;
+		GtkTreePath 	*job_path;
+
+		if (path == NULL)
+		{
+			g_cancellable_cancel(job->cancellable);
+			continue;
+		}
+
+		job_path = job->parent ? gtk_tree_row_reference_get_path(job->parent) : NULL;
+		if (job_path && (gtk_tree_path_compare(job_path, path) == 0 || gtk_tree_path_is_descendant(job_path, path)))
+			g_cancellable_cancel(job->cancellable);
+		if (job_path)
+			gtk_tree_path_free(job_path);
+	}
+
+	if (path)
+		gtk_tree_path_free(path);
+}
+
+static gboolean
+check_hidden_info(GFileInfo *info)
+{
+	if (CONFIG_SHOW_HIDDEN_FILES)
+		return FALSE;
+
+	return g_file_info_get_is_hidden(info) || g_file_info_get_is_backup(info);
+}
+
+/* Same order as treebrowser_browse() always used: directories first, then by name */
+static gint
+browse_compare(gboolean is_dir_a, const gchar *name_a, gboolean is_dir_b, const gchar *name_b)
+{
+	gint cmp;
+
+	if (is_dir_a != is_dir_b)
+		return is_dir_a ? -1 : 1;
+
+	cmp = utils_str_casecmp(name_a, name_b);
+
+	return cmp != 0 ? cmp : strcmp(name_a, name_b);
+}
+
+static gint
+browse_compare_infos(gconstpointer a, gconstpointer b)
+{
+	GFileInfo *info_a = *(GFileInfo **) a;
+	GFileInfo *info_b = *(GFileInfo **) b;
+
+	return browse_compare(g_file_info_get_file_type(info_a) == G_FILE_TYPE_DIRECTORY, g_file_info_get_name(info_a),
+						g_file_info_get_file_type(info_b) == G_FILE_TYPE_DIRECTORY, g_file_info_get_name(info_b));
+}
+
+static gint
+browse_compare_rows(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	const BrowseRow *row_a = a;
+	const BrowseRow *row_b = b;
+
+	return browse_compare(row_a->is_dir, row_a->name, row_b->is_dir, row_b->name);
+}
+
+/* Returns: how the given file sorts against the row at iter, 0 if it's the
+ * same. Rows without an URI (bookmarks, placeholders) always stay on top. */
+static gint
+browse_row_compare(GtkTreeIter *iter, gboolean is_dir, const gchar *name)
+{
+	gchar 		*row_name, *row_uri;
+	gint 		cmp;
+
+	gtk_tree_model_get(GTK_TREE_MODEL(treestore), iter,
+						TREEBROWSER_COLUMN_NAME, 	&row_name,
+						TREEBROWSER_COLUMN_URI, 	&row_uri,
+						-1);
+
+	/* directory rows always have children, at least the "(Empty)" one */
+	if (row_uri == NULL)
+		cmp = 1;
+	else
+		cmp = browse_compare(is_dir, name,
+						gtk_tree_model_iter_has_child(GTK_TREE_MODEL(treestore), iter), row_name);
+
+	g_free(row_name);
+	g_free(row_uri);
+
+	return cmp;
+}
+
+/* Re-reads the rows the job's files are inserted between */
+static void
+browse_job_read_rows(BrowseJob *job, GtkTreeIter *parent)
+{
+	GtkTreeIter 	iter;
+	gboolean 		valid;
+
+	g_sequence_remove_range(g_sequence_get_begin_iter(job->rows), g_sequence_get_end_iter(job->rows));
+
+	valid = gtk_tree_model_iter_children(GTK_TREE_MODEL(treestore), &iter, parent);
+	for (; valid; valid = gtk_tree_model_iter_next(GTK_TREE_MODEL(treestore), &iter))
+	{
+		BrowseRow 	*row;
+		gchar 		*name, *uri;
+
+		gtk_tree_model_get(GTK_TREE_MODEL(treestore), &iter,
+							TREEBROWSER_COLUMN_NAME, 	&name,
+							TREEBROWSER_COLUMN_URI, 	&uri,
+							-1);
+		g_free(uri);
+		/* rows without an URI (placeholders) stay on top */
+		if (uri == NULL)
+		{
+			g_free(name);
+			continue;
+		}
+
+		row = g_slice_new(BrowseRow);
+		/* directory rows always have children, at least the "(Empty)" one */
+		row->is_dir = gtk_tree_model_iter_has_child(GTK_TREE_MODEL(treestore), &iter);
+		row->name 	= name;
+		row->iter 	= iter;
+		g_sequence_append(job->rows, row);
+	}
+	/* the rows are already sorted, unless a monitor added them in a different order */
+	g_sequence_sort(job->rows, browse_compare_rows, NULL);
+
+	job->rows_stamp = browse_rows_stamp;
+}
+
+/* Inserts a batch of files into the rows loaded so far, keeping them sorted.
+ * The enumerator doesn't return the files in order, so the insert position
+ * of each file is looked up in job->rows. */
+static void
+browse_job_add_files(BrowseJob *job, GtkTreeIter *parent, GList *files)
+{
+	GtkTreeIter 	iter;
+	guint 			n_added = 0;
+
+	if (job->rows_stamp != browse_rows_stamp)
+		browse_job_read_rows(job, parent);
+
+	browse_adding_rows = TRUE;
+	for (; files != NULL; files = files->next)
+	{
+		GFileInfo 		*info = files->data;
+		GSequenceIter 	*pos;
+		BrowseRow 		key, *row;
+		gchar 			*utf8_name, *uri;
+		gboolean 		shown;
+
+		if (check_hidden_info(info))
+			continue;
+
+		key.is_dir 	= g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY;
+		key.name 	= (gchar *) g_file_info_get_name(info);
+
+		utf8_name = utils_get_utf8_from_locale(key.name);
+		shown = key.is_dir || check_filtered(utf8_name);
+		g_free(utf8_name);
+		if (! shown)
+			continue;
+
+		/* already there, a directory monitor was quicker */
+		pos = g_sequence_search(job->rows, &key, browse_compare_rows, NULL);
+		if (! g_sequence_iter_is_begin(pos) &&
+			browse_compare_rows(g_sequence_get(g_sequence_iter_prev(pos)), &key, NULL) == 0)
+			continue;
+
+		if (g_sequence_iter_is_end(pos))
+			gtk_tree_store_append(treestore, &iter, parent);
+		else
+			gtk_tree_store_insert_before(treestore, &iter, parent,
+										&((BrowseRow *) g_sequence_get(pos))->iter);
+
+		uri = g_strconcat(job->directory, key.name, NULL);
+		treebrowser_set_entry(&iter, key.name, uri, key.is_dir);
+		g_free(uri);
+
+		row = g_slice_new(BrowseRow);
+		row->is_dir = key.is_dir;
+		row->name 	= g_strdup(key.name);
+		row->iter 	= iter;
+		g_sequence_insert_before(pos, row);
+
+		n_added++;
+	}
+	browse_adding_rows = FALSE;
+
+	if (n_added > 0)
+	{
+		job->empty = FALSE;
+		treebrowser_queue_update_icons();
+	}
+}
+
+static void
+browse_job_finish(BrowseJob *job)
+{
+	GtkTreeIter 	parent_iter, *parent, iter;
+	GtkTreePath 	*path;
+
+	if (browse_job_get_parent(job, &parent, &parent_iter))
+	{
+		path = gtk_tree_row_reference_get_path(job->placeholder);
+		gtk_tree_model_get_iter(GTK_TREE_MODEL(treestore), &iter, path);
+		gtk_tree_path_free(path);
+
+		if (job->empty)
+			gtk_tree_store_set(treestore, &iter, TREEBROWSER_COLUMN_NAME, _("(Empty)"), -1);
+		else
+			gtk_tree_store_remove(treestore, &iter);
+	}
+
+	browse_job_free(job);
+
+	treebrowser_reveal_pending();
+}
+
+static void
+on_browse_next_files(GObject *object, GAsyncResult *result, gpointer user_data)
+{
+	BrowseJob 		*job = user_data;
+	GtkTreeIter 	parent_iter, *parent;
+	GList 			*files;
+
+	files = g_file_enumerator_next_files_finish(G_FILE_ENUMERATOR(object), result, NULL);
+
+	if (! browse_job_get_parent(job, &parent, &parent_iter))
+		browse_job_free(job);
+	else if (files == NULL)
+		browse_job_finish(job);
+	else
+	{
+		browse_job_add_files(job, parent, files);
+		g_file_enumerator_next_files_async(job->enumerator, BROWSE_BATCH_SIZE, G_PRIORITY_DEFAULT,
+											job->cancellable, on_browse_next_files, job);
+	}
+
+	g_list_foreach(files, (GFunc) g_object_unref, NULL);
+	g_list_free(files);
+}
+
+static void
+on_browse_enumerate_children(GObject *object, GAsyncResult *result, gpointer user_data)
+{
+	BrowseJob 		*job = user_data;
+	GtkTreeIter 	parent_iter, *parent;
+
+	job->enumerator = g_file_enumerate_children_finish(G_FILE(object), result, NULL);
+
+	if (! browse_job_get_parent(job, &parent, &parent_iter))
+		browse_job_free(job);
+	else if (job->enumerator == NULL)
+		browse_job_finish(job);
+	else
+		g_file_enumerator_next_files_async(job->enumerator, BROWSE_BATCH_SIZE, G_PRIORITY_DEFAULT,
+											job->cancellable, on_browse_next_files, job);
+}
+
+/* Starts loading directory into the children of parent, which only hold
+ * the placeholder row so far */
+static void
+browse_job_start(const gchar *directory, GtkTreeIter *parent, GtkTreeIter *placeholder)
+{
+	BrowseJob 		*job;
+	GtkTreePath 	*path;
+	GFile 			*file;
+
+	job = g_slice_new0(BrowseJob);
+	if (parent)
+	{
+		path = gtk_tree_model_get_path(GTK_TREE_MODEL(treestore), parent);
+		job->parent = gtk_tree_row_reference_new(GTK_TREE_MODEL(treestore), path);
+		gtk_tree_path_free(path);
+	}
+	path = gtk_tree_model_get_path(GTK_TREE_MODEL(treestore), placeholder);
+	job->placeholder = gtk_tree_row_reference_new(GTK_TREE_MODEL(treestore), path);
+	gtk_tree_path_free(path);
+
+	job->directory 		= g_strdup(directory);
+	job->cancellable 	= g_cancellable_new();
+	job->empty 			= TRUE;
+	job->rows 			= g_sequence_new((GDestroyNotify) browse_row_free);
+	job->rows_stamp 	= browse_rows_stamp - 1;
+	browse_jobs = g_slist_prepend(browse_jobs, job);
+
+	file = g_file_new_for_path(directory);
+	g_file_enumerate_children_async(file, BROWSE_ATTRIBUTES, G_FILE_QUERY_INFO_NONE, G_PRIORITY_DEFAULT,
+									job->cancellable, on_browse_enumerate_children, job);
+	g_object_unref(file);
+}
+
+
+/* ------------------
+ * DIRECTORY MONITORS
+ * ------------------ */
+
+typedef struct
+{
+	GtkTreeRowReference 	*row; 			/* NULL for the root */
+	gchar 					*directory; 	/* with a trailing separator */
+	GFileMonitor 			*monitor;
+} DirMonitor;
+
+static GSList 				*dir_monitors 				= NULL;
+
+static void 	on_dir_monitor_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+									GFileMonitorEvent event_type, gpointer user_data);
+
+static void
+dir_monitor_free(DirMonitor *dm)
+{
+	g_signal_handlers_disconnect_by_func(dm->monitor, on_dir_monitor_changed, dm);
+	g_file_monitor_cancel(dm->monitor);
+	g_object_unref(dm->monitor);
+	if (dm->row)
+		gtk_tree_row_reference_free(dm->row);
+	g_free(dm->directory);
+	g_slice_free(DirMonitor, dm);
+}
+
+/* Stops watching the directories expanded below path, and the one at path
+ * itself if include_self. A NULL path stops all of them. Monitors whose
+ * rows are gone are dropped as well. */
+static void
+dir_monitors_remove(GtkTreePath *path, gboolean include_self)
+{
+	GSList 			*node, *next;
+
+	for (node = dir_monitors; node != NULL; node = next)
+	{
+		DirMonitor 		*dm = node->data;
+		GtkTreePath 	*dm_path;
+		gboolean 		remove;
+
+		next = node->next;
+
+		dm_path = dm->row ? gtk_tree_row_reference_get_path(dm->row) : NULL;
+		if (path == NULL)
+			remove = TRUE;
+		else if (dm->row == NULL)
+			remove = FALSE;
+		else if (dm_path == NULL)
+			remove = TRUE;
+		else
+			remove = gtk_tree_path_is_descendant(dm_path, path) ||
+					(include_self && gtk_tree_path_compare(dm_path, path) == 0);
+		if (dm_path)
+			gtk_tree_path_free(dm_path);
+
+		if (remove)
+		{
+			dir_monitors = g_slist_delete_link(dir_monitors, node);
+			dir_monitor_free(dm);
+		}
+	}
+}
+
+/* Starts watching directory, shown in the children of iter or at the root */
+static void
+dir_monitor_add(const gchar *directory, GtkTreeIter *iter)
+{
+	DirMonitor 		*dm;
+	GFileMonitor 	*monitor;
+	GtkTreePath 	*path;
+	GFile 			*file;
+
+	file = g_file_new_for_path(directory);
+	monitor = g_file_monitor_directory(file, G_FILE_MONITOR_NONE, NULL, NULL);
+	g_object_unref(file);
+	if (monitor == NULL)
+		return;
+
+	dm = g_slice_new0(DirMonitor);
+	if (iter)
+	{
+		path = gtk_tree_model_get_path(GTK_TREE_MODEL(treestore), iter);
+		dm->row = gtk_tree_row_reference_new(GTK_TREE_MODEL(treestore), path);
+		gtk_tree_path_free(path);
+	}
+	dm->directory 	= g_str_has_suffix(directory, G_DIR_SEPARATOR_S)
+						? g_strdup(directory)
+						: g_strconcat(directory, G_DIR_SEPARATOR_S, NULL);
+	dm->monitor 	= monitor;
+	g_signal_connect(monitor, "changed", G_CALLBACK(on_dir_monitor_changed), dm);
+
+	dir_monitors = g_slist_prepend(dir_monitors, dm);
+}
+
+/* Returns: whether the row at iter is an "(Empty)" placeholder */
+static gboolean
+row_is_empty_placeholder(GtkTreeIter *iter)
+{
+	gchar 		*name, *uri;
+	gboolean 	empty;
+
+	gtk_tree_model_get(GTK_TREE_MODEL(treestore), iter,
+						TREEBROWSER_COLUMN_NAME, 	&name,
+						TREEBROWSER_COLUMN_URI, 	&uri,
+						-1);
+	empty = uri == NULL && utils_str_equal(name, _("(Empty)"));
+	g_free(name);
+	g_free(uri);
+
+	return empty;
+}
+
+static void
+dir_monitor_file_created(DirMonitor *dm, GtkTreeIter *parent, const gchar *fname)
+{
+	GtkTreeIter 	iter, sibling;
+	gboolean 		is_dir, has_sibling, shown;
+	gchar 			*uri, *utf8_name;
+	gint 			cmp = 1;
+
+	uri 		= g_strconcat(dm->directory, fname, NULL);
+	is_dir 		= g_file_test(uri, G_FILE_TEST_IS_DIR);
+	utf8_name 	= utils_get_utf8_from_locale(fname);
+	shown 		= ! check_hidden(uri) && (is_dir || check_filtered(utf8_name));
+	g_free(utf8_name);
+
+	if (shown)
+	{
+		has_sibling = gtk_tree_model_iter_children(GTK_TREE_MODEL(treestore), &sibling, parent);
+		while (has_sibling && (cmp = browse_row_compare(&sibling, is_dir, fname)) > 0)
+			has_sibling = gtk_tree_model_iter_next(GTK_TREE_MODEL(treestore), &sibling);
+
+		if (! has_sibling || cmp != 0)
+		{
+			if (has_sibling)
+				gtk_tree_store_insert_before(treestore, &iter, parent, &sibling);
+			else
+				gtk_tree_store_append(treestore, &iter, parent);
+			treebrowser_set_entry(&iter, fname, uri, is_dir);
+
+			/* the placeholder is always the first row */
+			if (gtk_tree_model_iter_children(GTK_TREE_MODEL(treestore), &sibling, parent) &&
+				row_is_empty_placeholder(&sibling))
+				gtk_tree_store_remove(treestore, &sibling);
+
+			treebrowser_queue_update_icons();
+		}
+	}
+
+	g_free(uri);
+}
+
+static void
+dir_monitor_file_deleted(DirMonitor *dm, GtkTreeIter *parent, const gchar *fname)
+{
+	GtkTreeIter 	iter, iter_empty;
+	GtkTreePath 	*path;
+	gchar 			*uri, *uri_current;
+	gboolean 		found = FALSE, valid;
+
+	uri = g_strconcat(dm->directory, fname, NULL);
+
+	valid = gtk_tree_model_iter_children(GTK_TREE_MODEL(treestore), &iter, parent);
+	while (valid && ! found)
+	{
+		gtk_tree_model_get(GTK_TREE_MODEL(treestore), &iter, TREEBROWSER_COLUMN_URI, &uri_current, -1);
+		found = utils_str_equal(uri, uri_current);
+		g_free(uri_current);
+		if (! found)
+			valid = gtk_tree_model_iter_next(GTK_TREE_MODEL(treestore), &iter);
+	}
+
+	if (found)
+	{
+		path = gtk_tree_model_get_path(GTK_TREE_MODEL(treestore), &iter);
+		dir_monitors_remove(path, TRUE);
+		gtk_tree_path_free(path);
+
+		/* keeps an expanded parent from collapsing */
+		if (parent && gtk_tree_model_iter_n_children(GTK_TREE_MODEL(treestore), parent) == 1)
+		{
+			gtk_tree_store_prepend(treestore, &iter_empty, parent);
+			gtk_tree_store_set(treestore, &iter_empty,
+							TREEBROWSER_COLUMN_ICON, 	NULL,
+							TREEBROWSER_COLUMN_NAME, 	_("(Empty)"),
+							TREEBROWSER_COLUMN_URI, 	NULL,
+							-1);
+		}
+		gtk_tree_store_remove(treestore, &iter);
+	}
+
+	g_free(uri);
+}
+
+static void
+on_dir_monitor_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+					GFileMonitorEvent event_type, gpointer user_data)
+{
+	DirMonitor 		*dm = user_data;
+	GtkTreeIter 	parent_iter, *parent = NULL;
+	GtkTreePath 	*path;
+	gchar 			*fname;
+
+	if (event_type != G_FILE_MONITOR_EVENT_CREATED && event_type != G_FILE_MONITOR_EVENT_DELETED)
+		return;
+
+	if (dm->row)
+	{
+		path = gtk_tree_row_reference_get_path(dm->row);
+		if (path == NULL)
+		{
+			dir_monitors = g_slist_remove(dir_monitors, dm);
+			dir_monitor_free(dm);
+			return;
+		}
+		gtk_tree_model_get_iter(GTK_TREE_MODEL(treestore), &parent_iter, path);
+		gtk_tree_path_free(path);
+		parent = &parent_iter;
+	}
+
+	fname = g_file_get_basename(file);
+	if (event_type == G_FILE_MONITOR_EVENT_CREATED)
+		dir_monitor_file_created(dm, parent, fname);
+	else
+		dir_monitor_file_deleted(dm, parent, fname);
+	g_free(fname);
+}
+
+#endif /* HAVE_GIO */
+
+static gboolean
+treebrowser_is_loading(void)
+{
+#ifdef HAVE_GIO
+	return browse_jobs != NULL;
+#else
+	return FALSE;
+#endif
+}
+
+/* Selects uri in the tree once the directories leading to it are loaded,
+ * and starts renaming it if rename is set */
+static void
+treebrowser_reveal(const gchar *uri, gboolean rename)
+{
+	setptr(reveal_uri, g_strdup(uri));
+	reveal_rename = rename;
+
+	treebrowser_reveal_pending();
+}
+
+static void
+treebrowser_reveal_pending(void)
+{
+	if (reveal_uri == NULL)
+		return;
+
+	/* expanding a directory starts loading it, this gets called again
+	 * once it's done to go on with the next one down */
+	treebrowser_expand_to_path(addressbar_last_address, reveal_uri);
+
+	if (treebrowser_search(reveal_uri, NULL))
+	{
+		if (reveal_rename)
+			treebrowser_rename_current();
+	}
+	else if (treebrowser_is_loading())
+		return;
+
+	setptr(reveal_uri, NULL);
+}
+
 static void
 treebrowser_browse(gchar *directory, gpointer parent)
 {
-	GtkTreeIter 	iter, iter_empty, *last_dir_iter = NULL;
+	GtkTreeIter 	iter;
+	gboolean 		has_parent;
+#ifdef HAVE_GIO
+	GtkTreeIter 	iter_old;
+#else
+	GtkTreeIter 	*last_dir_iter = NULL;
+	gboolean 		expanded = FALSE;
 	gboolean 		is_dir;
-	gboolean 		expanded = FALSE, has_parent;
 	gchar 			*utf8_name;
 	GSList 			*list, *node;
 
 	gchar 			*fname;
 	gchar 			*uri;
+#endif
 
 	directory 		= g_strconcat(directory, G_DIR_SEPARATOR_S, NULL);
 
@@ -494,10 +1398,47 @@ treebrowser_browse(gchar *directory, gpointer parent)
 
 	if (has_parent && tree_view_row_expanded_iter(GTK_TREE_VIEW(treeview), parent))
 	{
+#ifndef HAVE_GIO
 		expanded = TRUE;
+#endif
 		treebrowser_bookmarks_set_state();
 	}
 
+#ifdef HAVE_GIO
+	browse_jobs_cancel(parent);
+
+	/* rows below parent are about to be replaced, so are their monitors */
+	if (parent)
+	{
+		GtkTreePath *path = gtk_tree_model_get_path(GTK_TREE_MODEL(treestore), parent);
+
+		dir_monitors_remove(path, FALSE);
+		gtk_tree_path_free(path);
+	}
+	else
+	{
+		dir_monitors_remove(NULL, TRUE);
+		dir_monitor_add(directory, NULL);
+	}
+
+	/* The placeholder goes in before the old rows are removed, so that an
+	 * expanded parent doesn't collapse when it's left without children */
+	gtk_tree_store_prepend(treestore, &iter, parent);
+	gtk_tree_store_set(treestore, &iter,
+					TREEBROWSER_COLUMN_ICON, 	NULL,
+					TREEBROWSER_COLUMN_NAME, 	_("(Loading...)"),
+					TREEBROWSER_COLUMN_URI, 	NULL,
+					-1);
+	iter_old = iter;
+	if (gtk_tree_model_iter_next(GTK_TREE_MODEL(treestore), &iter_old))
+		while (gtk_tree_store_remove(treestore, &iter_old))
+			/* do nothing */;
+
+	browse_job_start(directory, parent, &iter);
+
+	if (! has_parent)
+		treebrowser_load_bookmarks();
+#else
 	if (parent)
 		gtk_tree_store_iter_clear_nodes(parent, FALSE);
 	else
@@ -515,8 +1456,6 @@ treebrowser_browse(gchar *directory, gpointer parent)
 
 			if (!check_hidden(uri))
 			{
-				GdkPixbuf *icon = NULL;
-
 				if (is_dir)
 				{
 					if (last_dir_iter == NULL)
@@ -527,49 +1466,28 @@ treebrowser_browse(gchar *directory, gpointer parent)
 						gtk_tree_iter_free(last_dir_iter);
 					}
 					last_dir_iter = gtk_tree_iter_copy(&iter);
-					icon = CONFIG_SHOW_ICONS ? utils_pixbuf_from_stock(GTK_STOCK_DIRECTORY) : NULL;
-					gtk_tree_store_set(treestore, &iter,
-										TREEBROWSER_COLUMN_ICON, 	icon,
-										TREEBROWSER_COLUMN_NAME, 	fname,
-										TREEBROWSER_COLUMN_URI, 	uri,
-										-1);
-					gtk_tree_store_prepend(treestore, &iter_empty, &iter);
-					gtk_tree_store_set(treestore, &iter_empty,
-									TREEBROWSER_COLUMN_ICON, 	NULL,
-									TREEBROWSER_COLUMN_NAME, 	_("(Empty)"),
-									TREEBROWSER_COLUMN_URI, 	NULL,
-									-1);
+					treebrowser_set_entry(&iter, fname, uri, TRUE);
 				}
 				else
 				{
 					if (check_filtered(utf8_name))
 					{
-						icon = CONFIG_SHOW_ICONS == 2
-									? utils_pixbuf_from_path(uri)
-									: CONFIG_SHOW_ICONS
-										? utils_pixbuf_from_stock(GTK_STOCK_FILE)
-										: NULL;
 						gtk_tree_store_append(treestore, &iter, parent);
-						gtk_tree_store_set(treestore, &iter,
-										TREEBROWSER_COLUMN_ICON, 	icon,
-										TREEBROWSER_COLUMN_NAME, 	fname,
-										TREEBROWSER_COLUMN_URI, 	uri,
-										-1);
+						treebrowser_set_entry(&iter, fname, uri, FALSE);
 					}
 				}
-
-				if (icon)
-					g_object_unref(icon);
 			}
 			g_free(utf8_name);
 			g_free(uri);
 			g_free(fname);
 		}
+		if (last_dir_iter)
+			gtk_tree_iter_free(last_dir_iter);
 	}
 	else
 	{
-		gtk_tree_store_prepend(treestore, &iter_empty, parent);
-		gtk_tree_store_set(treestore, &iter_empty,
+		gtk_tree_store_prepend(treestore, &iter, parent);
+		gtk_tree_store_set(treestore, &iter,
 						TREEBROWSER_COLUMN_ICON, 	NULL,
 						TREEBROWSER_COLUMN_NAME, 	_("(Empty)"),
 						TREEBROWSER_COLUMN_URI, 	NULL,
@@ -584,6 +1502,9 @@ treebrowser_browse(gchar *directory, gpointer parent)
 	else
 		treebrowser_load_bookmarks();
 
+	treebrowser_queue_update_icons();
+#endif
+
 	g_free(directory);
 
 }
@@ -868,7 +1789,7 @@ treebrowser_track_current(void)
 			if (utils_str_equal(froot, addressbar_last_address) != TRUE)
 				treebrowser_chroot(froot);
 
-			treebrowser_expand_to_path(froot, path_current);
+			treebrowser_reveal(path_current, FALSE);
 		}
 
 		g_strfreev(path_segments);
@@ -1065,8 +1986,7 @@ on_menu_create_new_object(GtkMenuItem *menuitem, const gchar *type)
 			if (creation_success)
 			{
 				treebrowser_browse(uri, refresh_root ? NULL : &iter);
-				if (treebrowser_search(uri_new, NULL))
-					treebrowser_rename_current();
+				treebrowser_reveal(uri_new, TRUE);
 				if (utils_str_equal(type, "file") && CONFIG_OPEN_NEW_FILES == TRUE)
 					document_open_file(uri_new,FALSE, NULL,NULL);
 			}
@@ -1570,6 +2490,10 @@ on_treeview_row_expanded(GtkWidget *widget, GtkTreeIter *iter, GtkTreePath *path
 		treebrowser_browse(uri, iter);
 		gtk_tree_view_expand_row(GTK_TREE_VIEW(treeview), path, FALSE);
 		flag_on_expand_refresh = FALSE;
+#ifdef HAVE_GIO
+		dir_monitors_remove(path, TRUE);
+		dir_monitor_add(uri, iter);
+#endif
 	}
 	if (CONFIG_SHOW_ICONS)
 	{
@@ -1578,6 +2502,7 @@ on_treeview_row_expanded(GtkWidget *widget, GtkTreeIter *iter, GtkTreePath *path
 		gtk_tree_store_set(treestore, iter, TREEBROWSER_COLUMN_ICON, icon, -1);
 		g_object_unref(icon);
 	}
+	treebrowser_queue_update_icons();
 
 	g_free(uri);
 }
@@ -1589,6 +2514,10 @@ on_treeview_row_collapsed(GtkWidget *widget, GtkTreeIter *iter, GtkTreePath *pat
 	gtk_tree_model_get(GTK_TREE_MODEL(treestore), iter, TREEBROWSER_COLUMN_URI, &uri, -1);
 	if (uri == NULL)
 		return;
+#ifdef HAVE_GIO
+	/* the rows below get collapsed too, and are browsed again on expand */
+	dir_monitors_remove(path, TRUE);
+#endif
 	if (CONFIG_SHOW_ICONS)
 	{
 		GdkPixbuf *icon = utils_pixbuf_from_stock(GTK_STOCK_DIRECTORY);
@@ -1714,6 +2643,10 @@ create_view_and_model(void)
 	treestore = gtk_tree_store_new(TREEBROWSER_COLUMNC, GDK_TYPE_PIXBUF, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT);
 
 	gtk_tree_view_set_model(GTK_TREE_VIEW(view), GTK_TREE_MODEL(treestore));
+#ifdef HAVE_GIO
+	g_signal_connect(treestore, "row-inserted", G_CALLBACK(on_treestore_rows_changed), NULL);
+	g_signal_connect(treestore, "row-deleted", G_CALLBACK(on_treestore_rows_changed), NULL);
+#endif
 	g_signal_connect(G_OBJECT(render_text), "edited", G_CALLBACK(on_treeview_renamed), view);
 
 	return view;
@@ -1804,6 +2737,9 @@ create_sidebar(void)
 	g_signal_connect(treeview, 			"row-collapsed", 		G_CALLBACK(on_treeview_row_collapsed), 			NULL);
 	g_signal_connect(treeview, 			"row-expanded", 		G_CALLBACK(on_treeview_row_expanded), 			NULL);
 	g_signal_connect(treeview, 			"key-press-event", 		G_CALLBACK(on_treeview_keypress), 			NULL);
+	g_signal_connect(treeview, 			"size-allocate", 		G_CALLBACK(treebrowser_queue_update_icons), 	NULL);
+	g_signal_connect(gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(scrollwin)),
+										"value-changed", 		G_CALLBACK(treebrowser_queue_update_icons), 	NULL);
 	g_signal_connect(addressbar, 		"activate", 			G_CALLBACK(on_addressbar_activate), 			NULL);
 	g_signal_connect(filter, 			"activate", 			G_CALLBACK(on_filter_activate), 				NULL);
 
@@ -2128,7 +3064,14 @@ plugin_init(GeanyData *data)
 
 	flag_on_expand_refresh = FALSE;
 
+#ifdef HAVE_GIO
+	/* directory loading callbacks can still arrive after the plugin was unloaded */
+	plugin_module_make_resident(geany_plugin);
+#endif
+
 	load_settings();
+	plugin_signal_connect(geany_plugin, G_OBJECT(gtk_icon_theme_get_default()), "changed", FALSE,
+		G_CALLBACK(on_icon_theme_changed), NULL);
 	create_sidebar();
 	treebrowser_chroot(get_default_dir());
 
@@ -2157,7 +3100,22 @@ plugin_init(GeanyData *data)
 void
 plugin_cleanup(void)
 {
-	g_free(addressbar_last_address);
+#ifdef HAVE_GIO
+	browse_jobs_cancel(NULL);
+	dir_monitors_remove(NULL, TRUE);
+#endif
+	if (icons_update_id)
+		g_source_remove(icons_update_id);
+	icons_update_id = 0;
+	/* statics outlive a resident module, see plugin_init() */
+	setptr(reveal_uri, NULL);
+	setptr(addressbar_last_address, NULL);
+	if (icon_cache)
+		g_hash_table_destroy(icon_cache);
+	icon_cache = NULL;
+	if (content_type_cache)
+		g_hash_table_destroy(content_type_cache);
+	content_type_cache = NULL;
 	g_free(CONFIG_FILE);
 	g_free(CONFIG_OPEN_EXTERNAL_CMD);
 	g_free(CONFIG_OPEN_TERMINAL);
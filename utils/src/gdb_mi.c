@@ -0,0 +1,793 @@
+/*
+ *      gdb_mi.c
+ *      
+ *      Copyright 2014 Colomban Wendling <colomban@geany.org>
+ *      
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *      
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/* 
+ * Parses GDB/MI records
+ * https://sourceware.org/gdb/current/onlinedocs/gdb/GDB_002fMI-Output-Syntax.html
+ * 
+ * A record is parsed in place in a copy of the line, and all of its nodes are
+ * allocated from chunks of memory owned by the record, so that it's freed at
+ * once.  Variable names are interned, and the results of large tuples are
+ * indexed by name.
+ * 
+ * gdb_mi_record_parse_raw() parses in the caller's line instead, into an
+ * arena the caller reuses for the next record, so it usually allocates
+ * nothing.
+ * 
+ * This is shared by the Debugger and Scope plugins, Scope parses through
+ * gdb_mi_record_parse_raw().
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "gdb_mi.h"
+
+
+#define ascii_isodigit(c) (((guchar) (c)) >= '0' && ((guchar) (c)) <= '7')
+
+/* alignment of the memory allocated for records */
+#define CHUNK_ALIGN (sizeof(union { gpointer p; gdouble d; gint64 i; }))
+#define CHUNK_ALIGNED(size) (((size) + CHUNK_ALIGN - 1) & ~(CHUNK_ALIGN - 1))
+
+/* minimal size of a memory chunk */
+#define CHUNK_MIN_SIZE 256
+
+/* tuples having at least this many results get an index */
+#define INDEX_MIN_RESULTS 8
+
+
+/* a piece of memory the parts of a record are allocated from */
+struct gdb_mi_chunk
+{
+	struct gdb_mi_chunk *next;
+	gsize size;
+	gsize used;
+};
+
+/* memory records are parsed into over and over */
+struct gdb_mi_arena
+{
+	struct gdb_mi_chunk *chunks;
+};
+
+/* open addressing hash table of the results of a tuple, by interned name */
+struct gdb_mi_index
+{
+	guint mask;
+	const struct gdb_mi_result *slots[1];
+};
+
+
+static struct gdb_mi_value *parse_value(struct gdb_mi_record *record, gchar **p);
+
+
+static struct gdb_mi_chunk *chunk_new(struct gdb_mi_chunk *next, gsize size)
+{
+	struct gdb_mi_chunk *chunk = g_malloc(CHUNK_ALIGNED(sizeof *chunk) + size);
+
+	chunk->next = next;
+	chunk->size = size;
+	chunk->used = 0;
+
+	return chunk;
+}
+
+static void chunks_free(struct gdb_mi_chunk *chunk)
+{
+	while (chunk)
+	{
+		struct gdb_mi_chunk *next = chunk->next;
+		g_free(chunk);
+		chunk = next;
+	}
+}
+
+/* allocates zeroed memory from the first of @chunks, prepending a new
+ * one if it's full */
+static gpointer chunks_alloc(struct gdb_mi_chunk **chunks, gsize size)
+{
+	struct gdb_mi_chunk *chunk = *chunks;
+	gchar *mem;
+
+	size = CHUNK_ALIGNED(size);
+	if (! chunk || chunk->used + size > chunk->size)
+	{
+		chunk = chunk_new(chunk, MAX(size, chunk ? chunk->size * 2 : CHUNK_MIN_SIZE));
+		*chunks = chunk;
+	}
+
+	mem = (gchar *) chunk + CHUNK_ALIGNED(sizeof *chunk) + chunk->used;
+	chunk->used += size;
+
+	return memset(mem, 0, size);
+}
+
+/* allocates zeroed memory for a part of @record */
+static gpointer record_alloc(struct gdb_mi_record *record, gsize size)
+{
+	return chunks_alloc(record->arena ? &record->arena->chunks : &record->chunks, size);
+}
+
+/* frees a record returned by gdb_mi_record_parse(), records parsed into an
+ * arena are left alone */
+void gdb_mi_record_free(struct gdb_mi_record *record)
+{
+	/* the record itself lives in the last chunk */
+	if (record && ! record->arena)
+		chunks_free(record->chunks);
+}
+
+/* Creates memory for gdb_mi_record_parse_raw() to parse records into.  Each
+ * parse reuses it, so once it grew to the size of the records parsing
+ * doesn't allocate anymore. */
+struct gdb_mi_arena *gdb_mi_arena_new(void)
+{
+	return g_new0(struct gdb_mi_arena, 1);
+}
+
+void gdb_mi_arena_free(struct gdb_mi_arena *arena)
+{
+	if (arena)
+	{
+		chunks_free(arena->chunks);
+		g_free(arena);
+	}
+}
+
+/* forgets the record parsed into @arena, keeping the memory */
+static void arena_reset(struct gdb_mi_arena *arena)
+{
+	struct gdb_mi_chunk *chunk = arena->chunks;
+
+	if (chunk && chunk->next)
+	{
+		/* the record didn't fit, merge the chunks so that the next one does */
+		gsize size = 0;
+
+		for (; chunk; chunk = chunk->next)
+			size += chunk->size;
+		chunks_free(arena->chunks);
+		arena->chunks = chunk_new(NULL, size);
+	}
+	else if (chunk)
+		chunk->used = 0;
+}
+
+/* hash of an interned name */
+static guint name_hash(const gchar *name)
+{
+	return (guint) ((GPOINTER_TO_SIZE(name) * 2654435761u) >> 16);
+}
+
+/* indexes the results of a tuple if there are enough of them,
+ * first ones win for duplicate names */
+static void index_results(struct gdb_mi_record *record, struct gdb_mi_result *first)
+{
+	const struct gdb_mi_result *res;
+	struct gdb_mi_index *index;
+	guint count = 0;
+	guint size = 1;
+
+	for (res = first; res; res = res->next)
+	{
+		if (res->var)
+			count++;
+	}
+	if (count < INDEX_MIN_RESULTS)
+		return;
+
+	while (size < count * 2)
+		size *= 2;
+
+	index = record_alloc(record, sizeof *index + (size - 1) * sizeof index->slots[0]);
+	index->mask = size - 1;
+	for (res = first; res; res = res->next)
+	{
+		guint i;
+
+		if (! res->var)
+			continue;
+		for (i = name_hash(res->var) & index->mask; index->slots[i]; i = (i + 1) & index->mask)
+		{
+			if (index->slots[i]->var == res->var)
+				break;
+		}
+		if (! index->slots[i])
+			index->slots[i] = res;
+	}
+
+	first->index = index;
+}
+
+/* remembers the first syntax error of @record */
+static void record_error(struct gdb_mi_record *record, const gchar *error)
+{
+	if (! record->error)
+		record->error = error;
+}
+
+/* unescapes the escape sequence at @p in a record parsed with
+ * gdb_mi_record_parse_raw(), leaving @p on its last character */
+static gchar parse_raw_escape(const struct gdb_mi_record *record, gchar **p)
+{
+	switch (**p)
+	{
+		case '\\':
+		case '"':
+			return **p;
+		case 'n':
+		case 'N':
+			if (record->newline)
+				return record->newline;
+			break;
+		case 't':
+		case 'T':
+			if (record->newline)
+				return '\t';
+			break;
+	}
+	/* others are kept as they are */
+	(*p)--;
+	return **p;
+}
+
+/* parses: cstring
+ * 
+ * cstring is defined as:
+ * 
+ * c-string ==>
+ *     """ seven-bit-iso-c-string-content """ 
+ * 
+ * The string is unescaped in place, which is possible as escapes are
+ * longer than the characters they stand for.
+ * 
+ * FIXME: what exactly does "seven-bit-iso-c-string-content" mean?
+ *        reading between the lines suggests it's US-ASCII with values >= 0x80
+ *        encoded as \NNN (most likely octal), but that's not really clear --
+ *        although it parses everything I encountered
+ * FIXME: this does NOT convert to UTF-8.  should it? */
+static gchar *parse_cstring(struct gdb_mi_record *record, gchar **p)
+{
+	gchar *str;
+	gchar *out;
+
+	if (**p != '"')
+		return record_alloc(record, 1);
+
+	(*p)++;
+	str = out = *p;
+	while (**p != '"' && **p != '\0')
+	{
+		gchar c = **p;
+		/* TODO: check expansions here */
+		if (c == '\\' && record->raw)
+		{
+			(*p)++;
+			c = parse_raw_escape(record, p);
+		}
+		else if (c == '\\')
+		{
+			(*p)++;
+			c = **p;
+			switch (g_ascii_tolower(c))
+			{
+				case '\\':
+				case '"': break;
+				case 'a': c = '\a'; break;
+				case 'b': c = '\b'; break;
+				case 'f': c = '\f'; break;
+				case 'n': c = '\n'; break;
+				case 'r': c = '\r'; break;
+				case 't': c = '\t'; break;
+				case 'v': c = '\v'; break;
+				default:
+					/* hex escape, 1-2 digits (\xN or \xNN)
+					 * 
+					 * FIXME: is this useful?  Is this right?
+					 * the original dbm_gdb.c:unescape_hex_values() used to
+					 * read escapes of the form \xNNN and treat them as wide
+					 * characters numbers, but  this looks weird for a C-like
+					 * escape.
+					 * Also, note that this doesn't seem to be referenced anywhere
+					 * in GDB/MI syntax.  Only reference in GDB manual is about
+					 * keybindings, which use the syntax implemented here */
+					if (g_ascii_tolower(**p) == 'x' && g_ascii_isxdigit((*p)[1]))
+					{
+						c = (gchar) g_ascii_xdigit_value(*++(*p));
+						if (g_ascii_isxdigit((*p)[1]))
+							c = (gchar) ((c * 16) + g_ascii_xdigit_value(*++(*p)));
+					}
+					/* octal escape, 1-3 digits (\N, \NN or \NNN) */
+					else if (ascii_isodigit(**p))
+					{
+						int i, v;
+						v = g_ascii_digit_value(**p);
+						for (i = 0; ascii_isodigit((*p)[1]) && i < 2; i++)
+							v = (v * 8) + g_ascii_digit_value(*++(*p));
+						if (v <= 0xff)
+							c = (gchar) v;
+						else
+						{
+							*p = *p - 3; /* put the whole sequence back */
+							c = **p;
+							g_warning("Octal escape sequence out of range: %.4s", *p);
+						}
+					}
+					else
+					{
+						g_warning("Unkown escape \"\\%c\"", **p);
+						(*p)--; /* put the \ back */
+						c = **p;
+					}
+					break;
+			}
+		}
+		*out++ = c;
+		(*p)++;
+	}
+	if (**p == '"')
+		(*p)++;
+	else
+		record_error(record, "\" expected");
+	*out = '\0';
+
+	return str;
+}
+
+/* parses: string
+ * the string is interned
+ * FIXME: what really is a string?  here it uses [a-zA-Z_-.][a-zA-Z0-9_-.]* but
+ *        the docs aren't clear on this */
+static const gchar *parse_string(gchar **p)
+{
+	gchar *base = *p;
+	const gchar *str;
+	gchar end;
+
+	if (g_ascii_isalpha(**p) || strchr("-_.", **p))
+	{
+		for ((*p)++; g_ascii_isalnum(**p) || strchr("-_.", **p); (*p)++)
+			;
+	}
+
+	/* terminate the string for a moment */
+	end = **p;
+	**p = '\0';
+	str = g_intern_string(base);
+	**p = end;
+
+	return str;
+}
+
+/* parses: string "=" value */
+static gboolean parse_result(struct gdb_mi_record *record, struct gdb_mi_result *result, gchar **p)
+{
+	result->var = parse_string(p);
+	while (g_ascii_isspace(**p)) (*p)++;
+	if (**p == '=')
+	{
+		(*p)++;
+		while (g_ascii_isspace(**p)) (*p)++;
+		result->val = parse_value(record, p);
+		if (! result->val)
+			record_error(record, "\" { or [ expected");
+	}
+	else
+		record_error(record, "= expected");
+	return result->var && result->val;
+}
+
+/* parses: value | result */
+static gboolean parse_item(struct gdb_mi_record *record, struct gdb_mi_result *item, gchar **p)
+{
+	return (item->val = parse_value(record, p)) != NULL || parse_result(record, item, p);
+}
+
+/* parses: cstring | list | tuple
+ * Actually, this is more permissive and allows mixed tuples/lists */
+static struct gdb_mi_value *parse_value(struct gdb_mi_record *record, gchar **p)
+{
+	struct gdb_mi_value *val = NULL;
+	if (**p == '"')
+	{
+		val = record_alloc(record, sizeof *val);
+		val->type = GDB_MI_VAL_STRING;
+		val->v.string = parse_cstring(record, p);
+	}
+	else if (**p == '{' || **p == '[')
+	{
+		struct gdb_mi_result *prev = NULL;
+		val = record_alloc(record, sizeof *val);
+		val->type = GDB_MI_VAL_LIST;
+		gchar end = **p == '{' ? '}' : ']';
+		(*p)++;
+		while (**p && **p != end)
+		{
+			struct gdb_mi_result *item = record_alloc(record, sizeof *item);
+			while (g_ascii_isspace(**p)) (*p)++;
+			if (parse_item(record, item, p))
+			{
+				if (prev)
+					prev->next = item;
+				else
+					val->v.list = item;
+				prev = item;
+			}
+			else
+				break;
+			while (g_ascii_isspace(**p)) (*p)++;
+			if (**p != ',') break;
+			(*p)++;
+		}
+		if (**p == end)
+			(*p)++;
+		else
+			record_error(record, end == '}' ? "} expected" : "] expected");
+		if (end == '}' && val->v.list)
+			index_results(record, val->v.list);
+	}
+	return val;
+}
+
+static gboolean is_prompt(const gchar *p)
+{
+	if (strncmp("(gdb)", p, 5) == 0)
+	{
+		p += 5;
+		while (g_ascii_isspace(*p)) p++;
+	}
+	return *p == 0;
+}
+
+/* parses: async-record | stream-record | result-record
+ * note: post-value data is ignored.
+ * 
+ * FIXME: that's NOT exactly what the GDB docs call an output, and that's not
+ *        exactly what a line could be.  The GDB docs state that a line can
+ *        contain more than one stream-record, as it's not terminated by a
+ *        newline, and as it defines:
+ * 
+ *        output ==> 
+ *            ( out-of-band-record )* [ result-record ] "(gdb)" nl
+ *        out-of-band-record ==>
+ *            async-record | stream-record
+ *        stream-record ==>
+ *            console-stream-output | target-stream-output | log-stream-output
+ *        console-stream-output ==>
+ *            "~" c-string
+ *        target-stream-output ==>
+ *            "@" c-string
+ *        log-stream-output ==>
+ *            "&" c-string
+ * 
+ *        so as none of the stream-outputs are terminated by a newline, and the
+ *        parser here only extracts the first record it will fail with combined
+ *        records in one line.
+ */
+static void record_parse(struct gdb_mi_record *record, gchar *p)
+{
+	/* FIXME: prompt detection should not really be useful, especially not as a
+	 * special case, as the prompt should always follow an (optional) record */
+	if (is_prompt(p))
+		record->type = GDB_MI_TYPE_PROMPT;
+	else
+	{
+		/* extract token */
+		gchar *token_end;
+		for (token_end = p; g_ascii_isdigit(*token_end); token_end++)
+			;
+		if (token_end > p)
+		{
+			record->token = p;
+			p = token_end;
+			while (g_ascii_isspace(*p)) p++;
+		}
+
+		/* extract record, terminating the token once past its type */
+		record->type = *p;
+		if (*p) ++p;
+		if (record->token)
+			*token_end = '\0';
+		while (g_ascii_isspace(*p)) p++;
+		switch (record->type)
+		{
+			case '~':
+			case '@':
+			case '&':
+				/* FIXME: although the syntax description in the docs are clear,
+				 * the "GDB/MI Stream Records" section does not agree with it,
+				 * widening the input to:
+				 * 
+				 * > [string-output] is either raw text (with an implicit new
+				 * > line) or a quoted C string (which does not contain an
+				 * > implicit newline).
+				 * 
+				 * This adds "raw text" to "c-string"... so? */
+				record->klass = parse_cstring(record, &p);
+				break;
+			case '^':
+			case '*':
+			case '+':
+			case '=':
+			{
+				struct gdb_mi_result *prev = NULL;
+				record->klass = parse_string(&p);
+				/* values without a name are accepted, as for breakpoints
+				 * with multiple locations in notifications */
+				while (*p)
+				{
+					while (g_ascii_isspace(*p)) p++;
+					if (*p != ',')
+					{
+						if (*p)
+							record_error(record, ", or end expected");
+						break;
+					}
+					else
+					{
+						struct gdb_mi_result *res = record_alloc(record, sizeof *res);
+						p++;
+						while (g_ascii_isspace(*p)) p++;
+						if (!parse_item(record, res, &p))
+						{
+							/* Scope reports record->error itself */
+							if (! record->raw)
+								g_warning("failed to parse result");
+							break;
+						}
+						if (prev)
+							prev->next = res;
+						else
+							record->first = res;
+						prev = res;
+					}
+				}
+				if (record->first)
+					index_results(record, record->first);
+				break;
+			}
+			default:
+				/* FIXME: what to do with invalid prefix? */
+				record->type = GDB_MI_TYPE_PROMPT;
+		}
+	}
+}
+
+struct gdb_mi_record *gdb_mi_record_parse(const gchar *line)
+{
+	gsize length = strlen(line);
+	gsize size = CHUNK_ALIGNED(sizeof (struct gdb_mi_record)) + CHUNK_ALIGNED(length + 1) +
+		MAX(length * 4, CHUNK_MIN_SIZE);
+	struct gdb_mi_record *record;
+	struct gdb_mi_chunk *chunk;
+	gchar *p;
+
+	/* the first chunk holds the record, the line and most likely all the
+	 * nodes, which take a few times the size of their text */
+	chunk = chunk_new(NULL, size);
+	record = chunks_alloc(&chunk, sizeof *record);
+	record->chunks = chunk;
+
+	p = record_alloc(record, length + 1);
+	memcpy(p, line, length + 1);
+	record_parse(record, p);
+
+	return record;
+}
+
+/* Parses @line in place into @arena, keeping its c-strings in GDB's 7-bit
+ * escaped form: only \\ and \" are unescaped, and if @newline isn't 0, \n
+ * becomes @newline and \t a tab.
+ * The record stays valid until the next parse into @arena, and as long as
+ * @line isn't changed.  It doesn't need to be freed. */
+struct gdb_mi_record *gdb_mi_record_parse_raw(gchar *line, gchar newline, struct gdb_mi_arena *arena)
+{
+	struct gdb_mi_record *record;
+
+	g_return_val_if_fail(arena != NULL, NULL);
+
+	arena_reset(arena);
+	record = chunks_alloc(&arena->chunks, sizeof *record);
+	record->arena = arena;
+	record->raw = TRUE;
+	record->newline = newline;
+	record_parse(record, line);
+
+	return record;
+}
+
+/* Extracts a variable value from a result
+ * @res may be NULL */
+static const struct gdb_mi_value *gdb_mi_result_var_value(const struct gdb_mi_result *result, const gchar *name)
+{
+	GQuark quark;
+
+	g_return_val_if_fail(name != NULL, NULL);
+
+	/* names are interned, so one never seen can't be found */
+	quark = g_quark_try_string(name);
+	if (! quark || ! result)
+		return NULL;
+	name = g_quark_to_string(quark);
+
+	if (result->index)
+	{
+		const struct gdb_mi_index *index = result->index;
+		guint i;
+
+		for (i = name_hash(name) & index->mask; index->slots[i]; i = (i + 1) & index->mask)
+		{
+			if (index->slots[i]->var == name)
+				return index->slots[i]->val;
+		}
+		return NULL;
+	}
+
+	for (; result; result = result->next)
+	{
+		if (result->var == name)
+			return result->val;
+	}
+	return NULL;
+}
+
+/* Extracts a variable value from a record
+ * @param res a first result, or NULL
+ * @param name the variable name
+ * @param type the expected type of the value
+ * @returns the value of @p name variable (type depending on @p type), or NULL
+ */
+const void *gdb_mi_result_var(const struct gdb_mi_result *result, const gchar *name, enum gdb_mi_value_type type)
+{
+	const struct gdb_mi_value *val = gdb_mi_result_var_value(result, name);
+	if (! val || val->type != type)
+		return NULL;
+	else if (val->type == GDB_MI_VAL_STRING)
+		return val->v.string;
+	else if (val->type == GDB_MI_VAL_LIST)
+		return val->v.list;
+	return NULL;
+}
+
+/* checks whether a record matches, possibly including some string values
+ * @param record a record
+ * @param type the expected type of the record
+ * @param klass the expected class of the record
+ * @param ... a NULL-terminated name/return location pairs for string results
+ * @returns TRUE if record matched, FALSE otherwise
+ * 
+ * Usage example
+ * @{
+ *     const gchar *id;
+ *     if (gdb_mi_record_matches(record, '=', 'thread-created', "id", &id, NULL))
+ *         // here record matched and `id` is present and a string
+ * @}
+ */
+gboolean gdb_mi_record_matches(const struct gdb_mi_record *record, enum gdb_mi_record_type type, const gchar *klass, ...)
+{
+	va_list ap;
+	const gchar *name;
+	gboolean success = TRUE;
+
+	g_return_val_if_fail(record != NULL, FALSE);
+
+	if (record->type != type || strcmp(record->klass, klass) != 0)
+		return FALSE;
+
+	va_start(ap, klass);
+	while ((name = va_arg(ap, const gchar *)) != NULL && success)
+	{
+		const gchar **out = va_arg(ap, const gchar **);
+
+		g_return_val_if_fail(out != NULL, FALSE);
+
+		*out = gdb_mi_result_var(record->first, name, GDB_MI_VAL_STRING);
+		success = *out != NULL;
+	}
+	va_end(ap);
+	return success;
+}
+
+
+#ifdef TEST
+
+static void gdb_mi_result_dump(const struct gdb_mi_result *r, gboolean next, gint indent);
+
+static void gdb_mi_value_dump(const struct gdb_mi_value *v, gint indent)
+{
+	fprintf(stderr, "%*stype = %d\n", indent * 2, "", v->type);
+	switch (v->type)
+	{
+		case GDB_MI_VAL_STRING:
+			fprintf(stderr, "%*sstring = %s\n", indent * 2, "", v->v.string);
+			break;
+		case GDB_MI_VAL_LIST:
+			fprintf(stderr, "%*slist =>\n", indent * 2, "");
+			if (v->v.list)
+				gdb_mi_result_dump(v->v.list, TRUE, indent + 1);
+			break;
+	}
+}
+
+static void gdb_mi_result_dump(const struct gdb_mi_result *r, gboolean next, gint indent)
+{
+	fprintf(stderr, "%*svar = %s\n", indent * 2, "", r->var);
+	fprintf(stderr, "%*sval =>\n", indent * 2, "");
+	gdb_mi_value_dump(r->val, indent + 1);
+	if (next && r->next)
+		gdb_mi_result_dump(r->next, next, indent);
+}
+
+static void gdb_mi_record_dump(const struct gdb_mi_record *record)
+{
+	fprintf(stderr, "record =>\n");
+	fprintf(stderr, "  type = '%c' (%d)\n", record->type ? record->type : '0', record->type);
+	fprintf(stderr, "  token = %s\n", record->token);
+	fprintf(stderr, "  class = %s\n", record->klass);
+	if (record->error)
+		fprintf(stderr, "  error = %s\n", record->error);
+	fprintf(stderr, "  results =>\n");
+	if (record->first)
+		gdb_mi_result_dump(record->first, TRUE, 2);
+}
+
+static gchar *read_line(FILE *fp)
+{
+	char buf[1024] = {0};
+	GString *line = g_string_new(NULL);
+
+	while (fgets(buf, sizeof buf, fp))
+	{
+		g_string_append(line, buf);
+		if (line->len < 1 || line->str[line->len - 1] == '\n')
+			break;
+	}
+
+	return g_string_free(line, line->len < 1);
+}
+
+int main(int argc, char **argv)
+{
+	/* --raw parses as Scope does for error messages */
+	gboolean raw = argc > 1 && strcmp(argv[1], "--raw") == 0;
+	struct gdb_mi_arena *arena = gdb_mi_arena_new();
+	gchar *line;
+
+	while ((line = read_line(stdin)) != NULL)
+	{
+		struct gdb_mi_record *record = raw ? gdb_mi_record_parse_raw(line, '\n', arena) : gdb_mi_record_parse(line);
+
+		gdb_mi_record_dump(record);
+		gdb_mi_record_free(record);
+
+		g_free(line);
+	}
+
+	gdb_mi_arena_free(arena);
+	return 0;
+}
+
+#endif
@@ -40,11 +40,13 @@ struct gdb_mi_value
 	} v;
 };
 
+struct gdb_mi_index;
 struct gdb_mi_result
 {
-	gchar *var;
+	const gchar *var; /*< interned, so it can be compared by address */
 	struct gdb_mi_value *val;
 	struct gdb_mi_result *next;
+	const struct gdb_mi_index *index; /*< private, set on the first result of large tuples */
 };
 
 enum gdb_mi_record_type
@@ -59,19 +61,27 @@ enum gdb_mi_record_type
 	GDB_MI_TYPE_LOG_STREAM = '&'
 };
 
+struct gdb_mi_chunk;
+struct gdb_mi_arena;
 struct gdb_mi_record
 {
 	enum gdb_mi_record_type type;
 	gchar *token;
-	gchar *klass; /*< contains the async record class or the stream output */
+	const gchar *klass; /*< contains the async record class or the stream output */
 	struct gdb_mi_result *first; /*< pointer to the first result (if any) */
+	const gchar *error; /*< why parsing stopped early, NULL if the whole line was parsed */
+	struct gdb_mi_chunk *chunks; /*< private, memory all of the record lives in */
+	struct gdb_mi_arena *arena; /*< private, memory the record lives in instead, if any */
+	gboolean raw; /*< private, whether c-strings are kept escaped */
+	gchar newline; /*< private, what \n is unescaped to in raw c-strings */
 };
 
 
-void gdb_mi_value_free(struct gdb_mi_value *val);
-void gdb_mi_result_free(struct gdb_mi_result *res, gboolean next);
 void gdb_mi_record_free(struct gdb_mi_record *record);
 struct gdb_mi_record *gdb_mi_record_parse(const gchar *line);
+struct gdb_mi_record *gdb_mi_record_parse_raw(gchar *line, gchar newline, struct gdb_mi_arena *arena);
+struct gdb_mi_arena *gdb_mi_arena_new(void);
+void gdb_mi_arena_free(struct gdb_mi_arena *arena);
 const void *gdb_mi_result_var(const struct gdb_mi_result *result, const gchar *name, enum gdb_mi_value_type type);
 gboolean gdb_mi_record_matches(const struct gdb_mi_record *record, enum gdb_mi_record_type type, const gchar *klass, ...) G_GNUC_NULL_TERMINATED;
 
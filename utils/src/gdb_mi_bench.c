@@ -0,0 +1,155 @@
+/*
+ *      gdb_mi_bench.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/*
+ * Benchmarks the GDB/MI parser on captured GDB/MI output
+ *
+ * Usage: gdb_mi_bench [-n ITERATIONS] LOG...
+ *
+ * Each LOG holds GDB/MI output, one record per line, as written by
+ * "gdb -i=mi" (e.g. captured with tee), typically with huge replies like
+ * those of -stack-list-frames or -data-read-memory.  Every line is parsed
+ * ITERATIONS times, then every result of the parsed records is looked up
+ * by name in its tuple.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "gdb_mi.h"
+
+
+/* looks up every named result of the tuple starting at @first and below,
+ * returns the number of lookups */
+static guint lookup_results(const struct gdb_mi_result *first)
+{
+	const struct gdb_mi_result *res;
+	guint count = 0;
+
+	gdb_mi_result_foreach (res, first)
+	{
+		if (res->var)
+		{
+			if (gdb_mi_result_var(first, res->var, res->val->type) == NULL)
+				fprintf(stderr, "failed to look up \"%s\"\n", res->var);
+			count++;
+		}
+		if (res->val->type == GDB_MI_VAL_LIST)
+			count += lookup_results(res->val->v.list);
+	}
+
+	return count;
+}
+
+int main(int argc, char **argv)
+{
+	GPtrArray *lines = g_ptr_array_new();
+	struct gdb_mi_record **records;
+	gsize bytes = 0;
+	guint iterations = 10;
+	guint lookups = 0;
+	GTimer *timer;
+	gdouble parse_time, lookup_time;
+	gint i;
+	guint n, l;
+
+	for (i = 1; i < argc; i++)
+	{
+		gchar *contents;
+		gchar **file_lines;
+		GError *error = NULL;
+
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+		{
+			i++;
+			iterations = MAX(atoi(argv[i]), 1);
+			continue;
+		}
+
+		if (! g_file_get_contents(argv[i], &contents, NULL, &error))
+		{
+			fprintf(stderr, "%s\n", error->message);
+			g_error_free(error);
+			return 1;
+		}
+
+		file_lines = g_strsplit(contents, "\n", -1);
+		for (l = 0; file_lines[l]; l++)
+		{
+			if (*file_lines[l])
+			{
+				g_ptr_array_add(lines, file_lines[l]);
+				bytes += strlen(file_lines[l]);
+			}
+			else
+				g_free(file_lines[l]);
+		}
+		g_free(file_lines);
+		g_free(contents);
+	}
+
+	if (lines->len == 0)
+	{
+		fprintf(stderr, "Usage: %s [-n ITERATIONS] LOG...\n", argv[0]);
+		return 1;
+	}
+
+	records = g_new(struct gdb_mi_record *, lines->len);
+	timer = g_timer_new();
+
+	/* parsing, keeping the records of the last iteration */
+	for (n = 0; n < iterations; n++)
+	{
+		for (l = 0; l < lines->len; l++)
+		{
+			if (n)
+				gdb_mi_record_free(records[l]);
+			records[l] = gdb_mi_record_parse(g_ptr_array_index(lines, l));
+		}
+	}
+	parse_time = g_timer_elapsed(timer, NULL);
+
+	/* looking up all the results */
+	g_timer_start(timer);
+	for (n = 0; n < iterations; n++)
+	{
+		for (l = 0; l < lines->len; l++)
+			lookups += lookup_results(records[l]->first);
+	}
+	lookup_time = g_timer_elapsed(timer, NULL);
+
+	printf("%u records, %" G_GSIZE_FORMAT " bytes, %u iterations\n", lines->len, bytes, iterations);
+	printf("parse:  %.3f s, %.1f MB/s, %.0f records/s\n", parse_time,
+		bytes * iterations / parse_time / 1e6, lines->len * iterations / parse_time);
+	printf("lookup: %.3f s, %.0f lookups/s\n", lookup_time, lookups / lookup_time);
+
+	for (l = 0; l < lines->len; l++)
+	{
+		gdb_mi_record_free(records[l]);
+		g_free(g_ptr_array_index(lines, l));
+	}
+	g_free(records);
+	g_ptr_array_free(lines, TRUE);
+	g_timer_destroy(timer);
+
+	return 0;
+}
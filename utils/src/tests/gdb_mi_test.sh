@@ -20,3 +20,8 @@ test -d "$SUBDIR" || mkdir "$SUBDIR"
 strip_comments < "$srcdir/tests/gdb_mi_test.input" | ./gdb_mi_test 2> "$TMPOUT"
 strip_comments < "$srcdir/tests/gdb_mi_test.expected" > "$TMPEXCPT"
 diff -u "$TMPEXCPT" "$TMPOUT"
+
+# records parsed keeping strings escaped, as Scope does
+strip_comments < "$srcdir/tests/gdb_mi_raw_test.input" | ./gdb_mi_test --raw 2> "$TMPOUT"
+strip_comments < "$srcdir/tests/gdb_mi_raw_test.expected" > "$TMPEXCPT"
+diff -u "$TMPEXCPT" "$TMPOUT"